@@ -69,6 +69,15 @@ struct MaterialData {
   vec2 padding;
 };
 
+// one per drawn node, instances of the same mesh share its indirect draw
+struct InstanceData {
+  mat4 model;
+  uint drawId;
+  uint pad0;
+  uint pad1;
+  uint pad2;
+};
+
 struct MeshBboxData {
   vec4 centerPos;
   vec4 extents;
@@ -80,6 +89,12 @@ struct IndirectDrawCount {
 
 struct CullingPushConstants {
   uint count;
+  // BindlessHeap indices
+  uint meshBboxBuffer;
+  uint inputIndirectBuffer;
+  uint inputInstanceBuffer;
+  uint outputIndirectBuffer;
+  uint drawCountBuffer;
 };
 
 #endif
@@ -14,29 +14,78 @@ MVP;
 layout(set = 1, binding = 0) uniform texture2D BindlessImage2D[];
 layout(set = 2, binding = 0) uniform sampler BindlessSampler[];
 
+#ifdef BINDLESS_HEAP
+// BindlessHeap's storage buffers, the shader's push constants say where the scene's are
+struct SceneBuffers {
+  uint vertices;
+  uint indices;
+  uint indirectDraws;
+  uint materials;
+  uint instances;
+};
+
 layout(set = 3, binding = 0) readonly buffer VertexBuffer {
   Vertex vertices[];
 }
-vertexAlias[4];
+vertexAlias[];
 
 layout(set = 3, binding = 0) readonly buffer IndexBuffer {
   uint indices[];
 }
-indexAlias[4];
+indexAlias[];
 
 layout(set = 3, binding = 0) readonly buffer IndirectDrawDataAndMeshDataBuffer {
   IndirectDrawDataAndMeshData meshDraws[];
 }
-indirectDrawAlias[4];
+indirectDrawAlias[];
 
 layout(set = 3, binding = 0) readonly buffer MaterialBufferForAllMesh {
   MaterialData materials[];
 }
-materialDataAlias[4];
+materialDataAlias[];
+
+layout(set = 3, binding = 0) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+}
+instanceAlias[];
+
+#define VERTEX_INDEX sceneBuffers.vertices
+#define INDICIES_INDEX sceneBuffers.indices
+#define INDIRECT_DRAW_INDEX sceneBuffers.indirectDraws
+#define MATERIAL_DATA_INDEX sceneBuffers.materials
+#define INSTANCE_DATA_INDEX sceneBuffers.instances
+#else
+layout(set = 3, binding = 0) readonly buffer VertexBuffer {
+  Vertex vertices[];
+}
+vertexAlias[5];
+
+layout(set = 3, binding = 0) readonly buffer IndexBuffer {
+  uint indices[];
+}
+indexAlias[5];
+
+layout(set = 3, binding = 0) readonly buffer IndirectDrawDataAndMeshDataBuffer {
+  IndirectDrawDataAndMeshData meshDraws[];
+}
+indirectDrawAlias[5];
+
+layout(set = 3, binding = 0) readonly buffer MaterialBufferForAllMesh {
+  MaterialData materials[];
+}
+materialDataAlias[5];
+
+layout(set = 3, binding = 0) readonly buffer InstanceBuffer {
+  InstanceData instances[];
+}
+instanceAlias[5];
 
 const int VERTEX_INDEX = 0;
 const int INDICIES_INDEX = 1;
 const int INDIRECT_DRAW_INDEX = 2;
 const int MATERIAL_DATA_INDEX = 3;
+const int INSTANCE_DATA_INDEX = 4;
+
+#endif
 
 #endif
@@ -41,10 +41,11 @@ void main()
     vec3 normal = normalize(flow.normal);
     if (material.normalTextureId != -1)
     {
-        normal = texture(
+        // BC5 normal maps only store xy
+        normal.xy = texture(
         sampler2D(BindlessImage2D[material.normalTextureId], BindlessSampler[0]),
-        flow.texCoord).rgb;
-        normal = normalize(normal * 2.0 - 1.0);
+        flow.texCoord).rg * 2.0 - 1.0;
+        normal.z = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
 
         const vec3 n = normalize(flow.normal);
         const vec3 t = normalize(flow.tangent.xyz);
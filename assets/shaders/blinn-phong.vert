@@ -28,20 +28,22 @@ void main()
 {
     Vertex vertex = vertexAlias[VERTEX_INDEX]
                       .vertices[/*gl_InstanceIndex + */ gl_VertexIndex];
+    mat4 instanceModel = instanceAlias[INSTANCE_DATA_INDEX].instances[gl_InstanceIndex].model;
+    mat4 model = MVP.model * instanceModel;
 
     flow.texCoord = vec2(vertex.uvX, vertex.uvY);
     vec3 position = vec3(vertex.posX, vertex.posY, vertex.posZ);
-    flow.position  = (MVP.model * vec4(position, 1.0)).xyz;
-    flow.normal = vec3(vertex.normalX, vertex.normalY, vertex.normalZ);
+    flow.position  = (model * vec4(position, 1.0)).xyz;
+    flow.normal = normalize(mat3(instanceModel) * vec3(vertex.normalX, vertex.normalY, vertex.normalZ));
     omaterialID = vertex.material;
-    flow.tangent = vec4(vertex.tangentX, vertex.tangentY, vertex.tangentZ, vertex.tangentW);
+    flow.tangent = vec4(mat3(instanceModel) * vec3(vertex.tangentX, vertex.tangentY, vertex.tangentZ), vertex.tangentW);
 
     //flow.normal = mat3(transpose(inverse(model))) * vec3(vertex.normalX, vertex.normalY, vertex.normalZ);
-    vec4 pos = MVP.projection * MVP.view * MVP.model * vec4(position, 1.0);
+    vec4 pos = MVP.projection * MVP.view * model * vec4(position, 1.0);
     
     if (gbufferConstData.applyJitter == 0) {
       gl_Position = pos;
     } else {
-      gl_Position = MVP.projection * MVP.view * MVP.model * MVP.jitterMat * vec4(position, 1.0);
+      gl_Position = MVP.projection * MVP.view * model * MVP.jitterMat * vec4(position, 1.0);
     }
 }
\ No newline at end of file
@@ -7,6 +7,23 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0) {
   return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+// Fresnel-Schlick for light integrated over a whole environment, rough surfaces
+// reflect less at grazing angles.
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness) {
+  return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+// Analytic fit of the split sum environment BRDF (Karis), stands in for the
+// scale and bias lookup table. Fresnel is included.
+vec3 envBRDFApprox(vec3 F0, float roughness, float NdotV) {
+  const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+  const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+  vec4 r = roughness * c0 + c1;
+  float a004 = min(r.x * r.x, exp2(-9.28 * NdotV)) * r.x + r.y;
+  vec2 AB = vec2(-1.04, 1.04) * a004 + r.zw;
+  return F0 * AB.x + AB.y;
+}
+
 // GGX/Trowbridge-Reitz
 // Determines the distribution of microfacets on the surface.
 // It models how rough or smooth a surface appears.
@@ -2,6 +2,7 @@ D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=vert blinn-phong.vert -o bli
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=frag blinn-phong.frag -o blinn-phong.frag.spv
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=vert equirectangular_to_cubemap.vert -o equirectangular_to_cubemap.vert.spv
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=frag equirectangular_to_cubemap.frag -o equirectangular_to_cubemap.frag.spv
+D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=comp prefilter_specular.comp -o prefilter_specular.comp.spv
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=vert skybox.vert -o skybox.vert.spv
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=frag skybox.frag -o skybox.frag.spv
 D:/VulkanSDK/1.3.243.0/Bin/glslc.exe -fshader-stage=vert gbuffer.vert -o gbuffer.vert.spv
@@ -1,6 +1,7 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : require
 #extension GL_GOOGLE_include_directive : require
+#define BINDLESS_HEAP
 #include "CommonStructs.glsl"
 #include "IndirectCommon.glsl"
 
@@ -22,13 +23,49 @@ layout(location = 4) out vec4 outgBufferPosition;
 // rg32s
 layout(location = 5) out vec2 outgBufferVelocity;
 
+struct GBufferPushConstants {
+  uint applyJitter;
+  uint feedbackOffset;
+  uint feedbackEnabled;
+  uint feedbackBuffer;
+  uint samplerIndex;
+};
+
+layout(push_constant) uniform constants {
+  GBufferPushConstants gbufferConstData;
+  SceneBuffers sceneBuffers;
+};
+
+// read back by TextureStreamer, one slice of the bindless array per frame in flight
+layout(set = 3, binding = 0) buffer TextureFeedback {
+  uint finestLevel[];
+}
+textureFeedback[];
+
+// One pixel in 64 reports 1 + log2 of the resolution it samples along the larger axis. That does not
+// depend on how many levels of the texture are resident, lod is relative to the current level 0
+void writeFeedback(int textureIndex, float lod) {
+  if (gbufferConstData.feedbackEnabled == 0 ||
+      ((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 7u) != 0) {
+    return;
+  }
+  ivec2 size = textureSize(
+      sampler2D(BindlessImage2D[textureIndex],
+                BindlessSampler[gbufferConstData.samplerIndex]),
+      0);
+  float finest = log2(float(max(size.x, size.y))) - max(lod, 0.0);
+  atomicMax(textureFeedback[gbufferConstData.feedbackBuffer]
+                .finestLevel[gbufferConstData.feedbackOffset + textureIndex],
+            uint(max(ceil(finest), 0.0)) + 1u);
+}
+
 void main() {
   int basecolorIndex = -1;
   int normalIndex = -1;
   int metallicRoughnessIndex = -1;
   int emissiveIndex = -1;
 
-  uint samplerIndex = 0;
+  uint samplerIndex = gbufferConstData.samplerIndex;
 
   float metallicFactor = 1.0;
   float roughnessFactor = 1.0;
@@ -52,6 +89,10 @@ void main() {
     outgBufferBaseColor = texture(sampler2D(BindlessImage2D[basecolorIndex],
                                             BindlessSampler[samplerIndex]),
                                   inTexCoord);
+    writeFeedback(basecolorIndex,
+                  textureQueryLod(sampler2D(BindlessImage2D[basecolorIndex],
+                                            BindlessSampler[samplerIndex]),
+                                  inTexCoord).y);
   } else {
     outgBufferBaseColor = vec4(0.5, .5, 0.5, 1.0);
   }
@@ -71,6 +112,10 @@ void main() {
     vec4 normalTexSampled = texture(
         sampler2D(BindlessImage2D[normalIndex], BindlessSampler[samplerIndex]),
         inTexCoord);
+    writeFeedback(normalIndex,
+                  textureQueryLod(sampler2D(BindlessImage2D[normalIndex],
+                                            BindlessSampler[samplerIndex]),
+                                  inTexCoord).y);
 
     vec3 normalTan = normalTexSampled.xyz;
     normalTan.y = 1.0f - normalTan.y;
@@ -88,6 +133,10 @@ void main() {
         texture(sampler2D(BindlessImage2D[metallicRoughnessIndex],
                           BindlessSampler[samplerIndex]),
                 inTexCoord);
+    writeFeedback(metallicRoughnessIndex,
+                  textureQueryLod(sampler2D(BindlessImage2D[metallicRoughnessIndex],
+                                            BindlessSampler[samplerIndex]),
+                                  inTexCoord).y);
 
     float specular =
         metallicRoughnessTexSampled
@@ -108,6 +157,10 @@ void main() {
     vec4 emissiveTexSampled = texture(sampler2D(BindlessImage2D[emissiveIndex],
                                                 BindlessSampler[samplerIndex]),
                                       inTexCoord);
+    writeFeedback(emissiveIndex,
+                  textureQueryLod(sampler2D(BindlessImage2D[emissiveIndex],
+                                            BindlessSampler[samplerIndex]),
+                                  inTexCoord).y);
     outgBufferEmissive.rgb = emissiveTexSampled.rgb;
   } else {
     outgBufferEmissive.rgb = vec3(0.0);
@@ -3,6 +3,7 @@
 #extension GL_EXT_debug_printf : enable
 
 #extension GL_GOOGLE_include_directive : require
+#define BINDLESS_HEAP
 #include "CommonStructs.glsl"
 #include "IndirectCommon.glsl"
 
@@ -17,41 +18,44 @@ layout(location = 7) out vec4 outPrevClipSpacePos;
 
 struct GBufferPushConstants {
   uint applyJitter;
+  uint feedbackOffset;
+  uint feedbackEnabled;
+  uint feedbackBuffer;
+  uint samplerIndex;
 };
 
 layout(push_constant) uniform constants {
   GBufferPushConstants gbufferConstData;
+  SceneBuffers sceneBuffers;
 };
 
 void main() {
-  uint index =
-      indexAlias[INDICIES_INDEX].indices[gl_BaseVertex + gl_VertexIndex];
-  debugPrintfEXT(
-      "gl_BaseVertex = %d gl_VertexIndex = %d, gl_BaseInstance = %d, index = %d, gl_InstanceIndex = %d",
-      gl_BaseVertex, gl_VertexIndex, gl_BaseInstance, index, gl_InstanceIndex);
-
+  InstanceData instance =
+      instanceAlias[INSTANCE_DATA_INDEX].instances[gl_InstanceIndex];
+  mat4 model = MVP.model * instance.model;
 
   Vertex vertex = vertexAlias[VERTEX_INDEX]
                       .vertices[/*gl_InstanceIndex + */ gl_VertexIndex];
 
   vec3 position = vec3(vertex.posX, vertex.posY, vertex.posZ);
-  vec3 normal = vec3(vertex.normalX, vertex.normalY, vertex.normalZ);
+  vec3 normal = normalize(mat3(instance.model) *
+                          vec3(vertex.normalX, vertex.normalY, vertex.normalZ));
   vec2 uv = vec2(vertex.uvX, vertex.uvY);
   if (gbufferConstData.applyJitter == 0) {
-    gl_Position = MVP.projection * MVP.view * MVP.model * vec4(position, 1.0);
+    gl_Position = MVP.projection * MVP.view * model * vec4(position, 1.0);
   } else {
-    gl_Position = MVP.projection * MVP.view * MVP.model * MVP.jitterMat *
+    gl_Position = MVP.projection * MVP.view * model * MVP.jitterMat *
                   vec4(position, 1.0);
   }
   outTexCoord = uv;
-  outflatMeshId =
-      indirectDrawAlias[INDIRECT_DRAW_INDEX].meshDraws[gl_DrawID].meshId;
+  outflatMeshId = instance.drawId;
   outflatMaterialId = vertex.material;
   outNormal = normal;
-  outTangent =
-      vec4(vertex.tangentX, vertex.tangentY, vertex.tangentZ, vertex.tangentW);
-  outModelSpacePos = (MVP.model * vec4(position, 1.0)).xyz;
-  outClipSpacePos = MVP.projection * MVP.view * MVP.model * vec4(position, 1.0);
+  outTangent = vec4(
+      mat3(instance.model) * vec3(vertex.tangentX, vertex.tangentY, vertex.tangentZ),
+      vertex.tangentW);
+  outModelSpacePos = (model * vec4(position, 1.0)).xyz;
+  outClipSpacePos = MVP.projection * MVP.view * model * vec4(position, 1.0);
   outPrevClipSpacePos =
-      MVP.projection * MVP.prevView * MVP.model * vec4(position, 1.0);
+      MVP.projection * MVP.prevView * model * vec4(position, 1.0);
 }
@@ -17,6 +17,12 @@ layout(set = 0, binding = 6) uniform sampler2D shadowMap;
 layout(set = 0, binding = 6) uniform sampler2DShadow shadowMap;
 #endif
 
+// taps per side of the PCF kernel, picked by LightingPass
+layout(constant_id = 0) const int pcfKernelSize = 4;
+
+// GGX prefiltered environment, level m for roughness m / (specularLevels - 1)
+layout(set = 0, binding = 7) uniform samplerCube specularEnvironment;
+
 layout(set = 1, binding = 0) uniform Transforms {
   mat4 viewProj;
   mat4 viewProjInv;
@@ -32,6 +38,8 @@ layout(set = 1, binding = 1) uniform Lights {
   mat4 lightVP;
   float innerConeAngle;
   float outerConeAngle;
+  float specularLevels;
+  vec4 irradianceSH[9];  // already convolved with the clamped cosine
 }
 lightData;
 
@@ -49,6 +57,18 @@ vec3 generateWorldPositionFromDepth(vec2 texturePos, float depth) {
   return worldPosition.xyz;
 }
 
+vec3 evaluateIrradiance(vec3 n) {
+  return lightData.irradianceSH[0].rgb * 0.282095 +
+         lightData.irradianceSH[1].rgb * 0.488603 * n.y +
+         lightData.irradianceSH[2].rgb * 0.488603 * n.z +
+         lightData.irradianceSH[3].rgb * 0.488603 * n.x +
+         lightData.irradianceSH[4].rgb * 1.092548 * n.x * n.y +
+         lightData.irradianceSH[5].rgb * 1.092548 * n.y * n.z +
+         lightData.irradianceSH[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0) +
+         lightData.irradianceSH[7].rgb * 1.092548 * n.x * n.z +
+         lightData.irradianceSH[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
 const float nearDistance = 10.0f;
 const float farDistance = 4000.0f;
 
@@ -95,13 +115,16 @@ float PCF(vec4 clipSpaceCoordWrtLight, float DdotL) {
   float result = 0.0;
   vec2 offset = (1.0 / texSize) * clipSpaceCoordWrtLight.w;
 
-  for (float i = -1.5; i <= 1.5; i += 1.0) {
-    for (float j = -1.5; j <= 1.5; j += 1.0) {
+  // centered on the texel, 4 taps per side reach from -1.5 to 1.5
+  const float kernelCenter = float(pcfKernelSize - 1) * 0.5;
+  for (int i = 0; i < pcfKernelSize; i++) {
+    for (int j = 0; j < pcfKernelSize; j++) {
+      vec2 tap = vec2(float(i), float(j)) - kernelCenter;
       result += computeShadow(clipSpaceCoordWrtLight +
-                              vec4(vec2(i, j) * offset, 0.0, 0.0), DdotL);
+                              vec4(tap * offset, 0.0, 0.0), DdotL);
     }
   }
-  return result / 16.0;
+  return result / float(pcfKernelSize * pcfKernelSize);
 }
 
 void main() {
@@ -147,6 +170,18 @@ void main() {
   vec3 diffuse = kD * basecolor / 3.14159265359;
 
   vec3 ambient = lightData.ambientColor.rgb * basecolor;
+  if (lightData.specularLevels > 0.0) {
+    float NdotV = max(dot(N, V), 0.0);
+    vec3 kDAmbient = (1.0 - fresnelSchlickRoughness(NdotV, F0, roughness)) *
+                     (1.0 - metallic);
+    vec3 irradiance = max(evaluateIrradiance(N), vec3(0.0));
+    vec3 prefiltered =
+        textureLod(specularEnvironment, reflect(-V, N),
+                   roughness * (lightData.specularLevels - 1.0))
+            .rgb;
+    ambient = kDAmbient * basecolor * irradiance +
+              prefiltered * envBRDFApprox(F0, roughness, NdotV);
+  }
 
   // Spotlight calculations
   vec3 lightToFragment = lightData.lightPos.xyz - worldPos.xyz;
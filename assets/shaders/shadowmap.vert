@@ -4,12 +4,18 @@
 #extension GL_EXT_debug_printf : enable
 
 #extension GL_GOOGLE_include_directive : require
+#define BINDLESS_HEAP
 #include "CommonStructs.glsl"
 #include "IndirectCommon.glsl"
 
+layout(push_constant) uniform constants {
+  SceneBuffers sceneBuffers;
+};
+
 void main()
 {
     Vertex vertex = vertexAlias[VERTEX_INDEX].vertices[gl_VertexIndex];
+    mat4 model = MVP.model * instanceAlias[INSTANCE_DATA_INDEX].instances[gl_InstanceIndex].model;
     vec3 position = vec3(vertex.posX, vertex.posY, vertex.posZ);
-    gl_Position = MVP.projection * MVP.view * MVP.model * vec4(position, 1.0);
+    gl_Position = MVP.projection * MVP.view * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -13,10 +13,11 @@ void main()
 {
     Vertex vertex = vertexAlias[VERTEX_INDEX]
                       .vertices[/*gl_InstanceIndex + */ gl_VertexIndex];
+    mat4 model = MVP.model * instanceAlias[INSTANCE_DATA_INDEX].instances[gl_InstanceIndex].model;
 
     vec3 position = vec3(vertex.posX, vertex.posY, vertex.posZ);
 
-    outClipSpacePos = MVP.projection * MVP.view * MVP.model * vec4(position, 1.0);
-    outPrevClipSpacePos = MVP.projection * MVP.prevView * MVP.model * vec4(position, 1.0);
+    outClipSpacePos = MVP.projection * MVP.view * model * vec4(position, 1.0);
+    outPrevClipSpacePos = MVP.projection * MVP.prevView * model * vec4(position, 1.0);
     gl_Position = outClipSpacePos;
 }
\ No newline at end of file
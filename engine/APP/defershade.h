@@ -1,6 +1,9 @@
 #pragma once
 #include "application.h"
 #include "FrameTimer.h"
+#include <memory>
+
+struct Mesh;
 
 class DeferShade : public Application
 {
@@ -9,6 +12,7 @@ public:
 	virtual void Shutdown() override;
 	virtual void run() override;
 private:
+	void initScene(const std::shared_ptr<Mesh>& glb);
 	struct AppState
 	{
 		bool running;
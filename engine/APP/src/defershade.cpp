@@ -15,12 +15,20 @@
 #include "LineBoxPass.h"
 
 #include "FrameTimeInfo.h"
+#include "MemoryBudgetInfo.h"
+#include "SpecializationInfo.h"
 #include "termination.h"
 #include "geometry.h"
 #include "backend.h"
 #include "Context.h"
+#include "BindlessHeap.h"
+#include "FrameUniforms.h"
+#include "UploadEngine.h"
+#include "TextureStreamer.h"
+#include "IBLPrecompute.h"
 #include "camera.h"
 #include "define.h"
+#include "log.h"
 #include "window.h"
 #include "mesh.h"
 
@@ -28,14 +36,19 @@ namespace
 {
 	std::shared_ptr<ImGuiLayer> uiLayer;
 
-	std::shared_ptr<Buffer> stageBuffer;
 	std::shared_ptr<Buffer> vertexBuffer;
 	std::shared_ptr<Buffer> indiceBuffer;
 	std::shared_ptr<Buffer> materialBuffer;
 	std::shared_ptr<Buffer> indirectBuffer;
 	std::shared_ptr<Buffer> indirectCountBuffer;
-	std::shared_ptr<Buffer> uniformBuffer;
+	std::shared_ptr<Buffer> instanceBuffer;
+	std::shared_ptr<FrameUniforms> uniforms;
 	std::shared_ptr<Buffer> lightBuffer;
+	// the scene buffers go through the transfer queue, the first frame acquires them
+	UploadTicket sceneUploads;
+	// frames are presented with an empty scene until the load finishes, the buffers are made then
+	std::shared_future<std::shared_ptr<Mesh>> sceneFuture;
+	std::shared_ptr<Mesh> scene;
 
 	std::shared_ptr<GBufferPass> gbufferPass;
 	std::shared_ptr<FullScreenPass> fullScreenPass;
@@ -47,15 +60,18 @@ namespace
 	std::shared_ptr<LightingPass> lightPass;
 	std::shared_ptr<SSRIntersectPass> ssrPass;
 	std::shared_ptr<LineBoxPass> lineBoxPass;
+	IBLPrecompute::Environment environment;
 	std::vector < std::shared_ptr < Sampler >> samplers;
-	void* ptr = nullptr;
+	uint32_t materialSampler = BindlessHeap::InvalidIndex;
 	int count;
+	int instanceCount;
 }
 
 void DeferShade::Init(uint32_t width, uint32_t height)
 {
 	CameraManager::init({ 0.0f, 2.0f, 4.0f });
-	GeometryManager::GetInstance().loadgltf(modelPath + "mirrors_edge_apartment_-_interior_scene.glb");
+	// decoded on a worker thread, run() builds the scene buffers once GeometryManager::update has uploaded it
+	sceneFuture = GeometryManager::GetInstance().loadAsync(modelPath + "mirrors_edge_apartment_-_interior_scene.glb");
 	uiLayer.reset(new ImGuiLayer());
 	gbufferPass.reset(new GBufferPass());
 	gbufferPass->init(width, height);
@@ -71,85 +87,131 @@ void DeferShade::Init(uint32_t width, uint32_t height)
 	lineBoxPass.reset(new LineBoxPass());
 	uiLayer->addUI(GetTermination());
 	uiLayer->addUI(new ImGuiFrameTimeInfo(&state.timer));
+	uiLayer->addUI(new ImGuiMemoryBudgetInfo());
+	uiLayer->addUI(new ImGuiSpecializationInfo());
 	uiLayer->addUI(new CameraUI());
 	uiLayer->addUI(gbufferPass.get());
-	auto gbufferPipeline = gbufferPass->pipeline();
-	auto glb = GeometryManager::GetInstance().getMesh(modelPath + "mirrors_edge_apartment_-_interior_scene.glb");
-	vertexBuffer.reset(new Buffer(glb->vertices.size() * sizeof(Vertex), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
-		vk::MemoryPropertyFlagBits::eDeviceLocal));
-	indiceBuffer.reset(new Buffer(glb->indices.size() * sizeof(std::uint32_t), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
-		vk::MemoryPropertyFlagBits::eDeviceLocal));
-	materialBuffer.reset(new Buffer(glb->materials.size() * sizeof(Material), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
-		vk::MemoryPropertyFlagBits::eDeviceLocal));
-	uniformBuffer.reset(new Buffer(sizeof(UniformTransforms), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer,
-		vk::MemoryPropertyFlagBits::eDeviceLocal));
+	uniforms.reset(new FrameUniforms(sizeof(UniformTransforms)));
 	lightBuffer.reset(new Buffer(sizeof(UniformTransforms), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst |
 		vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	stageBuffer.reset(new Buffer(sizeof(UniformTransforms), vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	ptr = Context::GetInstance().device.mapMemory(stageBuffer->memory, 0, stageBuffer->size);
-	indirectBuffer.reset(new Buffer(glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), vk::BufferUsageFlagBits::eShaderDeviceAddress |
-		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	indirectCountBuffer.reset(new Buffer(sizeof(int), vk::BufferUsageFlagBits::eShaderDeviceAddress |
-		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	UploadBufferData({}, vertexBuffer, glb->vertices.size() * sizeof(Vertex), glb->vertices.data());
-	UploadBufferData({}, indiceBuffer, glb->indices.size() * sizeof(std::uint32_t), glb->indices.data());
-	UploadBufferData({}, materialBuffer, glb->materials.size() * sizeof(Material), glb->materials.data());
-	UploadBufferData({}, indirectBuffer, glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), glb->indirectDrawData.data());
-	count = glb->indirectDrawData.size();
-	UploadBufferData({}, indirectCountBuffer, sizeof(int), &count);
-
 	samplers.emplace_back(new Sampler(vk::Filter::eNearest, vk::Filter::eNearest,
 		vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat,
-		vk::SamplerAddressMode::eRepeat, 10.0f));
-	gbufferPipeline->bindResource(0, 0, 0, uniformBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
-	gbufferPipeline->bindResource(1, 0, 0, { glb->textures.begin(), glb->textures.end() });
-	gbufferPipeline->bindResource(2, 0, 0, { samplers.begin(), 1 });
-	gbufferPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer }, vk::DescriptorType::eStorageBuffer);
-	cullingPass->init(glb, indirectBuffer);
+		vk::SamplerAddressMode::eRepeat, VK_LOD_CLAMP_NONE));
+	materialSampler = BindlessHeap::Instance().Register(*samplers[0]);
+	gbufferPass->pipeline()->bindResource(0, 0, 0, uniforms->buffer(), 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBufferDynamic);
 	shadowPass->init();
-	auto shadowPipeline = shadowPass->pipeline();
-	shadowPipeline->bindResource(0, 0, 0, lightBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
-	shadowPipeline->bindResource(1, 0, 0, { glb->textures.begin(), glb->textures.begin() + 1 });
-	shadowPipeline->bindResource(2, 0, 0, { samplers.begin(), 1 });
-	shadowPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer }, vk::DescriptorType::eStorageBuffer);
+	shadowPass->pipeline()->bindResource(0, 0, 0, lightBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
 	hierarchicalDepthBufferPass->init(gbufferPass->depthTexture());
 	ssaoPass->init(gbufferPass->depthTexture());
 	noisePass->init();
+	environment = IBLPrecompute::load(texturePath + "skybox.hdr");
 	lightPass->init(gbufferPass->normalTexture(), gbufferPass->specularTexture(),
 		gbufferPass->baseColorTexture(), gbufferPass->positionTexture(),
-		gbufferPass->depthTexture(), ssaoPass->ssaoTexture(), shadowPass->shadowmap());
+		gbufferPass->depthTexture(), ssaoPass->ssaoTexture(), shadowPass->shadowmap(),
+		environment.specular);
 	ssrPass->init(gbufferPass->normalTexture(), gbufferPass->specularTexture(),
 		lightPass->lightTexture(), hierarchicalDepthBufferPass->hierarchicalDepthTexture(),
 		noisePass->noiseTexture());
-	lineBoxPass->init(lightPass->lightTexture(), gbufferPass->depthTexture(), glb);
 	fullScreenPass->pipeline()->bindResource(0, 0, 0, { ssrPass->intersectTexture()
 		}, samplers.back());
 }
 
+void DeferShade::initScene(const std::shared_ptr<Mesh>& glb)
+{
+	// built in locals, a step that throws leaves the frame loop drawing the empty scene it had
+	std::shared_ptr<Buffer> sceneVertices(new Buffer(glb->vertices.size() * sizeof(Vertex), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryPropertyFlagBits::eDeviceLocal));
+	std::shared_ptr<Buffer> sceneIndices(new Buffer(glb->indices.size() * sizeof(std::uint32_t), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+		vk::MemoryPropertyFlagBits::eDeviceLocal));
+	std::shared_ptr<Buffer> sceneMaterials(new Buffer(glb->materials.size() * sizeof(Material), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer,
+		vk::MemoryPropertyFlagBits::eDeviceLocal));
+	std::shared_ptr<Buffer> sceneIndirect(new Buffer(glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
+	std::shared_ptr<Buffer> sceneIndirectCount(new Buffer(sizeof(int), vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
+	std::shared_ptr<Buffer> sceneInstances(new Buffer(glb->instances.size() * sizeof(MeshInstance), vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
+	auto& uploads = UploadEngine::Instance();
+	uploads.Upload(sceneVertices, 0, glb->vertices.size() * sizeof(Vertex), glb->vertices.data());
+	uploads.Upload(sceneIndices, 0, glb->indices.size() * sizeof(std::uint32_t), glb->indices.data());
+	// the materials index the scene's textures, the shaders index BindlessHeap
+	std::vector<Material> materials = glb->materials;
+	auto remap = [&glb](int& id) {
+		if (id >= 0)
+		{
+			const uint32_t index = glb->textures[id]->bindlessIndex;
+			id = index == BindlessHeap::InvalidIndex ? -1 : int(index);
+		}
+		};
+	for (auto& material : materials)
+	{
+		remap(material.diffuseTextureId);
+		remap(material.normalTextureId);
+		remap(material.specularTextureId);
+		remap(material.emissiveTextureId);
+		remap(material.occlusionTexture);
+		remap(material.reflectTextureId);
+	}
+	uploads.Upload(sceneMaterials, 0, materials.size() * sizeof(Material), materials.data());
+	uploads.Upload(sceneIndirect, 0, glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), glb->indirectDrawData.data());
+	const int drawCount = int(glb->indirectDrawData.size());
+	UploadBufferData({}, sceneIndirectCount, sizeof(int), &drawCount);
+	const UploadTicket ticket = uploads.Upload(sceneInstances, 0, glb->instances.size() * sizeof(MeshInstance), glb->instances.data());
+	uploads.Flush();
+
+	// textures and buffers got their heap descriptors when they were created, the passes only need the indices
+	const SceneBuffers sceneBuffers{
+		.vertices = sceneVertices->bindlessIndex,
+		.indices = sceneIndices->bindlessIndex,
+		.indirectDraws = sceneIndirect->bindlessIndex,
+		.materials = sceneMaterials->bindlessIndex,
+		.instances = sceneInstances->bindlessIndex,
+	};
+	gbufferPass->setScene(sceneBuffers, materialSampler);
+	cullingPass->init(glb, sceneIndirect, sceneInstances);
+	shadowPass->setScene(sceneBuffers);
+	TextureStreamer::Instance().Init(glb->textures);
+	lineBoxPass->init(lightPass->lightTexture(), gbufferPass->depthTexture(), glb);
+
+	scene = glb;
+	vertexBuffer = std::move(sceneVertices);
+	indiceBuffer = std::move(sceneIndices);
+	materialBuffer = std::move(sceneMaterials);
+	indirectBuffer = std::move(sceneIndirect);
+	indirectCountBuffer = std::move(sceneIndirectCount);
+	instanceBuffer = std::move(sceneInstances);
+	sceneUploads = ticket;
+	count = drawCount;
+	instanceCount = int(glb->instances.size());
+}
+
 void DeferShade::Shutdown()
 {
 	auto device = Context::GetInstance().device;
-	device.unmapMemory(stageBuffer->memory);
+	BindlessHeap::Instance().Release(BindlessType::Samplers, materialSampler);
+	materialSampler = BindlessHeap::InvalidIndex;
 	for (auto sampler : samplers)
 	{
 		sampler.reset();
 	}
 	samplers.clear();
 
-	stageBuffer.reset();
+	sceneFuture = {};
+	scene.reset();
 	vertexBuffer.reset();
 	indiceBuffer.reset();
 	materialBuffer.reset();
-	uniformBuffer.reset();
+	uniforms.reset();
 	lightBuffer.reset();
 	indirectBuffer.reset();
 	indirectCountBuffer.reset();
+	instanceBuffer.reset();
 	indirectBuffer.reset();
 
 	lineBoxPass.reset();
 	ssrPass.reset();
 	lightPass.reset();
+	environment = {};
 	noisePass.reset();
 	ssaoPass.reset();
 	hierarchicalDepthBufferPass.reset();
@@ -218,13 +280,20 @@ void DeferShade::run()
 		uniform.model = glm::mat4(1.0f);
 		uniform.view = glm::lookAt(lightPos, target, up);
 		uniform.projection = glm::perspective(glm::radians(60.0f), (float)1280 / 1280, 0.1f, 15.0f);
-		memcpy(ptr, &uniform, sizeof(UniformTransforms));
-		CopyBuffer(stageBuffer->buffer, lightBuffer->buffer, sizeof(UniformTransforms), 0, 0);
+		UploadBufferData({}, lightBuffer, sizeof(UniformTransforms), &uniform);
 		lightData.ambientColor = glm::vec4(1.f, 1.f, 1.f, 1.f);
 		lightData.lightColor = glm::vec4(1.f, 1.f, 1.f, 1.f);
 		lightData.lightVP = uniform.projection * uniform.view;
 		lightData.lightDir = glm::vec4(front, 1.f);
 		lightData.lightPos = glm::vec4(lightPos, 1.0f);
+		if (environment.specular)
+		{
+			lightData.specularLevels = float(IBLPrecompute::SpecularLevels);
+			for (int i = 0; i < 9; i++)
+			{
+				lightData.irradianceSH[i] = environment.irradiance.coefficients[i];
+			}
+		}
 	}
 
 	UniformTransforms uniform;
@@ -235,9 +304,32 @@ void DeferShade::run()
 		uniform.prevViewMat = uniform.view;
 		uniform.view = CameraManager::mainCamera->GetViewMatrix();
 		uniform.projection = glm::perspective(glm::radians(45.0f), (float)1280 / 720, 0.1f, 1000.0f);
-		memcpy(ptr, &uniform, sizeof(UniformTransforms));
-		CopyBuffer(stageBuffer->buffer, uniformBuffer->buffer, sizeof(UniformTransforms), 0, 0);
 		state.timer.newFrame();
+		GeometryManager::GetInstance().update();
+		if (sceneFuture.valid() && sceneFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			// a failed load or setup keeps the scene empty
+			try
+			{
+				initScene(sceneFuture.get());
+			}
+			catch (const std::exception& e)
+			{
+				DEMO_LOG(Error, std::format("Failed to load the scene: {}", e.what()));
+			}
+			catch (...)
+			{
+				DEMO_LOG(Error, "Failed to load the scene");
+			}
+			sceneFuture = {};
+		}
+		// hierarchy edits reach the instances gbuffer.vert draws and the bounds culling.comp tests, once the
+		// first upload of the instances has been acquired so the copies land after it
+		if (scene && UploadEngine::Instance().Done(sceneUploads) && scene->updateTransforms())
+		{
+			UploadBufferData({}, instanceBuffer, scene->instances.size() * sizeof(MeshInstance), scene->instances.data());
+			cullingPass->upload(*scene);
+		}
 		auto deltatime = state.timer.lastFrameTime<std::chrono::milliseconds>();
 		auto current_frame = Context::GetInstance().current_frame;
 		auto& cmdbufs = Context::GetInstance().cmdbufs;
@@ -245,22 +337,32 @@ void DeferShade::run()
 			ProcessInput(*CameraManager::mainCamera, deltatime.count() / 1000.0);
 		}
 		VulkanBackend::BeginFrame(deltatime.count() / 1000.0, cmdbufs[current_frame], cmdbufAvaliableFences[current_frame], imageAvaliables[current_frame]);
-		cullingPass->cull(cmdbufs[current_frame], Context::GetInstance().image_index);
-		cullingPass->addBarrierForCulledBuffers(cmdbufs[current_frame], vk::PipelineStageFlagBits::eDrawIndirect,
-			Context::GetInstance().queueFamileInfo.computeFamilyIndex.value(), Context::GetInstance().queueFamileInfo.graphicsFamilyIndex.value());
+		TextureStreamer::Instance().BeginFrame(current_frame);
+		UploadEngine::Instance().Acquire(cmdbufs[current_frame], sceneUploads);
+		// the copy of this frame slot is free once BeginFrame has waited on its fence
+		uniforms->write(current_frame, &uniform, sizeof(UniformTransforms));
+		// until the scene is in, the geometry passes only clear their targets
+		const bool sceneLoaded = instanceBuffer != nullptr;
+		if (sceneLoaded)
+		{
+			cullingPass->cull(cmdbufs[current_frame], Context::GetInstance().image_index);
+			cullingPass->addBarrierForCulledBuffers(cmdbufs[current_frame], vk::PipelineStageFlagBits::eDrawIndirect,
+				Context::GetInstance().queueFamileInfo.computeFamilyIndex.value(), Context::GetInstance().queueFamileInfo.graphicsFamilyIndex.value());
+		}
 
 		gbufferPass->render({
-			{.set = 0, .bindIdx = 0},
+			{.set = 0, .bindIdx = 0, .dynamicOffsets = { uniforms->offset(current_frame) }},
 			{.set = 1, .bindIdx = 0},
 			{.set = 2, .bindIdx = 0},
 			{.set = 3, .bindIdx = 0}
-			}, indiceBuffer->buffer, cullingPass->culledIndirectDrawBuffer()->buffer, cullingPass->culledIndirectDrawCountBuffer()->buffer, count, sizeof(IndirectCommandAndMeshData));
+			}, sceneLoaded ? indiceBuffer->buffer : vk::Buffer(), sceneLoaded ? cullingPass->culledIndirectDrawBuffer()->buffer : vk::Buffer(),
+			sceneLoaded ? cullingPass->culledIndirectDrawCountBuffer()->buffer : vk::Buffer(), instanceCount, sizeof(IndirectCommandAndMeshData));
 		shadowPass->render({
 			{.set = 0, .bindIdx = 0},
 			{.set = 1, .bindIdx = 0},
 			{.set = 2, .bindIdx = 0},
 			{.set = 3, .bindIdx = 0}
-			}, indiceBuffer->buffer, indirectBuffer->buffer, count, sizeof(IndirectCommandAndMeshData));
+			}, sceneLoaded ? indiceBuffer->buffer : vk::Buffer(), sceneLoaded ? indirectBuffer->buffer : vk::Buffer(), count, sizeof(IndirectCommandAndMeshData));
 		//layer->OnRender();
 		//skyboxLayer->OnRender();
 		noisePass->generateNoise(cmdbufs[current_frame]);
@@ -13,6 +13,7 @@
 #include "FullScreenPass.h"
 
 #include "FrameTimeInfo.h"
+#include "MemoryBudgetInfo.h"
 #include "termination.h"
 #include "geometry.h"
 #include "Pipeline.h"
@@ -48,11 +49,14 @@ namespace
 	std::shared_ptr<Buffer> materialBuffer;
 	std::shared_ptr<Buffer> indirectBuffer;
 	std::shared_ptr<Buffer> indirectCountBuffer;
+	std::shared_ptr<Buffer> instanceBuffer;
+	std::shared_ptr<Mesh> scene;
 	std::shared_ptr<Buffer> uniformBuffer;
 	std::shared_ptr<Buffer> lightBuffer;
 	std::vector < std::shared_ptr < Sampler >> samplers;
 	void* ptr = nullptr;
 	int count;
+	int instanceCount;
 
 }
 
@@ -76,6 +80,7 @@ void ForwardShade::Init(uint32_t width, uint32_t height)
 	lightBoxPass.reset(new LightBoxPass());
 	fullScreenPass.reset(new FullScreenPass(false));
 	uiLayer->addUI(new ImGuiFrameTimeInfo(&state.timer));
+	uiLayer->addUI(new ImGuiMemoryBudgetInfo());
 	uiLayer->addUI(new CameraUI());
 	uiLayer->addUI(forwardPass.get());
 	clearPass->init(colorTexture, depthTexture);
@@ -98,7 +103,7 @@ void ForwardShade::Init(uint32_t width, uint32_t height)
 		vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
 	stageBuffer.reset(new Buffer(sizeof(UniformTransforms), vk::BufferUsageFlagBits::eTransferSrc,
 		vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	ptr = Context::GetInstance().device.mapMemory(stageBuffer->memory, 0, stageBuffer->size);
+	ptr = stageBuffer->mapped;
 	indirectBuffer.reset(new Buffer(glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), vk::BufferUsageFlagBits::eShaderDeviceAddress |
 		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
 	indirectCountBuffer.reset(new Buffer(sizeof(int), vk::BufferUsageFlagBits::eShaderDeviceAddress |
@@ -109,19 +114,24 @@ void ForwardShade::Init(uint32_t width, uint32_t height)
 	UploadBufferData({}, indirectBuffer, glb->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), glb->indirectDrawData.data());
 	count = glb->indirectDrawData.size();
 	UploadBufferData({}, indirectCountBuffer, sizeof(int), &count);
+	instanceBuffer.reset(new Buffer(glb->instances.size() * sizeof(MeshInstance), vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
+	UploadBufferData({}, instanceBuffer, glb->instances.size() * sizeof(MeshInstance), glb->instances.data());
+	instanceCount = glb->instances.size();
+	scene = glb;
 
 	samplers.emplace_back(new Sampler(vk::Filter::eLinear, vk::Filter::eLinear,
 		vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat,
-		vk::SamplerAddressMode::eRepeat, 10.0f));
+		vk::SamplerAddressMode::eRepeat, VK_LOD_CLAMP_NONE));
 	auto forwardPipeline = forwardPass->pipeline();
 	forwardPipeline->bindResource(0, 0, 0, uniformBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
 	forwardPipeline->bindResource(1, 0, 0, { glb->textures.begin(), glb->textures.end() });
 	forwardPipeline->bindResource(2, 0, 0, { samplers.begin(), 1 });
-	forwardPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer }, vk::DescriptorType::eStorageBuffer);
+	forwardPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer, instanceBuffer }, vk::DescriptorType::eStorageBuffer);
 	auto velocityPipeline = velocityPass->pipeline();
 	velocityPipeline->bindResource(0, 0, 0, uniformBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
-	velocityPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer }, vk::DescriptorType::eStorageBuffer);
-	cullingPass->init(glb, indirectBuffer);
+	velocityPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer, instanceBuffer }, vk::DescriptorType::eStorageBuffer);
+	cullingPass->init(glb, indirectBuffer, instanceBuffer);
 	fullScreenPass->init({ Context::GetInstance().swapchain->info.surfaceFormat.format });
 	fullScreenPass->pipeline()->bindResource(0, 0, 0, { taaPass->ColorTexture()
 		}, samplers.back());
@@ -130,7 +140,6 @@ void ForwardShade::Init(uint32_t width, uint32_t height)
 void ForwardShade::Shutdown()
 {
 	auto device = Context::GetInstance().device;
-	device.unmapMemory(stageBuffer->memory);
 	for (auto sampler : samplers)
 	{
 		sampler.reset();
@@ -145,6 +154,8 @@ void ForwardShade::Shutdown()
 	lightBuffer.reset();
 	indirectBuffer.reset();
 	indirectCountBuffer.reset();
+	instanceBuffer.reset();
+	scene.reset();
 	indirectBuffer.reset();
 
 	fullScreenPass.reset();
@@ -192,6 +203,11 @@ void ForwardShade::run()
 		uniform.jitter = CameraManager::JitterMat(frameIndex, 16, state.width, state.height);
 		memcpy(ptr, &uniform, sizeof(UniformTransforms));
 		CopyBuffer(stageBuffer->buffer, uniformBuffer->buffer, sizeof(UniformTransforms), 0, 0);
+		if (scene->updateTransforms())
+		{
+			UploadBufferData({}, instanceBuffer, scene->instances.size() * sizeof(MeshInstance), scene->instances.data());
+			cullingPass->upload(*scene);
+		}
 
 		state.timer.newFrame();
 		auto deltatime = state.timer.lastFrameTime<std::chrono::milliseconds>();
@@ -208,10 +224,10 @@ void ForwardShade::run()
 			Context::GetInstance().queueFamileInfo.computeFamilyIndex.value(), Context::GetInstance().queueFamileInfo.graphicsFamilyIndex.value());
 		forwardPass->render(cmdbufs[current_frame], 0,
 			indiceBuffer->buffer, cullingPass->culledIndirectDrawBuffer()->buffer, cullingPass->culledIndirectDrawCountBuffer()->buffer,
-			count, sizeof(IndirectCommandAndMeshData), true);
+			instanceCount, sizeof(IndirectCommandAndMeshData), true);
 		velocityPass->render(cmdbufs[current_frame], 0,
 			indiceBuffer->buffer, cullingPass->culledIndirectDrawBuffer()->buffer, cullingPass->culledIndirectDrawCountBuffer()->buffer,
-			count, sizeof(IndirectCommandAndMeshData));
+			instanceCount, sizeof(IndirectCommandAndMeshData));
 		lightBoxPass->render(cmdbufs[current_frame], 0,
 			forwardPass->LightPos());
 		taaPass->doAA(cmdbufs[current_frame], frameIndex, isCamMoving);
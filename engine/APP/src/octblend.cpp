@@ -39,6 +39,7 @@ namespace
 	std::shared_ptr<Buffer> materialBuffer;
 	std::shared_ptr<Buffer> indirectBuffer;
 	std::shared_ptr<Buffer> indirectCountBuffer;
+	std::shared_ptr<Buffer> instanceBuffer;
 	std::shared_ptr<Buffer> uniformBuffer;
 	void* ptr = nullptr;
 	int count;
@@ -83,6 +84,10 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 	indirect.materialIndex = 0;
 	indirect.meshId = 0;
 	mesh->indirectDrawData.push_back(indirect);
+	MeshInstance instance{};
+	instance.model = glm::mat4(1.0f);
+	instance.drawId = 0;
+	mesh->instances.push_back(instance);
 	auto texture = TextureManager::Instance().Load(texturePath + "matrix.jpg");
 	mesh->textures.push_back(texture);
 	Material mat;
@@ -108,7 +113,7 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
 	stageBuffer.reset(new Buffer(sizeof(UniformTransforms), vk::BufferUsageFlagBits::eTransferSrc,
 		vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	ptr = Context::GetInstance().device.mapMemory(stageBuffer->memory, 0, stageBuffer->size);
+	ptr = stageBuffer->mapped;
 	indirectBuffer.reset(new Buffer(mesh->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), vk::BufferUsageFlagBits::eShaderDeviceAddress |
 		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
 	indirectCountBuffer.reset(new Buffer(sizeof(int), vk::BufferUsageFlagBits::eShaderDeviceAddress |
@@ -119,6 +124,9 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 	UploadBufferData({}, indirectBuffer, mesh->indirectDrawData.size() * sizeof(IndirectCommandAndMeshData), mesh->indirectDrawData.data());
 	count = mesh->indirectDrawData.size();
 	UploadBufferData({}, indirectCountBuffer, sizeof(int), &count);
+	instanceBuffer.reset(new Buffer(mesh->instances.size() * sizeof(MeshInstance), vk::BufferUsageFlagBits::eShaderDeviceAddress |
+		vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eStorageBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal));
+	UploadBufferData({}, instanceBuffer, mesh->instances.size() * sizeof(MeshInstance), mesh->instances.data());
 
 	CameraManager::init({ 0.0f, 0.0f, 4.0f });
 	colorTexture = TextureManager::Instance().Create(width, height, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eColorAttachment |
@@ -129,7 +137,7 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 
 	samplers.emplace_back(new Sampler(vk::Filter::eLinear, vk::Filter::eLinear,
 		vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat,
-		vk::SamplerAddressMode::eRepeat, 10.0f));
+		vk::SamplerAddressMode::eRepeat, VK_LOD_CLAMP_NONE));
 
 	forwardPass.reset(new ForwardPass());
 	forwardPass->init(colorTexture, depthTexture, true);
@@ -139,7 +147,7 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 	forwardPipeline->bindResource(0, 0, 0, uniformBuffer, 0, sizeof(UniformTransforms), vk::DescriptorType::eUniformBuffer);
 	forwardPipeline->bindResource(1, 0, 0, { mesh->textures.begin(), mesh->textures.end() });
 	forwardPipeline->bindResource(2, 0, 0, { samplers.begin(), 1 });
-	forwardPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer }, vk::DescriptorType::eStorageBuffer);
+	forwardPipeline->bindResource(3, 0, 0, { vertexBuffer, indiceBuffer, indirectBuffer, materialBuffer, instanceBuffer }, vk::DescriptorType::eStorageBuffer);
 	fullScreenPass->init({ Context::GetInstance().swapchain->info.surfaceFormat.format });
 	fullScreenPass->pipeline()->bindResource(0, 0, 0, { colorTexture }, samplers.back());
 
@@ -164,7 +172,6 @@ void OctBlend::Init(uint32_t width, uint32_t height)
 void OctBlend::Shutdown()
 {
 	auto device = Context::GetInstance().device;
-	device.unmapMemory(stageBuffer->memory);
 	for (auto sampler : samplers)
 	{
 		sampler.reset();
@@ -188,6 +195,7 @@ void OctBlend::Shutdown()
 	uniformBuffer.reset();
 	indirectBuffer.reset();
 	indirectCountBuffer.reset();
+	instanceBuffer.reset();
 	indirectBuffer.reset();
 
 	fullScreenPass.reset();
@@ -12,5 +12,9 @@ struct LightData {
     glm::aligned_mat4 lightVP;
     float innerAngle = 0.523599f;  // 30 degree
     float outerAngle = 1.22173f;   // 70 degree
+    // mips of the prefiltered environment bound to the lighting pass, 0 falls back to ambientColor
+    float specularLevels = 0.0f;
+    // SH9 irradiance of the environment, see IBLPrecompute
+    glm::aligned_vec4 irradianceSH[9] = {};
     Camera lightCam;
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 class GPUProgram;
 struct Mesh;
 class Buffer;
+class FrameUniforms;
 class Pipeline;
 
 class CullingPass
@@ -21,6 +22,12 @@ public:
 	struct GPUCullingPassPushConstants
 	{
 		uint32_t drawCount;
+		// BindlessHeap indices of the buffers
+		uint32_t meshBboxBuffer;
+		uint32_t inputIndirectBuffer;
+		uint32_t inputInstanceBuffer;
+		uint32_t outputIndirectBuffer;
+		uint32_t drawCountBuffer;
 	};
 
 	struct ViewBuffer
@@ -36,9 +43,12 @@ public:
 	CullingPass() = default;
 	~CullingPass();
 
-	void init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> inputIndirectBuffer);
+	// culls per instance, every visible instance becomes one draw in the output buffer
+	void init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> inputIndirectBuffer,
+		std::shared_ptr<Buffer> instanceBuffer);
 
-	void upload();
+	// the bounds of mesh->aabbs again, after Mesh::updateTransforms has moved instances
+	void upload(const Mesh& mesh);
 
 	void cull(vk::CommandBuffer cmdbuf, int frameIndex);
 
@@ -58,10 +68,10 @@ public:
 private:
 	std::shared_ptr<GPUProgram> shader;
 	std::shared_ptr<Pipeline> m_pipeline;
-	std::shared_ptr<Buffer> stageBuffer;
-	std::shared_ptr<Buffer> camFrustumBuffer;
+	std::shared_ptr<FrameUniforms> camFrustumUniforms;
 	std::shared_ptr<Buffer> meshBboxBuffer;
 	std::shared_ptr<Buffer> inputIndirectDrawBuffer;
+	std::shared_ptr<Buffer> inputInstanceBuffer;
 	std::shared_ptr<Buffer> outputIndirectDrawBuffer;
 	std::shared_ptr<Buffer> outputIndirectDrawCountBuffer;
 
@@ -2,6 +2,7 @@
 #include <vector>
 #include "Pipeline.h"
 #include "ImGuiBase.h"
+#include "mesh.h"
 
 class Texture;
 class RenderPass;
@@ -13,6 +14,13 @@ public:
 	struct GBufferPushConstants 
 	{
 		uint32_t applyJitter;
+		// slice of the texture streaming feedback buffer written this frame
+		uint32_t feedbackOffset;
+		uint32_t feedbackEnabled;
+		// BindlessHeap indices
+		uint32_t feedbackBuffer;
+		uint32_t samplerIndex;
+		SceneBuffers sceneBuffers;
 	};
 
 	GBufferPass();
@@ -53,6 +61,12 @@ public:
 	std::shared_ptr<Texture> depthTexture() const { return m_depthTexture; }
 
 	void setImageId(void* id) { this->id = id; }
+	// where the scene's buffers and the sampler for materials are in BindlessHeap
+	void setScene(const SceneBuffers& buffers, uint32_t sampler)
+	{
+		sceneBuffers = buffers;
+		samplerIndex = sampler;
+	}
 
 	virtual void customUI() override;
 
@@ -73,4 +87,6 @@ private:
 	std::shared_ptr<GPUProgram> gBufferShader;
 
 	void* id;
+	SceneBuffers sceneBuffers = {};
+	uint32_t samplerIndex = 0;
 };
\ No newline at end of file
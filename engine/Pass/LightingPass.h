@@ -7,6 +7,7 @@ class Pipeline;
 class Texture;
 class Sampler;
 class Buffer;
+class FrameUniforms;
 
 class LightingPass
 {
@@ -19,7 +20,8 @@ public:
 		std::shared_ptr<Texture> gBufferPosition,
 		std::shared_ptr<Texture> gBufferDepth,
 		std::shared_ptr<Texture> ambientOcclusion,
-		std::shared_ptr<Texture> shadowDepth);
+		std::shared_ptr<Texture> shadowDepth,
+		std::shared_ptr<Texture> specularEnvironment = nullptr);
 	void render(vk::CommandBuffer cmdbuf, uint32_t index, const LightData& data,
 		const glm::mat4& viewMat, const glm::mat4& projMat);
 	
@@ -39,14 +41,12 @@ private:
 	std::shared_ptr<Texture> gBufferPosition;
 	std::shared_ptr<Texture> ambientOcclusion;
 	std::shared_ptr<Texture> shadowDepth;
+	std::shared_ptr<Texture> specularEnvironment;
 	std::shared_ptr<Sampler> sampler;
 	std::shared_ptr<Sampler> samplerShadowMap;
-	std::shared_ptr<Buffer> cameraBuffer;
-	std::shared_ptr<Buffer> lightBuffer;
-	std::shared_ptr<Buffer> stageBuffer1;
-	std::shared_ptr<Buffer> stageBuffer2;
-	void* ptr1;
-	void* ptr2;
+	// Transforms, then LightData at lightOffset
+	std::shared_ptr<FrameUniforms> uniforms;
+	uint32_t lightOffset = 0;
 
 	uint32_t width = 0;
 	uint32_t height = 0;
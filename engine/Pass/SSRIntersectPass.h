@@ -4,6 +4,7 @@ class Pipeline;
 class Texture;
 class Sampler;
 class Buffer;
+class FrameUniforms;
 
 class SSRIntersectPass
 {
@@ -26,9 +27,7 @@ private:
 	std::shared_ptr<Texture> hierarchicalDepth;
 	std::shared_ptr<Texture> noiseTexture;
 	std::shared_ptr<Sampler> sampler;
-	std::shared_ptr<Buffer> cameraBuffer;
-	std::shared_ptr<Buffer> stageBuffer;
-	void* ptr{ nullptr };
+	std::shared_ptr<FrameUniforms> cameraUniforms;
 
 	uint32_t width;
 	uint32_t height;
@@ -1,6 +1,7 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include "Pipeline.h"
+#include "mesh.h"
 
 class Texture;
 class RenderPass;
@@ -18,10 +19,13 @@ public:
 
 	std::shared_ptr<Pipeline> pipeline() { return m_pipeline; }
 	std::shared_ptr<Texture> shadowmap() { return m_shadowmap; }
+	// where the scene's buffers are in BindlessHeap
+	void setScene(const SceneBuffers& buffers) { m_sceneBuffers = buffers; }
 private:
 	std::vector<vk::Framebuffer> m_framebuffers;
 	std::shared_ptr<Texture> m_shadowmap;
 	std::shared_ptr<RenderPass> m_renderPass;
 	std::shared_ptr<Pipeline> m_pipeline;
 	std::shared_ptr<GPUProgram> m_shadowShader;
+	SceneBuffers m_sceneBuffers = {};
 };
\ No newline at end of file
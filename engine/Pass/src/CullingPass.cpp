@@ -4,30 +4,22 @@
 #include "define.h"
 #include "mesh.h"
 #include "Buffer.h"
+#include "BindlessHeap.h"
+#include "FrameUniforms.h"
 #include "program.h"
 #include "camera.h"
 #include <glm/gtc/matrix_transform.hpp>
 
-constexpr uint32_t MESH_BBOX_SET = 0;
-constexpr uint32_t INPUT_INDIRECT_BUFFER_SET = 1;
-constexpr uint32_t OUTPUT_INDIRECT_BUFFER_SET = 2;
-constexpr uint32_t OUTPUT_INDIRECT_COUNT_BUFFER_SET = 3;
-constexpr uint32_t CAMERA_FRUSTUM_SET = 4;
+constexpr uint32_t BINDLESS_BUFFER_SET = 0;
+constexpr uint32_t CAMERA_FRUSTUM_SET = 1;
 constexpr uint32_t BINDING_0 = 0;
 
-namespace
-{
-	void* p;
-}
-
-void CullingPass::init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> inputIndirectBuffer)
+void CullingPass::init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> inputIndirectBuffer,
+	std::shared_ptr<Buffer> instanceBuffer)
 {
 	inputIndirectDrawBuffer = inputIndirectBuffer;
-	camFrustumBuffer.reset(new Buffer(sizeof(ViewBuffer), vk::BufferUsageFlagBits::eShaderDeviceAddress |
-		vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	stageBuffer.reset(new Buffer(sizeof(ViewBuffer), vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
-	p = Context::GetInstance().device.mapMemory(stageBuffer->memory, 0, sizeof(ViewBuffer));
+	inputInstanceBuffer = instanceBuffer;
+	camFrustumUniforms.reset(new FrameUniforms(sizeof(ViewBuffer)));
 	for (auto aabb : mesh->aabbs)
 	{
 		meshBBosData.emplace_back(MeshBoundBoxBuffer{
@@ -43,7 +35,7 @@ void CullingPass::init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> input
 		vk::MemoryPropertyFlagBits::eDeviceLocal));
 	UploadBufferData({}, meshBboxBuffer, totalSize, meshBBosData.data());
 
-	outputIndirectDrawBuffer.reset(new Buffer(sizeof(IndirectCommandAndMeshData) * mesh->indirectDrawData.size(),
+	outputIndirectDrawBuffer.reset(new Buffer(sizeof(IndirectCommandAndMeshData) * mesh->instances.size(),
 		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
 		vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eDeviceLocal));
 
@@ -54,57 +46,14 @@ void CullingPass::init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> input
 	shader.reset(new GPUProgram(shaderPath + "culling.comp.spv"));
 
 	std::vector<Pipeline::SetDescriptor> setLayouts;
-	{
-		Pipeline::SetDescriptor set;
-		set.set = MESH_BBOX_SET;
-		vk::DescriptorSetLayoutBinding binding;
-		binding.setBinding(0)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
-			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
-		set.bindings.push_back(binding);
-		setLayouts.push_back(set);
-	}
-	{
-		Pipeline::SetDescriptor set;
-		set.set = INPUT_INDIRECT_BUFFER_SET;
-		vk::DescriptorSetLayoutBinding binding;
-		binding.setBinding(0)
-			.setDescriptorCount(50)
-			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
-			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
-		set.bindings.push_back(binding);
-		setLayouts.push_back(set);
-	}
-	{
-		Pipeline::SetDescriptor set;
-		set.set = OUTPUT_INDIRECT_BUFFER_SET;
-		vk::DescriptorSetLayoutBinding binding;
-		binding.setBinding(0)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
-			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
-		set.bindings.push_back(binding);
-		setLayouts.push_back(set);
-	}
-	{
-		Pipeline::SetDescriptor set;
-		set.set = OUTPUT_INDIRECT_COUNT_BUFFER_SET;
-		vk::DescriptorSetLayoutBinding binding;
-		binding.setBinding(0)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
-			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
-		set.bindings.push_back(binding);
-		setLayouts.push_back(set);
-	}
+	setLayouts.push_back(BindlessHeap::Instance().Descriptor(BindlessType::Buffers, BINDLESS_BUFFER_SET));
 	{
 		Pipeline::SetDescriptor set;
 		set.set = CAMERA_FRUSTUM_SET;
 		vk::DescriptorSetLayoutBinding binding;
 		binding.setBinding(0)
 			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
 		set.bindings.push_back(binding);
 		setLayouts.push_back(set);
@@ -119,48 +68,48 @@ void CullingPass::init(std::shared_ptr<Mesh> mesh, std::shared_ptr<Buffer> input
 		.computerShader = shader->Compute,
 		.pushConstants = ranges,
 	};
-	m_pipeline.reset(new Pipeline(desc, "main"));
+	m_pipeline.reset(new Pipeline(desc, "culling"));
 	m_pipeline->allocateDescriptors({
-		{.set = MESH_BBOX_SET, .count = 1},
-		{.set = INPUT_INDIRECT_BUFFER_SET, .count = 1},
-		{.set = OUTPUT_INDIRECT_BUFFER_SET, .count = 1},
-		{.set = OUTPUT_INDIRECT_COUNT_BUFFER_SET, .count = 1},
 		{.set = CAMERA_FRUSTUM_SET, .count = 3},
 		});
-	m_pipeline->bindResource(MESH_BBOX_SET, BINDING_0, 0, meshBboxBuffer, 0, meshBboxBuffer->size, 
-		vk::DescriptorType::eStorageBuffer);
-	m_pipeline->bindResource(INPUT_INDIRECT_BUFFER_SET, BINDING_0, 0, inputIndirectDrawBuffer, 0, 
-		inputIndirectDrawBuffer->size, vk::DescriptorType::eStorageBuffer);
-	m_pipeline->bindResource(OUTPUT_INDIRECT_BUFFER_SET, BINDING_0, 0, outputIndirectDrawBuffer, 0,
-		outputIndirectDrawBuffer->size, vk::DescriptorType::eStorageBuffer);
-	m_pipeline->bindResource(OUTPUT_INDIRECT_COUNT_BUFFER_SET, BINDING_0, 0, outputIndirectDrawCountBuffer,
-		0, outputIndirectDrawCountBuffer->size, vk::DescriptorType::eStorageBuffer);
-	m_pipeline->bindResource(CAMERA_FRUSTUM_SET, BINDING_0, 0, camFrustumBuffer, 0,
-		camFrustumBuffer->size, vk::DescriptorType::eUniformBuffer);
+	m_pipeline->bindResource(CAMERA_FRUSTUM_SET, BINDING_0, 0, camFrustumUniforms->buffer(), 0,
+		sizeof(ViewBuffer), vk::DescriptorType::eUniformBufferDynamic);
 
 }
 
 CullingPass::~CullingPass()
 {
-	Context::GetInstance().device.unmapMemory(stageBuffer->memory);
 	m_pipeline.reset();
-	stageBuffer.reset();
-	camFrustumBuffer.reset();
+	camFrustumUniforms.reset();
 	meshBboxBuffer.reset();
+	inputInstanceBuffer.reset();
 	outputIndirectDrawBuffer.reset();
 	outputIndirectDrawCountBuffer.reset();
 	shader.reset();
 }
 
 
-void CullingPass::upload()
+void CullingPass::upload(const Mesh& mesh)
 {
+	for (size_t i = 0; i < mesh.aabbs.size(); i++)
+	{
+		meshBBosData[i] = MeshBoundBoxBuffer{
+			.centerPos = glm::vec4(mesh.aabbs[i].center, 1.0f),
+			.extents = glm::vec4(mesh.aabbs[i].extent, 1.0f),
+		};
+	}
+	UploadBufferData({}, meshBboxBuffer, sizeof(MeshBoundBoxBuffer) * meshBBosData.size(), meshBBosData.data());
 }
 
 void CullingPass::cull(vk::CommandBuffer cmdbuf, int frameIndex)
 {
 	GPUCullingPassPushConstants pushConst{
 		.drawCount = uint32_t(meshBBosData.size()),
+		.meshBboxBuffer = meshBboxBuffer->bindlessIndex,
+		.inputIndirectBuffer = inputIndirectDrawBuffer->bindlessIndex,
+		.inputInstanceBuffer = inputInstanceBuffer->bindlessIndex,
+		.outputIndirectBuffer = outputIndirectDrawBuffer->bindlessIndex,
+		.drawCountBuffer = outputIndirectDrawCountBuffer->bindlessIndex,
 	};
 	auto camera = CameraManager::mainCamera;
 	float fov = 45.0f;
@@ -227,21 +176,32 @@ void CullingPass::cull(vk::CommandBuffer cmdbuf, int frameIndex)
 	const glm::vec3 backNormal = -getNormal(farTopRight, farBottomRight, farTopLeft);
 	frustum.frustumPlanes[5] = glm::vec4(backNormal, -glm::dot(backNormal, farTopRight));
 
-	memcpy(p, &frustum, sizeof(ViewBuffer));
-	CopyBuffer(stageBuffer->buffer, camFrustumBuffer->buffer, sizeof(ViewBuffer), 0, 0);
+	// frameIndex is the swapchain image, the copy is picked by the frame slot its fence guards
+	const uint32_t frame = Context::GetInstance().current_frame;
+	camFrustumUniforms->write(frame, &frustum, sizeof(ViewBuffer));
 
 	m_pipeline->bind(cmdbuf);
 	m_pipeline->updatePushConstant(cmdbuf, vk::ShaderStageFlagBits::eCompute,
 		sizeof(GPUCullingPassPushConstants), &pushConst);
 	m_pipeline->bindDescriptorSets(cmdbuf, {
-		{.set = MESH_BBOX_SET, .bindIdx = 0},
-		{.set = INPUT_INDIRECT_BUFFER_SET, .bindIdx = 0},
-		{.set = OUTPUT_INDIRECT_BUFFER_SET, .bindIdx = 0},
-		{.set = OUTPUT_INDIRECT_COUNT_BUFFER_SET, .bindIdx = 0},
-		{.set = CAMERA_FRUSTUM_SET, .bindIdx = 0},
+		{.set = BINDLESS_BUFFER_SET, .bindIdx = 0},
+		{.set = CAMERA_FRUSTUM_SET, .bindIdx = 0, .dynamicOffsets = { camFrustumUniforms->offset(frame) }},
 		});
 	m_pipeline->updateDescriptorSets();
 
+	// barrier() only orders a workgroup, so the count is cleared before the dispatch instead of by its first thread.
+	// The clear waits for the last frame's indirect draws to have read it
+	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, {});
+	cmdbuf.fillBuffer(outputIndirectDrawCountBuffer->buffer, 0, sizeof(uint32_t), 0);
+	vk::BufferMemoryBarrier cleared;
+	cleared.setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+		.setDstAccessMask(vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite)
+		.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+		.setBuffer(outputIndirectDrawCountBuffer->buffer)
+		.setSize(sizeof(uint32_t));
+	cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, {}, cleared, {});
+
 	cmdbuf.dispatch((pushConst.drawCount / 256) + 1, 1, 1);
 
 }
@@ -40,8 +40,6 @@ namespace
 ForwardPass::~ForwardPass()
 {
 	Context::GetInstance().device.destroyFramebuffer(framebuffer);
-	Context::GetInstance().device.unmapMemory(stageBuffer1->memory);
-	Context::GetInstance().device.unmapMemory(stageBuffer2->memory);
 }
 
 void ForwardPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<Texture> depthTexture, bool clear)
@@ -61,8 +59,8 @@ void ForwardPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<Te
 			vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal));
 		stageBuffer2.reset(new Buffer(sizeof(LightData), vk::BufferUsageFlagBits::eTransferSrc
 			, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-		ptr1 = Context::GetInstance().device.mapMemory(stageBuffer1->memory, 0, sizeof(Transforms));
-		ptr2 = Context::GetInstance().device.mapMemory(stageBuffer2->memory, 0, sizeof(Transforms));
+		ptr1 = stageBuffer1->mapped;
+		ptr2 = stageBuffer2->mapped;
 	}
 	{
 		m_renderPass.reset(new RenderPass(std::vector<vk::Format>{colorTexture->format, depthTexture->format},
@@ -124,7 +122,7 @@ void ForwardPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<Te
 			set.set = STORAGE_BUFFER_SET;
 			vk::DescriptorSetLayoutBinding binding;
 			binding.setBinding(0)
-				.setDescriptorCount(4)
+				.setDescriptorCount(5)
 				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
 				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
 			set.bindings.push_back(binding);
@@ -167,7 +165,7 @@ void ForwardPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<Te
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 		};
-		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "forward"));
 		m_pipeline->allocateDescriptors({
 			{.set = CAMERA_SET, .count = 1},
 			{.set = TEXTURES_SET, .count = 1},
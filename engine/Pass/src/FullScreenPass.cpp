@@ -78,7 +78,7 @@ void FullScreenPass::init(std::vector<vk::Format> colorTextureFormats)
 		.depthTestEnable = false,
 		.depthWriteEnable = false,
 	};
-	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "full screen"));
 	m_pipeline->allocateDescriptors({
 		{.set = 0, .count = 1}
 		});
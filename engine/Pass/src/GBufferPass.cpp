@@ -3,6 +3,9 @@
 #include "Context.h"
 #include "program.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
+#include "BindlessHeap.h"
+#include "Buffer.h"
 #include "camera.h"
 #include "define.h"
 
@@ -12,12 +15,6 @@ constexpr uint32_t CAMERA_SET = 0;
 constexpr uint32_t TEXTURES_SET = 1;
 constexpr uint32_t SAMPLER_SET = 2;
 constexpr uint32_t STORAGE_BUFFER_SET = 3;
-// storing vertex/index/indirect/material buffer in array
-constexpr uint32_t BINDING_0 = 0;
-constexpr uint32_t BINDING_1 = 1;
-constexpr uint32_t BINDING_2 = 2;
-constexpr uint32_t BINDING_3 = 3;
-constexpr uint32_t BINDING_4 = 4;
 
 GBufferPass::GBufferPass()
 {
@@ -85,49 +82,21 @@ void GBufferPass::init(unsigned int width, unsigned int height)
 			vk::DescriptorSetLayoutBinding binding;
 			binding.setBinding(0)
 				.setDescriptorCount(1)
-				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = TEXTURES_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(500)
-				.setDescriptorType(vk::DescriptorType::eSampledImage)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = SAMPLER_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(50)
-				.setDescriptorType(vk::DescriptorType::eSampler)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = STORAGE_BUFFER_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(4)
-				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
+				.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
 			set.bindings.push_back(binding);
 			setLayouts.push_back(set);
 		}
+		auto& heap = BindlessHeap::Instance();
+		setLayouts.push_back(heap.Descriptor(BindlessType::Textures, TEXTURES_SET));
+		setLayouts.push_back(heap.Descriptor(BindlessType::Samplers, SAMPLER_SET));
+		// vertex/index/indirect/material/instance buffers and the texture streaming feedback
+		setLayouts.push_back(heap.Descriptor(BindlessType::Buffers, STORAGE_BUFFER_SET));
 
 		std::vector<vk::PushConstantRange> ranges(1);
 		ranges[0].setOffset(0)
 			.setSize(sizeof(GBufferPushConstants))
-			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
 
 		const Pipeline::GraphicsPipelineDescriptor gpDesc = {
 			.sets = setLayouts,
@@ -148,12 +117,9 @@ void GBufferPass::init(unsigned int width, unsigned int height)
 			.depthCompareOperation = vk::CompareOp::eLess,
 		};
 
-		m_pipeline.reset(new Pipeline(gpDesc, renderPass->vkRenderPass()));
+		m_pipeline.reset(new Pipeline(gpDesc, renderPass->vkRenderPass(), "gbuffer"));
 		m_pipeline->allocateDescriptors({
 			{.set = CAMERA_SET, .count = 3},
-			{.set = TEXTURES_SET, .count = 1},
-			{.set = SAMPLER_SET, .count = 1},
-			{.set = STORAGE_BUFFER_SET, .count = 1},
 			});
 	}
 }
@@ -184,17 +150,37 @@ void GBufferPass::render(const std::vector<Pipeline::SetAndBindingIndex>& sets,
 	cmdbufs[current_frame].beginRenderPass(renderPassBI, vk::SubpassContents::eInline);
 	cmdbufs[current_frame].setViewport(0, { vk::Viewport{ 0, (float)height, (float)width, -(float)height, 0.0f, 1.0f } });
 	cmdbufs[current_frame].setScissor(0, { vk::Rect2D{vk::Offset2D{0, 0}, vk::Extent2D{ width, height } } });
+	auto& streamer = TextureStreamer::Instance();
 	GBufferPushConstants pushConst{
 		.applyJitter = uint32_t(applyJitter),
+		.feedbackOffset = streamer.FeedbackOffset(current_frame),
+		.feedbackEnabled = uint32_t(streamer.Active()),
+		.feedbackBuffer = streamer.Active() ? streamer.FeedbackBuffer()->bindlessIndex : 0,
+		.samplerIndex = samplerIndex,
+		.sceneBuffers = sceneBuffers,
 	};
 	m_pipeline->bind(cmdbufs[current_frame]);
-	cmdbufs[current_frame].pushConstants(m_pipeline->vkPipelineLayout(), vk::ShaderStageFlagBits::eVertex, 0, sizeof(GBufferPushConstants), &pushConst);
+	cmdbufs[current_frame].pushConstants(m_pipeline->vkPipelineLayout(), vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment,
+		0, sizeof(GBufferPushConstants), &pushConst);
 	m_pipeline->bindDescriptorSets(cmdbufs[current_frame], sets);
 	m_pipeline->updateDescriptorSets();
-	cmdbufs[current_frame].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
-	cmdbufs[current_frame].drawIndexedIndirectCount(indirectDrawBuffer, 0, indirectDrawCountBuffer,
-		0, numMeshes, bufferSize);
+	// nothing to draw while the scene is loading, the targets are still cleared
+	if (numMeshes > 0)
+	{
+		cmdbufs[current_frame].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
+		cmdbufs[current_frame].drawIndexedIndirectCount(indirectDrawBuffer, 0, indirectDrawCountBuffer,
+			0, numMeshes, bufferSize);
+	}
 	cmdbufs[current_frame].endRenderPass();
+	if (streamer.Active())
+	{
+		// the feedback is read on the host once the frame's fence has signaled
+		vk::MemoryBarrier barrier;
+		barrier.setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+			.setDstAccessMask(vk::AccessFlagBits::eHostRead);
+		cmdbufs[current_frame].pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost,
+			{}, barrier, {}, {});
+	}
 	gBufferBaseColorTexture->layout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	gBufferNormalTexture->layout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	gBufferEmissiveTexture->layout = vk::ImageLayout::eShaderReadOnlyOptimal;
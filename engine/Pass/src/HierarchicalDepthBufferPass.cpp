@@ -86,7 +86,7 @@ void HierarchicalDepthBufferPass::init(std::shared_ptr<Texture> depthTexture)
 		.specializationConsts = { specializationMap },
 		.specializationData_ = &miplevels,
 	};
-	m_pipeline.reset(new Pipeline(desc));
+	m_pipeline.reset(new Pipeline(desc, "hierarchical depth"));
 	m_pipeline->allocateDescriptors({
 		{.set = HIERARCHICALDEPTH_SET, .count = 1}
 		});
@@ -126,7 +126,7 @@ void LightBoxPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<T
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 	};
-	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "light box"));
 	m_pipeline->allocateDescriptors({
 		{.set = STORAGE_BUFFER_SET, .count = 1},
 		});
@@ -3,6 +3,7 @@
 #include "Pipeline.h"
 #include "Texture.h"
 #include "Buffer.h"
+#include "FrameUniforms.h"
 #include "Sampler.h"
 #include "program.h"
 #include "Context.h"
@@ -17,6 +18,7 @@ constexpr uint32_t BINDING_DEPTH = 3;
 constexpr uint32_t BINDING_POSITION = 4;
 constexpr uint32_t BINDING_AMBIENTOCCLUSION = 5;
 constexpr uint32_t BINDING_SHADOWDEPTH = 6;
+constexpr uint32_t BINDING_SPECULAR_ENVIRONMENT = 7;
 
 constexpr uint32_t TRANSFORM_LIGHT_DATA_SET = 1;
 constexpr uint32_t BINDING_TRANSFORM = 0;
@@ -33,8 +35,6 @@ LightingPass::LightingPass() {}
 
 LightingPass::~LightingPass()
 {
-	Context::GetInstance().device.unmapMemory(stageBuffer1->memory);
-	Context::GetInstance().device.unmapMemory(stageBuffer2->memory);
 	Context::GetInstance().device.destroyFramebuffer(frameBuffer);
 }
 
@@ -44,7 +44,8 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 						std::shared_ptr<Texture> gBufferPosition, 
 						std::shared_ptr<Texture> gBufferDepth, 
 						std::shared_ptr<Texture> ambientOcclusion, 
-						std::shared_ptr<Texture> shadowDepth)
+						std::shared_ptr<Texture> shadowDepth,
+						std::shared_ptr<Texture> specularEnvironment)
 {
 	width = Context::GetInstance().swapchain->info.imageExtent.width;
 	height = Context::GetInstance().swapchain->info.imageExtent.height;
@@ -55,6 +56,7 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 	this->gBufferDepth = gBufferDepth;
 	this->ambientOcclusion = ambientOcclusion;
 	this->shadowDepth = shadowDepth;
+	this->specularEnvironment = specularEnvironment;
 	sampler.reset(new Sampler(vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge,
 		vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, 100.0f));
 	samplerShadowMap.reset(new Sampler(vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge,
@@ -62,16 +64,8 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 	outLightingTexture = TextureManager::Instance().Create(width, height, vk::Format::eB8G8R8A8Unorm,
 		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled |
 		vk::ImageUsageFlagBits::eStorage);
-	cameraBuffer.reset(new Buffer(sizeof(Transforms), vk::BufferUsageFlagBits::eUniformBuffer|
-		vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	stageBuffer1.reset(new Buffer(sizeof(Transforms), vk::BufferUsageFlagBits::eTransferSrc
-		, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	lightBuffer.reset(new Buffer(sizeof(LightData), vk::BufferUsageFlagBits::eUniformBuffer |
-		vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal));
-	stageBuffer2.reset(new Buffer(sizeof(LightData), vk::BufferUsageFlagBits::eTransferSrc
-		, vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	ptr1 = Context::GetInstance().device.mapMemory(stageBuffer1->memory, 0, sizeof(Transforms));
-	ptr2 = Context::GetInstance().device.mapMemory(stageBuffer2->memory, 0, sizeof(Transforms));
+	lightOffset = static_cast<uint32_t>(FrameUniforms::aligned(sizeof(Transforms)));
+	uniforms.reset(new FrameUniforms(lightOffset + sizeof(LightData)));
 	m_renderPass.reset(new RenderPass(std::vector<vk::Format>{vk::Format::eB8G8R8A8Unorm},
 		std::vector<vk::ImageLayout>{vk::ImageLayout::eUndefined},
 		std::vector<vk::ImageLayout>{vk::ImageLayout::eShaderReadOnlyOptimal},
@@ -128,6 +122,11 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 		set.bindings.push_back(binding);
+		binding.setBinding(BINDING_SPECULAR_ENVIRONMENT)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
+		set.bindings.push_back(binding);
 		setLayouts.push_back(set);
 	}
 	{
@@ -136,12 +135,12 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 		vk::DescriptorSetLayoutBinding binding;
 		binding.setBinding(BINDING_TRANSFORM)
 			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 		set.bindings.push_back(binding);
 		binding.setBinding(BINDING_LIGHT)
 			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setStageFlags(vk::ShaderStageFlagBits::eFragment);
 		set.bindings.push_back(binding);
 		setLayouts.push_back(set);
@@ -159,8 +158,12 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 		.depthTestEnable = false,
 		.depthWriteEnable = false,
 		.depthCompareOperation = vk::CompareOp::eAlways,
+		.permutations = {
+			{.name = "pcfKernelSize", .constantID = 0, .stages = vk::ShaderStageFlagBits::eFragment,
+				.value = 4, .minValue = 1, .maxValue = 8 },
+		},
 	};
-	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "lighting"));
 
 	m_pipeline->allocateDescriptors({
 		{.set = GBUFFERDATA_SET, .count = 1},
@@ -178,10 +181,15 @@ void LightingPass::init(std::shared_ptr<Texture> gBufferNormal,
 	const bool useSampler2DForShadows = false;
 	m_pipeline->bindResource(GBUFFERDATA_SET, BINDING_SHADOWDEPTH, 0, shadowDepth,
 		useSampler2DForShadows ? sampler : samplerShadowMap);
-	m_pipeline->bindResource(TRANSFORM_LIGHT_DATA_SET, BINDING_TRANSFORM, 0, cameraBuffer,
-		0, sizeof(Transforms), vk::DescriptorType::eUniformBuffer);
-	m_pipeline->bindResource(TRANSFORM_LIGHT_DATA_SET, BINDING_LIGHT, 0, lightBuffer, 0,
-		sizeof(LightData), vk::DescriptorType::eUniformBuffer);
+	// left unbound without an environment, lighting.frag only reads it when LightData::specularLevels is set
+	if (specularEnvironment)
+	{
+		m_pipeline->bindResource(GBUFFERDATA_SET, BINDING_SPECULAR_ENVIRONMENT, 0, specularEnvironment, sampler);
+	}
+	m_pipeline->bindResource(TRANSFORM_LIGHT_DATA_SET, BINDING_TRANSFORM, 0, uniforms->buffer(),
+		0, sizeof(Transforms), vk::DescriptorType::eUniformBufferDynamic);
+	m_pipeline->bindResource(TRANSFORM_LIGHT_DATA_SET, BINDING_LIGHT, 0, uniforms->buffer(), lightOffset,
+		sizeof(LightData), vk::DescriptorType::eUniformBufferDynamic);
 }
 
 void LightingPass::render(vk::CommandBuffer cmdbuf, uint32_t index, const LightData& data, const glm::mat4& viewMat, const glm::mat4& projMat)
@@ -191,10 +199,9 @@ void LightingPass::render(vk::CommandBuffer cmdbuf, uint32_t index, const LightD
 	transform.viewProj = viewProjMat;
 	transform.viewProjInv = glm::inverse(viewProjMat);
 	transform.viewInv = glm::inverse(viewMat);
-	memcpy(ptr1, &transform, sizeof(Transforms));
-	memcpy(ptr2, &data, sizeof(LightData));
-	CopyBuffer(stageBuffer1->buffer, cameraBuffer->buffer, sizeof(Transforms), 0, 0);
-	CopyBuffer(stageBuffer2->buffer, lightBuffer->buffer, sizeof(LightData), 0, 0);
+	const uint32_t frame = Context::GetInstance().current_frame;
+	uniforms->write(frame, &transform, sizeof(Transforms));
+	uniforms->write(frame, &data, sizeof(LightData), lightOffset);
 	
 	std::array<vk::ClearValue, 1> clearValues;
 	clearValues[0].setColor({ 0.f, 1.f, 0.f, 0.f });
@@ -211,7 +218,7 @@ void LightingPass::render(vk::CommandBuffer cmdbuf, uint32_t index, const LightD
 		m_pipeline->bind(cmdbuf);
 		m_pipeline->bindDescriptorSets(cmdbuf, {
 			{.set = GBUFFERDATA_SET, .bindIdx = 0},
-			{.set = TRANSFORM_LIGHT_DATA_SET, .bindIdx = 0},
+			{.set = TRANSFORM_LIGHT_DATA_SET, .bindIdx = 0, .dynamicOffsets = { uniforms->offset(frame), uniforms->offset(frame) }},
 			});
 		m_pipeline->updateDescriptorSets();
 		cmdbuf.draw(4, 1, 0, 0);
@@ -127,7 +127,7 @@ void LineBoxPass::init(std::shared_ptr<Texture> inColorTexture, std::shared_ptr<
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 	};
-	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+	m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "line box"));
 	m_pipeline->allocateDescriptors({
 		{.set = STORAGE_BUFFER_SET, .count = 1},
 		});
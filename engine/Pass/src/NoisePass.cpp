@@ -90,7 +90,7 @@ void NoisePass::init()
 		.computerShader = shader->Compute,
 		.pushConstants = range,
 	};
-	m_pipeline.reset(new Pipeline(desc));
+	m_pipeline.reset(new Pipeline(desc, "noise"));
 	m_pipeline->allocateDescriptors({
 		{.set = NOISE_SET, .count = 1},
 		});
@@ -70,8 +70,12 @@ void SSAOPass::init(std::shared_ptr<Texture> gBufferDepth)
 		.sets = setLayouts,
 		.computerShader = shader->Compute,
 		.pushConstants = range,
+		.permutations = {
+			{.name = "ssaoRings", .constantID = 0, .value = 3, .minValue = 2, .maxValue = 8 },
+			{.name = "ssaoSamples", .constantID = 1, .value = 6, .minValue = 1, .maxValue = 16 },
+		},
 	};
-	m_pipeline.reset(new Pipeline(desc));
+	m_pipeline.reset(new Pipeline(desc, "ssao"));
 	m_pipeline->allocateDescriptors({
 		{.set = SSAO_OUTPUT_SET, .count = 1},
 		{.set = INPUT_TEXTURES_SET, .count = 1},
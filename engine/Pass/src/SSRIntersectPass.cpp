@@ -5,6 +5,7 @@
 #include "program.h"
 #include "Texture.h"
 #include "Buffer.h"
+#include "FrameUniforms.h"
 #include "Context.h"
 #include "camera.h"
 #include <glm/glm.hpp>
@@ -20,6 +21,15 @@ constexpr uint32_t BINDING_GBUFFER_BASECOLOR = 2;
 constexpr uint32_t BINDING_HIERARCHICALDEPTH = 3;
 constexpr uint32_t BINDING_NOISE = 4;
 
+// INPUT_TEXTURES_SET in binding order, written through the set's update template
+struct InputTextures {
+	vk::DescriptorImageInfo worldNormal;
+	vk::DescriptorImageInfo specular;
+	vk::DescriptorImageInfo baseColor;
+	vk::DescriptorImageInfo hierarchicalDepth;
+	vk::DescriptorImageInfo noise;
+};
+
 constexpr uint32_t INPUT_CAMERA_SET = 2;
 constexpr uint32_t BINDING_CAMERA_TRANSFORM = 0;
 
@@ -42,7 +52,6 @@ SSRIntersectPass::SSRIntersectPass()
 
 SSRIntersectPass::~SSRIntersectPass()
 {
-	Context::GetInstance().device.unmapMemory(stageBuffer->memory);
 }
 
 void SSRIntersectPass::init(std::shared_ptr<Texture> gBufferNormal, std::shared_ptr<Texture> gBufferSpecular, std::shared_ptr<Texture> gBufferBaseColor, std::shared_ptr<Texture> hierarchicalDepth, std::shared_ptr<Texture> noiseTexture)
@@ -63,11 +72,7 @@ void SSRIntersectPass::init(std::shared_ptr<Texture> gBufferNormal, std::shared_
 		vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage, mipLevels);
 	outSSRIntersectTexture->layout = vk::ImageLayout::eUndefined;
 
-	cameraBuffer.reset(new Buffer(sizeof(Transforms), vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-		vk::MemoryPropertyFlagBits::eDeviceLocal));
-	stageBuffer.reset(new Buffer(sizeof(Transforms), vk::BufferUsageFlagBits::eTransferSrc,
-		vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
-	ptr = Context::GetInstance().device.mapMemory(stageBuffer->memory, 0, sizeof(Transforms));
+	cameraUniforms.reset(new FrameUniforms(sizeof(Transforms)));
 	auto shader = std::make_shared<GPUProgram>(shaderPath + "ssr.comp.spv");
 	std::vector<Pipeline::SetDescriptor> setLayouts;
 	{
@@ -118,7 +123,7 @@ void SSRIntersectPass::init(std::shared_ptr<Texture> gBufferNormal, std::shared_
 		vk::DescriptorSetLayoutBinding binding;
 		binding.setBinding(BINDING_CAMERA_TRANSFORM)
 			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
 			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
 		set.bindings.push_back(binding);
 		setLayouts.push_back(set);
@@ -132,8 +137,11 @@ void SSRIntersectPass::init(std::shared_ptr<Texture> gBufferNormal, std::shared_
 		.sets = setLayouts,
 		.computerShader = shader->Compute,
 		.pushConstants = range,
+		.permutations = {
+			{.name = "ssrMaxSteps", .constantID = 0, .value = 50, .minValue = 8, .maxValue = 256 },
+		},
 	};
-	m_pipeline.reset(new Pipeline(desc));
+	m_pipeline.reset(new Pipeline(desc, "ssr intersect"));
 	m_pipeline->allocateDescriptors({
 		{.set = SSR_INTERSECT_OUTPUT_SET, .count = 1},
 		{.set = INPUT_TEXTURES_SET, .count = 1},
@@ -141,18 +149,16 @@ void SSRIntersectPass::init(std::shared_ptr<Texture> gBufferNormal, std::shared_
 		});
 	m_pipeline->bindResource(SSR_INTERSECT_OUTPUT_SET, BINDING_OUT_SSR_INTERSECT, 0,
 		outSSRIntersectTexture, vk::DescriptorType::eStorageImage);
-	m_pipeline->bindResource(INPUT_TEXTURES_SET, BINDING_GBUFFER_WORLDNORMAL, 0,
-		gBufferNormal, sampler);
-	m_pipeline->bindResource(INPUT_TEXTURES_SET, BINDING_GBUFFER_SPECULAR, 0,
-		gBufferSpecular, sampler);
-	m_pipeline->bindResource(INPUT_TEXTURES_SET, BINDING_GBUFFER_BASECOLOR, 0,
-		gBufferBaseColor, sampler);
-	m_pipeline->bindResource(INPUT_TEXTURES_SET, BINDING_HIERARCHICALDEPTH, 0,
-		hierarchicalDepth, sampler);
-	m_pipeline->bindResource(INPUT_TEXTURES_SET, BINDING_NOISE, 0,
-		noiseTexture, sampler);
+	const InputTextures inputTextures = {
+		.worldNormal = { sampler->vkSampler(), gBufferNormal->view, vk::ImageLayout::eGeneral },
+		.specular = { sampler->vkSampler(), gBufferSpecular->view, vk::ImageLayout::eGeneral },
+		.baseColor = { sampler->vkSampler(), gBufferBaseColor->view, vk::ImageLayout::eGeneral },
+		.hierarchicalDepth = { sampler->vkSampler(), hierarchicalDepth->view, vk::ImageLayout::eGeneral },
+		.noise = { sampler->vkSampler(), noiseTexture->view, vk::ImageLayout::eGeneral },
+	};
+	m_pipeline->updateDescriptorSet(INPUT_TEXTURES_SET, 0, inputTextures);
 	m_pipeline->bindResource(INPUT_CAMERA_SET, BINDING_CAMERA_TRANSFORM, 0,
-		cameraBuffer, 0, sizeof(Transforms), vk::DescriptorType::eUniformBuffer);
+		cameraUniforms->buffer(), 0, sizeof(Transforms), vk::DescriptorType::eUniformBufferDynamic);
 }
 
 void SSRIntersectPass::run(vk::CommandBuffer cmdbuf)
@@ -166,8 +172,8 @@ void SSRIntersectPass::run(vk::CommandBuffer cmdbuf)
 	transform.projection = glm::perspective(glm::radians(45.0f), (float)width / height, 0.1f, 1000.0f);
 	transform.viewInv = glm::inverse(transform.view);
 	transform.projectionInv = glm::inverse(transform.projection);
-	memcpy(ptr, &transform, sizeof(Transforms));
-	CopyBuffer(stageBuffer->buffer, cameraBuffer->buffer, sizeof(Transforms), 0, 0);
+	const uint32_t frame = Context::GetInstance().current_frame;
+	cameraUniforms->write(frame, &transform, sizeof(Transforms));
 	m_pipeline->bind(cmdbuf);
 	PushConst pushConst{
 		.resolution = glm::uvec2(width, height),
@@ -177,7 +183,7 @@ void SSRIntersectPass::run(vk::CommandBuffer cmdbuf)
 	m_pipeline->bindDescriptorSets(cmdbuf, {
 		{.set = SSR_INTERSECT_OUTPUT_SET, .bindIdx = 0},
 		{.set = INPUT_TEXTURES_SET, .bindIdx = 0},
-		{.set = INPUT_CAMERA_SET, .bindIdx = 0},
+		{.set = INPUT_CAMERA_SET, .bindIdx = 0, .dynamicOffsets = { cameraUniforms->offset(frame) }},
 		});
 	m_pipeline->updateDescriptorSets();
 	outSSRIntersectTexture->transitionImageLayout(cmdbuf, vk::ImageLayout::eGeneral);
@@ -3,6 +3,7 @@
 #include "render_process.h"
 #include "program.h"
 #include "Texture.h"
+#include "BindlessHeap.h"
 #include "Context.h"
 #include "define.h"
 
@@ -70,43 +71,21 @@ void ShadowMapPass::init()
 			set.bindings.push_back(binding);
 			setLayouts.push_back(set);
 		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = TEXTURES_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(1)
-				.setDescriptorType(vk::DescriptorType::eSampledImage)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = SAMPLER_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(1)
-				.setDescriptorType(vk::DescriptorType::eSampler)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
-		{
-			Pipeline::SetDescriptor set;
-			set.set = STORAGE_BUFFER_SET;
-			vk::DescriptorSetLayoutBinding binding;
-			binding.setBinding(0)
-				.setDescriptorCount(4)
-				.setDescriptorType(vk::DescriptorType::eStorageBuffer)
-				.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
-			set.bindings.push_back(binding);
-			setLayouts.push_back(set);
-		}
+		auto& heap = BindlessHeap::Instance();
+		setLayouts.push_back(heap.Descriptor(BindlessType::Textures, TEXTURES_SET));
+		setLayouts.push_back(heap.Descriptor(BindlessType::Samplers, SAMPLER_SET));
+		setLayouts.push_back(heap.Descriptor(BindlessType::Buffers, STORAGE_BUFFER_SET));
+
+		std::vector<vk::PushConstantRange> ranges(1);
+		ranges[0].setOffset(0)
+			.setSize(sizeof(SceneBuffers))
+			.setStageFlags(vk::ShaderStageFlagBits::eVertex);
+
 		const Pipeline::GraphicsPipelineDescriptor gpDesc = {
 			.sets = setLayouts,
 			.vertexShader = m_shadowShader->Vertex,
 			.fragmentShader = m_shadowShader->Fragment,
+			.pushConstants = ranges,
 			.dynamicStates = {vk::DynamicState::eViewport , vk::DynamicState::eScissor},
 			.colorTextureFormats = {},
 			.depthTextureFormat = depthFormat,
@@ -117,12 +96,9 @@ void ShadowMapPass::init()
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 		};
-		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "shadow map"));
 		m_pipeline->allocateDescriptors({
 			{.set = CAMERA_SET, .count = 1},
-			{.set = TEXTURES_SET, .count = 1},
-			{.set = SAMPLER_SET, .count = 1},
-			{.set = STORAGE_BUFFER_SET, .count = 1},
 			});
 	}
 }
@@ -144,10 +120,15 @@ void ShadowMapPass::render(const std::vector<Pipeline::SetAndBindingIndex>& sets
 	cmdbufs[current_frame].setViewport(0, { vk::Viewport{ 0, (float)ShadowMapSize, (float)ShadowMapSize, -(float)ShadowMapSize, 0.0f, 1.0f } });
 	cmdbufs[current_frame].setScissor(0, { vk::Rect2D{vk::Offset2D{0, 0}, vk::Extent2D{ ShadowMapSize, ShadowMapSize } } });
 	m_pipeline->bind(cmdbufs[current_frame]);
+	m_pipeline->updatePushConstant(cmdbufs[current_frame], vk::ShaderStageFlagBits::eVertex, sizeof(SceneBuffers),
+		&m_sceneBuffers);
 	m_pipeline->bindDescriptorSets(cmdbufs[current_frame], sets);
 	m_pipeline->updateDescriptorSets();
-	cmdbufs[current_frame].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
-	cmdbufs[current_frame].drawIndexedIndirect(indirectDrawBuffer, 0, numMeshes, bufferSize);
+	if (numMeshes > 0)
+	{
+		cmdbufs[current_frame].bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint32);
+		cmdbufs[current_frame].drawIndexedIndirect(indirectDrawBuffer, 0, numMeshes, bufferSize);
+	}
 	cmdbufs[current_frame].endRenderPass();
 	m_shadowmap->layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 }
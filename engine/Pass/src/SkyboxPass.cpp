@@ -100,7 +100,7 @@ void SkyboxPass::init(std::shared_ptr<Texture> colorTexture, std::shared_ptr<Tex
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLessOrEqual,
 		};
-		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass()));
+		m_pipeline.reset(new Pipeline(gpDesc, m_renderPass->vkRenderPass(), "skybox"));
 		m_pipeline->allocateDescriptors({
 			{.set = TEXTURES_AND_SAMPLER_SET, .count = 1},
 			{.set = VERTEX_INDEX_SET, .count = 1},
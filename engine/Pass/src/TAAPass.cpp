@@ -15,6 +15,14 @@ constexpr uint32_t INPUT_HISTORY_BUFFER_BINDING = 1;
 constexpr uint32_t INPUT_VELOCITY_BUFFER_BINDING = 2;
 constexpr uint32_t INPUT_COLOR_BUFFER_BINDING = 3;
 
+// INPUT_DATA_SET in binding order, written through the set's update template
+struct InputData {
+	vk::DescriptorImageInfo depth;
+	vk::DescriptorImageInfo history;
+	vk::DescriptorImageInfo velocity;
+	vk::DescriptorImageInfo color;
+};
+
 void TAAPass::init(std::shared_ptr<Texture> depthTexture, std::shared_ptr<Texture> velocityTexture, std::shared_ptr<Texture> colorTexture)
 {
 	width = depthTexture->width;
@@ -85,16 +93,19 @@ void TAAPass::init(std::shared_ptr<Texture> depthTexture, std::shared_ptr<Textur
 		.computerShader = shader->Compute,
 		.pushConstants = ranges,
 	};
-	pipeline.reset(new Pipeline(desc));
+	pipeline.reset(new Pipeline(desc, "taa"));
 	pipeline->allocateDescriptors({
 		{.set = OUTPUT_IMG_SET, .count = 1},
 		{.set = INPUT_DATA_SET, .count = 1},
 		});
 	pipeline->bindResource(OUTPUT_IMG_SET, OUTPUT_IMAGE_BINDING, 0, outColorTexture, vk::DescriptorType::eStorageImage);
-	pipeline->bindResource(INPUT_DATA_SET, INPUT_DEPTH_BUFFER_BINDING, 0, this->depthTexture, pointSampler);
-	pipeline->bindResource(INPUT_DATA_SET, INPUT_HISTORY_BUFFER_BINDING, 0, historyTexture, sampler);
-	pipeline->bindResource(INPUT_DATA_SET, INPUT_VELOCITY_BUFFER_BINDING, 0, this->velocityTexture, sampler);
-	pipeline->bindResource(INPUT_DATA_SET, INPUT_COLOR_BUFFER_BINDING, 0, this->colorTexture, pointSampler);
+	const InputData inputData = {
+		.depth = { pointSampler->vkSampler(), this->depthTexture->view, vk::ImageLayout::eGeneral },
+		.history = { sampler->vkSampler(), historyTexture->view, vk::ImageLayout::eGeneral },
+		.velocity = { sampler->vkSampler(), this->velocityTexture->view, vk::ImageLayout::eGeneral },
+		.color = { pointSampler->vkSampler(), this->colorTexture->view, vk::ImageLayout::eGeneral },
+	};
+	pipeline->updateDescriptorSet(INPUT_DATA_SET, 0, inputData);
 	
 	initSharpenPipeline();
 }
@@ -183,7 +194,7 @@ void TAAPass::initSharpenPipeline()
 		.sets = setLayouts,
 		.computerShader = shader->Compute,
 	};
-	sharpenPipeline.reset(new Pipeline(desc));
+	sharpenPipeline.reset(new Pipeline(desc, "taa sharpen"));
 	sharpenPipeline->allocateDescriptors({
 		{.set = 0, .count = 1},
 		{.set = 1, .count = 1},
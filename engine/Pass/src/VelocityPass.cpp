@@ -81,7 +81,7 @@ void VelocityPass::init(uint32_t width, uint32_t height)
 		set.set = STORAGE_BUFFER_SET;
 		vk::DescriptorSetLayoutBinding binding;
 		binding.setBinding(0)
-			.setDescriptorCount(4)
+			.setDescriptorCount(5)
 			.setDescriptorType(vk::DescriptorType::eStorageBuffer)
 			.setStageFlags(vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment);
 		set.bindings.push_back(binding);
@@ -100,7 +100,7 @@ void VelocityPass::init(uint32_t width, uint32_t height)
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 	};
-	pipeline_.reset(new Pipeline(gpDesc, renderPass->vkRenderPass()));
+	pipeline_.reset(new Pipeline(gpDesc, renderPass->vkRenderPass(), "velocity"));
 	pipeline_->allocateDescriptors({
 			{.set = CAMERA_SET, .count = 1},
 			{.set = TEXTURES_SET, .count = 1},
@@ -2,6 +2,10 @@
 #include <unordered_map>
 #include <string>
 #include <memory>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <mutex>
 
 struct Mesh;
 
@@ -14,10 +18,28 @@ public:
 	static GeometryManager& GetInstance();
 	std::shared_ptr<Mesh> loadobj(std::string name);
 	std::shared_ptr<Mesh> loadgltf(std::string name);
+	// decodes on a worker thread, the future becomes ready after update() has uploaded the textures
+	std::shared_future<std::shared_ptr<Mesh>> loadAsync(std::string name);
+	// finishes decoded async loads, call once per frame from the render thread
+	void update();
+	bool isReady(std::string name);
+	// returns the "cube" placeholder while the mesh is still loading
 	std::shared_ptr<Mesh> getMesh(std::string name);
 	
 private:
 	GeometryManager();
 	static std::unique_ptr<GeometryManager> instance;
 	std::unordered_map<std::string, std::shared_ptr<Mesh>> m_Contain;
+
+	struct PendingLoad
+	{
+		std::string name;
+		std::shared_ptr<Mesh> mesh;
+		std::future<void> decode;
+		std::promise<std::shared_ptr<Mesh>> promise;
+		std::chrono::steady_clock::time_point start;
+	};
+	std::vector<PendingLoad> m_Pending;
+	std::unordered_map<std::string, std::shared_future<std::shared_ptr<Mesh>>> m_Loading;
+	std::mutex m_Mutex;
 };
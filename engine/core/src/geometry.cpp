@@ -1,10 +1,19 @@
 #include "geometry.h"
 #include "mesh.h"
+#include "log.h"
+#include <format>
+#include <iterator>
 
 std::unique_ptr<GeometryManager> GeometryManager::instance = nullptr;
 
 GeometryManager::~GeometryManager()
 {
+	for (auto& pending : m_Pending)
+	{
+		pending.decode.wait();
+	}
+	m_Pending.clear();
+	m_Loading.clear();
 	for (auto m : m_Contain)
 	{
 		m.second.reset();
@@ -36,6 +45,7 @@ std::shared_ptr<Mesh> GeometryManager::loadobj(std::string name)
 	std::shared_ptr<Mesh> mesh;
 	mesh.reset(new Mesh());
 	mesh->loadobj(name);
+	std::lock_guard<std::mutex> lock(m_Mutex);
 	m_Contain[name] = mesh;
 	return mesh;
 }
@@ -45,17 +55,106 @@ std::shared_ptr<Mesh> GeometryManager::loadgltf(std::string name)
 	std::shared_ptr<Mesh> mesh;
 	mesh.reset(new Mesh());
 	mesh->loadgltf(name);
+	std::lock_guard<std::mutex> lock(m_Mutex);
 	m_Contain[name] = mesh;
 	return mesh;
 }
 
+std::shared_future<std::shared_ptr<Mesh>> GeometryManager::loadAsync(std::string name)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (auto it = m_Contain.find(name); it != m_Contain.end())
+	{
+		std::promise<std::shared_ptr<Mesh>> ready;
+		ready.set_value(it->second);
+		return ready.get_future().share();
+	}
+	if (auto it = m_Loading.find(name); it != m_Loading.end())
+	{
+		return it->second;
+	}
+	PendingLoad pending;
+	pending.name = name;
+	pending.mesh.reset(new Mesh());
+	pending.start = std::chrono::steady_clock::now();
+	bool isObj = name.size() >= 4 && name.compare(name.size() - 4, 4, ".obj") == 0;
+	pending.decode = std::async(std::launch::async, [mesh = pending.mesh, name, isObj]() {
+		if (isObj)
+		{
+			mesh->loadobj(name, true);
+		}
+		else
+		{
+			mesh->loadgltf(name, true);
+		}
+		});
+	auto future = pending.promise.get_future().share();
+	m_Loading[name] = future;
+	m_Pending.push_back(std::move(pending));
+	return future;
+}
+
+void GeometryManager::update()
+{
+	// loadAsync may add loads from other threads while these finish
+	std::vector<PendingLoad> pending;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		pending.swap(m_Pending);
+	}
+	std::vector<PendingLoad> unfinished;
+	for (auto it = pending.begin(); it != pending.end(); ++it)
+	{
+		if (it->decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			unfinished.push_back(std::move(*it));
+			continue;
+		}
+		try
+		{
+			it->decode.get();
+			it->mesh->uploadTextures();
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Contain[it->name] = it->mesh;
+				m_Loading.erase(it->name);
+			}
+			auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - it->start);
+			DEMO_LOG(Info, std::format("Async load {} finished in {:.2f} ms", it->name, elapsed.count()));
+			it->promise.set_value(it->mesh);
+		}
+		catch (...)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_Mutex);
+				m_Loading.erase(it->name);
+			}
+			DEMO_LOG(Error, std::format("Async load {} failed", it->name));
+			it->promise.set_exception(std::current_exception());
+		}
+	}
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Pending.insert(m_Pending.begin(), std::make_move_iterator(unfinished.begin()), std::make_move_iterator(unfinished.end()));
+}
+
+bool GeometryManager::isReady(std::string name)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Contain.find(name) != m_Contain.end();
+}
+
 std::shared_ptr<Mesh> GeometryManager::getMesh(std::string name)
 {
-	if (m_Contain.find(name) == m_Contain.end())
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	if (auto it = m_Contain.find(name); it != m_Contain.end())
+	{
+		return it->second;
+	}
+	if (m_Loading.find(name) != m_Loading.end())
 	{
-		throw("Geometry No Exise.");
+		return m_Contain["cube"];
 	}
-	return m_Contain[name];
+	throw("Geometry No Exise.");
 }
 
 GeometryManager::GeometryManager()
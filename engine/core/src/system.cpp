@@ -12,6 +12,7 @@
 #include "geometry.h"
 #include "Context.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
 
 bool app_on_event(unsigned short code, void* sender, void* listener_inst, EventContext context);
 bool app_on_key(unsigned short code, void* sender, void* listener_inst, EventContext context);
@@ -32,6 +33,7 @@ void SystemManger::Init(uint32_t width, uint32_t height, std::string name)
 
 void SystemManger::Shutdown()
 {
+	TextureStreamer::Instance().Clear();
 	TextureManager::Instance().Clear();
 	GeometryManager::Quit();
 	VulkanBackend::Quit();
@@ -0,0 +1,268 @@
+#include "transform.h"
+#include "mesh.h"
+#include "log.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <execution>
+#include <format>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+uint32_t TransformHierarchy::addNode(uint32_t parent, const glm::vec3& translation, const glm::quat& rotation,
+	const glm::vec3& scale, const glm::mat4& matrix)
+{
+	const uint32_t index = static_cast<uint32_t>(m_Parents.size());
+	assert(parent == InvalidIndex || (parent < index && m_SubtreeEnd[parent] == index));
+	m_Parents.push_back(parent);
+	m_SubtreeEnd.push_back(index + 1);
+	m_Translations.push_back(translation);
+	m_Rotations.push_back(rotation);
+	m_Scales.push_back(scale);
+	m_Matrices.push_back(matrix);
+	m_World.push_back(glm::mat4(1.0f));
+	m_Dirty.push_back(1);
+	m_Updated.push_back(InvalidIndex);
+	for (uint32_t p = parent; p != InvalidIndex; p = m_Parents[p])
+	{
+		m_SubtreeEnd[p] = index + 1;
+	}
+	if (parent == InvalidIndex)
+	{
+		m_RootOf.push_back(static_cast<uint32_t>(m_Roots.size()));
+		m_Roots.push_back(index);
+		m_RootDirty.push_back(1);
+	}
+	else
+	{
+		m_RootOf.push_back(m_RootOf[parent]);
+		m_RootDirty[m_RootOf[parent]] = 1;
+	}
+	return index;
+}
+
+TransformHierarchy TransformHierarchy::fromNodes(const std::vector<Node*>& nodes, std::vector<uint32_t>& nodeIndices)
+{
+	TransformHierarchy hierarchy;
+	std::unordered_map<const Node*, size_t> inputIndex;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		inputIndex[nodes[i]] = i;
+	}
+	nodeIndices.assign(nodes.size(), InvalidIndex);
+
+	std::vector<std::pair<Node*, uint32_t>> stack;
+	for (Node* root : nodes)
+	{
+		if (root->parent)
+		{
+			continue;
+		}
+		stack.emplace_back(root, InvalidIndex);
+		while (!stack.empty())
+		{
+			auto [node, parent] = stack.back();
+			stack.pop_back();
+			const uint32_t index = hierarchy.addNode(parent, node->translation, node->rotation, node->scale, node->matrix);
+			if (auto it = inputIndex.find(node); it != inputIndex.end())
+			{
+				nodeIndices[it->second] = index;
+			}
+			// reversed so that the first child is popped first
+			for (auto child = node->children.rbegin(); child != node->children.rend(); ++child)
+			{
+				stack.emplace_back(*child, index);
+			}
+		}
+	}
+	return hierarchy;
+}
+
+void TransformHierarchy::setTranslation(uint32_t index, const glm::vec3& translation)
+{
+	m_Translations[index] = translation;
+	markDirty(index);
+}
+
+void TransformHierarchy::setRotation(uint32_t index, const glm::quat& rotation)
+{
+	m_Rotations[index] = rotation;
+	markDirty(index);
+}
+
+void TransformHierarchy::setScale(uint32_t index, const glm::vec3& scale)
+{
+	m_Scales[index] = scale;
+	markDirty(index);
+}
+
+void TransformHierarchy::markDirty(uint32_t index)
+{
+	m_Dirty[index] = 1;
+	m_RootDirty[m_RootOf[index]] = 1;
+}
+
+glm::mat4 TransformHierarchy::localMatrix(uint32_t index) const
+{
+	// same composition as Node::localMatrix
+	return glm::translate(glm::mat4(1.0f), m_Translations[index]) * glm::mat4(m_Rotations[index]) *
+		glm::scale(glm::mat4(1.0f), m_Scales[index]) * m_Matrices[index];
+}
+
+size_t TransformHierarchy::updateRange(uint32_t first, uint32_t last)
+{
+	size_t updated = 0;
+	for (uint32_t i = first; i < last; i++)
+	{
+		const uint32_t p = m_Parents[i];
+		const bool parentChanged = p != InvalidIndex && m_Updated[p] == m_Frame;
+		if (!m_Dirty[i] && !parentChanged)
+		{
+			continue;
+		}
+		m_World[i] = p == InvalidIndex ? localMatrix(i) : m_World[p] * localMatrix(i);
+		m_Updated[i] = m_Frame;
+		m_Dirty[i] = 0;
+		updated++;
+	}
+	return updated;
+}
+
+size_t TransformHierarchy::update(bool parallel)
+{
+	m_Frame++;
+	std::vector<uint32_t> dirtyRoots;
+	for (uint32_t slot = 0; slot < m_Roots.size(); slot++)
+	{
+		if (m_RootDirty[slot])
+		{
+			dirtyRoots.push_back(slot);
+			m_RootDirty[slot] = 0;
+		}
+	}
+	// roots own disjoint ranges, so they can be updated without synchronization
+	auto updateRoot = [this](uint32_t slot) {
+		const uint32_t root = m_Roots[slot];
+		return updateRange(root, m_SubtreeEnd[root]);
+		};
+	if (parallel && dirtyRoots.size() > 1)
+	{
+		return std::transform_reduce(std::execution::par, dirtyRoots.begin(), dirtyRoots.end(), size_t(0),
+			std::plus<>(), updateRoot);
+	}
+	return std::transform_reduce(dirtyRoots.begin(), dirtyRoots.end(), size_t(0), std::plus<>(), updateRoot);
+}
+
+void TransformHierarchy::benchmark(uint32_t nodeCount)
+{
+	using clock = std::chrono::steady_clock;
+	auto elapsedMs = [](clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+		};
+
+	// random forest in depth-first order, the same shape is built as a pointer tree
+	constexpr uint32_t rootCount = 64;
+	constexpr size_t maxDepth = 32;
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_int_distribution<size_t> pop(0, 3);
+	auto randomRotation = [&]() {
+		return glm::angleAxis(unit(rng) * glm::pi<float>(), glm::normalize(glm::vec3(unit(rng), unit(rng), 1.0f)));
+		};
+
+	TransformHierarchy hierarchy;
+	std::vector<Node*> nodes(nodeCount);
+	std::vector<uint32_t> path;
+	const uint32_t nodesPerRoot = std::max(1u, nodeCount / rootCount);
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		if (i % nodesPerRoot == 0)
+		{
+			path.clear();
+		}
+		else
+		{
+			const size_t keep = std::max<size_t>(1, path.size() - std::min(pop(rng), path.size()));
+			path.resize(std::min(keep, maxDepth));
+		}
+		const uint32_t parent = path.empty() ? InvalidIndex : path.back();
+		Node* node = new Node{};
+		node->index = i;
+		node->parent = parent == InvalidIndex ? nullptr : nodes[parent];
+		node->matrix = glm::mat4(1.0f);
+		node->skin = nullptr;
+		node->translation = glm::vec3(unit(rng), unit(rng), unit(rng));
+		node->rotation = randomRotation();
+		node->scale = glm::vec3(1.0f + 0.01f * unit(rng));
+		if (node->parent)
+		{
+			node->parent->children.push_back(node);
+		}
+		nodes[i] = node;
+		path.push_back(hierarchy.addNode(parent, node->translation, node->rotation, node->scale, node->matrix));
+	}
+
+	auto start = clock::now();
+	std::vector<glm::mat4> pointerWorld(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		pointerWorld[i] = nodes[i]->getMatrix();
+	}
+	const double pointerMs = elapsedMs(start);
+
+	start = clock::now();
+	hierarchy.update(false);
+	const double fullSerialMs = elapsedMs(start);
+
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			const glm::vec4 diff = glm::abs(pointerWorld[i][c] - hierarchy.worldMatrix(i)[c]);
+			maxError = std::max({ maxError, diff.x, diff.y, diff.z, diff.w });
+		}
+	}
+
+	for (uint32_t root : hierarchy.m_Roots)
+	{
+		hierarchy.setRotation(root, randomRotation());
+	}
+	start = clock::now();
+	const size_t fullCount = hierarchy.update(true);
+	const double fullParallelMs = elapsedMs(start);
+
+	// touch 1% of the nodes, only their subtrees are recomputed
+	std::uniform_int_distribution<uint32_t> pick(0, nodeCount - 1);
+	for (uint32_t i = 0; i < nodeCount / 100; i++)
+	{
+		const uint32_t index = pick(rng);
+		hierarchy.setTranslation(index, hierarchy.m_Translations[index] + glm::vec3(0.0f, 0.1f, 0.0f));
+	}
+	start = clock::now();
+	const size_t incrementalCount = hierarchy.update(true);
+	const double incrementalMs = elapsedMs(start);
+
+	start = clock::now();
+	const size_t cleanCount = hierarchy.update(true);
+	const double cleanMs = elapsedMs(start);
+
+	for (Node* node : nodes)
+	{
+		if (!node->parent)
+		{
+			delete node;
+		}
+	}
+
+	DEMO_LOG(Info, std::format("Transform benchmark, {} nodes in {} roots:", nodeCount, hierarchy.m_Roots.size()));
+	DEMO_LOG(Info, std::format("  Node::getMatrix for every node: {:.3f} ms", pointerMs));
+	DEMO_LOG(Info, std::format("  flat full update, serial:       {:.3f} ms (max error {:.2e})", fullSerialMs, maxError));
+	DEMO_LOG(Info, std::format("  flat full update, parallel:     {:.3f} ms ({} matrices)", fullParallelMs, fullCount));
+	DEMO_LOG(Info, std::format("  flat 1% dirty update:           {:.3f} ms ({} matrices)", incrementalMs, incrementalCount));
+	DEMO_LOG(Info, std::format("  flat clean update:              {:.3f} ms ({} matrices)", cleanMs, cleanCount));
+}
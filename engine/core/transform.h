@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+struct Node;
+
+// Flat structure-of-arrays node hierarchy. Nodes are stored in depth-first order, so a parent
+// always comes before its children and every subtree is a contiguous range [i, subtreeEnd[i]).
+// update() only recomputes dirty subtrees and runs the roots in parallel.
+class TransformHierarchy
+{
+public:
+	static constexpr uint32_t InvalidIndex = ~0u;
+
+	// the node is appended as the last descendant of parent, so children have to be added
+	// depth first, right after their parent's subtree
+	uint32_t addNode(uint32_t parent, const glm::vec3& translation = glm::vec3(0.0f),
+		const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+		const glm::vec3& scale = glm::vec3(1.0f), const glm::mat4& matrix = glm::mat4(1.0f));
+	// flattens a pointer tree, nodeIndices receives the flat index of every input node
+	static TransformHierarchy fromNodes(const std::vector<Node*>& nodes, std::vector<uint32_t>& nodeIndices);
+
+	void setTranslation(uint32_t index, const glm::vec3& translation);
+	void setRotation(uint32_t index, const glm::quat& rotation);
+	void setScale(uint32_t index, const glm::vec3& scale);
+
+	// returns the number of world matrices that were recomputed
+	size_t update(bool parallel = true);
+	// true if the world matrix changed in the last update()
+	bool changed(uint32_t index) const { return m_Updated[index] == m_Frame; }
+
+	const glm::mat4& worldMatrix(uint32_t index) const { return m_World[index]; }
+	uint32_t parent(uint32_t index) const { return m_Parents[index]; }
+	size_t size() const { return m_Parents.size(); }
+
+	// compares a full and an incremental update against Node::getMatrix on a random tree
+	static void benchmark(uint32_t nodeCount = 100000);
+
+private:
+	void markDirty(uint32_t index);
+	size_t updateRange(uint32_t first, uint32_t last);
+	glm::mat4 localMatrix(uint32_t index) const;
+
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_SubtreeEnd;
+	std::vector<uint32_t> m_RootOf;
+	std::vector<glm::vec3> m_Translations;
+	std::vector<glm::quat> m_Rotations;
+	std::vector<glm::vec3> m_Scales;
+	std::vector<glm::mat4> m_Matrices;
+	std::vector<glm::mat4> m_World;
+	std::vector<uint8_t> m_Dirty;
+	std::vector<uint32_t> m_Updated;
+
+	std::vector<uint32_t> m_Roots;
+	// indexed like m_Roots
+	std::vector<uint8_t> m_RootDirty;
+	uint32_t m_Frame = 0;
+};
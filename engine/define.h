@@ -4,3 +4,4 @@
 extern std::string shaderPath;
 extern std::string texturePath;
 extern std::string modelPath;
+extern std::string cachePath;
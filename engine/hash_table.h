@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <cstddef>
 
 typedef std::uint32_t u32;
 typedef float f32;
@@ -24,6 +25,16 @@ inline u32 murmur_mix(u32 hash) {
     return hash;
 }
 
+// byte wise FNV-1a, chain calls through hash to cover several buffers
+inline std::uint64_t fnv1a_64(const void* data, std::size_t size, std::uint64_t hash = 14695981039346656037ull) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
 inline u32 lower_nearest_2_power(u32 x) {
     while (x & (x - 1)) x ^= (x & -x);
     return x;
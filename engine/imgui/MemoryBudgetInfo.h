@@ -0,0 +1,14 @@
+#pragma once
+#include "ImGuiBase.h"
+class ImGuiMemoryBudgetInfo :
+    public ImGuiBase
+{
+public:
+    ImGuiMemoryBudgetInfo() = default;
+
+private:
+    virtual void viewMainMenu() final;
+    virtual void customUI() final;
+
+    bool mOpen{ true };
+};
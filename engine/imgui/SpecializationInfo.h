@@ -0,0 +1,18 @@
+#pragma once
+#include "ImGuiBase.h"
+#include <string>
+#include <unordered_map>
+class ImGuiSpecializationInfo :
+    public ImGuiBase
+{
+public:
+    ImGuiSpecializationInfo() = default;
+
+private:
+    virtual void viewMainMenu() final;
+    virtual void customUI() final;
+
+    bool mOpen{ true };
+    // slider values being dragged, by label, applied when the slider is let go
+    std::unordered_map<std::string, int> mEditing;
+};
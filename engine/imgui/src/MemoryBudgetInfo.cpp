@@ -0,0 +1,63 @@
+#include "MemoryBudgetInfo.h"
+#include "MemoryBudget.h"
+#include "MemoryAllocator.h"
+#include "imgui.h"
+
+namespace
+{
+    double toMB(uint64_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+}
+
+void ImGuiMemoryBudgetInfo::viewMainMenu()
+{
+    if (ImGui::MenuItem("Memory Budget"))
+    {
+        mOpen = !mOpen;
+    }
+}
+
+void ImGuiMemoryBudgetInfo::customUI()
+{
+    if (!mOpen)
+    {
+        return;
+    }
+
+    if (ImGui::CollapsingHeader("Memory Budget", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        ImGui::Indent(10.0f);
+        const auto heaps = MemoryBudget::Instance().Heaps();
+        for (size_t i = 0; i < heaps.size(); i++)
+        {
+            const auto& heap = heaps[i];
+            if (heap.budget == 0 && heap.allocated == 0)
+            {
+                continue;
+            }
+            ImGui::Text("Heap %zu%s: %.1f / %.1f MB", i, heap.deviceLocal ? " (device local)" : "",
+                toMB(heap.usage), toMB(heap.budget));
+            const float used = heap.budget ? float(double(heap.usage) / double(heap.budget)) : 0.0f;
+            ImGui::ProgressBar(used, ImVec2(-1.0f, 0.0f));
+            ImGui::Text("Engine %.1f MB used of %.1f MB in %u allocations", toMB(heap.used), toMB(heap.allocated),
+                heap.allocations);
+            ImGui::Indent(10.0f);
+            for (uint32_t c = 0; c < MemoryBudget::CategoryCount; c++)
+            {
+                if (heap.categories[c])
+                {
+                    ImGui::Text("%s %.1f MB", MemoryBudget::CategoryName(static_cast<MemoryCategory>(c)),
+                        toMB(heap.categories[c]));
+                }
+            }
+            ImGui::Unindent(10.0f);
+        }
+        const auto stats = MemoryAllocator::Instance().GetStats();
+        ImGui::Text("%u blocks of %.1f MB, %.1f MB free, %u sub-allocations", stats.blocks, toMB(stats.blockBytes),
+            toMB(stats.blockFreeBytes), stats.subAllocations);
+        ImGui::Text("%u dedicated allocations of %.1f MB", stats.dedicated, toMB(stats.dedicatedBytes));
+        ImGui::Unindent(10.0f);
+    }
+}
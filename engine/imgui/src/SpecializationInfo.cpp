@@ -0,0 +1,50 @@
+#include "SpecializationInfo.h"
+#include "Pipeline.h"
+#include "imgui.h"
+
+void ImGuiSpecializationInfo::viewMainMenu()
+{
+    if (ImGui::MenuItem("Shader Variants"))
+    {
+        mOpen = !mOpen;
+    }
+}
+
+void ImGuiSpecializationInfo::customUI()
+{
+    if (!mOpen)
+    {
+        return;
+    }
+
+    if (ImGui::CollapsingHeader("Shader Variants", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        ImGui::Indent(10.0f);
+        for (Pipeline* pipeline : Pipeline::Permutable())
+        {
+            ImGui::Text("%s", pipeline->debugName().c_str());
+            ImGui::Indent(10.0f);
+            // copied, setSpecialization changes the values
+            const auto constants = pipeline->specializations();
+            for (const auto& constant : constants)
+            {
+                const std::string label = constant.name + "##" + pipeline->debugName();
+                const auto editing = mEditing.find(label);
+                int value = editing != mEditing.end() ? editing->second : static_cast<int>(constant.value);
+                if (ImGui::SliderInt(label.c_str(), &value, static_cast<int>(constant.minValue),
+                    static_cast<int>(constant.maxValue)))
+                {
+                    mEditing[label] = value;
+                }
+                // every value is a pipeline of its own, only the one the slider ends on is built
+                if (ImGui::IsItemDeactivatedAfterEdit())
+                {
+                    pipeline->setSpecialization(constant.name, static_cast<uint32_t>(value));
+                    mEditing.erase(label);
+                }
+            }
+            ImGui::Unindent(10.0f);
+        }
+        ImGui::Unindent(10.0f);
+    }
+}
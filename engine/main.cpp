@@ -2,10 +2,111 @@
 #include "forwardshade.h"
 #include "octblend.h"
 #include "system.h"
+#include "transform.h"
+#include "obj_reader.h"
+#include "Texture.h"
+#include "TextureStreamer.h"
+#include "IBLPrecompute.h"
+#include "HDRPack.h"
+#include "TLSF.h"
+#include "Pipeline.h"
+#include "DescriptorUpdater.h"
+#include "log.h"
+#include <charconv>
+#include <cstdint>
+#include <format>
+#include <string>
+#include <string_view>
+
+namespace
+{
+	// the whole of text as a number, false for anything else
+	template<typename T>
+	bool parseNumber(std::string_view text, T& value)
+	{
+		const char* end = text.data() + text.size();
+		const auto result = std::from_chars(text.data(), end, value);
+		return result.ec == std::errc() && result.ptr == end;
+	}
+}
 
 int main(int argc, char** argv)
 {
 	SystemManger::Init(1280, 720);
+	// the benchmarks print their results and exit without starting the app
+	if (argc > 1 && std::string(argv[1]) == "--bench-transforms")
+	{
+		TransformHierarchy::benchmark(100000);
+		SystemManger::Shutdown();
+		return 0;
+	}
+	if (argc > 2 && std::string(argv[1]) == "--bench-obj")
+	{
+		ObjReader::benchmark(argv[2]);
+		SystemManger::Shutdown();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-hdr-pack")
+	{
+		// a 4096x2048 panorama
+		HDRPack::benchmark(4096 * 2048);
+		SystemManger::Shutdown();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-allocator")
+	{
+		TLSF::benchmark(1000000);
+		SystemManger::Shutdown();
+		return 0;
+	}
+	if (argc > 1 && std::string(argv[1]) == "--bench-descriptors")
+	{
+		DescriptorUpdater::benchmark(1000);
+		SystemManger::Shutdown();
+		return 0;
+	}
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		if (arg == "--mips=none") TextureManager::Instance().SetMipGeneration(MipGeneration::None);
+		if (arg == "--mips=gpu") TextureManager::Instance().SetMipGeneration(MipGeneration::GPUBlit);
+		if (arg == "--mips=cpu-box") TextureManager::Instance().SetMipGeneration(MipGeneration::CPU, MipFilter::Box);
+		if (arg == "--mips=cpu-kaiser") TextureManager::Instance().SetMipGeneration(MipGeneration::CPU, MipFilter::Kaiser);
+		if (arg == "--bc=none") TextureManager::Instance().SetBlockCompression(BlockCompression::None);
+		if (arg == "--bc=bc1") TextureManager::Instance().SetBlockCompression(BlockCompression::BC1);
+		if (arg == "--bc=bc7") TextureManager::Instance().SetBlockCompression(BlockCompression::BC7);
+		if (arg == "--texture-sharing=path") TextureManager::Instance().SetContentSharing(false);
+		if (arg == "--cubemap=gpu") TextureManager::Instance().SetCubemapConversion(CubemapConversion::GPU);
+		if (arg == "--cubemap=cpu") TextureManager::Instance().SetCubemapConversion(CubemapConversion::CPU);
+		if (arg == "--ibl-reference") IBLPrecompute::SetReferenceCheck(true);
+		if (arg == "--stream-textures") TextureStreamer::Instance().SetEnabled(true);
+		if (arg.starts_with("--stream-budget="))
+		{
+			size_t megabytes = 0;
+			if (parseNumber(std::string_view(arg).substr(16), megabytes) && megabytes <= (SIZE_MAX >> 20))
+			{
+				TextureStreamer::Instance().SetBudget(megabytes << 20);
+			}
+			else
+			{
+				DEMO_LOG(Warning, std::format("Ignoring {}, the budget is a number of MB", arg));
+			}
+		}
+		// --spec:pcfKernelSize=2, for every pipeline with a specialization constant of that name
+		if (arg.starts_with("--spec:") && arg.find('=') != std::string::npos)
+		{
+			const size_t equals = arg.find('=');
+			uint32_t value = 0;
+			if (parseNumber(std::string_view(arg).substr(equals + 1), value))
+			{
+				Pipeline::SetSpecializationDefault(arg.substr(7, equals - 7), value);
+			}
+			else
+			{
+				DEMO_LOG(Warning, std::format("Ignoring {}, the value is an unsigned integer", arg));
+			}
+		}
+	}
 	{
 		Application* app = new OctBlend();
 		app->Init(1280, 720);
@@ -0,0 +1,67 @@
+#include "mapped_file.h"
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+	m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size))
+	{
+		return;
+	}
+	m_Size = static_cast<size_t>(size.QuadPart);
+	m_Valid = true;
+	if (m_Size == 0)
+	{
+		return;
+	}
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping)
+	{
+		m_Data = static_cast<const char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+#else
+	m_Fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (m_Fd < 0 || fstat(m_Fd, &st) != 0)
+	{
+		return;
+	}
+	m_Size = static_cast<size_t>(st.st_size);
+	m_Valid = true;
+	if (m_Size == 0)
+	{
+		return;
+	}
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_Fd, 0);
+	m_Data = data == MAP_FAILED ? nullptr : static_cast<const char*>(data);
+#endif
+	m_Valid = m_Data != nullptr;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_Data) UnmapViewOfFile(m_Data);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File != INVALID_HANDLE_VALUE) CloseHandle(m_File);
+#else
+	if (m_Data) munmap(const_cast<char*>(m_Data), m_Size);
+	if (m_Fd >= 0) close(m_Fd);
+#endif
+}
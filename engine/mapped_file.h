@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// read only view of a whole file, pages are brought in by the OS as they are touched
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool valid() const { return m_Valid; }
+	const char* data() const { return m_Data; }
+	size_t size() const { return m_Size; }
+
+private:
+#ifdef _WIN32
+	// HANDLEs, so that windows.h stays out of the header
+	void* m_File = reinterpret_cast<void*>(intptr_t(-1));
+	void* m_Mapping = nullptr;
+#else
+	int m_Fd = -1;
+#endif
+	const char* m_Data = nullptr;
+	size_t m_Size = 0;
+	bool m_Valid = false;
+};
@@ -1,6 +1,7 @@
 #include "mesh.h"
 #include "log.h"
 #include "Texture.h"
+#include "TextureStreamer.h"
 #include <glm/gtc/type_ptr.hpp>
 
 #include <iostream>
@@ -16,10 +17,143 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 // #define TINYGLTF_NOEXCEPTION // optional. disable exception handling.
 #include "tiny_gltf.h"
+#include "obj_reader.h"
+
+#include <chrono>
+#include <execution>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+// KHR_draco_mesh_compression is compiled in once draco has been built with its CMake project:
+// draco.lib goes to vendor/lib, where engine.vcxproj links it from, and the generated
+// draco/draco_features.h onto the include path
+#if __has_include(<draco/draco_features.h>)
+#define DEMO_DRACO_SUPPORT 1
+#include <draco/compression/decode.h>
+#endif
 
 using namespace std;
 
 namespace {
+	struct DracoPrimitive
+	{
+		std::vector<Vertex> vertices;
+		std::vector<std::uint32_t> indices;
+		bool valid = false;
+	};
+	using DracoPrimitives = std::unordered_map<uint64_t, DracoPrimitive>;
+
+	uint64_t primitiveKey(int mesh, size_t primitive)
+	{
+		return (uint64_t(mesh) << 32) | uint64_t(primitive);
+	}
+
+	bool isDracoPrimitive(const tinygltf::Primitive& primitive)
+	{
+		return primitive.extensions.find("KHR_draco_mesh_compression") != primitive.extensions.end();
+	}
+
+	void decodeDracoPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive, DracoPrimitive& out)
+	{
+#if defined(DEMO_DRACO_SUPPORT)
+		const tinygltf::Value& ext = primitive.extensions.at("KHR_draco_mesh_compression");
+		const tinygltf::BufferView& view = model.bufferViews[ext.Get("bufferView").GetNumberAsInt()];
+		const tinygltf::Buffer& buffer = model.buffers[view.buffer];
+		draco::DecoderBuffer decoderBuffer;
+		decoderBuffer.Init(reinterpret_cast<const char*>(buffer.data.data() + view.byteOffset), view.byteLength);
+		draco::Decoder decoder;
+		auto result = decoder.DecodeMeshFromBuffer(&decoderBuffer);
+		if (!result.ok())
+		{
+			DEMO_LOG(Error, std::format("Draco decode failed: {}", result.status().error_msg_string()));
+			return;
+		}
+		std::unique_ptr<draco::Mesh> dracoMesh = std::move(result).value();
+
+		out.vertices.resize(dracoMesh->num_points());
+		const tinygltf::Value& attributes = ext.Get("attributes");
+		auto readAttribute = [&](const char* name, int8_t components, auto&& write) {
+			if (!attributes.Has(name))
+			{
+				return;
+			}
+			const draco::PointAttribute* attribute = dracoMesh->GetAttributeByUniqueId(attributes.Get(name).GetNumberAsInt());
+			if (!attribute)
+			{
+				return;
+			}
+			float value[4] = {};
+			for (draco::PointIndex i(0); i < dracoMesh->num_points(); ++i)
+			{
+				attribute->ConvertValue<float>(attribute->mapped_index(i), components, value);
+				write(out.vertices[i.value()], value);
+			}
+		};
+		readAttribute("POSITION", 3, [](Vertex& v, const float* f) { v.Position = glm::make_vec3(f); });
+		readAttribute("NORMAL", 3, [](Vertex& v, const float* f) { v.Normal = glm::normalize(glm::make_vec3(f)); });
+		readAttribute("TEXCOORD_0", 2, [](Vertex& v, const float* f) { v.TexCoords = glm::make_vec2(f); });
+		readAttribute("TANGENT", 4, [](Vertex& v, const float* f) { v.Tangent = glm::make_vec4(f); });
+		for (auto& vert : out.vertices)
+		{
+			vert.materialId = primitive.material;
+		}
+
+		out.indices.resize(size_t(dracoMesh->num_faces()) * 3);
+		for (draco::FaceIndex f(0); f < dracoMesh->num_faces(); ++f)
+		{
+			const auto& face = dracoMesh->face(f);
+			out.indices[f.value() * 3 + 0] = face[0].value();
+			out.indices[f.value() * 3 + 1] = face[1].value();
+			out.indices[f.value() * 3 + 2] = face[2].value();
+		}
+		out.valid = true;
+#else
+		DEMO_LOG(Error, "KHR_draco_mesh_compression primitive skipped, engine was built without draco");
+#endif
+	}
+
+	// decodes every draco primitive of the model in parallel before the node hierarchy is walked
+	DracoPrimitives decodeDracoPrimitives(const tinygltf::Model& model)
+	{
+		DracoPrimitives dracoPrimitives;
+		std::vector<std::pair<const tinygltf::Primitive*, DracoPrimitive*>> jobs;
+		size_t compressedBytes = 0;
+		for (int m = 0; m < model.meshes.size(); m++)
+		{
+			for (size_t p = 0; p < model.meshes[m].primitives.size(); p++)
+			{
+				const auto& primitive = model.meshes[m].primitives[p];
+				if (!isDracoPrimitive(primitive))
+				{
+					continue;
+				}
+				const auto& ext = primitive.extensions.at("KHR_draco_mesh_compression");
+				compressedBytes += model.bufferViews[ext.Get("bufferView").GetNumberAsInt()].byteLength;
+				jobs.emplace_back(&primitive, &dracoPrimitives[primitiveKey(m, p)]);
+			}
+		}
+		if (jobs.empty())
+		{
+			return dracoPrimitives;
+		}
+		auto start = std::chrono::steady_clock::now();
+		std::for_each(std::execution::par, jobs.begin(), jobs.end(), [&model](auto& job) {
+			decodeDracoPrimitive(model, *job.first, *job.second);
+			});
+		auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+		size_t decodedBytes = 0;
+		for (auto& [key, decoded] : dracoPrimitives)
+		{
+			decodedBytes += decoded.vertices.size() * sizeof(Vertex) + decoded.indices.size() * sizeof(std::uint32_t);
+		}
+		DEMO_LOG(Info, std::format("Draco: decoded {} primitives in {:.2f} ms, {} KB compressed -> {} KB",
+			jobs.size(), elapsed.count(), compressedBytes / 1024, decodedBytes / 1024));
+		return dracoPrimitives;
+	}
+
 	std::string getFileExtension(const std::string& filePath) {
 		size_t pos = filePath.find_last_of('.');
 		if (pos != std::string::npos && pos != filePath.length() - 1) {
@@ -27,7 +161,38 @@ namespace {
 		}
 		return ""; // ûк׺ʱؿַ
 	}
-	void loadNode(Node* parent, const tinygltf::Node& node,uint32_t nodeIndex, const tinygltf::Model& model, Mesh* _mesh)
+	struct GltfLoadContext
+	{
+		const DracoPrimitives& dracoPrimitives;
+		// glTF mesh index -> indirect draws holding its primitives
+		std::unordered_map<int, std::vector<uint32_t>> meshDraws;
+		// one entry per (node, draw) pair, turned into instances once the hierarchy is loaded
+		std::vector<std::pair<Node*, uint32_t>> nodeDraws;
+	};
+
+	AABB transformAABB(const AABB& local, const glm::mat4& matrix)
+	{
+		glm::vec3 posMin{ std::numeric_limits<float>::max() };
+		glm::vec3 posMax{ std::numeric_limits<float>::lowest() };
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 pos{ corner & 1 ? local.maxPos.x : local.minPos.x,
+				corner & 2 ? local.maxPos.y : local.minPos.y,
+				corner & 4 ? local.maxPos.z : local.minPos.z };
+			pos = glm::vec3(matrix * glm::vec4(pos, 1.0f));
+			posMin = glm::min(posMin, pos);
+			posMax = glm::max(posMax, pos);
+		}
+		AABB aabb;
+		aabb.minPos = posMin;
+		aabb.maxPos = posMax;
+		aabb.extent = (posMax - posMin) * 0.5f;
+		aabb.center = posMin + aabb.extent;
+		return aabb;
+	}
+
+	void loadNode(Node* parent, const tinygltf::Node& node,uint32_t nodeIndex, const tinygltf::Model& model, Mesh* _mesh,
+		GltfLoadContext& context)
 	{
 		Node* newNode = new Node{};
 		newNode->index = nodeIndex;
@@ -71,7 +236,7 @@ namespace {
 		{
 			for (auto i = 0; i < node.children.size(); i++)
 			{
-				loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, _mesh);
+				loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, _mesh, context);
 			}
 		}
 
@@ -83,7 +248,10 @@ namespace {
 			{
 				std::abort();
 			}*/
-			for (size_t j = 0; j < mesh.primitives.size(); j++)
+			// every glTF mesh is stored once, further nodes referencing it only add instances
+			const bool meshLoaded = context.meshDraws.contains(node.mesh);
+			auto& meshDraws = context.meshDraws[node.mesh];
+			for (size_t j = 0; j < mesh.primitives.size() && !meshLoaded; j++)
 			{
 				const tinygltf::Primitive& primitive = mesh.primitives[j];
 				if (primitive.indices < 0)
@@ -97,7 +265,24 @@ namespace {
 				glm::vec3 posMin{};
 				glm::vec3 posMax{};
 				bool hasSkin = false;
+				const bool isDraco = isDracoPrimitive(primitive);
+				if (isDraco)
+				{
+					const DracoPrimitive& decoded = context.dracoPrimitives.at(primitiveKey(node.mesh, j));
+					if (!decoded.valid)
+					{
+						continue;
+					}
+					const tinygltf::Accessor& posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+					posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+					posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+					vertexCount = static_cast<uint32_t>(decoded.vertices.size());
+					indexCount = static_cast<uint32_t>(decoded.indices.size());
+					_mesh->vertices.insert(_mesh->vertices.end(), decoded.vertices.begin(), decoded.vertices.end());
+					_mesh->indices.insert(_mesh->indices.end(), decoded.indices.begin(), decoded.indices.end());
+				}
 				// Vertices
+				if (!isDraco)
 				{
 					const float* bufferPos = nullptr;
 					const float* bufferNormals = nullptr;
@@ -175,6 +360,7 @@ namespace {
 					}
 				}
 				// Indices
+				if (!isDraco)
 				{
 					const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
 					const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
@@ -225,17 +411,21 @@ namespace {
 				aabb.maxPos = posMax;
 				aabb.extent = (posMax - posMin) * 0.5f;
 				aabb.center = posMin + aabb.extent;
-				_mesh->aabbs.push_back(aabb);
+				_mesh->localAabbs.push_back(aabb);
 				IndirectCommandAndMeshData indirectData;
 				indirectData.command.setFirstIndex(indexStart)
 					.setFirstInstance(0)
 					.setIndexCount(indexCount)
-					.setInstanceCount(1)
+					.setInstanceCount(0)
 					.setVertexOffset(vertexStart);
 				indirectData.meshId = _mesh->indirectDrawData.size();
 				indirectData.materialIndex = primitive.material;
+				meshDraws.push_back(indirectData.meshId);
 				_mesh->indirectDrawData.push_back(indirectData);
-				_mesh->nodes.push_back(newNode);
+			}
+			for (auto drawId : meshDraws)
+			{
+				context.nodeDraws.emplace_back(newNode, drawId);
 			}
 		}
 		if (parent)
@@ -284,6 +474,46 @@ namespace
 	}
 }
 
+namespace
+{
+	// runs on the decode workers, so failures are reported through an empty image instead of an exception
+	Mesh::ImageData decodeImage(const std::string& filename, TextureKind kind)
+	{
+		// the thread local flag keeps worker threads from racing on the global one
+		stbi_set_flip_vertically_on_load_thread(true);
+		int w, h, channel;
+		stbi_uc* pixels = stbi_load(filename.c_str(), &w, &h, &channel, STBI_rgb_alpha);
+		Mesh::ImageData image;
+		if (!pixels)
+		{
+			DEMO_LOG(Error, std::format("Failed to load image {}", filename));
+			return image;
+		}
+		image.pixels.assign(pixels, pixels + size_t(w) * h * 4);
+		image.width = w;
+		image.height = h;
+		image.channel = 4;
+		image.format = vk::Format::eR8G8B8A8Srgb;
+		image.kind = kind;
+		stbi_image_free(pixels);
+		return image;
+	}
+
+	// tinygltf would decode every image on the parsing thread, this only keeps the encoded bytes
+	// so that they can be decoded concurrently once the file has been read
+	bool keepEncodedImage(tinygltf::Image*, const int imageIndex, std::string*, std::string*, int, int,
+		const unsigned char* bytes, int size, void* userData)
+	{
+		auto& encoded = *static_cast<std::vector<std::vector<unsigned char>>*>(userData);
+		if (encoded.size() <= size_t(imageIndex))
+		{
+			encoded.resize(imageIndex + 1);
+		}
+		encoded[imageIndex].assign(bytes, bytes + size);
+		return true;
+	}
+}
+
 Mesh::~Mesh()
 {
 	for (auto texture : textures)
@@ -294,82 +524,138 @@ Mesh::~Mesh()
 }
 
 
-void Mesh::loadobj(string path)
+void Mesh::prepareTextures()
 {
-	directory = path.substr(0, path.find_last_of('/'));
-	tinyobj::ObjReaderConfig reader_config;
-	tinyobj::ObjReader reader;
-	if (!reader.ParseFromFile(path, reader_config))
+	auto& manager = TextureManager::Instance();
+	preparedImages.clear();
+	preparedImages.resize(pendingImages.size());
+	std::vector<size_t> order(pendingImages.size());
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t i) {
+		auto& image = pendingImages[i];
+		preparedImages[i].hash = TextureManager::ContentHash(image.pixels.data(), image.width, image.height, image.channel,
+			image.format, image.kind);
+		});
+
+	// images repeated within this model are compressed once. Whether one is already on the GPU is only known
+	// on the render thread, so those are compressed too and then dropped by uploadTextures()
+	std::unordered_map<uint64_t, size_t> first;
+	for (size_t i = 0; i < pendingImages.size(); i++)
 	{
-		if (!reader.Error().empty())
+		preparedImages[i].source = first.try_emplace(preparedImages[i].hash, i).first->second;
+	}
+	std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t i) {
+		auto& prepared = preparedImages[i];
+		if (prepared.source != i)
 		{
 			return;
 		}
+		auto& image = pendingImages[i];
+		prepared.isCompressed = manager.PrepareCompressed(image.pixels.data(), image.width, image.height, image.channel,
+			image.format, image.kind, prepared.compressed, &prepared.cacheFile);
+		prepared.prepared = true;
+		});
+}
+
+void Mesh::uploadTextures()
+{
+	auto& manager = TextureManager::Instance();
+	const auto statsBefore = manager.GetSharingStats();
+	if (preparedImages.size() != pendingImages.size())
+	{
+		prepareTextures();
 	}
 
-	auto& attrib = reader.GetAttrib();
-	auto& shapes = reader.GetShapes();
-	auto& materials = reader.GetMaterials();
-	int total_vtx_num = 0;
+	auto& streamer = TextureStreamer::Instance();
+	manager.BeginBatch();
+	for (size_t i = 0; i < pendingImages.size(); i++)
+	{
+		const auto& prepared = preparedImages[preparedImages[i].source];
+		std::shared_ptr<Texture> shared = manager.FindShared(preparedImages[i].hash);
+		if (!shared)
+		{
+			auto& image = pendingImages[prepared.source];
+			// block compressed images only get their tail uploaded when they can be streamed
+			if (prepared.isCompressed)
+			{
+				shared = streamer.Create(prepared.compressed, prepared.cacheFile);
+			}
+			if (!shared)
+			{
+				shared = prepared.isCompressed ? manager.Create(prepared.compressed) :
+					manager.Create(image.pixels.data(), image.width, image.height, image.channel, image.format);
+			}
+			manager.AddShared(shared, preparedImages[i].hash);
+		}
+		textures.push_back(shared);
+	}
+	manager.EndBatch();
+
+	const auto stats = manager.GetSharingStats();
+	if (stats.hits > statsBefore.hits)
+	{
+		DEMO_LOG(Info, std::format("Reused {} of {} textures, {:.1f} MB saved ({:.1f} MB over {} shared textures in total)",
+			stats.hits - statsBefore.hits, pendingImages.size(), (stats.bytesSaved - statsBefore.bytesSaved) / (1024.0 * 1024.0),
+			stats.bytesSaved / (1024.0 * 1024.0), stats.textures));
+	}
+	pendingImages.clear();
+	preparedImages.clear();
+}
+
+void Mesh::loadobj(string path, bool deferUpload)
+{
+	auto loadStart = std::chrono::steady_clock::now();
+	directory = path.substr(0, path.find_last_of('/'));
+	ObjReader reader;
+	ObjData obj;
+	if (!reader.parse(path, obj))
+	{
+		DEMO_LOG(Error, reader.error());
+		return;
+	}
+	auto parseTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart);
+	DEMO_LOG(Info, std::format("Parsed {} ({:.1f} MB) in {:.2f} ms, {:.1f} MB/s", path, reader.bytes() / (1024.0 * 1024.0),
+		parseTime.count() * 1000.0, reader.bytes() / (1024.0 * 1024.0) / parseTime.count()));
+
+	auto& shapes = obj.shapes;
+	auto& materials = obj.materials;
+	size_t total_vtx_num = 0;
 
 	for (size_t s = 0; s < shapes.size(); s++)
 	{
-		total_vtx_num += shapes[s].mesh.num_face_vertices.size() * 3;
+		total_vtx_num += shapes[s].indices.size();
 	}
 	vertices.reserve(total_vtx_num);
+	indices.reserve(total_vtx_num);
 	for (size_t s = 0; s < shapes.size(); s++)
 	{
 		int IndexStart = indices.size();
 		int VertexStart = vertices.size();
 
-		glm::vec3 posMin{10000.0f};
-		glm::vec3 posMax{-10000.0f};
+		glm::vec3 posMin{ std::numeric_limits<float>::max() };
+		glm::vec3 posMax{ std::numeric_limits<float>::lowest() };
 
-		size_t index_offset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+		const auto& shapeIndices = shapes[s].indices;
+		for (size_t v = 0; v < shapeIndices.size(); v++)
 		{
-			size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
-			if (fv != 3)
+			const ObjIndex& idx = shapeIndices[v];
+			Vertex vert;
+			vert.Position = glm::make_vec3(&obj.positions[3 * size_t(idx.position)]);
+			if (idx.texcoord >= 0 && idx.normal >= 0)
 			{
-				return;
+				vert.Normal = glm::make_vec3(&obj.normals[3 * size_t(idx.normal)]);
+				vert.TexCoords = glm::make_vec2(&obj.texcoords[2 * size_t(idx.texcoord)]);
 			}
-
-			for (size_t v = 0; v < fv; v++)
+			else
 			{
-				tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-
-				tinyobj::real_t vx = attrib.vertices[3 * size_t(idx.vertex_index) + 0];
-				tinyobj::real_t vy = attrib.vertices[3 * size_t(idx.vertex_index) + 1];
-				tinyobj::real_t vz = attrib.vertices[3 * size_t(idx.vertex_index) + 2];
-
-				if (idx.texcoord_index >= 0 && idx.normal_index >= 0)
-				{
-					tinyobj::real_t nx = attrib.normals[3 * size_t(idx.normal_index) + 0];
-					tinyobj::real_t ny = attrib.normals[3 * size_t(idx.normal_index) + 1];
-					tinyobj::real_t nz = attrib.normals[3 * size_t(idx.normal_index) + 2];
-
-					tinyobj::real_t tx = attrib.texcoords[2 * size_t(idx.texcoord_index) + 0];
-					tinyobj::real_t ty = attrib.texcoords[2 * size_t(idx.texcoord_index) + 1];
-					Vertex vert;
-					vert.Position = glm::vec3{ vx,  vy, vz };
-					vert.Normal = glm::vec3{ nx,  ny, nz };
-					vert.TexCoords = glm::vec2{ tx, ty };
-					vertices.push_back(vert);
-				}
-				else
-				{
-					Vertex vert;
-					vert.Position = glm::vec3{ vx,  vy, vz };
-					vert.Normal = glm::vec3{ 0 };
-					vert.TexCoords = glm::vec2{ 0 };
-					vertices.push_back(vert);
-				}
-				posMin = glm::vec3(std::min(posMin.x, vertices.back().Position.x), std::min(posMin.y, vertices.back().Position.y), std::min(posMin.z, vertices.back().Position.z));
-				posMax = glm::vec3(std::max(posMin.x, vertices.back().Position.x), std::max(posMin.y, vertices.back().Position.y), std::max(posMin.z, vertices.back().Position.z));
-				vertices.back().materialId = shapes[s].mesh.material_ids[f];
-				this->indices.push_back(this->indices.size());
+				vert.Normal = glm::vec3{ 0 };
+				vert.TexCoords = glm::vec2{ 0 };
 			}
-			index_offset += fv;
+			vert.materialId = shapes[s].materialIds[v / 3];
+			posMin = glm::min(posMin, vert.Position);
+			posMax = glm::max(posMax, vert.Position);
+			vertices.push_back(vert);
+			this->indices.push_back(this->indices.size());
 		}
 		AABB aabb;
 		aabb.minPos = posMin;
@@ -377,17 +663,37 @@ void Mesh::loadobj(string path)
 		aabb.extent = (posMax - posMin) * 0.5f;
 		aabb.center = posMin + aabb.extent;
 		aabbs.push_back(aabb);
+		localAabbs.push_back(aabb);
 		IndirectCommandAndMeshData indirectData;
 		indirectData.command.setFirstIndex(IndexStart)
-			.setFirstInstance(0)
-			.setIndexCount(index_offset)
+			.setFirstInstance(indirectDrawData.size())
+			.setIndexCount(shapeIndices.size())
 			.setInstanceCount(1)
 			.setVertexOffset(VertexStart);
 		indirectData.meshId = indirectDrawData.size();
 		indirectData.materialIndex = vertices.back().materialId;
+		MeshInstance instance{};
+		instance.model = glm::mat4(1.0f);
+		instance.drawId = indirectData.meshId;
+		instances.push_back(instance);
 		indirectDrawData.push_back(indirectData);
 	}
 	generate_tangents(vertices, indices);
+	// texture ids are handed out here, the files are decoded after the material loop. Materials sharing
+	// a map share its id
+	std::vector<std::pair<std::string, TextureKind>> imageFiles;
+	std::unordered_map<std::string, int> imageIds;
+	auto addImage = [&](const std::string& name, TextureKind kind) {
+		const std::string key = name + '|' + std::to_string(static_cast<int>(kind));
+		if (auto it = imageIds.find(key); it != imageIds.end())
+		{
+			return it->second;
+		}
+		imageFiles.emplace_back(directory + '/' + name, kind);
+		const int id = static_cast<int>(textures.size() + pendingImages.size() + imageFiles.size() - 1);
+		imageIds.emplace(key, id);
+		return id;
+		};
 	for (size_t i = 0; i < materials.size(); i++)
 	{
 		Material material;
@@ -397,37 +703,56 @@ void Mesh::loadobj(string path)
 		material.emission_ior = glm::vec4(materials[i].emission[0], materials[i].emission[1], materials[i].emission[2], materials[i].ior);
 		if (materials[i].ambient_texname != "")
 		{
-			material.reflectTextureId = textures.size();
-			std::shared_ptr<Texture> reflectTex = TextureManager::Instance().Load(directory + '/' + materials[i].ambient_texname);
-			textures.push_back(reflectTex);
+			material.reflectTextureId = addImage(materials[i].ambient_texname, TextureKind::Color);
 		}
 		if (materials[i].diffuse_texname != "")
 		{
-			material.diffuseTextureId = textures.size();
-			std::shared_ptr<Texture> diffuseTex = TextureManager::Instance().Load(directory + '/' + materials[i].diffuse_texname);
-			textures.push_back(diffuseTex);
+			material.diffuseTextureId = addImage(materials[i].diffuse_texname, TextureKind::Color);
 		}
 		if (materials[i].specular_texname != "")
 		{
-			material.specularTextureId = textures.size();
-			std::shared_ptr<Texture> specularTex = TextureManager::Instance().Load(directory + '/' + materials[i].specular_texname);
-			textures.push_back(specularTex);
+			material.specularTextureId = addImage(materials[i].specular_texname, TextureKind::Data);
 		}
 		if (materials[i].bump_texname != "")
 		{
-			material.normalTextureId = textures.size();
-			std::shared_ptr<Texture> normalTex = TextureManager::Instance().Load(directory + '/' + materials[i].bump_texname);
-			textures.push_back(normalTex);
+			material.normalTextureId = addImage(materials[i].bump_texname, TextureKind::Normal);
 		}
 		this->materials.push_back(material);
 	}
+
+	// every map of the model is decoded concurrently
+	auto decodeStart = std::chrono::steady_clock::now();
+	const size_t firstImage = pendingImages.size();
+	pendingImages.resize(firstImage + imageFiles.size());
+	std::vector<size_t> order(imageFiles.size());
+	std::iota(order.begin(), order.end(), size_t(0));
+	std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t i) {
+		pendingImages[firstImage + i] = decodeImage(imageFiles[i].first, imageFiles[i].second);
+		});
+	for (size_t i = firstImage; i < pendingImages.size(); i++)
+	{
+		if (pendingImages[i].pixels.empty())
+		{
+			throw std::runtime_error("image load failed");
+		}
+	}
+	auto decodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart);
+	DEMO_LOG(Info, std::format("Decoded {} images in {:.2f} ms", imageFiles.size(), decodeTime.count()));
+	prepareTextures();
+	if (!deferUpload)
+	{
+		uploadTextures();
+	}
 }
 
-void Mesh::loadgltf(std::string path)
+void Mesh::loadgltf(std::string path, bool deferUpload)
 {
-	stbi_set_flip_vertically_on_load(false);
+	auto loadStart = std::chrono::steady_clock::now();
+	stbi_set_flip_vertically_on_load_thread(false);
 	tinygltf::Model model;
 	tinygltf::TinyGLTF loader;
+	std::vector<std::vector<unsigned char>> encodedImages;
+	loader.SetImageLoader(keepEncodedImage, &encodedImages);
 	std::string err;
 	std::string warn;
 	bool ret = false;
@@ -454,6 +779,32 @@ void Mesh::loadgltf(std::string path)
 		return;
 	}
 
+	auto decodeStart = std::chrono::steady_clock::now();
+	std::vector<std::string> decodeErrors(model.images.size());
+	std::vector<size_t> imageOrder(model.images.size());
+	std::iota(imageOrder.begin(), imageOrder.end(), size_t(0));
+	std::for_each(std::execution::par, imageOrder.begin(), imageOrder.end(), [&](size_t i) {
+		if (i >= encodedImages.size() || encodedImages[i].empty())
+		{
+			return;
+		}
+		stbi_set_flip_vertically_on_load_thread(false);
+		std::string decodeWarning;
+		tinygltf::LoadImageData(&model.images[i], static_cast<int>(i), &decodeErrors[i], &decodeWarning, 0, 0,
+			encodedImages[i].data(), static_cast<int>(encodedImages[i].size()), nullptr);
+		});
+	for (const auto& decodeError : decodeErrors)
+	{
+		if (!decodeError.empty())
+		{
+			DEMO_LOG(Error, "Err: " + decodeError);
+			return;
+		}
+	}
+	encodedImages.clear();
+	auto decodeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart);
+	DEMO_LOG(Info, std::format("Decoded {} images in {:.2f} ms", model.images.size(), decodeTime.count()));
+
 	for (auto& texture : model.textures)
 	{
 		vk::Format format = vk::Format::eR8G8B8A8Unorm;
@@ -461,10 +812,14 @@ void Mesh::loadgltf(std::string path)
 		{
 			format = vk::Format::eR16G16B16A16Unorm;
 		}
-		auto t = TextureManager::Instance().Create(model.images[texture.source].image.data(), 
-			model.images[texture.source].width, model.images[texture.source].height, 
-			model.images[texture.source].bits / 8 * model.images[texture.source].component, format);
-		textures.push_back(t);
+		auto& source = model.images[texture.source];
+		ImageData image;
+		image.pixels = source.image;
+		image.width = source.width;
+		image.height = source.height;
+		image.channel = source.bits / 8 * source.component;
+		image.format = format;
+		pendingImages.push_back(std::move(image));
 	}
 	//ʹimageе⣬ʹindexbufferviewжȡͼstbimageȡstbi_set_flip_vertically_on_load(false);
 	// 20241114ڼģǰ÷ǷתͲ¼
@@ -533,42 +888,86 @@ void Mesh::loadgltf(std::string path)
 		}
 		materials.push_back(currentMat);
 	}
+	// the material decides how each texture is compressed
+	auto setKind = [this](int textureId, TextureKind kind) {
+		if (textureId >= 0 && size_t(textureId) < pendingImages.size())
+		{
+			pendingImages[textureId].kind = kind;
+		}
+		};
+	for (const auto& mat : materials)
+	{
+		setKind(mat.normalTextureId, TextureKind::Normal);
+		setKind(mat.specularTextureId, TextureKind::Data);
+	}
+	prepareTextures();
+	if (!deferUpload)
+	{
+		uploadTextures();
+	}
+	const DracoPrimitives dracoPrimitives = decodeDracoPrimitives(model);
+	GltfLoadContext context{ .dracoPrimitives = dracoPrimitives };
 	const auto& scene = model.scenes[model.defaultScene > -1 ? model.defaultScene : 0];
 	for (size_t i = 0; i < scene.nodes.size(); i++)
 	{
 		const auto node = model.nodes[scene.nodes[i]];
-		loadNode(nullptr,node, scene.nodes[i], model, this);
+		loadNode(nullptr,node, scene.nodes[i], model, this, context);
+	}
+	// vertices stay in mesh space, instances of one draw are kept contiguous so that
+	// firstInstance/instanceCount of the indirect command cover them
+	std::vector<std::vector<Node*>> drawNodes(indirectDrawData.size());
+	for (auto& [node, drawId] : context.nodeDraws)
+	{
+		drawNodes[drawId].push_back(node);
 	}
-	for (int i = 0; i < nodes.size(); i++)
+	std::vector<uint32_t> nodeIndices;
+	hierarchy = TransformHierarchy::fromNodes(linearNodes, nodeIndices);
+	hierarchy.update();
+	std::unordered_map<const Node*, uint32_t> hierarchyIndex;
+	for (size_t i = 0; i < linearNodes.size(); i++)
 	{
-		const glm::mat4 localMatrix = nodes[i]->getMatrix();
-		int start = indirectDrawData[i].command.vertexOffset;
-		int end = vertices.size();
-		glm::vec3 posMin{ 1000 };
-		glm::vec3 posMax{ -1000 };
-		if (i != nodes.size() - 1)
+		hierarchyIndex[linearNodes[i]] = nodeIndices[i];
+	}
+	for (uint32_t i = 0; i < indirectDrawData.size(); i++)
+	{
+		indirectDrawData[i].command.setFirstInstance(instances.size())
+			.setInstanceCount(drawNodes[i].size());
+		for (Node* node : drawNodes[i])
 		{
-			end = indirectDrawData[i + 1].command.vertexOffset;
+			const uint32_t transform = hierarchyIndex.at(node);
+			MeshInstance instance{};
+			instance.model = hierarchy.worldMatrix(transform);
+			instance.drawId = i;
+			instances.push_back(instance);
+			instanceTransforms.push_back(transform);
+			aabbs.push_back(transformAABB(localAabbs[i], instance.model));
+			nodes.push_back(node);
 		}
-		for (int j = start; j < end; j++)
+	}
+	DEMO_LOG(Info, std::format("{}: {} draws, {} instances", path, indirectDrawData.size(), instances.size()));
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart);
+	DEMO_LOG(Info, std::format("Loaded {} ({} KB on disk, {} vertices, {} indices) in {:.2f} ms", path,
+		std::filesystem::file_size(path) / 1024, vertices.size(), indices.size(), elapsed.count()));
+}
+
+bool Mesh::updateTransforms()
+{
+	if (hierarchy.update() == 0)
+	{
+		return false;
+	}
+	bool moved = false;
+	for (size_t i = 0; i < instanceTransforms.size(); i++)
+	{
+		if (!hierarchy.changed(instanceTransforms[i]))
 		{
-			Vertex& vertex = vertices[j];
-			vertex.Position = glm::vec3(localMatrix * glm::vec4(vertex.Position, 1.0f));
-			vertex.Normal = glm::normalize(glm::mat3(localMatrix) * vertex.Normal);
-			posMin = glm::vec3(std::min(posMin.x, vertex.Position.x), std::min(posMin.y, vertex.Position.y), std::min(posMin.z, vertex.Position.z));
-			posMax = glm::vec3(std::max(posMax.x, vertex.Position.x), std::max(posMax.y, vertex.Position.y), std::max(posMax.z, vertex.Position.z));
+			continue;
 		}
-		AABB& aabb = aabbs[i];
-		aabb.minPos = posMin;
-		aabb.maxPos = posMax;
-		aabb.extent = (posMax - posMin) * 0.5f;
-		aabb.center = posMin + aabb.extent;
-		//AABB& aabb = aabbs[i];
-		//aabb.minPos = glm::vec3(glm::vec4(aabb.minPos, 1.0f) * localMatrix);
-		//aabb.maxPos = glm::vec3(glm::vec4(aabb.maxPos, 1.0f) * localMatrix);
-		//aabb.extent = (aabb.maxPos - aabb.minPos) * 0.5f;
-		//aabb.center = aabb.minPos + aabb.extent;
+		instances[i].model = hierarchy.worldMatrix(instanceTransforms[i]);
+		aabbs[i] = transformAABB(localAabbs[instances[i].drawId], instances[i].model);
+		moved = true;
 	}
+	return moved;
 }
 
 glm::mat4 Node::localMatrix()
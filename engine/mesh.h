@@ -6,6 +6,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "Vertex.h"
+#include "transform.h"
+#include "BlockCompressor.h"
+#include "KTX2.h"
 
 class Texture;
 
@@ -36,6 +39,25 @@ struct IndirectCommandAndMeshData
 	uint32_t materialIndex;
 };
 
+// per instance data read by the vertex shaders and the culling pass, matches InstanceData in CommonStructs.glsl
+struct MeshInstance
+{
+	glm::mat4 model;
+	uint32_t drawId;
+	uint32_t padding[3];
+};
+
+// BindlessHeap indices of the scene's buffers, pushed to the shaders that include IndirectCommon.glsl with
+// BINDLESS_HEAP defined, matches SceneBuffers there
+struct SceneBuffers
+{
+	uint32_t vertices;
+	uint32_t indices;
+	uint32_t indirectDraws;
+	uint32_t materials;
+	uint32_t instances;
+};
+
 struct AABB
 {
 	glm::vec3 minPos;
@@ -74,14 +96,55 @@ struct Mesh
 	std::vector<std::shared_ptr<Texture>> textures;
 	std::vector<glm::mat4> transforms;
 	std::vector<Material> materials;
+	// world space bounds, one per instance
 	std::vector<AABB> aabbs;
+	// mesh space bounds, one per indirect draw
+	std::vector<AABB> localAabbs;
 	std::vector<IndirectCommandAndMeshData> indirectDrawData;
+	// grouped by draw, indirectDrawData[i] covers its instances via firstInstance/instanceCount
+	std::vector<MeshInstance> instances;
+	// flattened node hierarchy of glTF scenes, instanceTransforms maps every instance to its node
+	TransformHierarchy hierarchy;
+	std::vector<uint32_t> instanceTransforms;
 	std::vector<Node*> linearNodes;
 	std::vector<Node*> nodes;
 	std::string directory;
+
+	// decoded pixels waiting for uploadTextures(), filled by the loaders when deferUpload is set
+	struct ImageData
+	{
+		std::vector<unsigned char> pixels;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t channel = 4;
+		vk::Format format = vk::Format::eR8G8B8A8Unorm;
+		TextureKind kind = TextureKind::Color;
+	};
+	std::vector<ImageData> pendingImages;
+	// what prepareTextures() made of pendingImages, one per image. Duplicates within the model point at the
+	// first image with the same content, which is the only one compressed
+	struct PreparedImage
+	{
+		uint64_t hash = 0;
+		size_t source = 0;
+		bool prepared = false;
+		bool isCompressed = false;
+		KTX2Image compressed;
+		std::string cacheFile;
+	};
+	std::vector<PreparedImage> preparedImages;
+
 	~Mesh();
-	void loadobj(std::string path);
-	void loadgltf(std::string path);
+	// with deferUpload the loaders only touch the CPU and can run on a worker thread, they block compress the
+	// images there too. uploadTextures() must then be called on the render thread
+	void loadobj(std::string path, bool deferUpload = false);
+	void loadgltf(std::string path, bool deferUpload = false);
+	// hashing, KTX2 cache reads and block compression, CPU only
+	void prepareTextures();
+	// only records the copies, runs prepareTextures() first when the loader has not
+	void uploadTextures();
+	// applies edits made through hierarchy to instances and aabbs, true if any instance moved
+	bool updateTransforms();
 
 	std::vector<glm::vec3> flatten()
 	{
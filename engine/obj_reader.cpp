@@ -0,0 +1,470 @@
+#include "obj_reader.h"
+#include "log.h"
+#include "tiny_obj_loader.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include "mapped_file.h"
+
+namespace
+{
+	constexpr int InheritMaterial = -2;
+
+	struct ChunkPiece
+	{
+		bool newShape = false;
+		std::string name;
+		size_t firstIndex = 0;
+		size_t firstTriangle = 0;
+	};
+
+	// everything a chunk produces, indices are fixed up once the attribute counts of the previous chunks are known
+	struct Chunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		std::vector<float> positions;
+		std::vector<float> normals;
+		std::vector<float> texcoords;
+		std::vector<ObjIndex> indices;
+		// chunk local material name ids, InheritMaterial until the first usemtl of the chunk
+		std::vector<int> materials;
+		std::vector<ChunkPiece> pieces;
+		std::vector<std::string> materialNames;
+		std::vector<std::string> mtllibs;
+		// relative (negative) indices, position in indices and which attribute
+		std::vector<std::pair<size_t, int>> fixups;
+		int currentMaterial = InheritMaterial;
+	};
+
+	bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	void skipSpace(const char*& p, const char* end)
+	{
+		while (p < end && isSpace(*p)) p++;
+	}
+
+	std::string_view restOfLine(const char* p, const char* end)
+	{
+		skipSpace(p, end);
+		while (end > p && isSpace(end[-1])) end--;
+		return std::string_view(p, end - p);
+	}
+
+	bool parseFloat(const char*& p, const char* end, float& value)
+	{
+		skipSpace(p, end);
+		if (p < end && *p == '+') p++;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+		{
+			return false;
+		}
+		p = result.ptr;
+		return true;
+	}
+
+	bool parseInt(const char*& p, const char* end, int& value)
+	{
+		if (p < end && *p == '+') p++;
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+		{
+			return false;
+		}
+		p = result.ptr;
+		return true;
+	}
+
+	// turns a 1 based (or negative, relative) OBJ index into a 0 based one, relative ones are chunk local
+	int resolveIndex(Chunk& chunk, int value, size_t count, size_t slot, int attribute)
+	{
+		if (value > 0)
+		{
+			return value - 1;
+		}
+		if (value < 0)
+		{
+			chunk.fixups.emplace_back(slot, attribute);
+			return static_cast<int>(count) + value;
+		}
+		return -1;
+	}
+
+	void parseFace(Chunk& chunk, const char* p, const char* end)
+	{
+		ObjIndex polygon[64];
+		int count = 0;
+		std::vector<ObjIndex> overflow;
+		while (true)
+		{
+			skipSpace(p, end);
+			if (p >= end)
+			{
+				break;
+			}
+			int values[3] = { 0, 0, 0 };
+			for (int attribute = 0; attribute < 3; attribute++)
+			{
+				if (p < end && *p != '/')
+				{
+					parseInt(p, end, values[attribute]);
+				}
+				if (p < end && *p == '/')
+				{
+					p++;
+					continue;
+				}
+				break;
+			}
+			while (p < end && !isSpace(*p)) p++;
+			ObjIndex index;
+			index.position = values[0];
+			index.texcoord = values[1];
+			index.normal = values[2];
+			if (count < 64)
+			{
+				polygon[count] = index;
+			}
+			else
+			{
+				overflow.push_back(index);
+			}
+			count++;
+		}
+		auto corner = [&](int i) { return i < 64 ? polygon[i] : overflow[i - 64]; };
+		// fan triangulation, same as tinyobj's default
+		for (int k = 1; k + 1 < count; k++)
+		{
+			for (int i : { 0, k, k + 1 })
+			{
+				const ObjIndex raw = corner(i);
+				const size_t slot = chunk.indices.size();
+				ObjIndex index;
+				index.position = resolveIndex(chunk, raw.position, chunk.positions.size() / 3, slot, 0);
+				index.texcoord = resolveIndex(chunk, raw.texcoord, chunk.texcoords.size() / 2, slot, 1);
+				index.normal = resolveIndex(chunk, raw.normal, chunk.normals.size() / 3, slot, 2);
+				chunk.indices.push_back(index);
+			}
+			chunk.materials.push_back(chunk.currentMaterial);
+		}
+	}
+
+	void parseLine(Chunk& chunk, const char* p, const char* end)
+	{
+		skipSpace(p, end);
+		if (p >= end || *p == '#')
+		{
+			return;
+		}
+		auto keyword = [&](std::string_view key) {
+			if (size_t(end - p) > key.size() && std::string_view(p, key.size()) == key && isSpace(p[key.size()]))
+			{
+				p += key.size();
+				return true;
+			}
+			return false;
+			};
+		if (keyword("v"))
+		{
+			float v[3] = { 0.0f, 0.0f, 0.0f };
+			parseFloat(p, end, v[0]) && parseFloat(p, end, v[1]) && parseFloat(p, end, v[2]);
+			chunk.positions.insert(chunk.positions.end(), v, v + 3);
+		}
+		else if (keyword("vn"))
+		{
+			float v[3] = { 0.0f, 0.0f, 0.0f };
+			parseFloat(p, end, v[0]) && parseFloat(p, end, v[1]) && parseFloat(p, end, v[2]);
+			chunk.normals.insert(chunk.normals.end(), v, v + 3);
+		}
+		else if (keyword("vt"))
+		{
+			float v[2] = { 0.0f, 0.0f };
+			parseFloat(p, end, v[0]) && parseFloat(p, end, v[1]);
+			chunk.texcoords.insert(chunk.texcoords.end(), v, v + 2);
+		}
+		else if (keyword("f"))
+		{
+			parseFace(chunk, p, end);
+		}
+		else if (keyword("o") || keyword("g"))
+		{
+			ChunkPiece piece;
+			piece.newShape = true;
+			piece.name = restOfLine(p, end);
+			piece.firstIndex = chunk.indices.size();
+			piece.firstTriangle = chunk.materials.size();
+			chunk.pieces.push_back(piece);
+		}
+		else if (keyword("usemtl"))
+		{
+			const std::string name(restOfLine(p, end));
+			auto it = std::find(chunk.materialNames.begin(), chunk.materialNames.end(), name);
+			chunk.currentMaterial = static_cast<int>(it - chunk.materialNames.begin());
+			if (it == chunk.materialNames.end())
+			{
+				chunk.materialNames.push_back(name);
+			}
+		}
+		else if (keyword("mtllib"))
+		{
+			chunk.mtllibs.emplace_back(restOfLine(p, end));
+		}
+	}
+
+	void parseChunk(Chunk& chunk)
+	{
+		chunk.pieces.push_back(ChunkPiece{});
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', chunk.end - p));
+			if (!lineEnd)
+			{
+				lineEnd = chunk.end;
+			}
+			parseLine(chunk, p, lineEnd);
+			p = lineEnd + 1;
+		}
+	}
+
+	void readFloats(std::istringstream& line, float* values, int count)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			line >> values[i];
+		}
+	}
+
+	// texture statements may carry options (-bm 1.0 ...), the file name is the last token
+	std::string textureName(std::istringstream& line)
+	{
+		std::string token;
+		std::string name;
+		while (line >> token)
+		{
+			name = token;
+		}
+		return name;
+	}
+}
+
+bool ObjReader::parseMtl(const std::string& path, ObjData& data)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::string text;
+	while (std::getline(file, text))
+	{
+		std::istringstream line(text);
+		std::string key;
+		line >> key;
+		if (key == "newmtl")
+		{
+			data.materials.emplace_back();
+			line >> data.materials.back().name;
+			continue;
+		}
+		if (data.materials.empty())
+		{
+			continue;
+		}
+		ObjMaterial& material = data.materials.back();
+		if (key == "Ka") readFloats(line, material.ambient, 3);
+		else if (key == "Kd") readFloats(line, material.diffuse, 3);
+		else if (key == "Ks") readFloats(line, material.specular, 3);
+		else if (key == "Ke") readFloats(line, material.emission, 3);
+		else if (key == "Ns") line >> material.shininess;
+		else if (key == "Ni") line >> material.ior;
+		else if (key == "d") line >> material.dissolve;
+		else if (key == "Tr")
+		{
+			float transparency = 0.0f;
+			line >> transparency;
+			material.dissolve = 1.0f - transparency;
+		}
+		else if (key == "illum") line >> material.illum;
+		else if (key == "map_Ka") material.ambient_texname = textureName(line);
+		else if (key == "map_Kd") material.diffuse_texname = textureName(line);
+		else if (key == "map_Ks") material.specular_texname = textureName(line);
+		else if (key == "map_Bump" || key == "map_bump" || key == "bump") material.bump_texname = textureName(line);
+	}
+	return true;
+}
+
+bool ObjReader::parse(const std::string& path, ObjData& data)
+{
+	m_Error.clear();
+	MappedFile file(path);
+	if (!file.valid())
+	{
+		m_Error = "Cannot open " + path;
+		return false;
+	}
+	m_Bytes = file.size();
+
+	// split at line boundaries
+	std::vector<Chunk> chunks;
+	const char* begin = file.data();
+	const char* fileEnd = begin + file.size();
+	while (begin < fileEnd)
+	{
+		const char* end = begin + std::min(m_ChunkSize, size_t(fileEnd - begin));
+		if (end < fileEnd)
+		{
+			const char* newline = static_cast<const char*>(std::memchr(end, '\n', fileEnd - end));
+			end = newline ? newline + 1 : fileEnd;
+		}
+		Chunk& chunk = chunks.emplace_back();
+		chunk.begin = begin;
+		chunk.end = end;
+		begin = end;
+	}
+	std::for_each(std::execution::par, chunks.begin(), chunks.end(), parseChunk);
+
+	const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+	std::unordered_map<std::string, int> materialIds;
+	std::vector<std::string> loadedLibs;
+	for (auto& chunk : chunks)
+	{
+		for (auto& lib : chunk.mtllibs)
+		{
+			if (std::find(loadedLibs.begin(), loadedLibs.end(), lib) != loadedLibs.end())
+			{
+				continue;
+			}
+			loadedLibs.push_back(lib);
+			if (!parseMtl(directory + lib, data))
+			{
+				DEMO_LOG(Warning, "Cannot open material library " + directory + lib);
+			}
+		}
+	}
+	for (int i = 0; i < data.materials.size(); i++)
+	{
+		materialIds.emplace(data.materials[i].name, i);
+	}
+
+	// attribute offsets and the material bound at the start of every chunk
+	struct ChunkBase
+	{
+		size_t positions = 0;
+		size_t normals = 0;
+		size_t texcoords = 0;
+		int material = -1;
+	};
+	std::vector<ChunkBase> bases(chunks.size());
+	ChunkBase running;
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		bases[c] = running;
+		running.positions += chunks[c].positions.size() / 3;
+		running.normals += chunks[c].normals.size() / 3;
+		running.texcoords += chunks[c].texcoords.size() / 2;
+		if (chunks[c].currentMaterial != InheritMaterial)
+		{
+			auto it = materialIds.find(chunks[c].materialNames[chunks[c].currentMaterial]);
+			running.material = it == materialIds.end() ? -1 : it->second;
+		}
+	}
+
+	std::vector<size_t> chunkIndex(chunks.size());
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		chunkIndex[c] = c;
+	}
+	std::for_each(std::execution::par, chunkIndex.begin(), chunkIndex.end(), [&](size_t c) {
+		Chunk& chunk = chunks[c];
+		const ChunkBase& base = bases[c];
+		for (auto& [slot, attribute] : chunk.fixups)
+		{
+			ObjIndex& index = chunk.indices[slot];
+			if (attribute == 0) index.position += static_cast<int>(base.positions);
+			if (attribute == 1) index.texcoord += static_cast<int>(base.texcoords);
+			if (attribute == 2) index.normal += static_cast<int>(base.normals);
+		}
+		std::vector<int> globalIds(chunk.materialNames.size());
+		for (size_t i = 0; i < chunk.materialNames.size(); i++)
+		{
+			auto it = materialIds.find(chunk.materialNames[i]);
+			globalIds[i] = it == materialIds.end() ? -1 : it->second;
+		}
+		for (auto& material : chunk.materials)
+		{
+			material = material == InheritMaterial ? base.material : globalIds[material];
+		}
+		});
+
+	data.positions.reserve(data.positions.size() + running.positions * 3);
+	data.normals.reserve(data.normals.size() + running.normals * 3);
+	data.texcoords.reserve(data.texcoords.size() + running.texcoords * 2);
+	for (auto& chunk : chunks)
+	{
+		data.positions.insert(data.positions.end(), chunk.positions.begin(), chunk.positions.end());
+		data.normals.insert(data.normals.end(), chunk.normals.begin(), chunk.normals.end());
+		data.texcoords.insert(data.texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+		for (size_t i = 0; i < chunk.pieces.size(); i++)
+		{
+			const ChunkPiece& piece = chunk.pieces[i];
+			if (piece.newShape || data.shapes.empty())
+			{
+				data.shapes.emplace_back().name = piece.name;
+			}
+			const size_t lastIndex = i + 1 < chunk.pieces.size() ? chunk.pieces[i + 1].firstIndex : chunk.indices.size();
+			const size_t lastTriangle = i + 1 < chunk.pieces.size() ? chunk.pieces[i + 1].firstTriangle : chunk.materials.size();
+			ObjShape& shape = data.shapes.back();
+			shape.indices.insert(shape.indices.end(), chunk.indices.begin() + piece.firstIndex, chunk.indices.begin() + lastIndex);
+			shape.materialIds.insert(shape.materialIds.end(), chunk.materials.begin() + piece.firstTriangle,
+				chunk.materials.begin() + lastTriangle);
+		}
+		// release the chunk as soon as it is merged to keep the peak low
+		chunk = Chunk{};
+	}
+	std::erase_if(data.shapes, [](const ObjShape& shape) { return shape.indices.empty(); });
+	return true;
+}
+
+void ObjReader::benchmark(const std::string& path)
+{
+	using clock = std::chrono::steady_clock;
+	auto start = clock::now();
+	tinyobj::ObjReader tinyReader;
+	const bool tinyOk = tinyReader.ParseFromFile(path);
+	const double tinyMs = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	start = clock::now();
+	ObjReader reader;
+	ObjData data;
+	const bool ok = reader.parse(path, data);
+	const double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+	const double megabytes = reader.bytes() / (1024.0 * 1024.0);
+	size_t triangles = 0;
+	for (auto& shape : data.shapes)
+	{
+		triangles += shape.materialIds.size();
+	}
+	size_t tinyTriangles = 0;
+	for (auto& shape : tinyReader.GetShapes())
+	{
+		tinyTriangles += shape.mesh.num_face_vertices.size();
+	}
+	DEMO_LOG(Info, std::format("OBJ benchmark {} ({:.1f} MB):", path, megabytes));
+	DEMO_LOG(Info, std::format("  tinyobj:   {:.2f} ms, {:.1f} MB/s, {} shapes, {} triangles{}", tinyMs,
+		megabytes / (tinyMs / 1000.0), tinyReader.GetShapes().size(), tinyTriangles, tinyOk ? "" : " (failed)"));
+	DEMO_LOG(Info, std::format("  ObjReader: {:.2f} ms, {:.1f} MB/s, {} shapes, {} triangles{}", ms,
+		megabytes / (ms / 1000.0), data.shapes.size(), triangles, ok ? "" : " (failed)"));
+}
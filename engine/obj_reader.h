@@ -0,0 +1,71 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Streaming replacement for tinyobj, the file is memory mapped, split into chunks at line
+// boundaries and the chunks are tokenised in parallel. Supports the subset the engine uses:
+// v/vt/vn, polygonal f (fan triangulated), o/g, usemtl, mtllib and the common MTL statements.
+
+struct ObjIndex
+{
+	int position = -1;
+	int texcoord = -1;
+	int normal = -1;
+};
+
+struct ObjShape
+{
+	std::string name;
+	// three per triangle
+	std::vector<ObjIndex> indices;
+	// one per triangle, -1 when no material is bound
+	std::vector<int> materialIds;
+};
+
+struct ObjMaterial
+{
+	std::string name;
+	float ambient[3] = { 0.0f, 0.0f, 0.0f };
+	float diffuse[3] = { 0.0f, 0.0f, 0.0f };
+	float specular[3] = { 0.0f, 0.0f, 0.0f };
+	float emission[3] = { 0.0f, 0.0f, 0.0f };
+	float shininess = 1.0f;
+	float ior = 1.0f;
+	float dissolve = 1.0f;
+	int illum = 0;
+	std::string ambient_texname;
+	std::string diffuse_texname;
+	std::string specular_texname;
+	std::string bump_texname;
+};
+
+struct ObjData
+{
+	std::vector<float> positions;
+	std::vector<float> normals;
+	std::vector<float> texcoords;
+	std::vector<ObjShape> shapes;
+	std::vector<ObjMaterial> materials;
+};
+
+class ObjReader
+{
+public:
+	explicit ObjReader(size_t chunkSize = 8u << 20) : m_ChunkSize(chunkSize) {}
+
+	bool parse(const std::string& path, ObjData& data);
+	const std::string& error() const { return m_Error; }
+	// size of the last parsed file
+	uint64_t bytes() const { return m_Bytes; }
+
+	// parses the file with tinyobj and with ObjReader and logs the throughput in MB/s
+	static void benchmark(const std::string& path);
+
+private:
+	bool parseMtl(const std::string& path, ObjData& data);
+
+	size_t m_ChunkSize;
+	uint64_t m_Bytes = 0;
+	std::string m_Error;
+};
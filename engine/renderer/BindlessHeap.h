@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Pipeline.h"
+
+class Texture;
+class Sampler;
+class Buffer;
+
+enum class BindlessType
+{
+    Textures,
+    Samplers,
+    Buffers,
+};
+
+// One update after bind, partially bound descriptor set per resource type that every pipeline shares. Textures
+// made by TextureManager and storage buffers are registered when they are created and keep their index until
+// they are destroyed, so the descriptor is written once instead of by every pass that uses the resource.
+// Shaders index the arrays with what materials and push constants hand them, see IndirectCommon.glsl
+class BindlessHeap final {
+public:
+    static BindlessHeap& Instance() {
+        if (!instance_) {
+            instance_.reset(new BindlessHeap);
+        }
+        return *instance_;
+    }
+
+    static constexpr uint32_t InvalidIndex = UINT32_MAX;
+    // lowered to what the device allows a stage to access
+    static constexpr uint32_t MaxTextures = 16384;
+    static constexpr uint32_t MaxSamplers = 256;
+    static constexpr uint32_t MaxBuffers = 4096;
+
+    // until this is called, and after Quit, nothing is registered and every index is InvalidIndex
+    void Init(uint32_t framesInFlight);
+    void Quit();
+    bool Initialized() const { return static_cast<bool>(pool_); }
+
+    // a 2D image in the shader read only layout. InvalidIndex when the array is full
+    uint32_t Register(const Texture& texture);
+    uint32_t Register(const Sampler& sampler);
+    // the whole buffer, as a storage buffer
+    uint32_t Register(const Buffer& buffer);
+    // points index at the view that replaced the texture's, frames in flight may still sample the old one
+    void Update(uint32_t index, const Texture& texture);
+    // the index is handed out again once no frame in flight can use it
+    void Release(BindlessType type, uint32_t index);
+    // right after the fence of the frame slot about to be recorded has been waited on
+    void BeginFrame();
+
+    // the heap's set for the pipeline to bind at set, instead of a set of its own
+    Pipeline::SetDescriptor Descriptor(BindlessType type, uint32_t set) const;
+
+    struct Stats
+    {
+        std::array<uint32_t, 3> live = {};
+        std::array<uint32_t, 3> capacity = {};
+        uint64_t writes = 0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<BindlessHeap> instance_;
+
+    struct Heap
+    {
+        vk::DescriptorType type;
+        vk::DescriptorSetLayout layout;
+        vk::DescriptorSet set;
+        uint32_t capacity = 0;
+        // indices below next have been handed out at least once
+        uint32_t next = 0;
+        std::vector<uint32_t> free;
+        uint32_t live = 0;
+        bool warned = false;
+    };
+
+    struct Retired
+    {
+        BindlessType type;
+        uint32_t index;
+        uint64_t frame;
+    };
+
+    BindlessHeap() {}
+    uint32_t allocate(BindlessType type);
+    void write(BindlessType type, uint32_t index, const vk::DescriptorImageInfo* image,
+        const vk::DescriptorBufferInfo* buffer);
+
+    std::mutex mutex_;
+    vk::DescriptorPool pool_;
+    std::array<Heap, 3> heaps_;
+    std::deque<Retired> retired_;
+    // descriptors of larger buffers cover the start of them
+    vk::DeviceSize maxBufferRange_ = 0;
+    uint32_t framesInFlight_ = 0;
+    uint64_t frame_ = 0;
+    uint64_t writes_ = 0;
+};
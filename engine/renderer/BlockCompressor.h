@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <cstddef>
+
+// how a texture is sampled, decides the block format it is compressed to
+enum class TextureKind
+{
+    // albedo and emissive maps, alpha is kept
+    Color,
+    // tangent space normal maps, only xy are stored and the shaders reconstruct z
+    Normal,
+    // other packed channels such as metallic-roughness or specular
+    Data,
+};
+
+enum class BlockCompression
+{
+    None,
+    // BC1 for opaque color and data maps, BC7 where alpha is needed
+    BC1,
+    BC7,
+};
+
+class BlockCompressor final
+{
+public:
+    // bumped whenever the encoder output changes so that stale cache entries are not used
+    static constexpr uint32_t Version = 1;
+
+    // opaque grey linear images go to BC4 and are expanded back to RGB by the view swizzle
+    static vk::Format chooseFormat(const unsigned char* rgba, uint32_t width, uint32_t height, TextureKind kind,
+        bool srgb, BlockCompression mode);
+    static bool isBlockCompressed(vk::Format format);
+    static uint32_t blockBytes(vk::Format format);
+    static size_t levelSize(vk::Format format, uint32_t width, uint32_t height);
+    static vk::ComponentMapping components(vk::Format format);
+
+    // RGBA8 in, blocks out. Rows of blocks are encoded in parallel
+    static void encode(const unsigned char* rgba, uint32_t width, uint32_t height, vk::Format format, unsigned char* out);
+    // BC7 blocks are only decoded in mode 6, the one the encoder writes
+    static void decode(const unsigned char* blocks, uint32_t width, uint32_t height, vk::Format format, unsigned char* rgba);
+    // over the channels the format keeps
+    static double psnr(const unsigned char* rgba, uint32_t width, uint32_t height, vk::Format format, const unsigned char* blocks);
+};
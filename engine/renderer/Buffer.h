@@ -1,30 +1,29 @@
 #pragma once
 
 #include "vulkan/vulkan.hpp"
+#include "MemoryAllocator.h"
 
 class Buffer {
 public:
 	vk::Buffer buffer;
-	vk::DeviceMemory memory;
+	MemoryAllocation allocation;
+	// persistently mapped for host visible memory, null otherwise. The memory block can be shared with other
+	// buffers, so it must not be mapped again
+	void* mapped = nullptr;
 	size_t size;
+	// where BindlessHeap has storage buffers, UINT32_MAX for other buffers
+	uint32_t bindlessIndex = UINT32_MAX;
 
-	Buffer(size_t size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags property);
+	// the memory has every property flag, and as many of preferred as a memory type offers
+	Buffer(size_t size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags property, vk::MemoryPropertyFlags preferred = {});
 	~Buffer();
 
 private:
-
-	struct MemoryInfo
-	{
-		size_t size;
-		uint32_t index;
-	};
-	bool use_devAddr  = false;
 	void createBuffer(size_t size, vk::BufferUsageFlags usage);
-	void allocateMemory(MemoryInfo info);
-	void bindMemory2Buf();
-	MemoryInfo queryMemoryInfo(vk::MemoryPropertyFlags property);
 	
 };
 void CopyBuffer(vk::Buffer& src, vk::Buffer& dst, size_t size, size_t srcoffset, size_t dstoffset);
+// staged through StagingRing, the copy lands at the start of the next frame or before the next single use
+// submission, whichever comes first. fence is unused
 bool UploadBufferData(vk::Fence fence, std::shared_ptr<Buffer> buffer, size_t size, const void* data);
 bool UploadBufferDataRange(vk::Fence fence, std::shared_ptr<Buffer> buffer, size_t offset, size_t size, const void* data);
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Texture;
+class Buffer;
+
+// Destroys GPU objects once no frame that could still use them is in flight. Every retire goes to the bucket
+// of the frame being recorded and a bucket is emptied when BeginFrame comes back to it, by then the fence
+// of the frame has been waited on and, the queue completing in submission order, every frame before it
+class DeletionQueue final {
+public:
+    static DeletionQueue& Instance() {
+        if (!instance_) {
+            instance_.reset(new DeletionQueue);
+        }
+        return *instance_;
+    }
+
+    // until this is called, and after Quit, retired objects are destroyed right away
+    void Init(uint32_t framesInFlight);
+    // waits for the device and destroys everything still queued
+    void Quit();
+
+    void Retire(std::shared_ptr<Texture> texture);
+    void Retire(std::shared_ptr<Buffer> buffer);
+    void Retire(vk::ImageView view);
+    void Retire(vk::Framebuffer framebuffer);
+    void Retire(vk::Pipeline pipeline);
+
+    // right after the fence of the frame slot about to be recorded has been waited on
+    void BeginFrame();
+
+    size_t Pending();
+    uint64_t Destroyed() const { return destroyed_; }
+
+private:
+    static std::unique_ptr<DeletionQueue> instance_;
+
+    DeletionQueue() {}
+    void push(std::function<void()> destroy);
+
+    std::mutex mutex_;
+    std::vector<std::vector<std::function<void()>>> frames_;
+    uint64_t frame_ = 0;
+    std::atomic<uint64_t> destroyed_ = 0;
+};
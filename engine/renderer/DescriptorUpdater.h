@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+// Collects the descriptor writes of every pipeline and applies them together, as one vkUpdateDescriptorSets
+// followed by the template updates, at the start of the frame. Pipelines flush early when they are bound with
+// writes still queued, so nothing recorded sees a stale set. The infos are copied into arrays that keep their
+// capacity, so a frame that rebinds the same number of resources allocates nothing
+class DescriptorUpdater final {
+public:
+    static DescriptorUpdater& Instance() {
+        if (!instance_) {
+            instance_.reset(new DescriptorUpdater);
+        }
+        return *instance_;
+    }
+
+    void Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+        std::span<const vk::DescriptorImageInfo> images);
+    void Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+        std::span<const vk::DescriptorBufferInfo> buffers);
+    void Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+        std::span<const vk::BufferView> views);
+    void Write(vk::DescriptorSet set, uint32_t binding, const vk::AccelerationStructureKHR& accelerationStructure);
+    // size bytes of data are copied, laid out the way updateTemplate was created for
+    void Write(vk::DescriptorSet set, vk::DescriptorUpdateTemplate updateTemplate, const void* data, size_t size);
+
+    bool Pending();
+    void Flush();
+    // right after the fence of the frame slot about to be recorded has been waited on
+    void BeginFrame();
+    // logs what the updates cost over the run
+    void Quit();
+
+    struct Stats
+    {
+        uint64_t frames = 0;
+        // vkUpdateDescriptorSets calls, each with every write queued at the time
+        uint64_t flushes = 0;
+        uint64_t writes = 0;
+        uint64_t descriptors = 0;
+        uint64_t templateUpdates = 0;
+        double milliseconds = 0.0;
+        // the CPU time spent applying the updates of the last frame
+        double lastFrameMicroseconds = 0.0;
+    };
+    Stats GetStats();
+
+    // the per frame cost of rewriting the sets of a frame's worth of passes, written one pipeline at a time the
+    // way they used to be, batched into one update, and through update templates
+    static void benchmark(uint32_t frames);
+
+private:
+    static std::unique_ptr<DescriptorUpdater> instance_;
+
+    enum class Kind
+    {
+        Image,
+        Buffer,
+        TexelBuffer,
+        AccelerationStructure,
+    };
+
+    struct PendingWrite
+    {
+        vk::DescriptorSet set;
+        uint32_t binding;
+        uint32_t arrayElement;
+        uint32_t count;
+        vk::DescriptorType type;
+        Kind kind;
+        // into the array of its kind
+        size_t first;
+    };
+
+    struct PendingTemplate
+    {
+        vk::DescriptorSet set;
+        vk::DescriptorUpdateTemplate updateTemplate;
+        size_t offset;
+    };
+
+    DescriptorUpdater() {}
+    void flush();
+
+    std::mutex mutex_;
+    std::vector<vk::DescriptorImageInfo> images_;
+    std::vector<vk::DescriptorBufferInfo> buffers_;
+    std::vector<vk::BufferView> views_;
+    std::vector<vk::AccelerationStructureKHR> accelerationStructures_;
+    std::vector<PendingWrite> writes_;
+    std::vector<uint8_t> templateData_;
+    std::vector<PendingTemplate> templates_;
+    // rebuilt from writes_ by every flush, kept for their capacity
+    std::vector<vk::WriteDescriptorSet> vkWrites_;
+    std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> vkAccelerationWrites_;
+    Stats stats_;
+    double frameMicroseconds_ = 0.0;
+};
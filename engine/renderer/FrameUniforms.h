@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <memory>
+
+class Buffer;
+
+// One copy of per-frame uniform data for every frame in flight, in a single persistently mapped buffer that is
+// device local as well when the device has such memory. The copy of the frame being recorded is written while
+// the GPU still reads the others. Descriptors cover one copy with a dynamic uniform buffer, and offset(frame)
+// is the dynamic offset that selects it
+class FrameUniforms final {
+public:
+    // size is what one frame holds, blocks placed inside it start at multiples of aligned()
+    // frames defaults to the swapchain image count
+    explicit FrameUniforms(vk::DeviceSize size, uint32_t frames = 0);
+
+    // rounded up to minUniformBufferOffsetAlignment
+    static vk::DeviceSize aligned(vk::DeviceSize size);
+
+    std::shared_ptr<Buffer> buffer() const { return buffer_; }
+    vk::DeviceSize size() const { return size_; }
+    uint32_t frames() const { return frames_; }
+    uint32_t offset(uint32_t frame) const { return static_cast<uint32_t>(stride_ * frame); }
+    // only after the fence of the frame has been waited on
+    void write(uint32_t frame, const void* data, vk::DeviceSize size, vk::DeviceSize offset = 0);
+
+private:
+    std::shared_ptr<Buffer> buffer_;
+    vk::DeviceSize size_;
+    vk::DeviceSize stride_;
+    uint32_t frames_;
+};
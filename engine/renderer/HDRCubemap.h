@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "KTX2.h"
+
+enum class CubemapConversion
+{
+    // equirectangular_to_cubemap renders the faces, they are read back to build the cache entry
+    GPU,
+    // sampled on the CPU, works without a device
+    CPU,
+};
+
+// Equirectangular HDR panoramas to cubemaps with a full mip chain, in the layout KTX2 stores cubemaps in:
+// every level holds the six faces one after the other. Faces match what convert2Cubemap renders
+class HDRCubemap final
+{
+public:
+    static constexpr uint32_t FaceSize = 2048;
+    // bumped whenever the conversion output changes so that stale cache entries are not used
+    static constexpr uint32_t Version = 1;
+
+    // B10G11R11 and RGBA16F
+    static bool supports(vk::Format format);
+    static uint32_t texelBytes(vk::Format format);
+
+    // the view convert2Cubemap renders the face with
+    static glm::mat4 captureView(uint32_t face);
+
+    // fills face with faceSize * faceSize RGBA32F texels, rows top down
+    using FaceSource = std::function<void(uint32_t face, std::vector<float>& texels)>;
+    // box filters the chain of every face down to 1x1 and packs it to format
+    static KTX2Image build(uint32_t faceSize, vk::Format format, const FaceSource& source);
+
+    // rgba is the RGBA32F panorama as stb_image loads it with the vertical flip on. Bilinear, rows in parallel
+    static void sampleFace(const float* rgba, uint32_t width, uint32_t height, uint32_t face, uint32_t faceSize,
+        std::vector<float>& texels);
+    static KTX2Image convert(const float* rgba, uint32_t width, uint32_t height, uint32_t faceSize, vk::Format format);
+};
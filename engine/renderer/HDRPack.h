@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstddef>
+#include <cstdint>
+
+// Conversions between RGBA32F texels and the packed HDR formats: RGBA16F, E5B9G9R9 with its shared exponent
+// and B10G11R11. Rounding and clamping follow the conversion rules of the Vulkan spec, so what the device
+// decodes is what unpack returns
+class HDRPack final
+{
+public:
+    // RGBA32F, RGBA16F, E5B9G9R9 and B10G11R11, 0 for anything else
+    static uint32_t texelBytes(vk::Format format);
+
+    // the first of requested, E5B9G9R9, B10G11R11 and RGBA16F whose optimal tiling has every required feature,
+    // RGBA32F when none does. Only RGBA16F keeps alpha and negative values, so requested goes first
+    static vk::Format chooseFormat(vk::PhysicalDevice physicalDevice, vk::Format requested,
+        vk::FormatFeatureFlags required);
+
+    // count RGBA32F texels to format, chunks in parallel and four texels at a time with SSE2 where it is
+    // available. The result is bit for bit the one of the scalar functions below
+    static void pack(const float* rgba, size_t count, vk::Format format, void* out);
+    // alpha is 1 for the formats without one
+    static void unpack(const void* in, size_t count, vk::Format format, float* rgba);
+
+    struct RoundTrip
+    {
+        // per channel, relative to the largest rgb channel of the texel since that is what the shared
+        // exponent and the 5 bit exponents quantize against
+        double meanError = 0.0;
+        double maxError = 0.0;
+    };
+    static RoundTrip roundTrip(const float* rgba, size_t count, vk::Format format);
+
+    // log-uniform HDR texels through every format: SIMD against scalar time, whether both agree and the
+    // round trip error
+    static void benchmark(uint32_t texelCount);
+
+    static uint16_t packHalf(float value);
+    static float unpackHalf(uint16_t value);
+    static uint32_t packB10G11R11(const float* rgb);
+    static void unpackB10G11R11(uint32_t packed, float* rgb);
+    static uint32_t packE5B9G9R9(const float* rgb);
+    static void unpackE5B9G9R9(uint32_t packed, float* rgb);
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "KTX2.h"
+
+class Texture;
+
+// third order spherical harmonics of the environment, convolved with the clamped cosine and divided by pi:
+// evaluated at a normal they give the light a white lambertian surface reflects. rgb, w is unused
+struct SH9
+{
+    glm::vec4 coefficients[9] = {};
+};
+
+// Image based lighting precomputed from an environment cubemap, SH9 irradiance for diffuse and a GGX
+// prefiltered chain for specular whose level m is filtered for roughness m / (levels - 1). Both are cached
+// next to the cubemap they were computed from, so nothing is convolved at runtime
+class IBLPrecompute final
+{
+public:
+    static constexpr uint32_t SpecularSize = 256;
+    static constexpr uint32_t SpecularLevels = 6;
+    static constexpr uint32_t SpecularSamples = 512;
+    // the SH are projected from the first level at or below this size, finer ones change nothing visible
+    static constexpr uint32_t IrradianceSize = 128;
+    // bumped whenever the output changes so that stale cache entries are not used
+    static constexpr uint32_t Version = 1;
+
+    struct Environment
+    {
+        std::shared_ptr<Texture> specular;
+        SH9 irradiance;
+    };
+    // hdrFile goes through TextureManager::LoadHDRCubemap only when the lighting is not cached yet. The
+    // prefilter of a miss runs where TextureManager::GetCubemapConversion says the conversion runs
+    static Environment load(const std::string& hdrFile);
+    // with the GPU prefilter, also runs the CPU reference on a miss and logs how far apart the two are
+    static void SetReferenceCheck(bool enable);
+
+    // the direction a samplerCube looks up for (s, t) in [0, 1] on face, not normalized
+    static glm::vec3 faceDirection(uint32_t face, float s, float t);
+    // RGBA32F texels of a level of a B10G11R11 or RGBA16F cube, face after face
+    static void unpackLevel(const KTX2Image& cube, uint32_t level, std::vector<float>& texels);
+
+    // rows of all faces in parallel, four texels at a time with SSE where it is available
+    static SH9 projectSH(const KTX2Image& cube, uint32_t level);
+    static glm::vec3 evaluateSH(const SH9& sh, const glm::vec3& normal);
+
+    // reference for prefilter_specular.comp: importance samples GGX with N = V and reads every sample from
+    // the source level that matches its pdf. Returns an RGBA16F cube
+    static KTX2Image prefilterSpecular(const KTX2Image& cube, uint32_t size, uint32_t levels, uint32_t samples);
+
+    static bool readSH(const std::string& path, SH9& sh);
+    static bool writeSH(const std::string& path, const SH9& sh);
+};
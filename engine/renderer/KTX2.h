@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <string>
+#include <vector>
+#include "MipGenerator.h"
+
+// a single 2D image or cubemap with its mip chain, level offsets point into data. The levels of a cubemap
+// hold its six faces one after the other
+struct KTX2Image
+{
+    vk::Format format = vk::Format::eUndefined;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t faces = 1;
+    std::vector<MipGenerator::Level> levels;
+    std::vector<unsigned char> data;
+};
+
+// Minimal KTX 2.0 container for the texture cache: 2D or cube, one layer, no supercompression.
+// The data format descriptor is written for the block formats BlockCompressor produces and the
+// B10G11R11 and RGBA16F formats of the cubemap cache
+class KTX2 final
+{
+public:
+    static bool read(const std::string& path, KTX2Image& image);
+    static bool write(const std::string& path, const KTX2Image& image);
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "MemoryBudget.h"
+#include "TLSF.h"
+
+// where a buffer or image lives, a range of a pool block or a dedicated allocation of its own
+struct MemoryAllocation
+{
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    // persistently mapped at offset when the memory type is host visible, blocks are mapped once and
+    // vkMapMemory must not be called on them again
+    void* mapped = nullptr;
+    uint32_t memoryType = 0;
+    uint32_t block = 0;
+    // TLSF::InvalidNode for a dedicated allocation
+    uint32_t node = TLSF::InvalidNode;
+    MemoryCategory category = MemoryCategory::Other;
+};
+
+// Sub-allocates buffers and images from large device memory blocks, one list of blocks per memory type, each
+// managed by a TLSF. Buffers and images go to different blocks when bufferImageGranularity is above 1, so
+// linear and optimal resources never share a page. Big render targets, anything larger than half a block and
+// whatever the driver asks a dedicated allocation for get their own
+class MemoryAllocator final {
+public:
+    static MemoryAllocator& Instance() {
+        if (!instance_) {
+            instance_.reset(new MemoryAllocator);
+        }
+        return *instance_;
+    }
+
+    static constexpr vk::DeviceSize MaxBlockSize = vk::DeviceSize(256) << 20;
+    // render targets this large are dedicated, drivers can compress them better that way
+    static constexpr vk::DeviceSize DedicatedRenderTargetSize = vk::DeviceSize(8) << 20;
+
+    // the memory type in typeBits with every required flag that has the most preferred flags and then the
+    // fewest flags nobody asked for, so that device local host visible memory is kept for who wants it.
+    // UINT32_MAX when none has the required flags
+    static uint32_t FindMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags required,
+        vk::MemoryPropertyFlags preferred = {});
+    // whether a block of linear resources (buffers) or optimal ones (images) can take a resource of the other
+    // kind. With a bufferImageGranularity of 1 they cannot alias each other, above it they could share a page
+    static bool SharesBlock(vk::DeviceSize bufferImageGranularity, bool blockLinear, bool linear) {
+        return bufferImageGranularity <= 1 || blockLinear == linear;
+    }
+
+    // the memory is bound to the resource. Throws vk::OutOfDeviceMemoryError when no memory type with the
+    // required flags has room left
+    MemoryAllocation Allocate(vk::Buffer buffer, vk::MemoryPropertyFlags required, MemoryCategory category,
+        vk::MemoryPropertyFlags preferred = {});
+    MemoryAllocation Allocate(vk::Image image, vk::MemoryPropertyFlags required, MemoryCategory category,
+        vk::MemoryPropertyFlags preferred = {});
+    // resets allocation
+    void Free(MemoryAllocation& allocation);
+    // frees the blocks that are left, after every resource has been destroyed
+    void Quit();
+
+    struct Stats
+    {
+        uint32_t blocks = 0;
+        vk::DeviceSize blockBytes = 0;
+        vk::DeviceSize blockFreeBytes = 0;
+        uint32_t subAllocations = 0;
+        uint32_t dedicated = 0;
+        vk::DeviceSize dedicatedBytes = 0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<MemoryAllocator> instance_;
+
+    struct Block
+    {
+        vk::DeviceMemory memory;
+        void* mapped = nullptr;
+        uint32_t memoryType = 0;
+        bool linear = false;
+        std::unique_ptr<TLSF> allocator;
+    };
+
+    MemoryAllocator() {}
+    MemoryAllocation allocate(const vk::MemoryRequirements& requirements, bool dedicated,
+        const vk::MemoryDedicatedAllocateInfo& dedicatedInfo, vk::MemoryPropertyFlags required,
+        vk::MemoryPropertyFlags preferred, MemoryCategory category, bool linear);
+    // from the blocks of memoryType, a new block is added when none has room. False when that fails too
+    bool allocateFromBlocks(const vk::MemoryRequirements& requirements, uint32_t memoryType, bool linear,
+        MemoryAllocation& out);
+    bool allocateDedicated(const vk::MemoryRequirements& requirements, uint32_t memoryType,
+        const vk::MemoryDedicatedAllocateInfo& dedicatedInfo, MemoryAllocation& out);
+    // null when the heap is out of memory
+    vk::DeviceMemory allocateMemory(vk::DeviceSize size, uint32_t memoryType,
+        const vk::MemoryDedicatedAllocateInfo* dedicated);
+    vk::DeviceSize blockSize(uint32_t memoryType) const;
+
+    std::mutex mutex_;
+    std::vector<Block> blocks_;
+    vk::PhysicalDeviceMemoryProperties properties_;
+    vk::DeviceSize granularity_ = 1;
+    bool initialized_ = false;
+    uint32_t dedicated_ = 0;
+    vk::DeviceSize dedicatedBytes_ = 0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+enum class MemoryCategory
+{
+    Geometry,
+    Textures,
+    RenderTargets,
+    Staging,
+    Other,
+    Count,
+};
+
+// Accounts the device memory of the engine by heap, and what resources use of it by subsystem, and compares
+// the heaps with what VK_EXT_memory_budget reports. The budget is how much the driver lets the process use before it starts
+// paging, it shrinks when other applications take memory, so it is read again every frame
+class MemoryBudget final {
+public:
+    static MemoryBudget& Instance() {
+        if (!instance_) {
+            instance_.reset(new MemoryBudget);
+        }
+        return *instance_;
+    }
+
+    static constexpr uint32_t CategoryCount = static_cast<uint32_t>(MemoryCategory::Count);
+    static const char* CategoryName(MemoryCategory category);
+    // buffers and images are tagged from their usage
+    static MemoryCategory CategoryOf(vk::BufferUsageFlags usage, vk::MemoryPropertyFlags property);
+    static MemoryCategory CategoryOf(vk::ImageUsageFlags usage);
+
+    struct Heap
+    {
+        vk::DeviceSize size = 0;
+        bool deviceLocal = false;
+        // from the driver, they include what was allocated outside the engine
+        vk::DeviceSize budget = 0;
+        vk::DeviceSize usage = 0;
+        // device memory that went through Allocate
+        vk::DeviceSize allocated = 0;
+        uint32_t allocations = 0;
+        // what resources use of it, the rest is free space in MemoryAllocator blocks
+        vk::DeviceSize used = 0;
+        std::array<vk::DeviceSize, CategoryCount> categories = {};
+    };
+
+    vk::DeviceMemory Allocate(const vk::MemoryAllocateInfo& info);
+    // memory not from Allocate is freed without accounting
+    void Free(vk::DeviceMemory memory);
+    // size bytes of memoryType handed to a resource of category, and given back
+    void Track(uint32_t memoryType, vk::DeviceSize size, MemoryCategory category);
+    void Untrack(uint32_t memoryType, vk::DeviceSize size, MemoryCategory category);
+
+    // queries the budget and calls the pressure callbacks, once per frame after the fence wait
+    void Update();
+    std::vector<Heap> Heaps();
+
+    // excess is how far the usage of heap is above the pressure threshold. Called from Update every frame
+    // until the heap is back below, so a callback frees a little at a time
+    using PressureCallback = std::function<void(uint32_t heap, vk::DeviceSize excess)>;
+    uint32_t AddPressureCallback(PressureCallback callback);
+    void RemovePressureCallback(uint32_t id);
+    // fraction of the budget a heap may use before it is under pressure
+    void SetPressureThreshold(float fraction) { threshold_ = fraction; }
+    float PressureThreshold() const { return threshold_; }
+
+private:
+    static std::unique_ptr<MemoryBudget> instance_;
+
+    struct Allocation
+    {
+        vk::DeviceSize size;
+        uint32_t heap;
+    };
+
+    MemoryBudget() {}
+    // the heaps are read on first use, the physical device does not exist before
+    void initHeaps();
+
+    std::mutex mutex_;
+    std::vector<Heap> heaps_;
+    std::vector<uint32_t> typeHeaps_;
+    std::vector<bool> pressured_;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations_;
+    std::vector<std::pair<uint32_t, PressureCallback>> callbacks_;
+    uint32_t nextCallback_ = 0;
+    float threshold_ = 0.9f;
+};
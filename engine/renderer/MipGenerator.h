@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+enum class MipGeneration
+{
+    None,
+    // vkCmdBlitImage chain recorded into the upload command buffer
+    GPUBlit,
+    // filtered on the CPU and uploaded with the base level
+    CPU,
+};
+
+enum class MipFilter
+{
+    Box,
+    Kaiser,
+};
+
+class MipGenerator final
+{
+public:
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        size_t offset;
+        size_t size;
+    };
+
+    // RGBA8 (sRGB formats are filtered in linear space) and RGBA32F are supported
+    static bool supportsCPU(vk::Format format, uint32_t bytesPerPixel);
+    static bool supportsBlit(vk::PhysicalDevice physicalDevice, vk::Format format);
+
+    // writes the whole chain, base level included, tightly packed into out. Independent of the
+    // device, so it can be used headless or for offline baking
+    static std::vector<Level> generate(const void* data, uint32_t width, uint32_t height, uint32_t bytesPerPixel,
+        vk::Format format, MipFilter filter, std::vector<unsigned char>& out);
+
+    // expects every level in eTransferDstOptimal with level 0 filled, leaves every level in
+    // eShaderReadOnlyOptimal
+    static void recordBlit(vk::CommandBuffer cmdbuf, vk::Image image, uint32_t width, uint32_t height, uint32_t levels);
+};
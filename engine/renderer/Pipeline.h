@@ -1,9 +1,13 @@
 #pragma once
 
 #include <vulkan/vulkan.hpp>
+#include <future>
+#include <list>
+#include <map>
 #include <memory>
 #include <unordered_map>
 #include <mutex>
+#include <type_traits>
 
 #include "Shader.h"
 #include "Texture.h"
@@ -16,6 +20,24 @@ public:
 	struct SetDescriptor {
 		uint32_t set;
 		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		// a set owned elsewhere, like the ones of BindlessHeap. The pipeline neither creates the layout nor
+		// allocates the set, bindings are unused and the set is bound whatever bindIdx asks for
+		vk::DescriptorSetLayout layout = VK_NULL_HANDLE;
+		vk::DescriptorSet shared = VK_NULL_HANDLE;
+	};
+
+	// A specialization constant the pass lets be tuned. Every combination of values is a pipeline of its own
+	// that shares the layout and the descriptor sets, built on PipelineCompiler the first time it is selected
+	struct SpecConstant
+	{
+		std::string name;
+		uint32_t constantID = 0;
+		// the stages of a graphics pipeline it is given to
+		vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eAll;
+		// unless SetSpecializationDefault was called for the name
+		uint32_t value = 0;
+		uint32_t minValue = 0;
+		uint32_t maxValue = UINT32_MAX;
 	};
 
 	struct GraphicsPipelineDescriptor
@@ -48,6 +70,7 @@ public:
 		void* fragmentSpecializationData = nullptr;
 
 		std::vector<vk::PipelineColorBlendAttachmentState> blendAttachmentStates;
+		std::vector<SpecConstant> permutations;
 	};
 
 	struct ComputePipelineDescriptor
@@ -57,6 +80,7 @@ public:
 		std::vector<vk::PushConstantRange> pushConstants;
 		std::vector<vk::SpecializationMapEntry> specializationConsts;
 		void* specializationData_ = nullptr;
+		std::vector<SpecConstant> permutations;
 	};
 
 	struct RayTracingPipelineDescriptor
@@ -69,6 +93,8 @@ public:
 		// Add specialization const, but they are needed per shaderModule?
 	};
 
+	// the layouts are made right away, so descriptors can be allocated and written. The pipeline itself is
+	// created by PipelineCompiler and waited for by the first bind or vkPipeline
 	explicit Pipeline(const GraphicsPipelineDescriptor& desc, VkRenderPass renderPass, const std::string& name = "");
 	explicit Pipeline(const ComputePipelineDescriptor& desc, const std::string& name = "");
 	explicit Pipeline(const RayTracingPipelineDescriptor& desc, const std::string& name = "");
@@ -84,6 +110,17 @@ public:
 	void bindVertexBuffer(vk::CommandBuffer cmdbuf, vk::Buffer vertexBuffer);
 	void bindIndexBuffer(vk::CommandBuffer cmdbuf, vk::Buffer indexBuffer);
 
+	// selects the variant with constant at value, clamped to its range. The variant it replaces stays bound
+	// until the new one has been built
+	void setSpecialization(const std::string& constant, uint32_t value);
+	// with the values that are selected
+	const std::vector<SpecConstant>& specializations() const { return m_permutations; }
+	const std::string& debugName() const { return name; }
+	// the value pipelines created from now on start with for constants of that name
+	static void SetSpecializationDefault(const std::string& constant, uint32_t value);
+	// the living pipelines with permutations
+	static std::vector<Pipeline*> Permutable();
+
 	struct SetAndCount
 	{
 		uint32_t set;
@@ -96,6 +133,8 @@ public:
 	{
 		uint32_t set;
 		uint32_t bindIdx;
+		// one per dynamic buffer binding of the set, in binding order
+		std::vector<uint32_t> dynamicOffsets;
 	};
 	void bindDescriptorSets(vk::CommandBuffer commandBuffer, const std::vector<SetAndBindingIndex>& sets);
 
@@ -112,7 +151,19 @@ public:
 	void updateSamplersDescriptorSets(uint32_t set, uint32_t index, const std::vector<SetBindings>& bindings);
 	void updateTexturesDescriptorSets(uint32_t set, uint32_t index, const std::vector<SetBindings>& bindings);
 	void updateBuffersDescriptorSets(uint32_t set, uint32_t index, vk::DescriptorType type, const std::vector<SetBindings>& bindings);
+	// writes go to DescriptorUpdater and are applied together with those of every other pipeline at the start of
+	// the next frame, or here, which bind also does
 	void updateDescriptorSets();
+	// rewrites the whole set through an update template made once for its layout. data holds each binding in the
+	// order of SetDescriptor::bindings, as descriptorCount vk::DescriptorImageInfo, vk::DescriptorBufferInfo or
+	// vk::BufferView depending on the type, packed without padding. Not for shared sets or acceleration structures
+	void updateDescriptorSet(uint32_t set, uint32_t index, const void* data, size_t size);
+	template<typename T>
+	void updateDescriptorSet(uint32_t set, uint32_t index, const T& data)
+	{
+		static_assert(std::is_trivially_copyable_v<T>, "the data is copied until the update is applied");
+		updateDescriptorSet(set, index, &data, sizeof(T));
+	}
 
 	/// @brief Assigns the resource to a position in the resource array specific to te resource's type
 	void bindResource(uint32_t set, uint32_t binding, uint32_t index,
@@ -145,12 +196,40 @@ private:
 
 	void createRayTracingPipeline();
 
+	// run by PipelineCompiler, possibly on another thread
+	vk::Pipeline compileGraphicsPipeline(const std::vector<uint32_t>& values, const std::string& variantName);
+	vk::Pipeline compileComputePipeline(const std::vector<uint32_t>& values, const std::string& variantName);
+	vk::Pipeline compileRayTracingPipeline(const std::string& variantName);
+	// picks up the selected variant, waiting for it when nothing has been bound yet
+	void resolve() const;
+	// the variants that are neither selected nor bound, once their job has run
+	void dropUnusedVariants() const;
+	void initPermutations(const std::vector<SpecConstant>& permutations);
+	static void unregisterPermutable(Pipeline* pipeline);
+	// starts building the variant of the current values unless it exists
+	void requestVariant();
+
+	struct Specialization
+	{
+		std::vector<vk::SpecializationMapEntry> entries;
+		std::vector<uint8_t> data;
+		vk::SpecializationInfo info;
+	};
+	// the constants of the descriptor followed by the permutations of stage, null when there are none
+	const vk::SpecializationInfo* specialize(Specialization& out, vk::ShaderStageFlagBits stage,
+		const std::vector<vk::SpecializationMapEntry>& entries, const void* data, const std::vector<uint32_t>& values) const;
+	// what the descriptor points at has to outlive the constructor until the job has run
+	void keepShader(const std::weak_ptr<Shader>& shader);
+	void* keepSpecializationData(const std::vector<vk::SpecializationMapEntry>& entries, const void* data);
+
 	vk::PipelineLayout createPipelineLayout(
 		const std::vector<vk::DescriptorSetLayout>& descLayouts,
 		const std::vector<vk::PushConstantRange>& pushConsts) const;
 
 	void initDescriptorPool();
 	void initDescriptorLayout();
+	// made on the first updateDescriptorSet of the set
+	vk::DescriptorUpdateTemplate descriptorUpdateTemplate(uint32_t set);
 
 private:
 	std::string name;
@@ -158,7 +237,22 @@ private:
 	ComputePipelineDescriptor computePipelineDesc;
 	RayTracingPipelineDescriptor rayTracingPipelineDesc;
 	vk::PipelineBindPoint bindPoint = vk::PipelineBindPoint::eGraphics;
-	vk::Pipeline m_pipeline = VK_NULL_HANDLE;
+	// the bound variant
+	mutable vk::Pipeline m_pipeline = VK_NULL_HANDLE;
+	struct Variant
+	{
+		std::future<vk::Pipeline> compile;
+		vk::Pipeline pipeline = VK_NULL_HANDLE;
+	};
+	// keyed by the values of m_permutations
+	mutable std::map<std::vector<uint32_t>, Variant> m_variants;
+	std::vector<uint32_t> m_selected;
+	std::vector<SpecConstant> m_permutations;
+	static std::mutex s_permutationMutex;
+	static std::unordered_map<std::string, uint32_t> s_specializationDefaults;
+	static std::vector<Pipeline*> s_permutable;
+	mutable std::vector<std::shared_ptr<Shader>> m_shaders;
+	std::list<std::vector<uint8_t>> m_specializationData;
 	vk::PipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
 	vk::RenderPass m_vkRenderPass = VK_NULL_HANDLE;
 
@@ -166,15 +260,13 @@ private:
 	{
 		std::vector<vk::DescriptorSet> vkSets;
 		vk::DescriptorSetLayout vkLayout = VK_NULL_HANDLE;
+		bool shared = false;
+		std::vector<vk::DescriptorSetLayoutBinding> bindings;
+		vk::DescriptorUpdateTemplate updateTemplate = VK_NULL_HANDLE;
+		// of the data updateTemplate reads
+		size_t templateSize = 0;
 	};
 	std::unordered_map<uint32_t, DescriptorSet> m_descriptorSets;
 	vk::DescriptorPool m_descPool = VK_NULL_HANDLE;
 	std::vector<vk::PushConstantRange> m_pushConsts;
-
-	std::list<std::vector<vk::DescriptorBufferInfo>> m_bufferInfo;
-	std::list<vk::BufferView> m_bufferViewInfo;
-	std::list<std::vector<vk::DescriptorImageInfo>> m_imageInfo;
-	std::vector<vk::WriteDescriptorSetAccelerationStructureKHR> accelerationStructInfo;
-	std::vector<vk::WriteDescriptorSet> m_writeDescSets;
-	std::mutex mutex;
 };
\ No newline at end of file
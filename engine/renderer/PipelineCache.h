@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// The vk::PipelineCache every pipeline is created with. It is loaded from disk at startup when the file was
+// written by the same driver on the same device, and written back at shutdown and whenever new pipelines
+// have been created for a while, so warm runs skip compiling the pass pipelines from SPIR-V
+class PipelineCache final {
+public:
+    static PipelineCache& Instance() {
+        if (!instance_) {
+            instance_.reset(new PipelineCache);
+        }
+        return *instance_;
+    }
+
+    // how long after the last save pipelines created since then are written out
+    static constexpr std::chrono::seconds SaveInterval{ 30 };
+
+    // starts empty when the file is missing, damaged or from another device or driver
+    void Init(const std::string& file);
+    // saves and destroys the cache, after the last pipeline has been created
+    void Quit();
+    vk::PipelineCache Handle() const { return cache_; }
+
+    // once per frame, saves when pipelines were created and SaveInterval has passed since the last save
+    void Update();
+    bool Save();
+
+    // called by Pipeline with how long the creation took and the driver's feedback about it
+    void Record(const std::string& name, double milliseconds, const vk::PipelineCreationFeedback& feedback);
+
+    struct Stats
+    {
+        bool loaded = false;
+        size_t loadedBytes = 0;
+        uint32_t pipelines = 0;
+        // creations the driver reports as found in the cache, drivers may not report it at all
+        uint32_t hits = 0;
+        double milliseconds = 0.0;
+        uint32_t saves = 0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<PipelineCache> instance_;
+
+    // written before the driver's data, which is only passed on when every field matches
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t driverUUID[VK_UUID_SIZE];
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    PipelineCache() {}
+    FileHeader header() const;
+
+    vk::PipelineCache cache_;
+    std::string file_;
+    std::mutex mutex_;
+    Stats stats_;
+    uint32_t savedPipelines_ = 0;
+    std::chrono::steady_clock::time_point lastSave_;
+};
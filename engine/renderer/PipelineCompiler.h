@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads that create pipelines while the passes go on initializing. A Pipeline builds its layouts
+// right away, since descriptors are allocated and written straight after, and hands the vkCreate*Pipelines
+// call to the compiler. The pipeline waits on the future the first time it is bound. Creation goes through
+// the PipelineCache, which is internally synchronized, so any number of them can run at once
+class PipelineCompiler final {
+public:
+    static PipelineCompiler& Instance() {
+        if (!instance_) {
+            instance_.reset(new PipelineCompiler);
+        }
+        return *instance_;
+    }
+
+    // lowered to the hardware threads left next to the render thread
+    static constexpr uint32_t MaxThreads = 8;
+
+    // until this is called, and after Quit, Compile runs the job on the calling thread
+    void Init();
+    // waits for the jobs that were submitted
+    void Quit();
+
+    // name is only used for the report
+    std::future<vk::Pipeline> Compile(const std::string& name, std::function<vk::Pipeline()> job);
+    // called by Pipeline when its first use had to wait for the job
+    void Waited(const std::string& name, double milliseconds);
+
+    struct Stats
+    {
+        uint32_t threads = 0;
+        uint32_t pipelines = 0;
+        // the time spent in the jobs, and how long a burst of them took from the first submit to the last finish
+        double compileMilliseconds = 0.0;
+        double wallMilliseconds = 0.0;
+        // first uses that found the job still running
+        uint32_t waits = 0;
+        double waitMilliseconds = 0.0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<PipelineCompiler> instance_;
+
+    struct Job
+    {
+        std::string name;
+        std::packaged_task<vk::Pipeline()> task;
+    };
+
+    PipelineCompiler() {}
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> jobs_;
+    uint32_t running_ = 0;
+    bool stop_ = false;
+    Stats stats_;
+
+    // the burst of jobs the startup report is about, from a submit to an idle compiler until it is idle again
+    std::chrono::steady_clock::time_point burstStart_;
+    uint32_t burstPipelines_ = 0;
+    double burstMilliseconds_ = 0.0;
+};
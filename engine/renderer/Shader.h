@@ -1,13 +1,18 @@
 #pragma once
 #include "vulkan/vulkan.hpp"
+#include <cstdint>
+#include <span>
 #include <string>
 
 struct Shader
 {
 public:
-	Shader(const std::string& filename);
+	// the module is made from code, which only has to live through the call
+	Shader(std::span<const uint32_t> code);
 	~Shader();
 	void destroy();
 	std::string name;
 	vk::ShaderModule module;
+	// of the SPIR-V, ShaderPool shares a module between every file with the same code
+	uint64_t hash = 0;
 };
\ No newline at end of file
@@ -1,15 +1,44 @@
 #pragma once
 #include "Shader.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 
+// Shader modules keyed by the hash of their SPIR-V. A file that was loaded before is found by its path without
+// touching the disk, a new path is memory mapped and hashed, and only code no module has been made of yet is
+// handed to the driver. Modules are shared by every GPUProgram and Pipeline holding them and destroyed with the
+// last reference. Specialization constants are given at pipeline creation, so one module serves every variant
 class ShaderPool final {
 public:
 	static vk::Result Initialize();
 	static void Quit();
 	static ShaderPool& GetInstance() { return *instance; }
-	Shader CreateShader(const std::string filename, const std::string_view name = "");
+	// null when the file is missing or not SPIR-V
+	std::shared_ptr<Shader> Get(const std::string& filename);
 	~ShaderPool();
+
+	struct Stats
+	{
+		// alive right now
+		uint32_t modules = 0;
+		// found by path, found by the hash of another file's code, and made
+		uint64_t pathHits = 0;
+		uint64_t contentHits = 0;
+		uint64_t loads = 0;
+		uint64_t loadedBytes = 0;
+	};
+	Stats GetStats();
+
 private:
 	static std::unique_ptr<ShaderPool> instance;
 	ShaderPool();
-	std::vector<Shader> m_Shaders;
+	// from the deleter of the last reference
+	void release(uint64_t hash);
+
+	std::mutex m_Mutex;
+	std::unordered_map<uint64_t, std::weak_ptr<Shader>> m_Modules;
+	// hashes stay known after the module is gone, the file is then mapped again but not hashed
+	std::unordered_map<std::string, uint64_t> m_Paths;
+	Stats m_Stats;
 };
\ No newline at end of file
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class Buffer;
+
+// Persistently mapped staging memory that uploads are sub-allocated from linearly, wrapping around like a ring.
+// The copies are queued and recorded at the start of the next frame's command buffer, the bytes they used are
+// reclaimed once the fence of that frame has been waited on. Outside the frame loop Submit puts them on the
+// graphics queue behind a fence of their own, nothing ever waits for the queue to go idle
+class StagingRing final {
+public:
+    static StagingRing& Instance() {
+        if (!instance_) {
+            instance_.reset(new StagingRing);
+        }
+        return *instance_;
+    }
+
+    static constexpr vk::DeviceSize DefaultCapacity = vk::DeviceSize(64) << 20;
+    // copy offsets are kept aligned for image copies of any texel size
+    static constexpr vk::DeviceSize Alignment = 16;
+
+    void Init(uint32_t framesInFlight, vk::DeviceSize capacity = DefaultCapacity);
+    // after the device is idle, queued copies are dropped
+    void Quit();
+
+    // data is copied right away. Uploads that do not fit in what the ring has free get a staging buffer of their
+    // own, released with the frame or submission that copies them
+    void Upload(vk::Buffer dst, vk::DeviceSize offset, vk::DeviceSize size, const void* data);
+    // submits the queued copies, for work that is submitted before the next frame and reads the destinations
+    void Submit();
+    // after the fence of the frame slot has been waited on and cmdbuf has begun, outside any render pass
+    void BeginFrame(vk::CommandBuffer cmdbuf);
+
+    struct Stats
+    {
+        uint64_t uploads = 0;
+        uint64_t bytes = 0;
+        // uploads that did not fit in the ring
+        uint64_t oversized = 0;
+        uint64_t submissions = 0;
+        // times Upload waited on one of its own submissions to free space
+        uint64_t waits = 0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<StagingRing> instance_;
+
+    struct Copy
+    {
+        vk::Buffer src;
+        vk::Buffer dst;
+        vk::BufferCopy region;
+    };
+
+    // what holds ring space until the GPU is done with it, in the order the space was taken
+    struct Retirement
+    {
+        // ring position the copies used up to
+        uint64_t end = 0;
+        // the frame the copies were recorded into, for a Submit the fence signals instead
+        uint64_t frame = 0;
+        vk::CommandBuffer cmdbuf;
+        vk::Fence fence;
+        std::vector<std::unique_ptr<Buffer>> oversized;
+    };
+
+    StagingRing() {}
+    // positions grow forever, the offset in the ring is position % capacity
+    bool reserve(vk::DeviceSize size, vk::DeviceSize& offset);
+    bool retired(const Retirement& retirement);
+    void release(Retirement& retirement);
+    void record(vk::CommandBuffer cmdbuf);
+    void submit();
+
+    std::mutex mutex_;
+    std::unique_ptr<Buffer> ring_;
+    char* mapped_ = nullptr;
+    vk::DeviceSize capacity_ = 0;
+    uint64_t head_ = 0;
+    uint64_t tail_ = 0;
+    uint32_t framesInFlight_ = 0;
+    uint64_t frame_ = 0;
+    vk::CommandPool pool_;
+    std::vector<Copy> pending_;
+    std::vector<std::unique_ptr<Buffer>> pendingOversized_;
+    std::deque<Retirement> retirements_;
+    // command buffers and fences of finished submissions
+    std::vector<std::pair<vk::CommandBuffer, vk::Fence>> spare_;
+    Stats stats_;
+};
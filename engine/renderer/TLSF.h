@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Two level segregated fit allocator over the offsets of one memory block. Pure CPU bookkeeping, allocate and
+// free are O(1): free ranges are kept in lists by size class, found through two bitmaps, and coalesced with
+// their physical neighbours when freed. MemoryAllocator puts one on every device memory block
+class TLSF final
+{
+public:
+    static constexpr uint32_t InvalidNode = UINT32_MAX;
+
+    struct Allocation
+    {
+        uint64_t offset = 0;
+        // can be a little more than asked for, remainders too small to track stay with the allocation
+        uint64_t size = 0;
+        uint32_t node = InvalidNode;
+    };
+
+    explicit TLSF(uint64_t size);
+
+    // alignment is a power of two. False when no free range fits, which takes a walk over the free lists
+    bool allocate(uint64_t size, uint64_t alignment, Allocation& out);
+    void free(uint32_t node);
+
+    uint64_t size() const { return size_; }
+    uint64_t freeBytes() const { return free_; }
+    uint64_t largestFree() const;
+    uint32_t allocationCount() const { return allocations_; }
+    bool empty() const { return allocations_ == 0; }
+    // walks the blocks in address order: no gaps or overlaps, no two free neighbours, every free block in the
+    // list its size maps to and the bitmaps matching the lists
+    bool validate() const;
+
+    // random allocations and frees with the sizes and alignments of buffers and images, reports the time per
+    // operation, how fragmented the free space gets and whether the allocator stays consistent
+    static void benchmark(uint32_t operations);
+
+private:
+    static constexpr uint32_t SecondLevelBits = 5;
+    static constexpr uint32_t SecondLevelCount = 1u << SecondLevelBits;
+    // sizes below this share the first list of the first level, in steps of SmallSize / SecondLevelCount
+    static constexpr uint32_t SmallShift = 8;
+    static constexpr uint64_t SmallSize = 1ull << SmallShift;
+    static constexpr uint32_t FirstLevelCount = 64 - SmallShift + 1;
+    // every size is rounded up to this, so offsets stay multiples of it and a split off remainder is never
+    // smaller
+    static constexpr uint64_t Granularity = 16;
+
+    struct Node
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t prevPhysical = InvalidNode;
+        uint32_t nextPhysical = InvalidNode;
+        uint32_t prevFree = InvalidNode;
+        uint32_t nextFree = InvalidNode;
+        bool free = false;
+    };
+
+    static void mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel);
+    // a free block at least size large, InvalidNode when there is none
+    uint32_t findFree(uint64_t size) const;
+    // the first free block size aligned to alignment fits in, every list from the class of size on is walked.
+    // Only when findFree has nothing, so the slow search is left for allocations that would fail otherwise
+    uint32_t findFit(uint64_t size, uint64_t alignment) const;
+    bool fits(uint32_t node, uint64_t size, uint64_t alignment) const;
+    void insertFree(uint32_t node);
+    void removeFree(uint32_t node);
+    uint32_t newNode();
+    // the part of node from offset on becomes a new node, which is returned. Free lists are left alone
+    uint32_t split(uint32_t node, uint64_t offset);
+
+    uint64_t size_;
+    uint64_t free_;
+    uint32_t allocations_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> spare_;
+    uint64_t firstLevel_ = 0;
+    uint32_t secondLevel_[FirstLevelCount] = {};
+    uint32_t heads_[FirstLevelCount][SecondLevelCount];
+};
@@ -2,7 +2,13 @@
 
 #include <vulkan/vulkan.hpp>
 #include <string_view>
+#include <unordered_map>
 #include "Buffer.h"
+#include "MipGenerator.h"
+#include "BlockCompressor.h"
+#include "KTX2.h"
+#include "HDRCubemap.h"
+#include "UploadEngine.h"
 
 class TextureManager;
 
@@ -13,11 +19,14 @@ inline uint32_t getMipLevelsCount(uint32_t texWidth, uint32_t texHeight) {
 class Texture final {
 public:
     friend class TextureManager;
+    friend class TextureStreamer;
     ~Texture();
     Texture() {}
     void transitionImageLayout(vk::CommandBuffer cmdbuf, vk::ImageLayout newLayout);
+    // copies every level and layer back to the host and waits for it. Only for the formats HDRCubemap packs
+    KTX2Image readback();
     vk::Image image;
-    vk::DeviceMemory memory;
+    MemoryAllocation allocation;
     vk::ImageView view;
 
     vk::Format format;
@@ -30,14 +39,21 @@ public:
     uint32_t height;
     uint32_t depth;
     uint32_t miplevels = 1;
+    // 6 for cubemaps
+    uint32_t layers = 1;
+    // where BindlessHeap has the textures TextureManager creates to be sampled, UINT32_MAX for the others
+    uint32_t bindlessIndex = UINT32_MAX;
 private:
-    Texture(std::string_view filename);
-    Texture(std::string_view filename, vk::Format format);
+    // format is one of the RGBA8 formats
+    Texture(std::string_view filename, vk::Format format = vk::Format::eR8G8B8A8Srgb);
 
     Texture(void* data, uint32_t w, uint32_t h, vk::Format format = vk::Format::eR8G8B8A8Srgb);
     Texture(void* data, unsigned int w, unsigned int h, unsigned int channel, vk::Format format);
     Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-        int miplevels = 1);
+        int miplevels = 1, uint32_t layers = 1);
+    // the levels are staged for TextureManager to upload, without upload the image is left undefined for the
+    // caller to upload through UploadEngine
+    Texture(const KTX2Image& image, bool upload = true);
 
     void createImage(uint32_t w, uint32_t h);
     void createImageView();
@@ -47,8 +63,16 @@ private:
     void transitionImageLayoutFromDst2Optimal(vk::CommandBuffer buffer);
     void transitionImageLayoutFromUndefine2Opt(vk::CommandBuffer buffer);
     void transformData2Image(vk::CommandBuffer cmdbuf, Buffer&, uint32_t w, uint32_t h);
+    // creates the image and stages every level in one buffer, TextureManager hands it to UploadEngine
+    void uploadLevels(const void* data, size_t size, const std::vector<MipGenerator::Level>& levels);
 
     void init(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format);
+
+    // what the constructor staged, until TextureManager has uploaded it
+    std::unique_ptr<Buffer> staging_;
+    std::vector<MipGenerator::Level> stagedLevels_;
+    // only level 0 is staged, the others are blitted from it once the upload is acquired
+    bool blitMips_ = false;
 };
 
 class TextureManager final {
@@ -60,18 +84,127 @@ public:
         return *instance_;
     }
 
-    std::shared_ptr<Texture> Load(const std::string& filename);
-    std::shared_ptr<Texture> LoadHDRCubemap(const std::string& filename, vk::Format format);
+    // prefers the block compressed copy in the KTX2 cache, encoding and storing it on a miss
+    std::shared_ptr<Texture> Load(const std::string& filename, TextureKind kind = TextureKind::Color);
+    // the converted cubemap with its mip chain is cached as KTX2, keyed by the contents of the .hdr file.
+    // format is B10G11R11 or RGBA16F, image receives what was uploaded
+    std::shared_ptr<Texture> LoadHDRCubemap(const std::string& filename, vk::Format format, KTX2Image* image = nullptr);
+    // where LoadHDRCubemap caches the cubemap, data derived from it can be cached next to it
+    std::string CubemapCacheFile(const std::string& filename, vk::Format format) const;
 
     // data must be a RGBA8888 format data
     std::shared_ptr<Texture> Create(void* data, uint32_t w, uint32_t h, vk::Format format = vk::Format::eR8G8B8A8Srgb);
     std::shared_ptr<Texture> Create(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format);
-    std::shared_ptr<Texture> Create(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels = 1);
+    // 6 layers make a cubemap
+    std::shared_ptr<Texture> Create(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels = 1,
+        uint32_t layers = 1);
+    std::shared_ptr<Texture> Create(const KTX2Image& image);
+    // goes through the same cache for RGBA8 data, other formats are created uncompressed
+    std::shared_ptr<Texture> CreateCompressed(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format, TextureKind kind);
+    // the CPU half of CreateCompressed, safe to call from several threads. false when the data stays uncompressed
+    bool PrepareCompressed(const void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format, TextureKind kind,
+        KTX2Image& image, std::string* cacheFile = nullptr);
+    // shared textures are only released once every user has destroyed them
+    // the texture is released once no frame in flight can sample it, see DeletionQueue
     void Destroy(std::shared_ptr<Texture>);
     void Clear();
 
+    // Load hands out the texture already created for a path, and with content sharing enabled, for the
+    // same file or pixel content under another name. Every hit counts as one more user
+    struct SharingStats
+    {
+        uint32_t textures = 0;
+        uint32_t hits = 0;
+        size_t bytesSaved = 0;
+    };
+    static uint64_t ContentHash(const void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format, TextureKind kind);
+    // nullptr on a miss, otherwise adds a user
+    std::shared_ptr<Texture> FindShared(uint64_t contentHash);
+    void AddShared(const std::shared_ptr<Texture>& texture, uint64_t contentHash);
+    void SetContentSharing(bool enable) { contentSharing_ = enable; }
+    bool GetContentSharing() const { return contentSharing_; }
+    SharingStats GetSharingStats() const { return sharingStats_; }
+
+    // applies to textures created from pixel data afterwards, unsupported formats fall back to the other backend
+    void SetMipGeneration(MipGeneration mode, MipFilter filter = MipFilter::Kaiser) {
+        mipGeneration_ = mode;
+        mipFilter_ = filter;
+    }
+    MipGeneration GetMipGeneration() const { return mipGeneration_; }
+    MipFilter GetMipFilter() const { return mipFilter_; }
+
+    void SetBlockCompression(BlockCompression mode) { blockCompression_ = mode; }
+    BlockCompression GetBlockCompression() const { return blockCompression_; }
+
+    // how cubemaps missing from the cache are converted, RGBA16F is always converted on the CPU
+    void SetCubemapConversion(CubemapConversion mode) { cubemapConversion_ = mode; }
+    CubemapConversion GetCubemapConversion() const { return cubemapConversion_; }
+
+    // textures created from data between these calls go to UploadEngine together, outside of a batch each
+    // one is submitted right away
+    void BeginBatch();
+    void EndBatch();
+
+    // acquires the texture uploads and records the mip blits that follow them, so that the frame can sample
+    // every texture created so far. Right after UploadEngine::BeginFrame
+    void BeginFrame(vk::CommandBuffer cmdbuf);
+    // blocks until the textures created so far can be used by single use command buffers, for the ones
+    // rendered from while loading
+    void FinishUploads();
+
 private:
+    friend class Texture;
     static std::unique_ptr<TextureManager> instance_;
 
-    std::vector<std::shared_ptr<Texture>> datas_;
+    struct UploadBatch
+    {
+        uint32_t textures = 0;
+        size_t totalBytes = 0;
+    };
+
+    // hands what the constructor staged to UploadEngine
+    void upload(const std::shared_ptr<Texture>& texture);
+    void acquireUploads(vk::CommandBuffer cmdbuf);
+
+    std::shared_ptr<Texture> add(std::shared_ptr<Texture> texture);
+    std::string cacheFileName(uint64_t sourceHash, TextureKind kind, bool srgb) const;
+    std::string cubemapCacheFile(const std::vector<unsigned char>& bytes, vk::Format format) const;
+    // both fail when the device cannot sample the block format
+    bool loadCached(const std::string& cacheFile, KTX2Image& image);
+    bool encodeCached(const std::string& name, const std::string& cacheFile, const unsigned char* rgba,
+        uint32_t w, uint32_t h, bool srgb, TextureKind kind, KTX2Image& image);
+    bool supportsBlockFormat(vk::Format format);
+
+    struct SharedTexture
+    {
+        uint32_t users = 1;
+        size_t bytes = 0;
+        std::shared_ptr<Texture> texture;
+        std::vector<std::string> paths;
+        uint64_t contentHash = 0;
+    };
+    std::shared_ptr<Texture> acquireShared(Texture* texture);
+    // path may be empty and a contentHash of 0 skips the content lookup
+    void addShared(const std::shared_ptr<Texture>& texture, const std::string& path, uint64_t contentHash);
+
+    MipGeneration mipGeneration_ = MipGeneration::GPUBlit;
+    MipFilter mipFilter_ = MipFilter::Kaiser;
+    BlockCompression blockCompression_ = BlockCompression::BC7;
+    CubemapConversion cubemapConversion_ = CubemapConversion::GPU;
+
+    int batchDepth_ = 0;
+    UploadBatch batch_;
+    // the last texture upload, the ones before it are done once it is
+    UploadTicket uploads_;
+    // textures whose mips are blitted once their upload is acquired
+    std::vector<std::shared_ptr<Texture>> blits_;
+
+    bool contentSharing_ = true;
+    std::unordered_map<std::string, Texture*> pathLookup_;
+    std::unordered_map<uint64_t, Texture*> contentLookup_;
+    std::unordered_map<Texture*, SharedTexture> shared_;
+    SharingStats sharingStats_;
+
+    // keyed by the texture so that Destroy does not search
+    std::unordered_map<Texture*, std::shared_ptr<Texture>> datas_;
 };
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+// Decides which mip levels of the streamed textures should be resident. Pure CPU bookkeeping: it is fed the
+// shader feedback every frame, hands out load and drop requests, and is told when they have finished. It
+// never touches the device, so it can be driven with synthetic feedback
+class TextureResidency final
+{
+public:
+    // levels that stay resident whatever the feedback says, 64x64 and below for a full chain
+    static constexpr uint32_t TailLevels = 7;
+    // a texture only goes coarser once it has not asked for the finer level for this many frames
+    static constexpr uint64_t CoarsenDelay = 120;
+    // textures not sampled for this long fall back to their tail
+    static constexpr uint64_t IdleFrames = 600;
+    static constexpr uint32_t MaxLoadsPerUpdate = 4;
+
+    struct Request
+    {
+        uint32_t texture;
+        // finest level that is resident once the request has been carried out
+        uint32_t mip;
+    };
+
+    struct Stats
+    {
+        uint32_t loads = 0;
+        uint32_t drops = 0;
+        // loads that did not fit even after dropping everything allowed
+        uint32_t deferred = 0;
+    };
+
+    void resize(uint32_t textures);
+    // levelBytes[0] is the finest level. residentMip is what the texture was created with
+    void track(uint32_t texture, std::vector<size_t> levelBytes, uint32_t residentMip);
+    void untrack(uint32_t texture);
+    void setBudget(size_t bytes) { budget_ = bytes; }
+    size_t budget() const { return budget_; }
+
+    // feedback[i] is 0 when texture i was not sampled, otherwise 1 + log2 of the finest resolution sampled
+    // along its larger axis. Queues requests, at most one pending per texture
+    void update(std::span<const uint32_t> feedback, uint64_t frame);
+    std::vector<Request> takeRequests();
+    // success false leaves the texture as it was, so the request can be issued again later
+    void completed(uint32_t texture, uint32_t mip, bool success = true);
+
+    bool tracked(uint32_t texture) const { return texture < textures_.size() && textures_[texture].tracked; }
+    uint32_t residentMip(uint32_t texture) const { return textures_[texture].resident; }
+    uint32_t wantedMip(uint32_t texture) const { return textures_[texture].wanted; }
+    uint32_t tailMip(uint32_t texture) const { return textures_[texture].tail; }
+    // footprint of every tracked texture once its pending request is done
+    size_t committedBytes() const { return committed_; }
+    size_t residentBytes() const;
+    const Stats& stats() const { return stats_; }
+
+    static uint32_t tailFor(uint32_t levels) { return levels > TailLevels ? levels - TailLevels : 0; }
+
+private:
+    struct Entry
+    {
+        bool tracked = false;
+        bool pending = false;
+        uint32_t resident = 0;
+        uint32_t target = 0;
+        uint32_t wanted = 0;
+        uint32_t tail = 0;
+        uint64_t lastUsed = 0;
+        uint64_t wantedFrame = 0;
+        // suffix sums, bytes[m] is the footprint with level m and everything coarser resident
+        std::vector<size_t> bytes;
+    };
+
+    void request(uint32_t texture, uint32_t mip);
+    // drops levels from other textures until extra more bytes fit, least recently used first. Textures
+    // holding levels they no longer want go before any that still need theirs
+    bool makeRoom(size_t extra, uint32_t keep, uint64_t frame);
+
+    std::vector<Entry> textures_;
+    std::vector<Request> requests_;
+    size_t budget_ = size_t(512) << 20;
+    size_t committed_ = 0;
+    Stats stats_;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "KTX2.h"
+#include "TextureResidency.h"
+#include "UploadEngine.h"
+
+class Texture;
+class Buffer;
+
+// Streams the mip levels of block compressed textures from their KTX2 cache entries. Textures start with
+// their tail resident, gbuffer.frag reports the finest level it samples into a feedback buffer and
+// TextureResidency turns that into loads and drops, which a worker thread reads from disk. A finished
+// request is uploaded through UploadEngine and replaces the texture's image in place once the upload has been
+// acquired, the old image goes to the DeletionQueue
+class TextureStreamer final {
+public:
+    static TextureStreamer& Instance() {
+        if (!instance_) {
+            instance_.reset(new TextureStreamer);
+        }
+        return *instance_;
+    }
+
+    ~TextureStreamer();
+
+    // off by default, only applications that bind the feedback buffer and call Init/BeginFrame can stream
+    void SetEnabled(bool enable) { enabled_ = enable; }
+    bool Enabled() const { return enabled_; }
+    void SetBudget(size_t bytes) { residency_.setBudget(bytes); }
+
+    // uploads the tail of the chain, the finer levels are read back from cacheFile on demand.
+    // nullptr when the image is too small to be worth streaming or the cache entry is missing
+    std::shared_ptr<Texture> Create(const KTX2Image& image, const std::string& cacheFile);
+
+    // textures are what the materials sample, the feedback is indexed with their BindlessHeap index. When an
+    // image is replaced the heap's descriptor is pointed at the new one
+    void Init(const std::vector<std::shared_ptr<Texture>>& textures);
+    // once the fence of the frame slot has been waited on: consumes the feedback the slot wrote last time
+    // and swaps in what the worker has finished
+    void BeginFrame(uint32_t frame);
+    void Clear();
+
+    bool Active() const { return feedback_ != nullptr; }
+    std::shared_ptr<Buffer> FeedbackBuffer() const { return feedback_; }
+    uint32_t FeedbackOffset(uint32_t frame) const { return frame * slotCount_; }
+    const TextureResidency& Residency() const { return residency_; }
+
+private:
+    static std::unique_ptr<TextureStreamer> instance_;
+
+    // without the transfer queue every swap is an upload on the graphics queue, so only a few are done per frame
+    static constexpr uint32_t MaxSwapsPerFrame = 2;
+    // uploads on the transfer queue do not hold up the frame, this only bounds the staging memory
+    static constexpr uint32_t MaxUploadsPerFrame = 8;
+
+    struct Source
+    {
+        std::string cacheFile;
+        std::vector<size_t> levelBytes;
+        uint32_t residentMip;
+    };
+
+    struct Job
+    {
+        uint32_t slot;
+        uint32_t mip;
+        std::string cacheFile;
+    };
+
+    struct Result
+    {
+        uint32_t slot;
+        uint32_t mip;
+        bool success;
+        KTX2Image image;
+    };
+
+    struct Upload
+    {
+        uint32_t slot;
+        uint32_t mip;
+        std::shared_ptr<Texture> texture;
+        UploadTicket ticket;
+    };
+
+    TextureStreamer() {}
+    void work();
+    // the image of fresh takes the place of the slot's and the heap is updated
+    void swap(uint32_t slot, std::shared_ptr<Texture> fresh);
+    // the levels from first on, repacked so that level offsets start at 0
+    static KTX2Image slice(const KTX2Image& image, uint32_t first);
+
+    bool enabled_ = false;
+    TextureResidency residency_;
+    std::unordered_map<Texture*, Source> sources_;
+    // indexed by BindlessHeap index, null where nothing is streamed
+    std::vector<std::shared_ptr<Texture>> slots_;
+    std::vector<std::string> slotFiles_;
+
+    std::shared_ptr<Buffer> feedback_;
+    uint32_t* mapped_ = nullptr;
+    uint32_t slotCount_ = 0;
+    uint32_t framesInFlight_ = 0;
+    uint64_t frameCount_ = 0;
+    uint32_t pressureCallback_ = 0;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Job> jobs_;
+    std::deque<Result> results_;
+    bool stop_ = false;
+
+    // in the order of their tickets
+    std::deque<Upload> uploads_;
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MipGenerator.h"
+
+class Buffer;
+class Texture;
+
+// completes with the batch the upload was put in, a value of 0 is complete from the start
+struct UploadTicket
+{
+    uint64_t value = 0;
+};
+
+// Uploads buffers and images on the transfer queue from a thread of its own, so large copies run next to
+// rendering instead of in front of it. Uploads are batched into one submission each that signals the next
+// value of a timeline semaphore. When the transfer queue is of another family, the submission releases the
+// resources and the frame that first uses them acquires them, the frame's submission waits on the semaphore
+// for that value. Without a transfer queue apart from the graphics queue, uploads go through StagingRing and
+// their tickets are complete right away
+class UploadEngine final {
+public:
+    static UploadEngine& Instance() {
+        if (!instance_) {
+            instance_.reset(new UploadEngine);
+        }
+        return *instance_;
+    }
+
+    // a batch is submitted early once its staging buffers reach this size
+    static constexpr vk::DeviceSize MaxBatchBytes = vk::DeviceSize(64) << 20;
+
+    void Init();
+    // submits what is left and waits for it, before the resources are destroyed
+    void Quit();
+    bool Available() const { return worker_.joinable(); }
+
+    // data is copied right away. The resource is kept alive until the copy is done, and must not be used by
+    // the graphics queue before the ticket is acquired
+    UploadTicket Upload(std::shared_ptr<Buffer> dst, vk::DeviceSize offset, vk::DeviceSize size, const void* data);
+    // every level and layer of an image in the undefined layout, left in layout once acquired. Without the
+    // transfer queue the upload is a single use submission on the graphics queue
+    UploadTicket Upload(std::shared_ptr<Texture> dst, const void* data, size_t size,
+        const std::vector<MipGenerator::Level>& levels, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+    // the same from a staging buffer the caller has filled
+    UploadTicket Upload(std::shared_ptr<Texture> dst, std::unique_ptr<Buffer> staging,
+        const std::vector<MipGenerator::Level>& levels, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+    // true once the ticket has been acquired, the resource can be used by anything recorded from then on
+    bool Done(UploadTicket ticket) const { return ticket.value <= acquired_; }
+    // makes what cmdbuf records after this call see the uploads of ticket. The CPU only waits for the batch to
+    // be submitted, the frame's submission waits on the semaphore
+    void Acquire(vk::CommandBuffer cmdbuf, UploadTicket ticket);
+    // blocks until the copies are done on the GPU, they are acquired by the next frame
+    void Wait(UploadTicket ticket);
+    // submits the uploads added so far instead of waiting for the batch to fill up or the next frame
+    void Flush();
+
+    // acquires every batch that has finished and submits the uploads of the last frame, right after
+    // StagingRing::BeginFrame
+    void BeginFrame(vk::CommandBuffer cmdbuf);
+    // the value the frame's submission has to wait for, 0 when it acquired nothing. Resets it
+    uint64_t TakeFrameWait();
+    vk::Semaphore Semaphore() const { return semaphore_; }
+
+    struct Stats
+    {
+        uint64_t uploads = 0;
+        uint64_t bytes = 0;
+        uint64_t batches = 0;
+        // Acquire calls that found the batch still running
+        uint64_t stalls = 0;
+    };
+    Stats GetStats();
+
+private:
+    static std::unique_ptr<UploadEngine> instance_;
+
+    struct Request
+    {
+        uint64_t value;
+        std::unique_ptr<Buffer> staging;
+        std::shared_ptr<Buffer> buffer;
+        vk::DeviceSize offset = 0;
+        std::shared_ptr<Texture> texture;
+        std::vector<MipGenerator::Level> levels;
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    };
+
+    // the barriers that hand a batch over to the graphics queue
+    struct Acquires
+    {
+        uint64_t value;
+        std::vector<vk::BufferMemoryBarrier> buffers;
+        std::vector<vk::ImageMemoryBarrier> images;
+    };
+
+    // holds the staging memory and the resources until the semaphore reaches value
+    struct Batch
+    {
+        uint64_t value;
+        vk::CommandBuffer cmdbuf;
+        std::vector<Request> requests;
+    };
+
+    UploadEngine() {}
+    UploadTicket enqueue(Request request, vk::DeviceSize size);
+    // closes the batches up to value for the worker, with wait until it has submitted them
+    void flush(uint64_t value, bool wait);
+    void work();
+    // the copies with their layout transitions, the releases go to acquires when it is not null
+    void record(vk::CommandBuffer cmdbuf, const std::vector<Request>& requests, Acquires* acquires);
+    void submit(std::vector<Request> requests);
+    // records the acquires of the batches up to value
+    void acquire(vk::CommandBuffer cmdbuf, uint64_t value);
+    // frees the batches the semaphore has passed, on the worker thread that owns the pool
+    void recycle();
+
+    vk::Semaphore semaphore_;
+    vk::CommandPool pool_;
+    uint32_t srcFamily_ = 0;
+    uint32_t dstFamily_ = 0;
+
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable submitted_;
+    std::vector<Request> pending_;
+    // the value of the batch uploads are added to. Batches up to closedValue_ are handed to the worker
+    uint64_t openValue_ = 1;
+    vk::DeviceSize openBytes_ = 0;
+    uint64_t closedValue_ = 0;
+    uint64_t submittedValue_ = 0;
+    std::deque<Acquires> acquires_;
+    bool stop_ = false;
+    Stats stats_;
+
+    // only touched by the worker
+    std::deque<Batch> inflight_;
+    std::vector<vk::CommandBuffer> spare_;
+
+    // only touched by the render loop
+    uint64_t acquired_ = 0;
+    uint64_t frameWait_ = 0;
+};
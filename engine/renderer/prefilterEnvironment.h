@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+class Texture;
+
+// GGX prefiltered specular chain of a cubemap, level m for roughness m / (levels - 1). RGBA16F, storage and
+// transfer source usage so that it can be read back into the cache
+std::shared_ptr<Texture> prefilterEnvironment(std::shared_ptr<Texture> environment, uint32_t size, uint32_t levels,
+	uint32_t samples);
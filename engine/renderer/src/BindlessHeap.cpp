@@ -0,0 +1,228 @@
+#include "BindlessHeap.h"
+#include "Texture.h"
+#include "Sampler.h"
+#include "Buffer.h"
+#include "Context.h"
+#include "log.h"
+
+#include <algorithm>
+#include <format>
+
+std::unique_ptr<BindlessHeap> BindlessHeap::instance_ = nullptr;
+
+namespace {
+    const char* typeName(BindlessType type)
+    {
+        switch (type) {
+        case BindlessType::Textures:
+            return "texture";
+        case BindlessType::Samplers:
+            return "sampler";
+        default:
+            return "buffer";
+        }
+    }
+}
+
+void BindlessHeap::Init(uint32_t framesInFlight)
+{
+    auto& context = Context::GetInstance();
+    auto device = context.device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    framesInFlight_ = framesInFlight;
+    frame_ = 0;
+
+    auto chain = context.physicaldevice.getProperties2<vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceDescriptorIndexingProperties>();
+    const auto& limits = chain.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+    maxBufferRange_ = chain.get<vk::PhysicalDeviceProperties2>().properties.limits.maxStorageBufferRange;
+    heaps_[size_t(BindlessType::Textures)].type = vk::DescriptorType::eSampledImage;
+    heaps_[size_t(BindlessType::Textures)].capacity = std::min({ MaxTextures,
+        limits.maxPerStageDescriptorUpdateAfterBindSampledImages, limits.maxDescriptorSetUpdateAfterBindSampledImages });
+    heaps_[size_t(BindlessType::Samplers)].type = vk::DescriptorType::eSampler;
+    heaps_[size_t(BindlessType::Samplers)].capacity = std::min({ MaxSamplers,
+        limits.maxPerStageDescriptorUpdateAfterBindSamplers, limits.maxDescriptorSetUpdateAfterBindSamplers });
+    heaps_[size_t(BindlessType::Buffers)].type = vk::DescriptorType::eStorageBuffer;
+    heaps_[size_t(BindlessType::Buffers)].capacity = std::min({ MaxBuffers,
+        limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers });
+
+    std::vector<vk::DescriptorPoolSize> poolSizes;
+    for (const auto& heap : heaps_) {
+        poolSizes.push_back({ heap.type, heap.capacity });
+    }
+    vk::DescriptorPoolCreateInfo poolCI;
+    poolCI.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+        .setMaxSets(static_cast<uint32_t>(heaps_.size()))
+        .setPoolSizes(poolSizes);
+    pool_ = device.createDescriptorPool(poolCI);
+
+    // the arrays are written while frames that index other elements are in flight, elements nothing has
+    // been registered at are never accessed
+    const vk::DescriptorBindingFlags flags = vk::DescriptorBindingFlagBits::ePartiallyBound |
+        vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending |
+        vk::DescriptorBindingFlagBits::eVariableDescriptorCount;
+    for (auto& heap : heaps_) {
+        vk::DescriptorSetLayoutBinding binding;
+        binding.setBinding(0)
+            .setDescriptorType(heap.type)
+            .setDescriptorCount(heap.capacity)
+            .setStageFlags(vk::ShaderStageFlagBits::eAll);
+        vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlags;
+        bindingFlags.setBindingFlags(flags);
+        vk::DescriptorSetLayoutCreateInfo layoutCI;
+        layoutCI.setBindings(binding)
+            .setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+            .setPNext(&bindingFlags);
+        heap.layout = device.createDescriptorSetLayout(layoutCI);
+
+        vk::DescriptorSetVariableDescriptorCountAllocateInfo countInfo;
+        countInfo.setDescriptorCounts(heap.capacity);
+        vk::DescriptorSetAllocateInfo allocateInfo;
+        allocateInfo.setDescriptorPool(pool_)
+            .setSetLayouts(heap.layout)
+            .setPNext(&countInfo);
+        heap.set = device.allocateDescriptorSets(allocateInfo)[0];
+    }
+    DEMO_LOG(Info, std::format("Bindless heap: {} textures, {} samplers, {} buffers",
+        heaps_[size_t(BindlessType::Textures)].capacity, heaps_[size_t(BindlessType::Samplers)].capacity,
+        heaps_[size_t(BindlessType::Buffers)].capacity));
+}
+
+void BindlessHeap::Quit()
+{
+    auto device = Context::GetInstance().device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pool_) {
+        return;
+    }
+    DEMO_LOG(Info, std::format("Bindless heap: {} descriptor writes, {} textures, {} samplers and {} buffers still registered",
+        writes_, heaps_[size_t(BindlessType::Textures)].live, heaps_[size_t(BindlessType::Samplers)].live,
+        heaps_[size_t(BindlessType::Buffers)].live));
+    device.destroyDescriptorPool(pool_);
+    pool_ = nullptr;
+    for (auto& heap : heaps_) {
+        device.destroyDescriptorSetLayout(heap.layout);
+        heap = Heap();
+    }
+    retired_.clear();
+}
+
+uint32_t BindlessHeap::Register(const Texture& texture)
+{
+    vk::DescriptorImageInfo image(nullptr, texture.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t index = allocate(BindlessType::Textures);
+    write(BindlessType::Textures, index, &image, nullptr);
+    return index;
+}
+
+uint32_t BindlessHeap::Register(const Sampler& sampler)
+{
+    vk::DescriptorImageInfo image(sampler.vkSampler());
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t index = allocate(BindlessType::Samplers);
+    write(BindlessType::Samplers, index, &image, nullptr);
+    return index;
+}
+
+uint32_t BindlessHeap::Register(const Buffer& buffer)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    vk::DescriptorBufferInfo info(buffer.buffer, 0, std::min<vk::DeviceSize>(buffer.size, maxBufferRange_));
+    const uint32_t index = allocate(BindlessType::Buffers);
+    write(BindlessType::Buffers, index, nullptr, &info);
+    return index;
+}
+
+void BindlessHeap::Update(uint32_t index, const Texture& texture)
+{
+    vk::DescriptorImageInfo image(nullptr, texture.view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    std::lock_guard<std::mutex> lock(mutex_);
+    write(BindlessType::Textures, index, &image, nullptr);
+}
+
+void BindlessHeap::Release(BindlessType type, uint32_t index)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!pool_ || index == InvalidIndex) {
+        return;
+    }
+    heaps_[size_t(type)].live--;
+    retired_.push_back({ type, index, frame_ });
+}
+
+void BindlessHeap::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_++;
+    // the fence of that frame's slot is waited on framesInFlight frames later, the queue completes in order
+    while (!retired_.empty() && retired_.front().frame + framesInFlight_ <= frame_) {
+        heaps_[size_t(retired_.front().type)].free.push_back(retired_.front().index);
+        retired_.pop_front();
+    }
+}
+
+Pipeline::SetDescriptor BindlessHeap::Descriptor(BindlessType type, uint32_t set) const
+{
+    Pipeline::SetDescriptor descriptor;
+    descriptor.set = set;
+    descriptor.layout = heaps_[size_t(type)].layout;
+    descriptor.shared = heaps_[size_t(type)].set;
+    return descriptor;
+}
+
+BindlessHeap::Stats BindlessHeap::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    for (size_t i = 0; i < heaps_.size(); i++) {
+        stats.live[i] = heaps_[i].live;
+        stats.capacity[i] = heaps_[i].capacity;
+    }
+    stats.writes = writes_;
+    return stats;
+}
+
+uint32_t BindlessHeap::allocate(BindlessType type)
+{
+    if (!pool_) {
+        return InvalidIndex;
+    }
+    auto& heap = heaps_[size_t(type)];
+    uint32_t index = InvalidIndex;
+    if (!heap.free.empty()) {
+        index = heap.free.back();
+        heap.free.pop_back();
+    }
+    else if (heap.next < heap.capacity) {
+        index = heap.next++;
+    }
+    else {
+        if (!heap.warned) {
+            DEMO_LOG(Warning, std::format("All {} bindless {} descriptors are in use", heap.capacity, typeName(type)));
+            heap.warned = true;
+        }
+        return InvalidIndex;
+    }
+    heap.live++;
+    return index;
+}
+
+void BindlessHeap::write(BindlessType type, uint32_t index, const vk::DescriptorImageInfo* image,
+    const vk::DescriptorBufferInfo* buffer)
+{
+    if (!pool_ || index == InvalidIndex) {
+        return;
+    }
+    const auto& heap = heaps_[size_t(type)];
+    vk::WriteDescriptorSet write;
+    write.setDstSet(heap.set)
+        .setDstBinding(0)
+        .setDstArrayElement(index)
+        .setDescriptorCount(1)
+        .setDescriptorType(heap.type)
+        .setPImageInfo(image)
+        .setPBufferInfo(buffer);
+    Context::GetInstance().device.updateDescriptorSets(write, {});
+    writes_++;
+}
@@ -0,0 +1,671 @@
+#include "BlockCompressor.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+    // texel values in [0, 255], partial blocks at the image border repeat the edge texels
+    using Block = std::array<glm::vec4, 16>;
+
+    const int BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    void loadBlock(const unsigned char* rgba, uint32_t width, uint32_t height, uint32_t bx, uint32_t by, Block& block)
+    {
+        for (uint32_t y = 0; y < 4; y++)
+        {
+            const uint32_t sy = std::min(by * 4 + y, height - 1);
+            for (uint32_t x = 0; x < 4; x++)
+            {
+                const uint32_t sx = std::min(bx * 4 + x, width - 1);
+                const unsigned char* p = rgba + (size_t(sy) * width + sx) * 4;
+                block[y * 4 + x] = glm::vec4(p[0], p[1], p[2], p[3]);
+            }
+        }
+    }
+
+    struct BitWriter
+    {
+        unsigned char* out;
+        uint32_t position = 0;
+
+        void write(uint32_t value, uint32_t bits)
+        {
+            for (uint32_t i = 0; i < bits; i++, position++)
+            {
+                if ((value >> i) & 1)
+                {
+                    out[position >> 3] |= 1 << (position & 7);
+                }
+            }
+        }
+    };
+
+    struct BitReader
+    {
+        const unsigned char* in;
+        uint32_t position = 0;
+
+        uint32_t read(uint32_t bits)
+        {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < bits; i++, position++)
+            {
+                value |= ((in[position >> 3] >> (position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    float distance2(const glm::vec4& a, const glm::vec4& b)
+    {
+        const glm::vec4 d = a - b;
+        return glm::dot(d, d);
+    }
+
+    // principal axis of the block by power iteration on the covariance, mask selects the channels
+    void fitLine(const Block& block, const glm::vec4& mask, glm::vec4& low, glm::vec4& high)
+    {
+        glm::vec4 mean(0.0f);
+        for (const auto& texel : block)
+        {
+            mean += texel * mask;
+        }
+        mean /= 16.0f;
+
+        glm::mat4 covariance(0.0f);
+        for (const auto& texel : block)
+        {
+            const glm::vec4 d = (texel * mask) - mean;
+            covariance += glm::outerProduct(d, d);
+        }
+        // start from the covariance column of the channel that varies most
+        int widest = 0;
+        for (int c = 1; c < 4; c++)
+        {
+            widest = covariance[c][c] > covariance[widest][widest] ? c : widest;
+        }
+        glm::vec4 axis = covariance[widest];
+        for (int i = 0; i < 8; i++)
+        {
+            axis = covariance * axis;
+            const float length = glm::length(axis);
+            if (length < 1e-6f)
+            {
+                low = high = mean;
+                return;
+            }
+            axis /= length;
+        }
+
+        float tMin = std::numeric_limits<float>::max();
+        float tMax = std::numeric_limits<float>::lowest();
+        for (const auto& texel : block)
+        {
+            const float t = glm::dot((texel * mask) - mean, axis);
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        low = glm::clamp(mean + axis * tMin, 0.0f, 255.0f);
+        high = glm::clamp(mean + axis * tMax, 0.0f, 255.0f);
+    }
+
+    // least squares endpoints for fixed indices, weight is the contribution of the second endpoint
+    bool refitLine(const Block& block, const float* weights, const glm::vec4& mask, glm::vec4& first, glm::vec4& second)
+    {
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+        glm::vec4 ax(0.0f), bx(0.0f);
+        for (int i = 0; i < 16; i++)
+        {
+            const float b = weights[i];
+            const float a = 1.0f - b;
+            aa += a * a;
+            bb += b * b;
+            ab += a * b;
+            ax += block[i] * mask * a;
+            bx += block[i] * mask * b;
+        }
+        const float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1e-6f)
+        {
+            return false;
+        }
+        first = glm::clamp((ax * bb - bx * ab) / det, 0.0f, 255.0f);
+        second = glm::clamp((bx * aa - ax * ab) / det, 0.0f, 255.0f);
+        return true;
+    }
+
+    uint16_t packRGB565(const glm::vec4& c)
+    {
+        const uint32_t r = static_cast<uint32_t>(std::round(c.r * 31.0f / 255.0f));
+        const uint32_t g = static_cast<uint32_t>(std::round(c.g * 63.0f / 255.0f));
+        const uint32_t b = static_cast<uint32_t>(std::round(c.b * 31.0f / 255.0f));
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    glm::vec4 unpackRGB565(uint16_t v)
+    {
+        const uint32_t r = (v >> 11) & 31;
+        const uint32_t g = (v >> 5) & 63;
+        const uint32_t b = v & 31;
+        return glm::vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255.0f);
+    }
+
+    void bc1Palette(uint16_t c0, uint16_t c1, glm::vec4 palette[4])
+    {
+        palette[0] = unpackRGB565(c0);
+        palette[1] = unpackRGB565(c1);
+        if (c0 > c1)
+        {
+            palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+            palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+        }
+        else
+        {
+            palette[2] = (palette[0] + palette[1]) * 0.5f;
+            palette[3] = glm::vec4(0.0f, 0.0f, 0.0f, 255.0f);
+        }
+    }
+
+    void encodeBC1(const Block& block, unsigned char* out)
+    {
+        const glm::vec4 mask(1.0f, 1.0f, 1.0f, 0.0f);
+        const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        glm::vec4 low, high;
+        fitLine(block, mask, low, high);
+
+        uint16_t best0 = 0, best1 = 0;
+        uint32_t bestIndices = 0;
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 3; iteration++)
+        {
+            uint16_t c0 = packRGB565(high);
+            uint16_t c1 = packRGB565(low);
+            // the four color mode needs c0 > c1
+            if (c0 < c1)
+            {
+                std::swap(c0, c1);
+            }
+            glm::vec4 palette[4];
+            bc1Palette(c0, c1, palette);
+            uint32_t indices = 0;
+            float error = 0.0f;
+            float texelWeights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                uint32_t index = 0;
+                float nearest = std::numeric_limits<float>::max();
+                for (uint32_t p = 0; p < (c0 == c1 ? 1u : 4u); p++)
+                {
+                    const float d = distance2(block[i] * mask, palette[p] * mask);
+                    if (d < nearest)
+                    {
+                        nearest = d;
+                        index = p;
+                    }
+                }
+                indices |= index << (i * 2);
+                texelWeights[i] = weights[index];
+                error += nearest;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best0 = c0;
+                best1 = c1;
+                bestIndices = indices;
+            }
+            if (c0 == c1 || !refitLine(block, texelWeights, mask, high, low))
+            {
+                break;
+            }
+        }
+        std::memcpy(out, &best0, 2);
+        std::memcpy(out + 2, &best1, 2);
+        std::memcpy(out + 4, &bestIndices, 4);
+    }
+
+    void bc4Palette(uint8_t r0, uint8_t r1, float palette[8])
+    {
+        palette[0] = r0;
+        palette[1] = r1;
+        if (r0 > r1)
+        {
+            for (int k = 2; k < 8; k++)
+            {
+                palette[k] = ((8 - k) * r0 + (k - 1) * r1) / 7.0f;
+            }
+        }
+        else
+        {
+            for (int k = 2; k < 6; k++)
+            {
+                palette[k] = ((6 - k) * r0 + (k - 1) * r1) / 5.0f;
+            }
+            palette[6] = 0.0f;
+            palette[7] = 255.0f;
+        }
+    }
+
+    void encodeBC4(const float values[16], unsigned char* out)
+    {
+        float low = 255.0f, high = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            low = std::min(low, values[i]);
+            high = std::max(high, values[i]);
+        }
+
+        uint64_t bestBits = 0;
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            const uint8_t r0 = static_cast<uint8_t>(std::round(high));
+            const uint8_t r1 = static_cast<uint8_t>(std::round(low));
+            // equal endpoints fall into the six value mode, index 0 is still r0
+            float palette[8];
+            bc4Palette(r0, r1, palette);
+            uint64_t bits = uint64_t(r0) | (uint64_t(r1) << 8);
+            float error = 0.0f;
+            float a2 = 0.0f, b2 = 0.0f, ab = 0.0f, ax = 0.0f, bx = 0.0f;
+            for (int i = 0; i < 16; i++)
+            {
+                uint64_t index = 0;
+                float nearest = std::numeric_limits<float>::max();
+                for (uint64_t p = 0; p < (r0 == r1 ? 1u : 8u); p++)
+                {
+                    const float d = (values[i] - palette[p]) * (values[i] - palette[p]);
+                    if (d < nearest)
+                    {
+                        nearest = d;
+                        index = p;
+                    }
+                }
+                bits |= index << (16 + i * 3);
+                error += nearest;
+
+                const float b = index == 0 ? 0.0f : index == 1 ? 1.0f : (index - 1) / 7.0f;
+                const float a = 1.0f - b;
+                a2 += a * a;
+                b2 += b * b;
+                ab += a * b;
+                ax += a * values[i];
+                bx += b * values[i];
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                bestBits = bits;
+            }
+            const float det = a2 * b2 - ab * ab;
+            if (r0 == r1 || std::abs(det) < 1e-6f)
+            {
+                break;
+            }
+            const float refitHigh = std::clamp((ax * b2 - bx * ab) / det, 0.0f, 255.0f);
+            const float refitLow = std::clamp((bx * a2 - ax * ab) / det, 0.0f, 255.0f);
+            if (std::round(refitHigh) <= std::round(refitLow))
+            {
+                break;
+            }
+            high = refitHigh;
+            low = refitLow;
+        }
+        std::memcpy(out, &bestBits, 8);
+    }
+
+    // mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each and 4 bit indices
+    void encodeBC7(const Block& block, unsigned char* out)
+    {
+        const glm::vec4 mask(1.0f);
+        glm::vec4 low, high;
+        fitLine(block, mask, low, high);
+
+        glm::ivec4 bestQ0(0), bestQ1(0);
+        int bestP0 = 0, bestP1 = 0;
+        int bestIndices[16] = {};
+        float bestError = std::numeric_limits<float>::max();
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            for (int pbits = 0; pbits < 4; pbits++)
+            {
+                const int p0 = pbits & 1;
+                const int p1 = pbits >> 1;
+                const glm::ivec4 q0 = glm::clamp(glm::ivec4(glm::round((low - float(p0)) * 0.5f)), 0, 127);
+                const glm::ivec4 q1 = glm::clamp(glm::ivec4(glm::round((high - float(p1)) * 0.5f)), 0, 127);
+                const glm::ivec4 e0 = q0 * 2 + p0;
+                const glm::ivec4 e1 = q1 * 2 + p1;
+                glm::vec4 palette[16];
+                for (int k = 0; k < 16; k++)
+                {
+                    palette[k] = glm::vec4((e0 * (64 - BC7Weights[k]) + e1 * BC7Weights[k] + 32) >> 6);
+                }
+                // the projection onto the endpoint line picks the index, its neighbours absorb the rounding
+                const glm::vec4 direction = palette[15] - palette[0];
+                const float scale = glm::dot(direction, direction) > 0.0f ? 15.0f / glm::dot(direction, direction) : 0.0f;
+                int indices[16];
+                float error = 0.0f;
+                for (int i = 0; i < 16 && error < bestError; i++)
+                {
+                    const int guess = std::clamp(int(std::round(glm::dot(block[i] - palette[0], direction) * scale)), 0, 15);
+                    float nearest = std::numeric_limits<float>::max();
+                    for (int k = std::max(guess - 1, 0); k <= std::min(guess + 1, 15); k++)
+                    {
+                        const float d = distance2(block[i], palette[k]);
+                        if (d < nearest)
+                        {
+                            nearest = d;
+                            indices[i] = k;
+                        }
+                    }
+                    error += nearest;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestQ0 = q0;
+                    bestQ1 = q1;
+                    bestP0 = p0;
+                    bestP1 = p1;
+                    std::memcpy(bestIndices, indices, sizeof(indices));
+                }
+            }
+            float texelWeights[16];
+            for (int i = 0; i < 16; i++)
+            {
+                texelWeights[i] = BC7Weights[bestIndices[i]] / 64.0f;
+            }
+            if (bestError == 0.0f || !refitLine(block, texelWeights, mask, low, high))
+            {
+                break;
+            }
+        }
+
+        // the anchor index drops its top bit, so it has to be below 8
+        if (bestIndices[0] >= 8)
+        {
+            std::swap(bestQ0, bestQ1);
+            std::swap(bestP0, bestP1);
+            for (int& index : bestIndices)
+            {
+                index = 15 - index;
+            }
+        }
+        std::memset(out, 0, 16);
+        BitWriter writer{ out };
+        writer.write(1 << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            writer.write(bestQ0[c], 7);
+            writer.write(bestQ1[c], 7);
+        }
+        writer.write(bestP0, 1);
+        writer.write(bestP1, 1);
+        writer.write(bestIndices[0], 3);
+        for (int i = 1; i < 16; i++)
+        {
+            writer.write(bestIndices[i], 4);
+        }
+    }
+
+    void decodeBC1(const unsigned char* in, glm::vec4 texels[16])
+    {
+        uint16_t c0, c1;
+        uint32_t indices;
+        std::memcpy(&c0, in, 2);
+        std::memcpy(&c1, in + 2, 2);
+        std::memcpy(&indices, in + 4, 4);
+        glm::vec4 palette[4];
+        bc1Palette(c0, c1, palette);
+        for (int i = 0; i < 16; i++)
+        {
+            texels[i] = palette[(indices >> (i * 2)) & 3];
+        }
+    }
+
+    void decodeBC4(const unsigned char* in, float values[16])
+    {
+        uint64_t bits;
+        std::memcpy(&bits, in, 8);
+        float palette[8];
+        bc4Palette(static_cast<uint8_t>(bits & 0xff), static_cast<uint8_t>((bits >> 8) & 0xff), palette);
+        for (int i = 0; i < 16; i++)
+        {
+            values[i] = palette[(bits >> (16 + i * 3)) & 7];
+        }
+    }
+
+    void decodeBC7(const unsigned char* in, glm::vec4 texels[16])
+    {
+        if ((in[0] & 0x7f) != 0x40)
+        {
+            std::fill(texels, texels + 16, glm::vec4(0.0f));
+            return;
+        }
+        BitReader reader{ in, 7 };
+        glm::ivec4 q0, q1;
+        for (int c = 0; c < 4; c++)
+        {
+            q0[c] = reader.read(7);
+            q1[c] = reader.read(7);
+        }
+        const glm::ivec4 e0 = q0 * 2 + int(reader.read(1));
+        const glm::ivec4 e1 = q1 * 2 + int(reader.read(1));
+        for (int i = 0; i < 16; i++)
+        {
+            const int w = BC7Weights[reader.read(i == 0 ? 3 : 4)];
+            texels[i] = glm::vec4((e0 * (64 - w) + e1 * w + 32) >> 6);
+        }
+    }
+
+    template <typename Fn>
+    void parallelRows(uint32_t rows, Fn&& fn)
+    {
+        std::vector<uint32_t> indices(rows);
+        std::iota(indices.begin(), indices.end(), 0u);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), fn);
+    }
+}
+
+vk::Format BlockCompressor::chooseFormat(const unsigned char* rgba, uint32_t width, uint32_t height, TextureKind kind,
+    bool srgb, BlockCompression mode)
+{
+    if (mode == BlockCompression::None)
+    {
+        return vk::Format::eUndefined;
+    }
+    if (kind == TextureKind::Normal)
+    {
+        return vk::Format::eBc5UnormBlock;
+    }
+    bool opaque = true;
+    bool grey = true;
+    for (size_t i = 0, count = size_t(width) * height; i < count && (opaque || grey); i++)
+    {
+        const unsigned char* p = rgba + i * 4;
+        opaque = opaque && p[3] == 255;
+        grey = grey && p[0] == p[1] && p[1] == p[2];
+    }
+    // BC4 has no sRGB variant
+    if (opaque && grey && !srgb)
+    {
+        return vk::Format::eBc4UnormBlock;
+    }
+    if (opaque && mode == BlockCompression::BC1)
+    {
+        return srgb ? vk::Format::eBc1RgbSrgbBlock : vk::Format::eBc1RgbUnormBlock;
+    }
+    return srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+}
+
+bool BlockCompressor::isBlockCompressed(vk::Format format)
+{
+    return blockBytes(format) != 0;
+}
+
+uint32_t BlockCompressor::blockBytes(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eBc1RgbUnormBlock:
+    case vk::Format::eBc1RgbSrgbBlock:
+    case vk::Format::eBc4UnormBlock:
+        return 8;
+    case vk::Format::eBc5UnormBlock:
+    case vk::Format::eBc7UnormBlock:
+    case vk::Format::eBc7SrgbBlock:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+size_t BlockCompressor::levelSize(vk::Format format, uint32_t width, uint32_t height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+vk::ComponentMapping BlockCompressor::components(vk::Format format)
+{
+    if (format == vk::Format::eBc4UnormBlock)
+    {
+        return vk::ComponentMapping(vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eR,
+            vk::ComponentSwizzle::eOne);
+    }
+    return vk::ComponentMapping();
+}
+
+void BlockCompressor::encode(const unsigned char* rgba, uint32_t width, uint32_t height, vk::Format format, unsigned char* out)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const uint32_t size = blockBytes(format);
+    parallelRows(blocksY, [&](uint32_t by) {
+        Block block;
+        float channel[2][16];
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            unsigned char* dst = out + (size_t(by) * blocksX + bx) * size;
+            loadBlock(rgba, width, height, bx, by, block);
+            switch (format)
+            {
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+                encodeBC1(block, dst);
+                break;
+            case vk::Format::eBc4UnormBlock:
+            case vk::Format::eBc5UnormBlock:
+                for (int i = 0; i < 16; i++)
+                {
+                    channel[0][i] = block[i].r;
+                    channel[1][i] = block[i].g;
+                }
+                encodeBC4(channel[0], dst);
+                if (format == vk::Format::eBc5UnormBlock)
+                {
+                    encodeBC4(channel[1], dst + 8);
+                }
+                break;
+            case vk::Format::eBc7UnormBlock:
+            case vk::Format::eBc7SrgbBlock:
+                encodeBC7(block, dst);
+                break;
+            default:
+                break;
+            }
+        }
+        });
+}
+
+void BlockCompressor::decode(const unsigned char* blocks, uint32_t width, uint32_t height, vk::Format format, unsigned char* rgba)
+{
+    const uint32_t blocksX = (width + 3) / 4;
+    const uint32_t blocksY = (height + 3) / 4;
+    const uint32_t size = blockBytes(format);
+    parallelRows(blocksY, [&](uint32_t by) {
+        glm::vec4 texels[16];
+        float channel[2][16];
+        for (uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            const unsigned char* src = blocks + (size_t(by) * blocksX + bx) * size;
+            switch (format)
+            {
+            case vk::Format::eBc1RgbUnormBlock:
+            case vk::Format::eBc1RgbSrgbBlock:
+                decodeBC1(src, texels);
+                break;
+            case vk::Format::eBc4UnormBlock:
+            case vk::Format::eBc5UnormBlock:
+                decodeBC4(src, channel[0]);
+                if (format == vk::Format::eBc5UnormBlock)
+                {
+                    decodeBC4(src + 8, channel[1]);
+                }
+                for (int i = 0; i < 16; i++)
+                {
+                    texels[i] = format == vk::Format::eBc4UnormBlock ?
+                        glm::vec4(channel[0][i], channel[0][i], channel[0][i], 255.0f) :
+                        glm::vec4(channel[0][i], channel[1][i], 0.0f, 255.0f);
+                }
+                break;
+            case vk::Format::eBc7UnormBlock:
+            case vk::Format::eBc7SrgbBlock:
+                decodeBC7(src, texels);
+                break;
+            default:
+                std::fill(texels, texels + 16, glm::vec4(0.0f));
+                break;
+            }
+            for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++)
+            {
+                for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++)
+                {
+                    const glm::vec4 c = glm::round(texels[y * 4 + x]);
+                    unsigned char* p = rgba + (size_t(by * 4 + y) * width + bx * 4 + x) * 4;
+                    for (int i = 0; i < 4; i++)
+                    {
+                        p[i] = static_cast<unsigned char>(c[i]);
+                    }
+                }
+            }
+        }
+        });
+}
+
+double BlockCompressor::psnr(const unsigned char* rgba, uint32_t width, uint32_t height, vk::Format format, const unsigned char* blocks)
+{
+    std::vector<unsigned char> decoded(size_t(width) * height * 4);
+    decode(blocks, width, height, format, decoded.data());
+
+    int channels = 4;
+    if (format == vk::Format::eBc4UnormBlock)
+    {
+        channels = 1;
+    }
+    else if (format == vk::Format::eBc5UnormBlock)
+    {
+        channels = 2;
+    }
+    else if (format == vk::Format::eBc1RgbUnormBlock || format == vk::Format::eBc1RgbSrgbBlock)
+    {
+        channels = 3;
+    }
+    double sum = 0.0;
+    for (size_t i = 0, count = size_t(width) * height; i < count; i++)
+    {
+        for (int c = 0; c < channels; c++)
+        {
+            const double d = double(rgba[i * 4 + c]) - double(decoded[i * 4 + c]);
+            sum += d * d;
+        }
+    }
+    const double mse = sum / (double(width) * height * channels);
+    return mse == 0.0 ? std::numeric_limits<double>::infinity() : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
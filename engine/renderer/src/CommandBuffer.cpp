@@ -1,6 +1,7 @@
 #include "CommandBuffer.h"
 
 #include "Context.h"
+#include "StagingRing.h"
 
 std::vector<vk::CommandBuffer> CommandManager::Allocate(vk::CommandPool& pool, int count, bool is_primary)
 {
@@ -60,6 +61,8 @@ vk::CommandBuffer CommandManager::BeginSingle(vk::CommandPool& pool)
 void CommandManager::EndSingle(vk::CommandPool& pool, vk::CommandBuffer& buffer, vk::Queue& queue)
 {
 	End(buffer);
+	// the work may read buffers with uploads still queued
+	StagingRing::Instance().Submit();
 	vk::SubmitInfo submitInfo;
 	submitInfo.setCommandBuffers(buffer);
 	queue.submit(submitInfo);
@@ -186,6 +186,16 @@ void Context::selectPhysicalDevice()
 void Context::queryQueueFamily(vk::PhysicalDevice physicalDevice)
 {
 	auto queueFamilyProperties = physicalDevice.getQueueFamilyProperties();
+	// a family that can only transfer is usually a copy engine that runs next to the graphics queue
+	for (uint32_t i = 0; i < queueFamilyProperties.size(); ++i)
+	{
+		const auto flags = queueFamilyProperties[i].queueFlags;
+		if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)))
+		{
+			queueFamileInfo.transferFamilyIndex = i;
+			break;
+		}
+	}
 	for (uint32_t i = 0; i < queueFamilyProperties.size(); ++i)
 	{
 		if (!queueFamileInfo.graphicsFamilyIndex.has_value() && queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics)
@@ -217,7 +227,9 @@ void Context::createDevice() {
 	features.setSamplerAnisotropy(true)
 		.setFillModeNonSolid(true)
 		.setDrawIndirectFirstInstance(true)
-		.setMultiDrawIndirect(true);
+		.setMultiDrawIndirect(true)
+		.setTextureCompressionBC(physicaldevice.getFeatures().textureCompressionBC)
+		.setFragmentStoresAndAtomics(physicaldevice.getFeatures().fragmentStoresAndAtomics);
 	std::unordered_set<uint32_t> uniqueIndex;
 	bool shared[3] = { 0,0,0 };
 	uniqueIndex.insert(queueFamileInfo.graphicsFamilyIndex.value());
@@ -236,28 +248,33 @@ void Context::createDevice() {
 	else
 		uniqueIndex.insert(queueFamileInfo.transferFamilyIndex.value());
 	std::vector<vk::DeviceQueueCreateInfo> queueCIs;
-	float priorities = 1.0f;
+	const float priorities[] = { 1.0f, 1.0f };
+	// UploadEngine submits to the transfer queue from its own thread, without a family of its own it gets a
+	// second queue of the graphics family when there is one
+	const bool transferShared = queueFamileInfo.transferFamilyIndex.value() == queueFamileInfo.graphicsFamilyIndex.value();
+	const uint32_t graphicsQueues = transferShared &&
+		physicaldevice.getQueueFamilyProperties()[queueFamileInfo.graphicsFamilyIndex.value()].queueCount > 1 ? 2 : 1;
 	vk::DeviceQueueCreateInfo queueCI;
-	queueCI.setPQueuePriorities(&priorities)
-		.setQueueCount(1)
+	queueCI.setPQueuePriorities(priorities)
+		.setQueueCount(graphicsQueues)
 		.setQueueFamilyIndex(queueFamileInfo.graphicsFamilyIndex.value());
 	queueCIs.emplace_back(queueCI);
 	if (!shared[0])
 	{
-		queueCI.setPQueuePriorities(&priorities)
+		queueCI.setPQueuePriorities(priorities)
 			.setQueueCount(1)
 			.setQueueFamilyIndex(queueFamileInfo.presentFamilyIndex.value());
 		queueCIs.emplace_back(queueCI);
 	}if (!shared[1])
 	{
-		queueCI.setPQueuePriorities(&priorities)
+		queueCI.setPQueuePriorities(priorities)
 			.setQueueCount(1)
 			.setQueueFamilyIndex(queueFamileInfo.computeFamilyIndex.value());
 		queueCIs.emplace_back(queueCI);
 	}
 	if (!shared[2])
 	{
-		queueCI.setPQueuePriorities(&priorities)
+		queueCI.setPQueuePriorities(priorities)
 			.setQueueCount(1)
 			.setQueueFamilyIndex(queueFamileInfo.transferFamilyIndex.value());
 		queueCIs.emplace_back(queueCI);
@@ -279,6 +296,7 @@ void Context::createDevice() {
 		.setRuntimeDescriptorArray(true)
 		.setBufferDeviceAddress(true)
 		.setBufferDeviceAddressCaptureReplay(true)
+		.setTimelineSemaphore(true)
 		.setPNext(&shaderDrawParametersFeatures);
 	vk::PhysicalDeviceFeatures2 features2;
 	features2.setPNext(&vulkan12Features)
@@ -293,7 +311,7 @@ void Context::createDevice() {
 	graphicsQueue = device.getQueue(queueFamileInfo.graphicsFamilyIndex.value(), 0);
 	presentQueue = device.getQueue(queueFamileInfo.presentFamilyIndex.value(), 0);
 	computeQueue = device.getQueue(queueFamileInfo.computeFamilyIndex.value(), 0);
-	transferQueue = device.getQueue(queueFamileInfo.transferFamilyIndex.value(), 0);
+	transferQueue = device.getQueue(queueFamileInfo.transferFamilyIndex.value(), graphicsQueues - 1);
 }
 
 void Context::destroyDevice()
@@ -0,0 +1,105 @@
+#include "DeletionQueue.h"
+#include "Texture.h"
+#include "Buffer.h"
+#include "Context.h"
+
+std::unique_ptr<DeletionQueue> DeletionQueue::instance_ = nullptr;
+
+void DeletionQueue::Init(uint32_t framesInFlight)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frames_.resize(framesInFlight);
+    frame_ = 0;
+}
+
+void DeletionQueue::Quit()
+{
+    Context::GetInstance().device.waitIdle();
+    std::vector<std::vector<std::function<void()>>> frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames.swap(frames_);
+    }
+    for (auto& frame : frames) {
+        for (auto& destroy : frame) {
+            destroy();
+        }
+        destroyed_ += frame.size();
+    }
+}
+
+void DeletionQueue::Retire(std::shared_ptr<Texture> texture)
+{
+    if (texture) {
+        push([texture]() mutable { texture.reset(); });
+    }
+}
+
+void DeletionQueue::Retire(std::shared_ptr<Buffer> buffer)
+{
+    if (buffer) {
+        push([buffer]() mutable { buffer.reset(); });
+    }
+}
+
+void DeletionQueue::Retire(vk::ImageView view)
+{
+    if (view) {
+        push([view]() { Context::GetInstance().device.destroyImageView(view); });
+    }
+}
+
+void DeletionQueue::Retire(vk::Framebuffer framebuffer)
+{
+    if (framebuffer) {
+        push([framebuffer]() { Context::GetInstance().device.destroyFramebuffer(framebuffer); });
+    }
+}
+
+void DeletionQueue::Retire(vk::Pipeline pipeline)
+{
+    if (pipeline) {
+        push([pipeline]() { Context::GetInstance().device.destroyPipeline(pipeline); });
+    }
+}
+
+void DeletionQueue::BeginFrame()
+{
+    std::vector<std::function<void()>> expired;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (frames_.empty()) {
+            return;
+        }
+        frame_++;
+        expired.swap(frames_[frame_ % frames_.size()]);
+    }
+    // outside the lock, a destructor may retire what it owns
+    for (auto& destroy : expired) {
+        destroy();
+    }
+    destroyed_ += expired.size();
+}
+
+size_t DeletionQueue::Pending()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t pending = 0;
+    for (const auto& frame : frames_) {
+        pending += frame.size();
+    }
+    return pending;
+}
+
+void DeletionQueue::push(std::function<void()> destroy)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!frames_.empty()) {
+            frames_[frame_ % frames_.size()].push_back(std::move(destroy));
+            return;
+        }
+    }
+    destroy();
+    destroyed_++;
+}
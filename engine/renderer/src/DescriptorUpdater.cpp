@@ -0,0 +1,308 @@
+#include "DescriptorUpdater.h"
+#include "Context.h"
+#include "Texture.h"
+#include "Sampler.h"
+#include "Buffer.h"
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <list>
+
+std::unique_ptr<DescriptorUpdater> DescriptorUpdater::instance_ = nullptr;
+
+void DescriptorUpdater::Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+    std::span<const vk::DescriptorImageInfo> images)
+{
+    if (images.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    writes_.push_back({ set, binding, arrayElement, static_cast<uint32_t>(images.size()), type, Kind::Image, images_.size() });
+    images_.insert(images_.end(), images.begin(), images.end());
+}
+
+void DescriptorUpdater::Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+    std::span<const vk::DescriptorBufferInfo> buffers)
+{
+    if (buffers.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    writes_.push_back({ set, binding, arrayElement, static_cast<uint32_t>(buffers.size()), type, Kind::Buffer, buffers_.size() });
+    buffers_.insert(buffers_.end(), buffers.begin(), buffers.end());
+}
+
+void DescriptorUpdater::Write(vk::DescriptorSet set, uint32_t binding, uint32_t arrayElement, vk::DescriptorType type,
+    std::span<const vk::BufferView> views)
+{
+    if (views.empty()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    writes_.push_back({ set, binding, arrayElement, static_cast<uint32_t>(views.size()), type, Kind::TexelBuffer, views_.size() });
+    views_.insert(views_.end(), views.begin(), views.end());
+}
+
+void DescriptorUpdater::Write(vk::DescriptorSet set, uint32_t binding, const vk::AccelerationStructureKHR& accelerationStructure)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    writes_.push_back({ set, binding, 0, 1, vk::DescriptorType::eAccelerationStructureKHR, Kind::AccelerationStructure,
+        accelerationStructures_.size() });
+    accelerationStructures_.push_back(accelerationStructure);
+}
+
+void DescriptorUpdater::Write(vk::DescriptorSet set, vk::DescriptorUpdateTemplate updateTemplate, const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    // the entries hold handles, keep every block aligned for them
+    const size_t offset = (templateData_.size() + 7) & ~size_t(7);
+    templateData_.resize(offset + size);
+    std::memcpy(templateData_.data() + offset, data, size);
+    templates_.push_back({ set, updateTemplate, offset });
+}
+
+bool DescriptorUpdater::Pending()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !writes_.empty() || !templates_.empty();
+}
+
+void DescriptorUpdater::Flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush();
+}
+
+void DescriptorUpdater::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush();
+    stats_.frames++;
+    stats_.lastFrameMicroseconds = frameMicroseconds_;
+    frameMicroseconds_ = 0.0;
+}
+
+void DescriptorUpdater::Quit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    flush();
+    DEMO_LOG(Info, std::format("Descriptor updater: {} writes of {} descriptors and {} template updates in {} updates over {} frames, {:.2f} ms",
+        stats_.writes, stats_.descriptors, stats_.templateUpdates, stats_.flushes, stats_.frames, stats_.milliseconds));
+    images_ = {};
+    buffers_ = {};
+    views_ = {};
+    accelerationStructures_ = {};
+    writes_ = {};
+    templateData_ = {};
+    templates_ = {};
+    vkWrites_ = {};
+    vkAccelerationWrites_ = {};
+}
+
+DescriptorUpdater::Stats DescriptorUpdater::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void DescriptorUpdater::flush()
+{
+    if (writes_.empty() && templates_.empty()) {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    // the arrays are complete now, so the pointers into them stay valid through the update
+    vkWrites_.clear();
+    vkAccelerationWrites_.clear();
+    vkAccelerationWrites_.reserve(accelerationStructures_.size());
+    for (const auto& write : writes_) {
+        vk::WriteDescriptorSet vkWrite;
+        vkWrite.setDstSet(write.set)
+            .setDstBinding(write.binding)
+            .setDstArrayElement(write.arrayElement)
+            .setDescriptorCount(write.count)
+            .setDescriptorType(write.type);
+        switch (write.kind) {
+        case Kind::Image:
+            vkWrite.setPImageInfo(images_.data() + write.first);
+            break;
+        case Kind::Buffer:
+            vkWrite.setPBufferInfo(buffers_.data() + write.first);
+            break;
+        case Kind::TexelBuffer:
+            vkWrite.setPTexelBufferView(views_.data() + write.first);
+            break;
+        case Kind::AccelerationStructure:
+            vkAccelerationWrites_.emplace_back();
+            vkAccelerationWrites_.back().setAccelerationStructureCount(write.count)
+                .setPAccelerationStructures(accelerationStructures_.data() + write.first);
+            vkWrite.setPNext(&vkAccelerationWrites_.back());
+            break;
+        }
+        vkWrites_.push_back(vkWrite);
+        stats_.descriptors += write.count;
+    }
+
+    auto device = Context::GetInstance().device;
+    if (!vkWrites_.empty()) {
+        device.updateDescriptorSets(vkWrites_, {});
+        stats_.flushes++;
+    }
+    for (const auto& update : templates_) {
+        device.updateDescriptorSetWithTemplate(update.set, update.updateTemplate, templateData_.data() + update.offset);
+    }
+    stats_.writes += writes_.size();
+    stats_.templateUpdates += templates_.size();
+
+    images_.clear();
+    buffers_.clear();
+    views_.clear();
+    accelerationStructures_.clear();
+    writes_.clear();
+    templateData_.clear();
+    templates_.clear();
+
+    const double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    stats_.milliseconds += microseconds / 1000.0;
+    frameMicroseconds_ += microseconds;
+}
+
+void DescriptorUpdater::benchmark(uint32_t frames)
+{
+    using clock = std::chrono::steady_clock;
+    // about what the deferred path rebinds: a set per pass, each with its inputs and a couple of uniform blocks
+    constexpr uint32_t SetCount = 16;
+    constexpr uint32_t ImageBindings = 6;
+    constexpr uint32_t BufferBindings = 2;
+
+    auto device = Context::GetInstance().device;
+    auto texture = TextureManager::Instance().Create(4, 4, vk::Format::eR8G8B8A8Unorm, vk::ImageUsageFlagBits::eSampled);
+    Sampler sampler(vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerAddressMode::eClampToEdge,
+        vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge, 1.0f);
+    Buffer buffer(256, vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible |
+        vk::MemoryPropertyFlagBits::eHostCoherent);
+
+    std::array<vk::DescriptorSetLayoutBinding, ImageBindings + BufferBindings> bindings;
+    for (uint32_t i = 0; i < bindings.size(); i++) {
+        bindings[i].setBinding(i)
+            .setDescriptorCount(1)
+            .setDescriptorType(i < ImageBindings ? vk::DescriptorType::eCombinedImageSampler : vk::DescriptorType::eUniformBuffer)
+            .setStageFlags(vk::ShaderStageFlagBits::eAll);
+    }
+    vk::DescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.setBindings(bindings);
+    auto layout = device.createDescriptorSetLayout(layoutInfo);
+
+    const std::array<vk::DescriptorPoolSize, 2> poolSizes = { {
+        { vk::DescriptorType::eCombinedImageSampler, SetCount * ImageBindings },
+        { vk::DescriptorType::eUniformBuffer, SetCount * BufferBindings },
+    } };
+    vk::DescriptorPoolCreateInfo poolInfo;
+    poolInfo.setMaxSets(SetCount)
+        .setPoolSizes(poolSizes);
+    auto pool = device.createDescriptorPool(poolInfo);
+    const std::vector<vk::DescriptorSetLayout> layouts(SetCount, layout);
+    vk::DescriptorSetAllocateInfo allocateInfo;
+    allocateInfo.setDescriptorPool(pool)
+        .setSetLayouts(layouts);
+    const auto sets = device.allocateDescriptorSets(allocateInfo);
+
+    // the layout Pipeline builds its templates with, one entry per binding packed one after another
+    struct SetData
+    {
+        vk::DescriptorImageInfo images[ImageBindings];
+        vk::DescriptorBufferInfo buffers[BufferBindings];
+    };
+    std::array<vk::DescriptorUpdateTemplateEntry, ImageBindings + BufferBindings> entries;
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        const bool image = i < ImageBindings;
+        entries[i].setDstBinding(i)
+            .setDescriptorCount(1)
+            .setDescriptorType(bindings[i].descriptorType)
+            .setOffset(image ? offsetof(SetData, images) + i * sizeof(vk::DescriptorImageInfo) :
+                offsetof(SetData, buffers) + (i - ImageBindings) * sizeof(vk::DescriptorBufferInfo))
+            .setStride(image ? sizeof(vk::DescriptorImageInfo) : sizeof(vk::DescriptorBufferInfo));
+    }
+    vk::DescriptorUpdateTemplateCreateInfo templateInfo;
+    templateInfo.setDescriptorUpdateEntries(entries)
+        .setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+        .setDescriptorSetLayout(layout);
+    auto updateTemplate = device.createDescriptorUpdateTemplate(templateInfo);
+
+    const vk::DescriptorImageInfo imageInfo(sampler.vkSampler(), texture->view, vk::ImageLayout::eShaderReadOnlyOptimal);
+    const vk::DescriptorBufferInfo bufferInfo(buffer.buffer, 0, 256);
+
+    // how Pipeline wrote them before: a list node and vector per binding, and an update per pipeline when it was bound
+    double legacy = 0.0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        const auto start = clock::now();
+        for (const auto& set : sets) {
+            std::list<std::vector<vk::DescriptorImageInfo>> imageInfos;
+            std::list<std::vector<vk::DescriptorBufferInfo>> bufferInfos;
+            std::vector<vk::WriteDescriptorSet> writes;
+            for (uint32_t i = 0; i < bindings.size(); i++) {
+                vk::WriteDescriptorSet write;
+                write.setDstSet(set)
+                    .setDstBinding(i)
+                    .setDescriptorCount(1)
+                    .setDescriptorType(bindings[i].descriptorType);
+                if (i < ImageBindings) {
+                    imageInfos.push_back({ imageInfo });
+                    write.setImageInfo(imageInfos.back());
+                } else {
+                    bufferInfos.push_back({ bufferInfo });
+                    write.setBufferInfo(bufferInfos.back());
+                }
+                writes.push_back(write);
+            }
+            device.updateDescriptorSets(writes, {});
+        }
+        legacy += std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    }
+
+    auto& updater = Instance();
+    updater.Flush();
+    double batched = 0.0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        const auto start = clock::now();
+        for (const auto& set : sets) {
+            for (uint32_t i = 0; i < bindings.size(); i++) {
+                if (i < ImageBindings) {
+                    updater.Write(set, i, 0, bindings[i].descriptorType, std::span(&imageInfo, 1));
+                } else {
+                    updater.Write(set, i, 0, bindings[i].descriptorType, std::span(&bufferInfo, 1));
+                }
+            }
+        }
+        updater.Flush();
+        batched += std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    }
+
+    SetData data;
+    std::fill(std::begin(data.images), std::end(data.images), imageInfo);
+    std::fill(std::begin(data.buffers), std::end(data.buffers), bufferInfo);
+    double templated = 0.0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        const auto start = clock::now();
+        for (const auto& set : sets) {
+            updater.Write(set, updateTemplate, &data, sizeof(SetData));
+        }
+        updater.Flush();
+        templated += std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    }
+
+    DEMO_LOG(Info, std::format("Descriptor updates, {} sets of {} descriptors per frame over {} frames: {:.1f} us per frame written "
+        "per pipeline, {:.1f} us batched into one update, {:.1f} us through update templates",
+        SetCount, bindings.size(), frames, legacy / frames, batched / frames, templated / frames));
+
+    device.destroyDescriptorUpdateTemplate(updateTemplate);
+    device.destroyDescriptorPool(pool);
+    device.destroyDescriptorSetLayout(layout);
+    TextureManager::Instance().Destroy(texture);
+}
@@ -0,0 +1,31 @@
+#include "FrameUniforms.h"
+#include "Buffer.h"
+#include "Context.h"
+
+#include <cassert>
+#include <cstring>
+
+FrameUniforms::FrameUniforms(vk::DeviceSize size, uint32_t frames)
+    : size_(size), stride_(aligned(size)), frames_(frames)
+{
+    if (frames_ == 0) {
+        frames_ = Context::GetInstance().swapchain->info.imageCount;
+    }
+    // without resizable BAR device local host visible memory is a small heap, the buffers here are tiny
+    buffer_.reset(new Buffer(stride_ * frames_, vk::BufferUsageFlagBits::eUniformBuffer,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+        vk::MemoryPropertyFlagBits::eDeviceLocal));
+}
+
+vk::DeviceSize FrameUniforms::aligned(vk::DeviceSize size)
+{
+    const vk::DeviceSize alignment =
+        Context::GetInstance().physicaldevice.getProperties().limits.minUniformBufferOffsetAlignment;
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+void FrameUniforms::write(uint32_t frame, const void* data, vk::DeviceSize size, vk::DeviceSize offset)
+{
+    assert(frame < frames_ && offset + size <= size_);
+    std::memcpy(static_cast<char*>(buffer_->mapped) + stride_ * frame + offset, data, size);
+}
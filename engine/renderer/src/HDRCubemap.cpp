@@ -0,0 +1,152 @@
+#include "HDRCubemap.h"
+#include "HDRPack.h"
+#include "MipGenerator.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+namespace
+{
+    constexpr float Pi = 3.14159265358979f;
+
+    template <typename Fn>
+    void parallelRows(uint32_t rows, Fn&& fn)
+    {
+        std::vector<uint32_t> indices(rows);
+        std::iota(indices.begin(), indices.end(), 0u);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), fn);
+    }
+
+    // repeat addressing on both axes like the sampler convert2Cubemap reads the panorama with
+    void sampleBilinear(const float* rgba, uint32_t width, uint32_t height, float u, float v, float* out)
+    {
+        const float x = u * width - 0.5f;
+        const float y = v * height - 0.5f;
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const float tx = x - fx;
+        const float ty = y - fy;
+        auto wrap = [](int i, uint32_t size) {
+            i %= int(size);
+            return uint32_t(i < 0 ? i + int(size) : i);
+            };
+        const uint32_t x0 = wrap(int(fx), width);
+        const uint32_t x1 = wrap(int(fx) + 1, width);
+        const uint32_t y0 = wrap(int(fy), height);
+        const uint32_t y1 = wrap(int(fy) + 1, height);
+        const float* p00 = rgba + (size_t(y0) * width + x0) * 4;
+        const float* p10 = rgba + (size_t(y0) * width + x1) * 4;
+        const float* p01 = rgba + (size_t(y1) * width + x0) * 4;
+        const float* p11 = rgba + (size_t(y1) * width + x1) * 4;
+        for (int c = 0; c < 3; c++)
+        {
+            const float top = p00[c] + (p10[c] - p00[c]) * tx;
+            const float bottom = p01[c] + (p11[c] - p01[c]) * tx;
+            out[c] = top + (bottom - top) * ty;
+        }
+        out[3] = 1.0f;
+    }
+}
+
+bool HDRCubemap::supports(vk::Format format)
+{
+    return texelBytes(format) != 0;
+}
+
+uint32_t HDRCubemap::texelBytes(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eB10G11R11UfloatPack32:
+        return 4;
+    case vk::Format::eR16G16B16A16Sfloat:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+glm::mat4 HDRCubemap::captureView(uint32_t face)
+{
+    // in cube layer order. The panorama is loaded upside down and the capture viewport is flipped, so the
+    // up vectors point down and the +Y layer looks at -Y
+    static const glm::mat4 views[6] =
+    {
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  -1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f,  0.0f), glm::vec3(0.0f,  0.0f, 1.0f)),
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
+        glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
+    };
+    return views[face];
+}
+
+KTX2Image HDRCubemap::build(uint32_t faceSize, vk::Format format, const FaceSource& source)
+{
+    KTX2Image image;
+    image.format = format;
+    image.width = faceSize;
+    image.height = faceSize;
+    image.faces = 6;
+    const uint32_t texel = texelBytes(format);
+
+    // one face at a time, the float chain of a 2048 face alone is 85 MB
+    std::vector<float> texels;
+    std::vector<unsigned char> chain;
+    for (uint32_t face = 0; face < 6; face++)
+    {
+        source(face, texels);
+        const auto mips = MipGenerator::generate(texels.data(), faceSize, faceSize, 16, vk::Format::eR32G32B32A32Sfloat,
+            MipFilter::Box, chain);
+        if (face == 0)
+        {
+            size_t total = 0;
+            for (const auto& mip : mips)
+            {
+                const size_t size = size_t(mip.width) * mip.height * texel * 6;
+                image.levels.push_back({ mip.width, mip.height, total, size });
+                total += size;
+            }
+            image.data.resize(total);
+        }
+        for (size_t i = 0; i < mips.size(); i++)
+        {
+            const float* in = reinterpret_cast<const float*>(chain.data() + mips[i].offset);
+            unsigned char* out = image.data.data() + image.levels[i].offset + image.levels[i].size / 6 * face;
+            HDRPack::pack(in, size_t(mips[i].width) * mips[i].height, format, out);
+        }
+    }
+    return image;
+}
+
+void HDRCubemap::sampleFace(const float* rgba, uint32_t width, uint32_t height, uint32_t face, uint32_t faceSize,
+    std::vector<float>& texels)
+{
+    texels.resize(size_t(faceSize) * faceSize * 4);
+    // a 90 degree square frustum looks down -z in view space, the capture viewport puts +y on the top row
+    const glm::mat3 toWorld = glm::transpose(glm::mat3(captureView(face)));
+    parallelRows(faceSize, [&](uint32_t y) {
+        const float ndcY = 1.0f - 2.0f * (y + 0.5f) / faceSize;
+        float* out = texels.data() + size_t(y) * faceSize * 4;
+        for (uint32_t x = 0; x < faceSize; x++)
+        {
+            const float ndcX = 2.0f * (x + 0.5f) / faceSize - 1.0f;
+            const glm::vec3 dir = glm::normalize(toWorld * glm::vec3(ndcX, ndcY, -1.0f));
+            // the mapping of equirectangular_to_cubemap.frag
+            const float u = std::atan2(dir.z, dir.x) * (0.5f / Pi) + 0.5f;
+            const float v = std::asin(std::clamp(dir.y, -1.0f, 1.0f)) / Pi + 0.5f;
+            sampleBilinear(rgba, width, height, u, v, out + size_t(x) * 4);
+        }
+        });
+}
+
+KTX2Image HDRCubemap::convert(const float* rgba, uint32_t width, uint32_t height, uint32_t faceSize, vk::Format format)
+{
+    return build(faceSize, format, [&](uint32_t face, std::vector<float>& texels) {
+        sampleFace(rgba, width, height, face, faceSize, texels);
+        });
+}
@@ -0,0 +1,418 @@
+#include "HDRPack.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <format>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HDR_PACK_SSE2 1
+#endif
+
+namespace
+{
+    // large enough that scheduling a chunk costs nothing next to packing it
+    constexpr size_t ChunkTexels = 16384;
+    // (2^9 - 1) / 2^9 * 2^16, the largest value E5B9G9R9 holds
+    constexpr float SharedExponentMax = 65408.0f;
+
+    template <typename Fn>
+    void parallelChunks(size_t count, Fn&& fn)
+    {
+        std::vector<size_t> indices((count + ChunkTexels - 1) / ChunkTexels);
+        std::iota(indices.begin(), indices.end(), size_t(0));
+        std::for_each(std::execution::par, indices.begin(), indices.end(), [&](size_t chunk) {
+            const size_t first = chunk * ChunkTexels;
+            fn(first, std::min(ChunkTexels, count - first));
+            });
+    }
+
+    // unsigned float with a 5 bit exponent, rounded to nearest. Negatives and NaN become 0, anything above
+    // the largest finite value is clamped to it
+    uint32_t packUfloat(float value, uint32_t mantissaBits)
+    {
+        if (!(value > 0.0f))
+        {
+            return 0;
+        }
+        uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+        if (bits < (113u << 23))
+        {
+            // denormal, rounding up may give the smallest normal which has the same encoding
+            return static_cast<uint32_t>(value * std::ldexp(1.0f, 14 + int(mantissaBits)) + 0.5f);
+        }
+        // rebiasing exponent and mantissa together lets a mantissa that rounds up carry into the exponent
+        const uint32_t shift = 23 - mantissaBits;
+        const uint32_t packed = ((bits + (1u << (shift - 1))) >> shift) - (112u << mantissaBits);
+        return std::min(packed, (30u << mantissaBits) | ((1u << mantissaBits) - 1));
+    }
+
+    float unpackUfloat(uint32_t bits, uint32_t mantissaBits)
+    {
+        const uint32_t exponent = bits >> mantissaBits;
+        const uint32_t mantissa = bits & ((1u << mantissaBits) - 1);
+        if (exponent == 0)
+        {
+            return std::ldexp(float(mantissa), -14 - int(mantissaBits));
+        }
+        if (exponent == 31)
+        {
+            return mantissa ? std::numeric_limits<float>::quiet_NaN() : std::numeric_limits<float>::infinity();
+        }
+        return std::ldexp(1.0f + float(mantissa) / float(1u << mantissaBits), int(exponent) - 15);
+    }
+
+#ifdef HDR_PACK_SSE2
+    __m128i select(__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    // packUfloat of four lanes
+    __m128i packUfloat4(__m128 value, int mantissaBits)
+    {
+        const __m128i bits = _mm_castps_si128(value);
+        const __m128i positive = _mm_castps_si128(_mm_cmpgt_ps(value, _mm_setzero_ps()));
+        const int shift = 23 - mantissaBits;
+        __m128i normal = _mm_srl_epi32(_mm_add_epi32(bits, _mm_set1_epi32(1 << (shift - 1))), _mm_cvtsi32_si128(shift));
+        normal = _mm_sub_epi32(normal, _mm_set1_epi32(112 << mantissaBits));
+        const __m128i largest = _mm_set1_epi32((30 << mantissaBits) | ((1 << mantissaBits) - 1));
+        normal = select(_mm_cmpgt_epi32(normal, largest), largest, normal);
+        const __m128 scale = _mm_castsi128_ps(_mm_set1_epi32((127 + 14 + mantissaBits) << 23));
+        const __m128i denormal = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), _mm_set1_ps(0.5f)));
+        const __m128i small = _mm_cmplt_epi32(bits, _mm_set1_epi32(113 << 23));
+        return _mm_and_si128(select(small, denormal, normal), positive);
+    }
+
+    // packHalf of four lanes, zero extended to 32 bits
+    __m128i packHalf4(__m128 value)
+    {
+        const __m128i bits = _mm_castps_si128(value);
+        const __m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(0x8000));
+        const __m128 magnitude = _mm_castsi128_ps(_mm_and_si128(bits, _mm_set1_epi32(0x7FFFFFFF)));
+        const __m128i half = _mm_or_si128(sign, packUfloat4(magnitude, 10));
+        const __m128i nan = _mm_castps_si128(_mm_cmpunord_ps(value, value));
+        return select(nan, _mm_set1_epi32(0x7E00), half);
+    }
+
+    // SSE2 has no unsigned saturating pack from 32 to 16 bits, the values are moved into the signed range
+    __m128i narrow(__m128i low, __m128i high)
+    {
+        const __m128i bias = _mm_set1_epi32(0x8000);
+        const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias));
+        return _mm_xor_si128(packed, _mm_set1_epi16(-0x8000));
+    }
+
+    __m128i packB10G11R11x4(const float* rgba)
+    {
+        __m128 r = _mm_loadu_ps(rgba);
+        __m128 g = _mm_loadu_ps(rgba + 4);
+        __m128 b = _mm_loadu_ps(rgba + 8);
+        __m128 a = _mm_loadu_ps(rgba + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        return _mm_or_si128(_mm_or_si128(packUfloat4(r, 6), _mm_slli_epi32(packUfloat4(g, 6), 11)),
+            _mm_slli_epi32(packUfloat4(b, 5), 22));
+    }
+
+    __m128i packE5B9G9R9x4(const float* rgba)
+    {
+        __m128 r = _mm_loadu_ps(rgba);
+        __m128 g = _mm_loadu_ps(rgba + 4);
+        __m128 b = _mm_loadu_ps(rgba + 8);
+        __m128 a = _mm_loadu_ps(rgba + 12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        // max returns its second operand for NaN, which makes NaN 0 like the scalar path
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 limit = _mm_set1_ps(SharedExponentMax);
+        r = _mm_min_ps(_mm_max_ps(r, zero), limit);
+        g = _mm_min_ps(_mm_max_ps(g, zero), limit);
+        b = _mm_min_ps(_mm_max_ps(b, zero), limit);
+        const __m128 largest = _mm_max_ps(_mm_max_ps(r, g), b);
+
+        const __m128i floorLog2 = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(largest), 23), _mm_set1_epi32(127));
+        const __m128i lowest = _mm_set1_epi32(-16);
+        __m128i exponent = _mm_add_epi32(select(_mm_cmpgt_epi32(floorLog2, lowest), floorLog2, lowest), _mm_set1_epi32(16));
+        // 2^(24 - exponent) built from its bits, exponent is in [0, 31]
+        __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(151), exponent), 23));
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128i largestMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(largest, scale), half));
+        const __m128i overflow = _mm_cmpeq_epi32(largestMantissa, _mm_set1_epi32(512));
+        exponent = _mm_sub_epi32(exponent, overflow);
+        scale = _mm_mul_ps(scale, _mm_or_ps(_mm_and_ps(_mm_castsi128_ps(overflow), half),
+            _mm_andnot_ps(_mm_castsi128_ps(overflow), _mm_set1_ps(1.0f))));
+
+        const __m128i rs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+        const __m128i gs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+        const __m128i bs = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+        return _mm_or_si128(_mm_or_si128(rs, _mm_slli_epi32(gs, 9)),
+            _mm_or_si128(_mm_slli_epi32(bs, 18), _mm_slli_epi32(exponent, 27)));
+    }
+#endif
+
+    void packRange(const float* rgba, size_t count, vk::Format format, unsigned char* out, bool vectorize)
+    {
+        size_t i = 0;
+        switch (format)
+        {
+        case vk::Format::eR16G16B16A16Sfloat:
+#ifdef HDR_PACK_SSE2
+            for (; vectorize && i + 2 <= count; i += 2)
+            {
+                const __m128i packed = narrow(packHalf4(_mm_loadu_ps(rgba + i * 4)), packHalf4(_mm_loadu_ps(rgba + i * 4 + 4)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 8), packed);
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const uint16_t packed[4] = { HDRPack::packHalf(rgba[i * 4]), HDRPack::packHalf(rgba[i * 4 + 1]),
+                    HDRPack::packHalf(rgba[i * 4 + 2]), HDRPack::packHalf(rgba[i * 4 + 3]) };
+                std::memcpy(out + i * 8, packed, 8);
+            }
+            break;
+        case vk::Format::eB10G11R11UfloatPack32:
+#ifdef HDR_PACK_SSE2
+            for (; vectorize && i + 4 <= count; i += 4)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), packB10G11R11x4(rgba + i * 4));
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const uint32_t packed = HDRPack::packB10G11R11(rgba + i * 4);
+                std::memcpy(out + i * 4, &packed, 4);
+            }
+            break;
+        case vk::Format::eE5B9G9R9UfloatPack32:
+#ifdef HDR_PACK_SSE2
+            for (; vectorize && i + 4 <= count; i += 4)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 4), packE5B9G9R9x4(rgba + i * 4));
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const uint32_t packed = HDRPack::packE5B9G9R9(rgba + i * 4);
+                std::memcpy(out + i * 4, &packed, 4);
+            }
+            break;
+        default:
+            std::memcpy(out, rgba, count * 16);
+            break;
+        }
+    }
+}
+
+uint32_t HDRPack::texelBytes(vk::Format format)
+{
+    switch (format)
+    {
+    case vk::Format::eR32G32B32A32Sfloat:
+        return 16;
+    case vk::Format::eR16G16B16A16Sfloat:
+        return 8;
+    case vk::Format::eE5B9G9R9UfloatPack32:
+    case vk::Format::eB10G11R11UfloatPack32:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+vk::Format HDRPack::chooseFormat(vk::PhysicalDevice physicalDevice, vk::Format requested, vk::FormatFeatureFlags required)
+{
+    const vk::Format candidates[] = { requested, vk::Format::eE5B9G9R9UfloatPack32, vk::Format::eB10G11R11UfloatPack32,
+        vk::Format::eR16G16B16A16Sfloat };
+    for (vk::Format format : candidates)
+    {
+        if (texelBytes(format) != 0 && (physicalDevice.getFormatProperties(format).optimalTilingFeatures & required) == required)
+        {
+            return format;
+        }
+    }
+    return vk::Format::eR32G32B32A32Sfloat;
+}
+
+void HDRPack::pack(const float* rgba, size_t count, vk::Format format, void* out)
+{
+    const uint32_t texel = texelBytes(format);
+    unsigned char* bytes = static_cast<unsigned char*>(out);
+    parallelChunks(count, [&](size_t first, size_t n) {
+        packRange(rgba + first * 4, n, format, bytes + first * texel, true);
+        });
+}
+
+void HDRPack::unpack(const void* in, size_t count, vk::Format format, float* rgba)
+{
+    const uint32_t texel = texelBytes(format);
+    const unsigned char* bytes = static_cast<const unsigned char*>(in);
+    parallelChunks(count, [&](size_t first, size_t n) {
+        for (size_t i = first; i < first + n; i++)
+        {
+            const unsigned char* src = bytes + i * texel;
+            float* dst = rgba + i * 4;
+            uint16_t halves[4];
+            uint32_t packed;
+            switch (format)
+            {
+            case vk::Format::eR16G16B16A16Sfloat:
+                std::memcpy(halves, src, 8);
+                for (int c = 0; c < 4; c++)
+                {
+                    dst[c] = unpackHalf(halves[c]);
+                }
+                break;
+            case vk::Format::eB10G11R11UfloatPack32:
+                std::memcpy(&packed, src, 4);
+                unpackB10G11R11(packed, dst);
+                dst[3] = 1.0f;
+                break;
+            case vk::Format::eE5B9G9R9UfloatPack32:
+                std::memcpy(&packed, src, 4);
+                unpackE5B9G9R9(packed, dst);
+                dst[3] = 1.0f;
+                break;
+            default:
+                std::memcpy(dst, src, 16);
+                break;
+            }
+        }
+        });
+}
+
+HDRPack::RoundTrip HDRPack::roundTrip(const float* rgba, size_t count, vk::Format format)
+{
+    std::vector<unsigned char> packed(count * texelBytes(format));
+    std::vector<float> unpacked(count * 4);
+    pack(rgba, count, format, packed.data());
+    unpack(packed.data(), count, format, unpacked.data());
+
+    RoundTrip result;
+    for (size_t i = 0; i < count; i++)
+    {
+        const float* a = rgba + i * 4;
+        const float* b = unpacked.data() + i * 4;
+        const double largest = std::max({ std::abs(a[0]), std::abs(a[1]), std::abs(a[2]), 1e-6f });
+        for (int c = 0; c < 3; c++)
+        {
+            const double error = std::abs(double(a[c]) - double(b[c])) / largest;
+            result.meanError += error;
+            result.maxError = std::max(result.maxError, error);
+        }
+    }
+    result.meanError /= std::max<size_t>(count * 3, 1);
+    return result;
+}
+
+void HDRPack::benchmark(uint32_t texelCount)
+{
+    using clock = std::chrono::steady_clock;
+    auto elapsedMs = [](clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        };
+
+    // what a sky panorama spans, from deep shadow to the sun
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> exponent(-10.0f, 13.0f);
+    std::vector<float> rgba(size_t(texelCount) * 4);
+    for (size_t i = 0; i < texelCount; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            rgba[i * 4 + c] = std::exp2(exponent(rng));
+        }
+        rgba[i * 4 + 3] = 1.0f;
+    }
+
+    const vk::Format formats[] = { vk::Format::eR16G16B16A16Sfloat, vk::Format::eE5B9G9R9UfloatPack32,
+        vk::Format::eB10G11R11UfloatPack32 };
+    for (vk::Format format : formats)
+    {
+        const size_t size = size_t(texelCount) * texelBytes(format);
+        std::vector<unsigned char> scalar(size);
+        std::vector<unsigned char> vectorized(size);
+        auto start = clock::now();
+        packRange(rgba.data(), texelCount, format, scalar.data(), false);
+        const double scalarMs = elapsedMs(start);
+        start = clock::now();
+        packRange(rgba.data(), texelCount, format, vectorized.data(), true);
+        const double vectorMs = elapsedMs(start);
+        start = clock::now();
+        pack(rgba.data(), texelCount, format, vectorized.data());
+        const double parallelMs = elapsedMs(start);
+        const bool match = std::memcmp(scalar.data(), vectorized.data(), size) == 0;
+        const RoundTrip error = roundTrip(rgba.data(), texelCount, format);
+        DEMO_LOG(Info, std::format("{}: {} texels in {:.1f} MB instead of {:.1f} MB, scalar {:.2f} ms, SIMD {:.2f} ms, "
+            "parallel {:.2f} ms, {}, round trip error mean {:.2e} max {:.2e}", vk::to_string(format), texelCount,
+            size / (1024.0 * 1024.0), texelCount * 16.0 / (1024.0 * 1024.0), scalarMs, vectorMs, parallelMs,
+            match ? "SIMD matches scalar" : "SIMD DIFFERS from scalar", error.meanError, error.maxError));
+    }
+}
+
+uint16_t HDRPack::packHalf(float value)
+{
+    if (std::isnan(value))
+    {
+        return 0x7E00;
+    }
+    const uint16_t sign = std::signbit(value) ? 0x8000 : 0;
+    return static_cast<uint16_t>(sign | packUfloat(std::abs(value), 10));
+}
+
+float HDRPack::unpackHalf(uint16_t value)
+{
+    const float magnitude = unpackUfloat(value & 0x7FFF, 10);
+    return value & 0x8000 ? -magnitude : magnitude;
+}
+
+uint32_t HDRPack::packB10G11R11(const float* rgb)
+{
+    return packUfloat(rgb[0], 6) | (packUfloat(rgb[1], 6) << 11) | (packUfloat(rgb[2], 5) << 22);
+}
+
+void HDRPack::unpackB10G11R11(uint32_t packed, float* rgb)
+{
+    rgb[0] = unpackUfloat(packed & 0x7FF, 6);
+    rgb[1] = unpackUfloat((packed >> 11) & 0x7FF, 6);
+    rgb[2] = unpackUfloat(packed >> 22, 5);
+}
+
+uint32_t HDRPack::packE5B9G9R9(const float* rgb)
+{
+    // the shared exponent conversion of the Vulkan spec with N = 9, B = 15
+    float c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        c[i] = rgb[i] > 0.0f ? std::min(rgb[i], SharedExponentMax) : 0.0f;
+    }
+    const float largest = std::max(std::max(c[0], c[1]), c[2]);
+    uint32_t bits;
+    std::memcpy(&bits, &largest, 4);
+    int exponent = std::max(int(bits >> 23) - 127, -16) + 16;
+    float scale = std::ldexp(1.0f, 24 - exponent);
+    if (static_cast<uint32_t>(largest * scale + 0.5f) == 512)
+    {
+        exponent++;
+        scale *= 0.5f;
+    }
+    const uint32_t r = static_cast<uint32_t>(c[0] * scale + 0.5f);
+    const uint32_t g = static_cast<uint32_t>(c[1] * scale + 0.5f);
+    const uint32_t b = static_cast<uint32_t>(c[2] * scale + 0.5f);
+    return r | (g << 9) | (b << 18) | (uint32_t(exponent) << 27);
+}
+
+void HDRPack::unpackE5B9G9R9(uint32_t packed, float* rgb)
+{
+    const float scale = std::ldexp(1.0f, int(packed >> 27) - 24);
+    rgb[0] = float(packed & 0x1FF) * scale;
+    rgb[1] = float((packed >> 9) & 0x1FF) * scale;
+    rgb[2] = float((packed >> 18) & 0x1FF) * scale;
+}
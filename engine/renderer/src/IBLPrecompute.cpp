@@ -0,0 +1,513 @@
+#include "IBLPrecompute.h"
+#include "HDRPack.h"
+#include "Texture.h"
+#include "prefilterEnvironment.h"
+#include "hash_table.h"
+#include "log.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <numeric>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define IBL_PRECOMPUTE_SSE 1
+#endif
+
+namespace
+{
+    constexpr float Pi = 3.14159265358979f;
+
+    // real SH basis constants of bands 0 to 2
+    constexpr float Y00 = 0.282095f;
+    constexpr float Y1 = 0.488603f;
+    constexpr float Y2 = 1.092548f;
+    constexpr float Y20 = 0.315392f;
+    constexpr float Y22 = 0.546274f;
+    // the clamped cosine convolution of every band divided by pi
+    constexpr float BandScale[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+    bool referenceCheck = false;
+
+    template <typename Fn>
+    void parallelRows(uint32_t rows, Fn&& fn)
+    {
+        std::vector<uint32_t> indices(rows);
+        std::iota(indices.begin(), indices.end(), 0u);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), fn);
+    }
+
+    void basis(const glm::vec3& d, float* y)
+    {
+        y[0] = Y00;
+        y[1] = Y1 * d.y;
+        y[2] = Y1 * d.z;
+        y[3] = Y1 * d.x;
+        y[4] = Y2 * d.x * d.y;
+        y[5] = Y2 * d.y * d.z;
+        y[6] = Y20 * (3.0f * d.z * d.z - 1.0f);
+        y[7] = Y2 * d.x * d.z;
+        y[8] = Y22 * (d.x * d.x - d.y * d.y);
+    }
+
+    // the solid angle of the face area from the centre to (x, y) on the [-1, 1] square
+    float areaElement(float x, float y)
+    {
+        return std::atan2(x * y, std::sqrt(x * x + y * y + 1.0f));
+    }
+
+    float texelSolidAngle(uint32_t x, uint32_t y, uint32_t size)
+    {
+        const float step = 2.0f / size;
+        const float x0 = x * step - 1.0f;
+        const float y0 = y * step - 1.0f;
+        const float x1 = x0 + step;
+        const float y1 = y0 + step;
+        return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+    }
+
+    // adds the 9 rgb coefficients of row y of face into sums. The direction is linear in s along a row
+    void projectRow(const float* face, const float* solidAngles, uint32_t size, uint32_t faceIndex, uint32_t y,
+        float* sums)
+    {
+        const float t = (y + 0.5f) / size;
+        const glm::vec3 origin = IBLPrecompute::faceDirection(faceIndex, 0.0f, t);
+        const glm::vec3 axis = IBLPrecompute::faceDirection(faceIndex, 1.0f, t) - origin;
+        const float* row = face + size_t(y) * size * 4;
+        const float* weights = solidAngles + size_t(y) * size;
+        std::fill(sums, sums + 27, 0.0f);
+        uint32_t x = 0;
+#ifdef IBL_PRECOMPUTE_SSE
+        __m128 acc[27];
+        for (auto& a : acc)
+        {
+            a = _mm_setzero_ps();
+        }
+        const __m128 invSize = _mm_set1_ps(1.0f / size);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 three = _mm_set1_ps(3.0f);
+        for (; x + 4 <= size; x += 4)
+        {
+            const __m128 s = _mm_mul_ps(_mm_set_ps(x + 3.5f, x + 2.5f, x + 1.5f, x + 0.5f), invSize);
+            __m128 dx = _mm_add_ps(_mm_set1_ps(origin.x), _mm_mul_ps(s, _mm_set1_ps(axis.x)));
+            __m128 dy = _mm_add_ps(_mm_set1_ps(origin.y), _mm_mul_ps(s, _mm_set1_ps(axis.y)));
+            __m128 dz = _mm_add_ps(_mm_set1_ps(origin.z), _mm_mul_ps(s, _mm_set1_ps(axis.z)));
+            const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            const __m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(length2));
+            dx = _mm_mul_ps(dx, invLength);
+            dy = _mm_mul_ps(dy, invLength);
+            dz = _mm_mul_ps(dz, invLength);
+
+            // four RGBA texels to one register per channel
+            __m128 r = _mm_loadu_ps(row + x * 4);
+            __m128 g = _mm_loadu_ps(row + x * 4 + 4);
+            __m128 b = _mm_loadu_ps(row + x * 4 + 8);
+            __m128 a = _mm_loadu_ps(row + x * 4 + 12);
+            _MM_TRANSPOSE4_PS(r, g, b, a);
+            const __m128 w = _mm_loadu_ps(weights + x);
+            r = _mm_mul_ps(r, w);
+            g = _mm_mul_ps(g, w);
+            b = _mm_mul_ps(b, w);
+
+            const __m128 y[9] = {
+                _mm_set1_ps(Y00),
+                _mm_mul_ps(_mm_set1_ps(Y1), dy),
+                _mm_mul_ps(_mm_set1_ps(Y1), dz),
+                _mm_mul_ps(_mm_set1_ps(Y1), dx),
+                _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dx, dy)),
+                _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dy, dz)),
+                _mm_mul_ps(_mm_set1_ps(Y20), _mm_sub_ps(_mm_mul_ps(three, _mm_mul_ps(dz, dz)), one)),
+                _mm_mul_ps(_mm_set1_ps(Y2), _mm_mul_ps(dx, dz)),
+                _mm_mul_ps(_mm_set1_ps(Y22), _mm_sub_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy))),
+            };
+            for (int k = 0; k < 9; k++)
+            {
+                acc[k * 3 + 0] = _mm_add_ps(acc[k * 3 + 0], _mm_mul_ps(r, y[k]));
+                acc[k * 3 + 1] = _mm_add_ps(acc[k * 3 + 1], _mm_mul_ps(g, y[k]));
+                acc[k * 3 + 2] = _mm_add_ps(acc[k * 3 + 2], _mm_mul_ps(b, y[k]));
+            }
+        }
+        for (int i = 0; i < 27; i++)
+        {
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, acc[i]);
+            sums[i] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+#endif
+        for (; x < size; x++)
+        {
+            const glm::vec3 d = glm::normalize(origin + axis * ((x + 0.5f) / size));
+            float y[9];
+            basis(d, y);
+            const float* texel = row + size_t(x) * 4;
+            const float w = weights[x];
+            for (int k = 0; k < 9; k++)
+            {
+                sums[k * 3 + 0] += texel[0] * w * y[k];
+                sums[k * 3 + 1] += texel[1] * w * y[k];
+                sums[k * 3 + 2] += texel[2] * w * y[k];
+            }
+        }
+    }
+
+    // the face and coordinates a samplerCube picks for a direction
+    void directionToFace(const glm::vec3& d, uint32_t& face, float& s, float& t)
+    {
+        const glm::vec3 a = glm::abs(d);
+        float sc, tc, ma;
+        if (a.x >= a.y && a.x >= a.z)
+        {
+            face = d.x > 0.0f ? 0 : 1;
+            sc = d.x > 0.0f ? -d.z : d.z;
+            tc = -d.y;
+            ma = a.x;
+        }
+        else if (a.y >= a.z)
+        {
+            face = d.y > 0.0f ? 2 : 3;
+            sc = d.x;
+            tc = d.y > 0.0f ? d.z : -d.z;
+            ma = a.y;
+        }
+        else
+        {
+            face = d.z > 0.0f ? 4 : 5;
+            sc = d.z > 0.0f ? d.x : -d.x;
+            tc = -d.y;
+            ma = a.z;
+        }
+        s = 0.5f * (sc / ma + 1.0f);
+        t = 0.5f * (tc / ma + 1.0f);
+    }
+
+    // unpacked source levels for the reference prefilter, level 0 is the first one the output needs
+    struct SourceChain
+    {
+        std::vector<std::vector<float>> levels;
+        std::vector<uint32_t> sizes;
+
+        // bilinear within the face, clamped at its edges
+        glm::vec3 sampleLevel(uint32_t level, const glm::vec3& d) const
+        {
+            uint32_t face;
+            float s, t;
+            directionToFace(d, face, s, t);
+            const uint32_t size = sizes[level];
+            const float* texels = levels[level].data() + size_t(face) * size * size * 4;
+            const float x = std::clamp(s * size - 0.5f, 0.0f, size - 1.0f);
+            const float y = std::clamp(t * size - 0.5f, 0.0f, size - 1.0f);
+            const uint32_t x0 = uint32_t(x);
+            const uint32_t y0 = uint32_t(y);
+            const uint32_t x1 = std::min(x0 + 1, size - 1);
+            const uint32_t y1 = std::min(y0 + 1, size - 1);
+            const float tx = x - x0;
+            const float ty = y - y0;
+            auto texel = [&](uint32_t px, uint32_t py) {
+                const float* p = texels + (size_t(py) * size + px) * 4;
+                return glm::vec3(p[0], p[1], p[2]);
+                };
+            return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), tx), glm::mix(texel(x0, y1), texel(x1, y1), tx), ty);
+        }
+
+        glm::vec3 sample(const glm::vec3& d, float lod) const
+        {
+            lod = std::clamp(lod, 0.0f, float(levels.size() - 1));
+            const uint32_t fine = uint32_t(lod);
+            const uint32_t coarse = std::min(fine + 1, uint32_t(levels.size() - 1));
+            const glm::vec3 a = sampleLevel(fine, d);
+            return fine == coarse ? a : glm::mix(a, sampleLevel(coarse, d), lod - fine);
+        }
+    };
+
+    glm::vec2 hammersley(uint32_t i, uint32_t n)
+    {
+        uint32_t bits = i;
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return glm::vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+    }
+
+    glm::vec3 importanceSampleGGX(const glm::vec2& xi, const glm::vec3& n, float alpha)
+    {
+        const float phi = 2.0f * Pi * xi.x;
+        const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (alpha * alpha - 1.0f) * xi.y));
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        const glm::vec3 tangent = glm::normalize(glm::cross(up, n));
+        const glm::vec3 bitangent = glm::cross(n, tangent);
+        return glm::normalize(tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + n * cosTheta);
+    }
+}
+
+void IBLPrecompute::SetReferenceCheck(bool enable)
+{
+    referenceCheck = enable;
+}
+
+glm::vec3 IBLPrecompute::faceDirection(uint32_t face, float s, float t)
+{
+    const float sc = 2.0f * s - 1.0f;
+    const float tc = 2.0f * t - 1.0f;
+    switch (face)
+    {
+    case 0:
+        return glm::vec3(1.0f, -tc, -sc);
+    case 1:
+        return glm::vec3(-1.0f, -tc, sc);
+    case 2:
+        return glm::vec3(sc, 1.0f, tc);
+    case 3:
+        return glm::vec3(sc, -1.0f, -tc);
+    case 4:
+        return glm::vec3(sc, -tc, 1.0f);
+    default:
+        return glm::vec3(-sc, -tc, -1.0f);
+    }
+}
+
+void IBLPrecompute::unpackLevel(const KTX2Image& cube, uint32_t level, std::vector<float>& texels)
+{
+    const auto& info = cube.levels[level];
+    const size_t count = size_t(info.width) * info.height * cube.faces;
+    texels.resize(count * 4);
+    HDRPack::unpack(cube.data.data() + info.offset, count, cube.format, texels.data());
+}
+
+SH9 IBLPrecompute::projectSH(const KTX2Image& cube, uint32_t level)
+{
+    std::vector<float> texels;
+    unpackLevel(cube, level, texels);
+    const uint32_t size = cube.levels[level].width;
+    std::vector<float> solidAngles(size_t(size) * size);
+    for (uint32_t y = 0; y < size; y++)
+    {
+        for (uint32_t x = 0; x < size; x++)
+        {
+            solidAngles[size_t(y) * size + x] = texelSolidAngle(x, y, size);
+        }
+    }
+
+    std::vector<std::array<float, 27>> rows(size_t(size) * 6);
+    parallelRows(size * 6, [&](uint32_t row) {
+        const uint32_t face = row / size;
+        projectRow(texels.data() + size_t(face) * size * size * 4, solidAngles.data(), size, face, row % size,
+            rows[row].data());
+        });
+    // rows are summed in double so that the result does not depend on the face size
+    double total[27] = {};
+    for (const auto& row : rows)
+    {
+        for (int i = 0; i < 27; i++)
+        {
+            total[i] += row[i];
+        }
+    }
+    SH9 sh;
+    for (int k = 0; k < 9; k++)
+    {
+        sh.coefficients[k] = glm::vec4(glm::vec3(float(total[k * 3]), float(total[k * 3 + 1]), float(total[k * 3 + 2])) *
+            BandScale[k], 0.0f);
+    }
+    return sh;
+}
+
+glm::vec3 IBLPrecompute::evaluateSH(const SH9& sh, const glm::vec3& normal)
+{
+    float y[9];
+    basis(normal, y);
+    glm::vec3 result(0.0f);
+    for (int k = 0; k < 9; k++)
+    {
+        result += glm::vec3(sh.coefficients[k]) * y[k];
+    }
+    return result;
+}
+
+KTX2Image IBLPrecompute::prefilterSpecular(const KTX2Image& cube, uint32_t size, uint32_t levels, uint32_t samples)
+{
+    // finer source levels than the output only add aliasing to the mirror level and cost for the others
+    uint32_t first = 0;
+    while (first + 1 < cube.levels.size() && cube.levels[first].width > size)
+    {
+        first++;
+    }
+    SourceChain source;
+    for (uint32_t i = first; i < cube.levels.size(); i++)
+    {
+        source.levels.emplace_back();
+        unpackLevel(cube, i, source.levels.back());
+        source.sizes.push_back(cube.levels[i].width);
+    }
+    const float sourceSize = float(source.sizes[0]);
+    const float sourceTexelSolidAngle = 4.0f * Pi / (6.0f * sourceSize * sourceSize);
+
+    KTX2Image image;
+    image.format = vk::Format::eR16G16B16A16Sfloat;
+    image.width = size;
+    image.height = size;
+    image.faces = 6;
+    size_t total = 0;
+    for (uint32_t m = 0; m < levels; m++)
+    {
+        const uint32_t levelSize = std::max(size >> m, 1u);
+        const size_t bytes = size_t(levelSize) * levelSize * 8 * 6;
+        image.levels.push_back({ levelSize, levelSize, total, bytes });
+        total += bytes;
+    }
+    image.data.resize(total);
+
+    for (uint32_t m = 0; m < levels; m++)
+    {
+        const uint32_t levelSize = image.levels[m].width;
+        const float roughness = levels > 1 ? float(m) / float(levels - 1) : 0.0f;
+        const float alpha = roughness * roughness;
+        unsigned char* out = image.data.data() + image.levels[m].offset;
+        parallelRows(levelSize * 6, [&](uint32_t row) {
+            const uint32_t face = row / levelSize;
+            const uint32_t y = row % levelSize;
+            for (uint32_t x = 0; x < levelSize; x++)
+            {
+                const glm::vec3 n = glm::normalize(faceDirection(face, (x + 0.5f) / levelSize, (y + 0.5f) / levelSize));
+                glm::vec3 color(0.0f);
+                if (roughness == 0.0f)
+                {
+                    color = source.sample(n, std::log2(sourceSize / levelSize));
+                }
+                else
+                {
+                    float weight = 0.0f;
+                    for (uint32_t i = 0; i < samples; i++)
+                    {
+                        const glm::vec3 h = importanceSampleGGX(hammersley(i, samples), n, alpha);
+                        const float nDotH = std::max(glm::dot(n, h), 0.0f);
+                        const glm::vec3 l = glm::normalize(2.0f * nDotH * h - n);
+                        const float nDotL = glm::dot(n, l);
+                        if (nDotL <= 0.0f)
+                        {
+                            continue;
+                        }
+                        // with V = N the pdf of l is D / 4
+                        const float a2 = alpha * alpha;
+                        const float denominator = nDotH * nDotH * (a2 - 1.0f) + 1.0f;
+                        const float d = a2 / (Pi * denominator * denominator);
+                        const float sampleSolidAngle = 1.0f / (samples * d * 0.25f + 0.0001f);
+                        const float lod = 0.5f * std::log2(sampleSolidAngle / sourceTexelSolidAngle) + 1.0f;
+                        color += source.sample(l, lod) * nDotL;
+                        weight += nDotL;
+                    }
+                    color /= std::max(weight, 0.0001f);
+                }
+                const uint16_t packed[4] = { HDRPack::packHalf(color.r), HDRPack::packHalf(color.g),
+                    HDRPack::packHalf(color.b), HDRPack::packHalf(1.0f) };
+                std::memcpy(out + ((size_t(face) * levelSize + y) * levelSize + x) * 8, packed, 8);
+            }
+            });
+    }
+    return image;
+}
+
+bool IBLPrecompute::readSH(const std::string& path, SH9& sh)
+{
+    std::ifstream file(path, std::ios::binary);
+    return file && file.read(reinterpret_cast<char*>(&sh), sizeof(SH9)) && file.gcount() == sizeof(SH9);
+}
+
+bool IBLPrecompute::writeSH(const std::string& path, const SH9& sh)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    return file && file.write(reinterpret_cast<const char*>(&sh), sizeof(SH9));
+}
+
+IBLPrecompute::Environment IBLPrecompute::load(const std::string& hdrFile)
+{
+    constexpr vk::Format format = vk::Format::eB10G11R11UfloatPack32;
+    auto& manager = TextureManager::Instance();
+    const std::string cubemapFile = manager.CubemapCacheFile(hdrFile, format);
+    if (cubemapFile.empty())
+    {
+        DEMO_LOG(Warning, std::format("Failed to read {}, image based lighting is off", hdrFile));
+        return {};
+    }
+    // keyed on the cubemap cache entry, which is itself keyed on the content of the panorama
+    const uint32_t params[] = { SpecularSize, SpecularLevels, SpecularSamples, IrradianceSize, Version };
+    const uint64_t key = fnv1a_64(params, sizeof(params), fnv1a_64(cubemapFile.data(), cubemapFile.size()));
+    const auto directory = std::filesystem::path(cubemapFile).parent_path();
+    const std::string shFile = (directory / std::format("{:016x}.sh9", key)).string();
+    const std::string specularFile = (directory / std::format("{:016x}.ktx2", key)).string();
+
+    auto start = std::chrono::steady_clock::now();
+    Environment environment;
+    KTX2Image specular;
+    const bool cached = readSH(shFile, environment.irradiance) && KTX2::read(specularFile, specular) &&
+        specular.faces == 6 && specular.format == vk::Format::eR16G16B16A16Sfloat;
+    if (cached)
+    {
+        environment.specular = manager.Create(specular);
+    }
+    else
+    {
+        KTX2Image cube;
+        auto cubemap = manager.LoadHDRCubemap(hdrFile, format, &cube);
+        uint32_t level = 0;
+        while (level + 1 < cube.levels.size() && cube.levels[level].width > IrradianceSize)
+        {
+            level++;
+        }
+        environment.irradiance = projectSH(cube, level);
+        if (manager.GetCubemapConversion() == CubemapConversion::GPU)
+        {
+            // the prefilter samples the cubemap from a single use command buffer
+            manager.FinishUploads();
+            environment.specular = prefilterEnvironment(cubemap, SpecularSize, SpecularLevels, SpecularSamples);
+            specular = environment.specular->readback();
+            if (referenceCheck)
+            {
+                const KTX2Image reference = prefilterSpecular(cube, SpecularSize, SpecularLevels, SpecularSamples);
+                for (size_t m = 0; m < reference.levels.size(); m++)
+                {
+                    std::vector<float> gpu, cpu;
+                    unpackLevel(specular, uint32_t(m), gpu);
+                    unpackLevel(reference, uint32_t(m), cpu);
+                    double error = 0.0, worst = 0.0;
+                    for (size_t i = 0; i < gpu.size(); i += 4)
+                    {
+                        for (int c = 0; c < 3; c++)
+                        {
+                            const double relative = std::abs(gpu[i + c] - cpu[i + c]) / std::max(cpu[i + c], 1e-3f);
+                            error += relative;
+                            worst = std::max(worst, relative);
+                        }
+                    }
+                    DEMO_LOG(Info, std::format("Specular level {}: GPU to CPU reference mean {:.2f}%, worst {:.2f}%", m,
+                        100.0 * error / (gpu.size() / 4 * 3), 100.0 * worst));
+                }
+            }
+        }
+        else
+        {
+            specular = prefilterSpecular(cube, SpecularSize, SpecularLevels, SpecularSamples);
+            environment.specular = manager.Create(specular);
+        }
+        manager.Destroy(cubemap);
+        if (!KTX2::write(specularFile, specular) || !writeSH(shFile, environment.irradiance))
+        {
+            DEMO_LOG(Warning, std::format("Failed to write the lighting cache of {}", hdrFile));
+        }
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    DEMO_LOG(Info, std::format("{} the image based lighting of {}: SH9 irradiance, {} specular levels of {}x{} in {:.1f} ms",
+        cached ? "Loaded" : "Precomputed", hdrFile, specular.levels.size(), specular.width, specular.height, ms));
+    return environment;
+}
@@ -0,0 +1,286 @@
+#include "KTX2.h"
+#include "BlockCompressor.h"
+#include "HDRCubemap.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+    const unsigned char Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    // identifier, header and index, the level index follows
+    constexpr size_t LevelIndexOffset = 80;
+    constexpr size_t LevelIndexEntrySize = 24;
+
+    // Khronos data format descriptor values
+    constexpr uint8_t ModelBC1A = 128;
+    constexpr uint8_t ModelBC4 = 131;
+    constexpr uint8_t ModelBC5 = 132;
+    constexpr uint8_t ModelBC7 = 134;
+    constexpr uint8_t PrimariesBT709 = 1;
+    constexpr uint8_t TransferLinear = 1;
+    constexpr uint8_t TransferSRGB = 2;
+
+    void put8(std::vector<unsigned char>& out, uint8_t value)
+    {
+        out.push_back(value);
+    }
+
+    void put16(std::vector<unsigned char>& out, uint16_t value)
+    {
+        out.insert(out.end(), reinterpret_cast<unsigned char*>(&value), reinterpret_cast<unsigned char*>(&value) + 2);
+    }
+
+    void put32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        out.insert(out.end(), reinterpret_cast<unsigned char*>(&value), reinterpret_cast<unsigned char*>(&value) + 4);
+    }
+
+    void put64(std::vector<unsigned char>& out, uint64_t value)
+    {
+        out.insert(out.end(), reinterpret_cast<unsigned char*>(&value), reinterpret_cast<unsigned char*>(&value) + 8);
+    }
+
+    uint32_t get32(const std::vector<unsigned char>& in, size_t offset)
+    {
+        uint32_t value;
+        std::memcpy(&value, in.data() + offset, 4);
+        return value;
+    }
+
+    uint64_t get64(const std::vector<unsigned char>& in, size_t offset)
+    {
+        uint64_t value;
+        std::memcpy(&value, in.data() + offset, 8);
+        return value;
+    }
+
+    constexpr uint8_t ModelRGBSDA = 1;
+    constexpr uint8_t ChannelAlpha = 15;
+    constexpr uint8_t QualifierSigned = 0x40;
+    constexpr uint8_t QualifierFloat = 0x80;
+    constexpr uint32_t FloatOne = 0x3F800000;
+    constexpr uint32_t FloatMinusOne = 0xBF800000;
+
+    struct Sample
+    {
+        uint16_t offset;
+        uint8_t bits;
+        uint8_t channel;
+        uint32_t lower;
+        uint32_t upper;
+    };
+
+    // size of a 4x4 block or of a single texel
+    uint32_t texelBlockBytes(vk::Format format)
+    {
+        return BlockCompressor::isBlockCompressed(format) ? BlockCompressor::blockBytes(format) : HDRCubemap::texelBytes(format);
+    }
+
+    // block formats get one sample per 64 bit half of the block, the float formats one per channel
+    bool describe(vk::Format format, std::vector<unsigned char>& dfd)
+    {
+        uint8_t model;
+        uint32_t sampleCount = 1;
+        std::vector<Sample> samples;
+        switch (format)
+        {
+        case vk::Format::eBc1RgbUnormBlock:
+        case vk::Format::eBc1RgbSrgbBlock:
+            model = ModelBC1A;
+            break;
+        case vk::Format::eBc4UnormBlock:
+            model = ModelBC4;
+            break;
+        case vk::Format::eBc5UnormBlock:
+            model = ModelBC5;
+            sampleCount = 2;
+            break;
+        case vk::Format::eBc7UnormBlock:
+        case vk::Format::eBc7SrgbBlock:
+            model = ModelBC7;
+            break;
+        case vk::Format::eB10G11R11UfloatPack32:
+            model = ModelRGBSDA;
+            samples = { { 0, 11, QualifierFloat | 0, 0, FloatOne }, { 11, 11, QualifierFloat | 1, 0, FloatOne },
+                { 22, 10, QualifierFloat | 2, 0, FloatOne } };
+            break;
+        case vk::Format::eR16G16B16A16Sfloat:
+            model = ModelRGBSDA;
+            for (uint8_t channel : { uint8_t(0), uint8_t(1), uint8_t(2), ChannelAlpha })
+            {
+                samples.push_back({ static_cast<uint16_t>(samples.size() * 16), 16,
+                    static_cast<uint8_t>(QualifierFloat | QualifierSigned | channel), FloatMinusOne, FloatOne });
+            }
+            break;
+        default:
+            return false;
+        }
+        const bool block = BlockCompressor::isBlockCompressed(format);
+        const bool srgb = format == vk::Format::eBc1RgbSrgbBlock || format == vk::Format::eBc7SrgbBlock;
+        const uint32_t blockBits = texelBlockBytes(format) * 8;
+        if (block)
+        {
+            for (uint32_t s = 0; s < sampleCount; s++)
+            {
+                const uint32_t sampleBits = blockBits / sampleCount;
+                // BC5 stores red then green, the other models have a single channel 0
+                samples.push_back({ static_cast<uint16_t>(s * sampleBits), static_cast<uint8_t>(sampleBits),
+                    static_cast<uint8_t>(s), 0, 0xFFFFFFFF });
+            }
+        }
+        const uint16_t blockSize = static_cast<uint16_t>(24 + 16 * samples.size());
+
+        put32(dfd, 4 + blockSize);
+        put32(dfd, 0);
+        put16(dfd, 2);
+        put16(dfd, blockSize);
+        put8(dfd, model);
+        put8(dfd, PrimariesBT709);
+        put8(dfd, srgb ? TransferSRGB : TransferLinear);
+        put8(dfd, 0);
+        // 4x4x1 blocks or single texels, stored as dimension - 1
+        put8(dfd, block ? 3 : 0);
+        put8(dfd, block ? 3 : 0);
+        put8(dfd, 0);
+        put8(dfd, 0);
+        put8(dfd, static_cast<uint8_t>(blockBits / 8));
+        for (int i = 1; i < 8; i++)
+        {
+            put8(dfd, 0);
+        }
+        for (const auto& sample : samples)
+        {
+            put16(dfd, sample.offset);
+            put8(dfd, static_cast<uint8_t>(sample.bits - 1));
+            put8(dfd, sample.channel);
+            put32(dfd, 0);
+            put32(dfd, sample.lower);
+            put32(dfd, sample.upper);
+        }
+        return true;
+    }
+}
+
+bool KTX2::read(const std::string& path, KTX2Image& image)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file)
+    {
+        return false;
+    }
+    const size_t size = static_cast<size_t>(file.tellg());
+    if (size < LevelIndexOffset)
+    {
+        return false;
+    }
+    image.data.resize(size);
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(image.data.data()), size);
+    if (!file || std::memcmp(image.data.data(), Identifier, sizeof(Identifier)) != 0)
+    {
+        return false;
+    }
+
+    image.format = static_cast<vk::Format>(get32(image.data, 12));
+    image.width = get32(image.data, 20);
+    image.height = get32(image.data, 24);
+    const uint32_t depth = get32(image.data, 28);
+    const uint32_t layers = get32(image.data, 32);
+    const uint32_t faces = get32(image.data, 36);
+    const uint32_t levelCount = std::max(1u, get32(image.data, 40));
+    const uint32_t supercompression = get32(image.data, 44);
+    if (depth > 1 || layers > 1 || (faces != 1 && faces != 6) || supercompression != 0 || image.width == 0 || image.height == 0 ||
+        LevelIndexOffset + levelCount * LevelIndexEntrySize > size)
+    {
+        return false;
+    }
+
+    image.faces = faces;
+    image.levels.clear();
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        const size_t entry = LevelIndexOffset + i * LevelIndexEntrySize;
+        const uint64_t offset = get64(image.data, entry);
+        const uint64_t length = get64(image.data, entry + 8);
+        if (offset + length > size)
+        {
+            return false;
+        }
+        image.levels.push_back({ std::max(1u, image.width >> i), std::max(1u, image.height >> i),
+            static_cast<size_t>(offset), static_cast<size_t>(length) });
+    }
+    return true;
+}
+
+bool KTX2::write(const std::string& path, const KTX2Image& image)
+{
+    std::vector<unsigned char> dfd;
+    if (!describe(image.format, dfd))
+    {
+        return false;
+    }
+    const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+    const size_t dfdOffset = LevelIndexOffset + levelCount * LevelIndexEntrySize;
+    const size_t alignment = std::lcm<size_t>(texelBlockBytes(image.format), 4);
+
+    // levels are stored smallest first, each one aligned to the block size
+    std::vector<size_t> offsets(levelCount);
+    size_t end = dfdOffset + dfd.size();
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+        end = (end + alignment - 1) / alignment * alignment;
+        offsets[i] = end;
+        end += image.levels[i].size;
+    }
+
+    std::vector<unsigned char> out(Identifier, Identifier + sizeof(Identifier));
+    out.reserve(end);
+    put32(out, static_cast<uint32_t>(image.format));
+    // typeSize is 1 for block compressed formats and the size of the packed word or of a channel otherwise
+    put32(out, image.format == vk::Format::eR16G16B16A16Sfloat ? 2 : BlockCompressor::isBlockCompressed(image.format) ? 1 : 4);
+    put32(out, image.width);
+    put32(out, image.height);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, image.faces);
+    put32(out, levelCount);
+    put32(out, 0);
+    put32(out, static_cast<uint32_t>(dfdOffset));
+    put32(out, static_cast<uint32_t>(dfd.size()));
+    put32(out, 0);
+    put32(out, 0);
+    put64(out, 0);
+    put64(out, 0);
+    for (uint32_t i = 0; i < levelCount; i++)
+    {
+        put64(out, offsets[i]);
+        put64(out, image.levels[i].size);
+        put64(out, image.levels[i].size);
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    for (uint32_t i = levelCount; i-- > 0;)
+    {
+        out.resize(offsets[i], 0);
+        const unsigned char* level = image.data.data() + image.levels[i].offset;
+        out.insert(out.end(), level, level + image.levels[i].size);
+    }
+
+    // written next to the target and renamed, so a crash never leaves a truncated cache entry. The temporary
+    // name is per thread since the same texture may be encoded concurrently
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    const std::string temp = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(reinterpret_cast<const char*>(out.data()), out.size()))
+        {
+            return false;
+        }
+    }
+    std::filesystem::rename(temp, path, ec);
+    return !ec;
+}
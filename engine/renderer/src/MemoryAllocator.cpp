@@ -0,0 +1,270 @@
+#include "MemoryAllocator.h"
+#include "Context.h"
+#include "log.h"
+
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <format>
+
+std::unique_ptr<MemoryAllocator> MemoryAllocator::instance_ = nullptr;
+
+uint32_t MemoryAllocator::FindMemoryType(uint32_t typeBits, vk::MemoryPropertyFlags required,
+    vk::MemoryPropertyFlags preferred)
+{
+    const auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
+    uint32_t best = UINT32_MAX;
+    int bestCost = INT_MAX;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        const auto flags = properties.memoryTypes[i].propertyFlags;
+        if (!(typeBits & (1u << i)) || (flags & required) != required) {
+            continue;
+        }
+        const int missing = std::popcount(static_cast<VkMemoryPropertyFlags>(preferred & ~flags));
+        const int extra = std::popcount(static_cast<VkMemoryPropertyFlags>(flags & ~(required | preferred)));
+        const int cost = missing * 32 + extra;
+        if (cost < bestCost) {
+            best = i;
+            bestCost = cost;
+        }
+    }
+    return best;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(vk::Buffer buffer, vk::MemoryPropertyFlags required, MemoryCategory category,
+    vk::MemoryPropertyFlags preferred)
+{
+    auto device = Context::GetInstance().device;
+    auto chain = device.getBufferMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+        vk::BufferMemoryRequirementsInfo2(buffer));
+    const auto& dedicated = chain.get<vk::MemoryDedicatedRequirements>();
+    auto allocation = allocate(chain.get<vk::MemoryRequirements2>().memoryRequirements,
+        dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation,
+        vk::MemoryDedicatedAllocateInfo({}, buffer), required, preferred, category, true);
+    device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+MemoryAllocation MemoryAllocator::Allocate(vk::Image image, vk::MemoryPropertyFlags required, MemoryCategory category,
+    vk::MemoryPropertyFlags preferred)
+{
+    auto device = Context::GetInstance().device;
+    auto chain = device.getImageMemoryRequirements2<vk::MemoryRequirements2, vk::MemoryDedicatedRequirements>(
+        vk::ImageMemoryRequirementsInfo2(image));
+    const auto& requirements = chain.get<vk::MemoryRequirements2>().memoryRequirements;
+    const auto& dedicated = chain.get<vk::MemoryDedicatedRequirements>();
+    const bool bigTarget = category == MemoryCategory::RenderTargets && requirements.size >= DedicatedRenderTargetSize;
+    auto allocation = allocate(requirements,
+        dedicated.prefersDedicatedAllocation || dedicated.requiresDedicatedAllocation || bigTarget,
+        vk::MemoryDedicatedAllocateInfo(image, {}), required, preferred, category, false);
+    device.bindImageMemory(image, allocation.memory, allocation.offset);
+    return allocation;
+}
+
+void MemoryAllocator::Free(MemoryAllocation& allocation)
+{
+    if (!allocation.memory) {
+        return;
+    }
+    auto device = Context::GetInstance().device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    MemoryBudget::Instance().Untrack(allocation.memoryType, allocation.size, allocation.category);
+    if (allocation.node == TLSF::InvalidNode) {
+        if (allocation.mapped) {
+            device.unmapMemory(allocation.memory);
+        }
+        MemoryBudget::Instance().Free(allocation.memory);
+        dedicated_--;
+        dedicatedBytes_ -= allocation.size;
+    }
+    else if (allocation.block < blocks_.size() && blocks_[allocation.block].allocator) {
+        auto& block = blocks_[allocation.block];
+        block.allocator->free(allocation.node);
+        // one empty block per memory type is kept for the next allocation, any other is given back
+        if (block.allocator->empty()) {
+            for (uint32_t i = 0; i < blocks_.size(); i++) {
+                const auto& other = blocks_[i];
+                if (i != allocation.block && other.allocator && other.allocator->empty() &&
+                    other.memoryType == block.memoryType && other.linear == block.linear) {
+                    if (block.mapped) {
+                        device.unmapMemory(block.memory);
+                    }
+                    MemoryBudget::Instance().Free(block.memory);
+                    block = Block();
+                    break;
+                }
+            }
+        }
+    }
+    allocation = MemoryAllocation();
+}
+
+void MemoryAllocator::Quit()
+{
+    auto device = Context::GetInstance().device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t live = 0;
+    for (auto& block : blocks_) {
+        if (!block.allocator) {
+            continue;
+        }
+        live += block.allocator->allocationCount();
+        if (block.mapped) {
+            device.unmapMemory(block.memory);
+        }
+        MemoryBudget::Instance().Free(block.memory);
+    }
+    blocks_.clear();
+    if (live > 0 || dedicated_ > 0) {
+        DEMO_LOG(Warning, std::format("{} sub-allocations and {} dedicated allocations still live at shutdown", live, dedicated_));
+    }
+}
+
+MemoryAllocator::Stats MemoryAllocator::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    for (const auto& block : blocks_) {
+        if (block.allocator) {
+            stats.blocks++;
+            stats.blockBytes += block.allocator->size();
+            stats.blockFreeBytes += block.allocator->freeBytes();
+            stats.subAllocations += block.allocator->allocationCount();
+        }
+    }
+    stats.dedicated = dedicated_;
+    stats.dedicatedBytes = dedicatedBytes_;
+    return stats;
+}
+
+MemoryAllocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, bool dedicated,
+    const vk::MemoryDedicatedAllocateInfo& dedicatedInfo, vk::MemoryPropertyFlags required,
+    vk::MemoryPropertyFlags preferred, MemoryCategory category, bool linear)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!initialized_) {
+        auto physicaldevice = Context::GetInstance().physicaldevice;
+        properties_ = physicaldevice.getMemoryProperties();
+        granularity_ = physicaldevice.getProperties().limits.bufferImageGranularity;
+        initialized_ = true;
+    }
+    // the best memory type first, the next one when it is out of memory
+    uint32_t typeBits = requirements.memoryTypeBits;
+    for (;;) {
+        const uint32_t memoryType = FindMemoryType(typeBits, required, preferred);
+        if (memoryType == UINT32_MAX) {
+            throw vk::OutOfDeviceMemoryError(std::format("No memory type with {} has room for {} bytes",
+                vk::to_string(required), requirements.size));
+        }
+        MemoryAllocation allocation;
+        allocation.category = category;
+        const bool own = dedicated || requirements.size > blockSize(memoryType) / 2;
+        if (own ? allocateDedicated(requirements, memoryType, dedicatedInfo, allocation) :
+            allocateFromBlocks(requirements, memoryType, linear, allocation)) {
+            MemoryBudget::Instance().Track(memoryType, allocation.size, category);
+            return allocation;
+        }
+        typeBits &= ~(1u << memoryType);
+    }
+}
+
+bool MemoryAllocator::allocateFromBlocks(const vk::MemoryRequirements& requirements, uint32_t memoryType, bool linear,
+    MemoryAllocation& out)
+{
+    auto fill = [&](uint32_t index, const TLSF::Allocation& range) {
+        const auto& block = blocks_[index];
+        out.memory = block.memory;
+        out.offset = range.offset;
+        out.size = range.size;
+        out.mapped = block.mapped ? static_cast<char*>(block.mapped) + range.offset : nullptr;
+        out.memoryType = memoryType;
+        out.block = index;
+        out.node = range.node;
+    };
+
+    TLSF::Allocation range;
+    for (uint32_t i = 0; i < blocks_.size(); i++) {
+        auto& block = blocks_[i];
+        if (block.allocator && block.memoryType == memoryType && SharesBlock(granularity_, block.linear, linear) &&
+            block.allocator->allocate(requirements.size, requirements.alignment, range)) {
+            fill(i, range);
+            return true;
+        }
+    }
+
+    const vk::DeviceSize size = blockSize(memoryType);
+    auto memory = allocateMemory(size, memoryType, nullptr);
+    if (!memory) {
+        return false;
+    }
+    Block block;
+    block.memory = memory;
+    if (properties_.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        block.mapped = Context::GetInstance().device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+    }
+    block.memoryType = memoryType;
+    block.linear = linear;
+    block.allocator.reset(new TLSF(size));
+    uint32_t index = 0;
+    while (index < blocks_.size() && blocks_[index].allocator) {
+        index++;
+    }
+    if (index == blocks_.size()) {
+        blocks_.push_back(std::move(block));
+    }
+    else {
+        blocks_[index] = std::move(block);
+    }
+    // never fails, the allocation is at most half a block
+    blocks_[index].allocator->allocate(requirements.size, requirements.alignment, range);
+    fill(index, range);
+    return true;
+}
+
+bool MemoryAllocator::allocateDedicated(const vk::MemoryRequirements& requirements, uint32_t memoryType,
+    const vk::MemoryDedicatedAllocateInfo& dedicatedInfo, MemoryAllocation& out)
+{
+    auto memory = allocateMemory(requirements.size, memoryType, &dedicatedInfo);
+    if (!memory) {
+        return false;
+    }
+    out.memory = memory;
+    out.offset = 0;
+    out.size = requirements.size;
+    out.memoryType = memoryType;
+    out.node = TLSF::InvalidNode;
+    if (properties_.memoryTypes[memoryType].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        out.mapped = Context::GetInstance().device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+    }
+    dedicated_++;
+    dedicatedBytes_ += requirements.size;
+    return true;
+}
+
+vk::DeviceMemory MemoryAllocator::allocateMemory(vk::DeviceSize size, uint32_t memoryType,
+    const vk::MemoryDedicatedAllocateInfo* dedicated)
+{
+    vk::MemoryAllocateInfo info(size, memoryType);
+    // bufferDeviceAddress is always enabled, any buffer bound to the memory may ask for its address
+    vk::MemoryAllocateFlagsInfo flags(vk::MemoryAllocateFlagBits::eDeviceAddress);
+    if (!dedicated || dedicated->buffer) {
+        flags.setPNext(dedicated);
+        info.setPNext(&flags);
+    }
+    else {
+        info.setPNext(dedicated);
+    }
+    try {
+        return MemoryBudget::Instance().Allocate(info);
+    }
+    catch (const vk::OutOfDeviceMemoryError&) {
+        return nullptr;
+    }
+}
+
+vk::DeviceSize MemoryAllocator::blockSize(uint32_t memoryType) const
+{
+    // small heaps, like the 256 MB of host visible device memory without resizable BAR, get smaller blocks
+    const vk::DeviceSize heap = properties_.memoryHeaps[properties_.memoryTypes[memoryType].heapIndex].size;
+    return std::min(MaxBlockSize, std::max<vk::DeviceSize>(heap / 8, vk::DeviceSize(16) << 20));
+}
@@ -0,0 +1,169 @@
+#include "MemoryBudget.h"
+#include "Context.h"
+#include "log.h"
+
+#include <algorithm>
+#include <format>
+
+std::unique_ptr<MemoryBudget> MemoryBudget::instance_ = nullptr;
+
+const char* MemoryBudget::CategoryName(MemoryCategory category)
+{
+    switch (category) {
+    case MemoryCategory::Geometry:
+        return "Geometry";
+    case MemoryCategory::Textures:
+        return "Textures";
+    case MemoryCategory::RenderTargets:
+        return "Render targets";
+    case MemoryCategory::Staging:
+        return "Staging";
+    default:
+        return "Other";
+    }
+}
+
+MemoryCategory MemoryBudget::CategoryOf(vk::BufferUsageFlags usage, vk::MemoryPropertyFlags property)
+{
+    // uploads and readbacks only ever copy
+    const vk::BufferUsageFlags transfer = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+    if ((property & vk::MemoryPropertyFlagBits::eHostVisible) && !(usage & ~transfer)) {
+        return MemoryCategory::Staging;
+    }
+    const vk::BufferUsageFlags geometry = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eIndexBuffer |
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer |
+        vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eAccelerationStructureStorageKHR |
+        vk::BufferUsageFlagBits::eAccelerationStructureBuildInputReadOnlyKHR;
+    return (usage & geometry) ? MemoryCategory::Geometry : MemoryCategory::Other;
+}
+
+MemoryCategory MemoryBudget::CategoryOf(vk::ImageUsageFlags usage)
+{
+    const vk::ImageUsageFlags written = vk::ImageUsageFlagBits::eColorAttachment |
+        vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eStorage;
+    return (usage & written) ? MemoryCategory::RenderTargets : MemoryCategory::Textures;
+}
+
+vk::DeviceMemory MemoryBudget::Allocate(const vk::MemoryAllocateInfo& info)
+{
+    auto memory = Context::GetInstance().device.allocateMemory(info);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (heaps_.empty()) {
+        initHeaps();
+    }
+    const uint32_t heap = typeHeaps_[info.memoryTypeIndex];
+    allocations_.emplace(static_cast<VkDeviceMemory>(memory), Allocation{ info.allocationSize, heap });
+    heaps_[heap].allocated += info.allocationSize;
+    heaps_[heap].allocations++;
+    return memory;
+}
+
+void MemoryBudget::Free(vk::DeviceMemory memory)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = allocations_.find(static_cast<VkDeviceMemory>(memory));
+        if (it != allocations_.end()) {
+            heaps_[it->second.heap].allocated -= it->second.size;
+            heaps_[it->second.heap].allocations--;
+            allocations_.erase(it);
+        }
+    }
+    Context::GetInstance().device.freeMemory(memory);
+}
+
+void MemoryBudget::Track(uint32_t memoryType, vk::DeviceSize size, MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (heaps_.empty()) {
+        initHeaps();
+    }
+    auto& heap = heaps_[typeHeaps_[memoryType]];
+    heap.used += size;
+    heap.categories[static_cast<uint32_t>(category)] += size;
+}
+
+void MemoryBudget::Untrack(uint32_t memoryType, vk::DeviceSize size, MemoryCategory category)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& heap = heaps_[typeHeaps_[memoryType]];
+    heap.used -= size;
+    heap.categories[static_cast<uint32_t>(category)] -= size;
+}
+
+void MemoryBudget::Update()
+{
+    auto properties = Context::GetInstance().physicaldevice.getMemoryProperties2<vk::PhysicalDeviceMemoryProperties2,
+        vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+    const auto& budget = properties.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+    std::vector<std::pair<uint32_t, vk::DeviceSize>> pressure;
+    std::vector<PressureCallback> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (heaps_.empty()) {
+            initHeaps();
+        }
+        for (uint32_t i = 0; i < heaps_.size(); i++) {
+            auto& heap = heaps_[i];
+            heap.budget = budget.heapBudget[i];
+            heap.usage = budget.heapUsage[i];
+            const auto limit = static_cast<vk::DeviceSize>(double(heap.budget) * threshold_);
+            const bool pressured = heap.budget > 0 && heap.usage > limit;
+            if (pressured && !pressured_[i]) {
+                DEMO_LOG(Warning, std::format("Memory heap {} is above the pressure threshold, {:.1f} of {:.1f} MB used", i,
+                    heap.usage / (1024.0 * 1024.0), heap.budget / (1024.0 * 1024.0)));
+            }
+            pressured_[i] = pressured;
+            if (pressured) {
+                pressure.emplace_back(i, heap.usage - limit);
+            }
+        }
+        if (!pressure.empty()) {
+            for (const auto& [id, callback] : callbacks_) {
+                callbacks.push_back(callback);
+            }
+        }
+    }
+    // outside the lock, callbacks free memory
+    for (auto [heap, excess] : pressure) {
+        for (const auto& callback : callbacks) {
+            callback(heap, excess);
+        }
+    }
+}
+
+std::vector<MemoryBudget::Heap> MemoryBudget::Heaps()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return heaps_;
+}
+
+uint32_t MemoryBudget::AddPressureCallback(PressureCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t id = ++nextCallback_;
+    callbacks_.emplace_back(id, std::move(callback));
+    return id;
+}
+
+void MemoryBudget::RemovePressureCallback(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::erase_if(callbacks_, [&](const auto& entry) { return entry.first == id; });
+}
+
+void MemoryBudget::initHeaps()
+{
+    const auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
+    heaps_.resize(properties.memoryHeapCount);
+    pressured_.assign(properties.memoryHeapCount, false);
+    for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+        heaps_[i].size = properties.memoryHeaps[i].size;
+        heaps_[i].deviceLocal = static_cast<bool>(properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+    }
+    typeHeaps_.resize(properties.memoryTypeCount);
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        typeHeaps_[i] = properties.memoryTypes[i].heapIndex;
+    }
+}
@@ -0,0 +1,288 @@
+#include "MipGenerator.h"
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <numeric>
+
+namespace
+{
+    constexpr float KaiserRadius = 2.0f;
+    constexpr float KaiserAlpha = 4.0f;
+
+    bool isSrgb(vk::Format format)
+    {
+        return format == vk::Format::eR8G8B8A8Srgb || format == vk::Format::eB8G8R8A8Srgb;
+    }
+
+    float linearToSrgb(float c)
+    {
+        c = std::clamp(c, 0.0f, 1.0f);
+        return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    }
+
+    // decoding runs for every source texel, so it goes through a table
+    const float* srgbToLinearTable()
+    {
+        static const auto table = [] {
+            std::array<float, 256> values;
+            for (int i = 0; i < 256; i++)
+            {
+                const float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+            }();
+        return table.data();
+    }
+
+    float besselI0(float x)
+    {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 16; k++)
+        {
+            term *= (x / (2.0f * k)) * (x / (2.0f * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Kaiser windowed sinc, d in destination texels
+    float kaiser(float d)
+    {
+        if (std::abs(d) >= KaiserRadius)
+        {
+            return 0.0f;
+        }
+        const float pi = 3.14159265358979f;
+        const float sinc = d == 0.0f ? 1.0f : std::sin(pi * d) / (pi * d);
+        const float t = d / KaiserRadius;
+        return sinc * besselI0(KaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(KaiserAlpha);
+    }
+
+    struct Tap
+    {
+        uint32_t index;
+        float weight;
+    };
+
+    // weights of the source texels contributing to every destination texel along one axis,
+    // out of range texels are clamped to the edge
+    std::vector<std::vector<Tap>> computeTaps(uint32_t src, uint32_t dst, MipFilter filter)
+    {
+        const float scale = float(src) / float(dst);
+        std::vector<std::vector<Tap>> taps(dst);
+        for (uint32_t x = 0; x < dst; x++)
+        {
+            const float center = (x + 0.5f) * scale;
+            const float radius = (filter == MipFilter::Box ? 0.5f : KaiserRadius) * scale;
+            const int first = static_cast<int>(std::floor(center - radius));
+            const int last = static_cast<int>(std::ceil(center + radius));
+            float total = 0.0f;
+            for (int i = first; i < last; i++)
+            {
+                float weight;
+                if (filter == MipFilter::Box)
+                {
+                    // coverage of the source texel by the destination footprint
+                    weight = std::max(0.0f, std::min(i + 1.0f, center + radius) - std::max(float(i), center - radius));
+                }
+                else
+                {
+                    weight = kaiser((i + 0.5f - center) / scale);
+                }
+                if (weight == 0.0f)
+                {
+                    continue;
+                }
+                taps[x].push_back({ static_cast<uint32_t>(std::clamp(i, 0, int(src) - 1)), weight });
+                total += weight;
+            }
+            for (auto& tap : taps[x])
+            {
+                tap.weight /= total;
+            }
+        }
+        return taps;
+    }
+
+    template <typename Fn>
+    void parallelRows(uint32_t rows, Fn&& fn)
+    {
+        std::vector<uint32_t> indices(rows);
+        std::iota(indices.begin(), indices.end(), 0u);
+        std::for_each(std::execution::par, indices.begin(), indices.end(), fn);
+    }
+}
+
+bool MipGenerator::supportsCPU(vk::Format format, uint32_t bytesPerPixel)
+{
+    switch (format)
+    {
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+        return bytesPerPixel == 4;
+    case vk::Format::eR32G32B32A32Sfloat:
+        return bytesPerPixel == 16;
+    default:
+        return false;
+    }
+}
+
+bool MipGenerator::supportsBlit(vk::PhysicalDevice physicalDevice, vk::Format format)
+{
+    const auto features = physicalDevice.getFormatProperties(format).optimalTilingFeatures;
+    const auto required = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+        vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+    return (features & required) == required;
+}
+
+std::vector<MipGenerator::Level> MipGenerator::generate(const void* data, uint32_t width, uint32_t height,
+    uint32_t bytesPerPixel, vk::Format format, MipFilter filter, std::vector<unsigned char>& out)
+{
+    const uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+    std::vector<Level> levels;
+    size_t total = 0;
+    for (uint32_t i = 0, w = width, h = height; i < levelCount; i++, w = std::max(1u, w / 2), h = std::max(1u, h / 2))
+    {
+        levels.push_back({ w, h, total, size_t(w) * h * bytesPerPixel });
+        total += levels.back().size;
+    }
+    out.resize(total);
+    std::memcpy(out.data(), data, levels[0].size);
+
+    // the chain is filtered in linear float RGBA, each level from the previous unquantized one
+    const bool srgb = isSrgb(format);
+    const bool isFloat = format == vk::Format::eR32G32B32A32Sfloat;
+    std::vector<glm::vec4> current(size_t(width) * height);
+    parallelRows(height, [&](uint32_t y) {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const size_t texel = size_t(y) * width + x;
+            if (isFloat)
+            {
+                std::memcpy(&current[texel], static_cast<const float*>(data) + texel * 4, sizeof(glm::vec4));
+                continue;
+            }
+            const unsigned char* p = static_cast<const unsigned char*>(data) + texel * 4;
+            const float* table = srgbToLinearTable();
+            current[texel] = srgb ? glm::vec4(table[p[0]], table[p[1]], table[p[2]], p[3] / 255.0f) :
+                glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+        }
+        });
+
+    std::vector<glm::vec4> horizontal;
+    std::vector<glm::vec4> next;
+    for (uint32_t i = 1; i < levelCount; i++)
+    {
+        const uint32_t srcW = levels[i - 1].width;
+        const uint32_t srcH = levels[i - 1].height;
+        const uint32_t dstW = levels[i].width;
+        const uint32_t dstH = levels[i].height;
+        const auto tapsX = computeTaps(srcW, dstW, filter);
+        const auto tapsY = computeTaps(srcH, dstH, filter);
+
+        // separable: rows first, then columns
+        horizontal.assign(size_t(dstW) * srcH, glm::vec4(0.0f));
+        parallelRows(srcH, [&](uint32_t y) {
+            const glm::vec4* src = &current[size_t(y) * srcW];
+            glm::vec4* dst = &horizontal[size_t(y) * dstW];
+            for (uint32_t x = 0; x < dstW; x++)
+            {
+                glm::vec4 sum(0.0f);
+                for (const Tap& tap : tapsX[x])
+                {
+                    sum += src[tap.index] * tap.weight;
+                }
+                dst[x] = sum;
+            }
+            });
+        next.assign(size_t(dstW) * dstH, glm::vec4(0.0f));
+        parallelRows(dstH, [&](uint32_t y) {
+            glm::vec4* dst = &next[size_t(y) * dstW];
+            for (const Tap& tap : tapsY[y])
+            {
+                const glm::vec4* src = &horizontal[size_t(tap.index) * dstW];
+                for (uint32_t x = 0; x < dstW; x++)
+                {
+                    dst[x] += src[x] * tap.weight;
+                }
+            }
+
+            unsigned char* encoded = out.data() + levels[i].offset + size_t(y) * dstW * bytesPerPixel;
+            if (isFloat)
+            {
+                std::memcpy(encoded, dst, size_t(dstW) * sizeof(glm::vec4));
+                return;
+            }
+            for (uint32_t x = 0; x < dstW; x++)
+            {
+                glm::vec4 c = glm::clamp(dst[x], 0.0f, 1.0f);
+                if (srgb)
+                {
+                    c = glm::vec4(linearToSrgb(c.r), linearToSrgb(c.g), linearToSrgb(c.b), c.a);
+                }
+                const glm::vec4 bytes = glm::round(c * 255.0f);
+                encoded[x * 4 + 0] = static_cast<unsigned char>(bytes.r);
+                encoded[x * 4 + 1] = static_cast<unsigned char>(bytes.g);
+                encoded[x * 4 + 2] = static_cast<unsigned char>(bytes.b);
+                encoded[x * 4 + 3] = static_cast<unsigned char>(bytes.a);
+            }
+            });
+        std::swap(current, next);
+    }
+    return levels;
+}
+
+void MipGenerator::recordBlit(vk::CommandBuffer cmdbuf, vk::Image image, uint32_t width, uint32_t height, uint32_t levels)
+{
+    vk::ImageMemoryBarrier barrier;
+    barrier.setImage(image)
+        .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+        .setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
+
+    int32_t mipWidth = static_cast<int32_t>(width);
+    int32_t mipHeight = static_cast<int32_t>(height);
+    for (uint32_t i = 1; i < levels; i++)
+    {
+        barrier.subresourceRange.setBaseMipLevel(i - 1);
+        barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+            .setNewLayout(vk::ImageLayout::eTransferSrcOptimal)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead);
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, barrier);
+
+        const int32_t nextWidth = std::max(1, mipWidth / 2);
+        const int32_t nextHeight = std::max(1, mipHeight / 2);
+        vk::ImageBlit blit;
+        blit.setSrcSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i - 1, 0, 1))
+            .setSrcOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1) })
+            .setDstSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, 1))
+            .setDstOffsets({ vk::Offset3D(0, 0, 0), vk::Offset3D(nextWidth, nextHeight, 1) });
+        cmdbuf.blitImage(image, vk::ImageLayout::eTransferSrcOptimal, image, vk::ImageLayout::eTransferDstOptimal,
+            blit, vk::Filter::eLinear);
+
+        barrier.setOldLayout(vk::ImageLayout::eTransferSrcOptimal)
+            .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferRead)
+            .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, barrier);
+
+        mipWidth = nextWidth;
+        mipHeight = nextHeight;
+    }
+
+    barrier.subresourceRange.setBaseMipLevel(levels - 1);
+    barrier.setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+        .setNewLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+        .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+        .setDstAccessMask(vk::AccessFlagBits::eShaderRead);
+    cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, barrier);
+}
@@ -1,9 +1,23 @@
 #include "Pipeline.h"
 #include "Context.h"
+#include "DeletionQueue.h"
+#include "DescriptorUpdater.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
 
 
 static constexpr int MAX_DESCRIPTOR_SETS = 4096 * 3;
 
+std::mutex Pipeline::s_permutationMutex;
+std::unordered_map<std::string, uint32_t> Pipeline::s_specializationDefaults;
+std::vector<Pipeline*> Pipeline::s_permutable;
+
 #define ASSERT(expr, message) \
   {                           \
     void(message);            \
@@ -30,18 +44,34 @@ Pipeline::Pipeline(const RayTracingPipelineDescriptor& desc, const std::string&
 
 Pipeline::~Pipeline()
 {
+	unregisterPermutable(this);
 	auto device = Context::GetInstance().device;
-	device.destroyPipeline(m_pipeline);
+	// the jobs read the descriptor and the layout
+	for (auto& variant : m_variants)
+	{
+		if (variant.second.compile.valid())
+		{
+			variant.second.pipeline = variant.second.compile.get();
+		}
+		device.destroyPipeline(variant.second.pipeline);
+	}
 	device.destroyPipelineLayout(m_pipelineLayout);
+	// writes still queued for the sets must not reach them once they are freed
+	DescriptorUpdater::Instance().Flush();
 	device.destroyDescriptorPool(m_descPool);
 	for (const auto& set : m_descriptorSets)
 	{
-		device.destroyDescriptorSetLayout(set.second.vkLayout);
+		device.destroyDescriptorUpdateTemplate(set.second.updateTemplate);
+		if (!set.second.shared)
+		{
+			device.destroyDescriptorSetLayout(set.second.vkLayout);
+		}
 	}
 }
 
 vk::Pipeline Pipeline::vkPipeline() const
 {
+	resolve();
 	return m_pipeline;
 }
 
@@ -57,6 +87,7 @@ void Pipeline::updatePushConstant(vk::CommandBuffer cmdbuf, vk::ShaderStageFlags
 
 void Pipeline::bind(vk::CommandBuffer cmdbuf)
 {
+	resolve();
 	cmdbuf.bindPipeline(bindPoint, m_pipeline);
 	updateDescriptorSets();
 }
@@ -83,6 +114,10 @@ void Pipeline::allocateDescriptors(const std::vector<SetAndCount>& setAndCount)
 	for (auto set : setAndCount)
 	{
 		ASSERT(m_descriptorSets.contains(set.set), "This pipeline doesn't have a set with index " + std::to_string(set.set));
+		if (m_descriptorSets[set.set].shared)
+		{
+			continue;
+		}
 		vk::DescriptorSetAllocateInfo descSetAI;
 		descSetAI.setDescriptorPool(m_descPool)
 			.setDescriptorSetCount(1)
@@ -99,140 +134,70 @@ void Pipeline::bindDescriptorSets(vk::CommandBuffer commandBuffer, const std::ve
 {
 	for (const auto& set : sets)
 	{
-		commandBuffer.bindDescriptorSets(bindPoint, m_pipelineLayout, set.set, m_descriptorSets[set.set].vkSets[set.bindIdx], {});
+		const auto& descriptorSet = m_descriptorSets[set.set];
+		commandBuffer.bindDescriptorSets(bindPoint, m_pipelineLayout, set.set,
+			descriptorSet.vkSets[descriptorSet.shared ? 0 : set.bindIdx], set.dynamicOffsets);
 	}
 }
 
 void Pipeline::updateSamplersDescriptorSets(uint32_t set, uint32_t index, const std::vector<SetBindings>& bindings)
 {
 	ASSERT(!bindings.empty(), "bindings are empty");
-	std::vector<std::vector<vk::DescriptorImageInfo>> samplerInfo(bindings.size());
-	std::vector<vk::WriteDescriptorSet> writeDescSets; 
-	writeDescSets.reserve(bindings.size());
-	for (size_t idx = 0; auto & binding : bindings)
+	for (const auto& binding : bindings)
 	{
-		samplerInfo[idx].reserve(binding.samplers.size());
-		for (const auto& sampler : binding.samplers)
-		{
-			vk::DescriptorImageInfo si;
-			si.setSampler(sampler->vkSampler());
-			samplerInfo[idx].push_back(si);
-		}
-		vk::WriteDescriptorSet writeDescSet;
-		writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-			.setDstBinding(binding.binding_)
-			.setDstArrayElement(0)
-			.setDescriptorCount(samplerInfo[idx].size())
-			.setDescriptorType(vk::DescriptorType::eSampler)
-			.setImageInfo(samplerInfo[idx]);
-		writeDescSets.emplace_back(std::move(writeDescSet));
-		++idx;
+		bindResource(set, binding.binding_, index, binding.samplers);
 	}
-	Context::GetInstance().device.updateDescriptorSets(writeDescSets, {});
 }
 
 void Pipeline::updateTexturesDescriptorSets(uint32_t set, uint32_t index, const std::vector<SetBindings>& bindings)
 {
 	ASSERT(!bindings.empty(), "bindings are empty");
-	std::vector<std::vector<vk::DescriptorImageInfo>> imageInfo(bindings.size());
-	std::vector<vk::WriteDescriptorSet> writeDescSets;
-	writeDescSets.reserve(bindings.size());
-	for (size_t idx = 0; auto & binding : bindings)
+	for (const auto& binding : bindings)
 	{
-		imageInfo[idx].reserve(binding.textures.size());
-		for (const auto& texture : binding.textures)
-		{
-			vk::DescriptorImageInfo si;
-			si.setImageView(texture->view)
-				.setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
-			imageInfo[idx].push_back(si);
-		}
-		vk::WriteDescriptorSet writeDescSet;
-		writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-			.setDstBinding(binding.binding_)
-			.setDstArrayElement(0)
-			.setDescriptorCount(imageInfo[idx].size())
-			.setDescriptorType(vk::DescriptorType::eSampledImage)
-			.setImageInfo(imageInfo[idx]);
-		writeDescSets.emplace_back(std::move(writeDescSet));
-		++idx;
+		bindResource(set, binding.binding_, index, binding.textures);
 	}
-	Context::GetInstance().device.updateDescriptorSets(writeDescSets, {});
 }
 
 void Pipeline::updateBuffersDescriptorSets(uint32_t set, uint32_t index, vk::DescriptorType type, const std::vector<SetBindings>& bindings)
 {
 	ASSERT(!bindings.empty(), "bindings are empty");
-	std::vector<vk::DescriptorBufferInfo> bufferInfo;
-	//bufferInfo.reserve(bindings.size());
-	std::vector<vk::WriteDescriptorSet> writeDescSets;
-	writeDescSets.reserve(bindings.size());
-
-	for (auto& binding : bindings) {
-		vk::DescriptorBufferInfo bi;
-		bi.setBuffer(binding.buffer->buffer)
-			.setOffset(0)
-			.setRange(binding.bufferBytes);
-		bufferInfo.push_back(bi);
-	
-		vk::WriteDescriptorSet writeDescSet;
-		writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-			.setDstBinding(binding.binding_)
-			.setDstArrayElement(0)
-			.setDescriptorCount(1)
-			.setDescriptorType(type)
-			.setBufferInfo(bufferInfo.back());
-
-		writeDescSets.emplace_back(writeDescSet);
+	for (const auto& binding : bindings)
+	{
+		const vk::DescriptorBufferInfo bufferInfo(binding.buffer->buffer, 0, binding.bufferBytes);
+		DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding.binding_, 0, type,
+			std::span(&bufferInfo, 1));
 	}
-	Context::GetInstance().device.updateDescriptorSets(writeDescSets, {});
 }
 
 void Pipeline::updateDescriptorSets()
 {
-	if (!m_writeDescSets.empty())
-	{
-		std::unique_lock<std::mutex> mLock(mutex);
-		Context::GetInstance().device.updateDescriptorSets(m_writeDescSets, {});
+	DescriptorUpdater::Instance().Flush();
+}
 
-		m_writeDescSets.clear();
-		m_bufferInfo.clear();
-		m_bufferViewInfo.clear();
-		m_imageInfo.clear();
-		accelerationStructInfo.clear();
-	}
+void Pipeline::updateDescriptorSet(uint32_t set, uint32_t index, const void* data, size_t size)
+{
+	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
+	const vk::DescriptorUpdateTemplate updateTemplate = descriptorUpdateTemplate(set);
+	ASSERT(size == m_descriptorSets[set].templateSize, "The data doesn't match the bindings of the set");
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], updateTemplate, data, size);
 }
 
+// the infos of a call are gathered here before the updater copies them
+static thread_local std::vector<vk::DescriptorImageInfo> s_imageInfos;
+static thread_local std::vector<vk::DescriptorBufferInfo> s_bufferInfos;
+
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::shared_ptr<Buffer> buffer, uint32_t offset, uint32_t size, vk::DescriptorType type, vk::Format format)
 {
-	vk::DescriptorBufferInfo bufferInfo;
-	bufferInfo.setBuffer(buffer->buffer)
-		.setOffset(offset)
-		.setRange(size);
-	m_bufferInfo.emplace_back(std::vector<vk::DescriptorBufferInfo>{bufferInfo});
+	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
 	if (type == vk::DescriptorType::eStorageTexelBuffer || type == vk::DescriptorType::eUniformTexelBuffer)
 	{
 		ASSERT(format != vk::Format::eUndefined, "format must be specified");
-		// TODO: Bufferûvk::BufferView
+		// TODO: Buffer has no vk::BufferView to write yet
 		//bufferViewInfo_.emplace_back(buffer->requestBufferView(format));
+		return;
 	}
-	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
-	
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(1)
-		.setDescriptorType(type);
-	if (type == vk::DescriptorType::eStorageTexelBuffer || type == vk::DescriptorType::eUniformTexelBuffer)
-	{
-		writeDescSet.setTexelBufferView(m_bufferViewInfo.back());
-	}
-	else
-	{
-		writeDescSet.setBufferInfo(m_bufferInfo.back());
-	}
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	const vk::DescriptorBufferInfo bufferInfo(buffer->buffer, offset, size);
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, type, std::span(&bufferInfo, 1));
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::span<std::shared_ptr<Texture>> textures, std::shared_ptr<Sampler> sampler, uint32_t dstArrayElement)
@@ -241,9 +206,8 @@ void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std:
 	{
 		return;
 	}
-	std::unique_lock<std::mutex> mlock(mutex);
-	std::vector<vk::DescriptorImageInfo> imageInfos;
-	imageInfos.reserve(textures.size());
+	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
+	s_imageInfos.clear();
 	for (const auto& texture : textures)
 	{
 		vk::DescriptorImageInfo imageInfo;
@@ -253,180 +217,118 @@ void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std:
 		{
 			imageInfo.setSampler(sampler->vkSampler());
 		}
-		imageInfos.emplace_back(imageInfo);
+		s_imageInfos.push_back(imageInfo);
 	}
-	m_imageInfo.push_back(imageInfos);
-	if (imageInfos.empty())
-	{
-		return;
-	}
-	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(dstArrayElement)
-		.setDescriptorType((sampler ? vk::DescriptorType::eCombinedImageSampler : vk::DescriptorType::eSampledImage))
-		.setDescriptorCount(imageInfos.size())
-		.setImageInfo(m_imageInfo.back());
-
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, dstArrayElement,
+		sampler ? vk::DescriptorType::eCombinedImageSampler : vk::DescriptorType::eSampledImage, s_imageInfos);
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::span<std::shared_ptr<Sampler>> samplers)
 {
-	std::vector<vk::DescriptorImageInfo> imageInfos;
-	imageInfos.reserve(samplers.size());
+	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
+	s_imageInfos.clear();
 	for (const auto& sampler : samplers)
 	{
 		vk::DescriptorImageInfo imageInfo;
 		imageInfo.setSampler(sampler->vkSampler());
-		imageInfos.emplace_back(imageInfo);
+		s_imageInfos.push_back(imageInfo);
 	}
-	m_imageInfo.push_back(imageInfos);
-
-	ASSERT(m_descriptorSets[set].vkSets[index], "Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorType(vk::DescriptorType::eSampler)
-		.setDescriptorCount(imageInfos.size())
-		.setImageInfo(m_imageInfo.back());
-
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, vk::DescriptorType::eSampler,
+		s_imageInfos);
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::span<vk::ImageView> imageViews, vk::DescriptorType type)
 {
-	std::vector<vk::DescriptorImageInfo> imageInfos;
-	imageInfos.reserve(imageViews.size());
+	ASSERT(m_descriptorSets[set].vkSets[index],
+		"Did you allocate the descriptor set before binding to it?");
+	s_imageInfos.clear();
 	for (const auto& imview : imageViews)
 	{
 		vk::DescriptorImageInfo imageInfo;
 		imageInfo.setImageView(imview)
 			.setImageLayout(vk::ImageLayout::eGeneral);
-		imageInfos.push_back(imageInfo);
+		s_imageInfos.push_back(imageInfo);
 	}
-	m_imageInfo.push_back(imageInfos);
-	ASSERT(m_descriptorSets[set].vkSets[index],
-		"Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(imageInfos.size())
-		.setDescriptorType(type)
-		.setImageInfo(m_imageInfo.back());
-
-	m_writeDescSets.emplace_back(writeDescSet);
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, type, s_imageInfos);
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::vector<std::shared_ptr<Buffer>> buffers, vk::DescriptorType type)
 {
-	std::vector<vk::DescriptorBufferInfo> bufferInfos;
+	ASSERT(m_descriptorSets[set].vkSets[index],
+		"Did you allocate the descriptor set before binding to it?");
+	s_bufferInfos.clear();
 	for (auto& buffer : buffers)
 	{
 		vk::DescriptorBufferInfo bufferInfo;
 		bufferInfo.setBuffer(buffer->buffer)
 			.setOffset(0)
 			.setRange(buffer->size);
-		bufferInfos.push_back(bufferInfo);
+		s_bufferInfos.push_back(bufferInfo);
 	}
-	m_bufferInfo.push_back(bufferInfos);
-	ASSERT(m_descriptorSets[set].vkSets[index],
-		"Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(bufferInfos.size())
-		.setDescriptorType(type)
-		.setBufferInfo(m_bufferInfo.back());
-
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, type, s_bufferInfos);
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::shared_ptr<Texture> texture, vk::DescriptorType type)
 {
-	std::vector<vk::DescriptorImageInfo> imageInfos;
+	ASSERT(m_descriptorSets[set].vkSets[index],
+		"Did you allocate the descriptor set before binding to it?");
 	vk::DescriptorImageInfo imageInfo;
 	imageInfo.setImageView(texture->view)
 		.setImageLayout(vk::ImageLayout::eGeneral);
-	imageInfos.push_back(imageInfo);
-	m_imageInfo.push_back(imageInfos);
-	ASSERT(m_descriptorSets[set].vkSets[index],
-		"Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(imageInfos.size())
-		.setDescriptorType(type)
-		.setImageInfo(m_imageInfo.back());
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, type, std::span(&imageInfo, 1));
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, std::shared_ptr<Texture> texture, std::shared_ptr<Sampler> sampler, vk::DescriptorType type)
 {
-	std::vector<vk::DescriptorImageInfo> imageInfos;
+	ASSERT(m_descriptorSets[set].vkSets[index],
+		"Did you allocate the descriptor set before binding to it?");
 	vk::DescriptorImageInfo imageInfo;
 	imageInfo.setSampler(sampler->vkSampler())
 		.setImageView(texture->view)
 		.setImageLayout(vk::ImageLayout::eGeneral);
-	imageInfos.push_back(imageInfo);
-	m_imageInfo.push_back(imageInfos);
-	ASSERT(m_descriptorSets[set].vkSets[index],
-		"Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(imageInfos.size())
-		.setDescriptorType(type)
-		.setImageInfo(m_imageInfo.back());
-	m_writeDescSets.emplace_back(std::move(writeDescSet));
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, 0, type, std::span(&imageInfo, 1));
 }
 
 void Pipeline::bindResource(uint32_t set, uint32_t binding, uint32_t index, vk::AccelerationStructureKHR* accelStructHandle)
 {
-	vk::WriteDescriptorSetAccelerationStructureKHR accelerationSI;
-	accelerationSI.setAccelerationStructureCount(1)
-		.setPAccelerationStructures(accelStructHandle);
-	accelerationStructInfo.push_back(accelerationSI);
 	ASSERT(m_descriptorSets[set].vkSets[index],
 		"Did you allocate the descriptor set before binding to it?");
-
-	vk::WriteDescriptorSet writeDescSet;
-	writeDescSet.setPNext(&accelerationStructInfo.back())
-		.setDstSet(m_descriptorSets[set].vkSets[index])
-		.setDstBinding(binding)
-		.setDstArrayElement(0)
-		.setDescriptorCount(1u)
-		.setDescriptorType(vk::DescriptorType::eAccelerationStructureKHR);
-	m_writeDescSets.emplace_back(writeDescSet);
+	DescriptorUpdater::Instance().Write(m_descriptorSets[set].vkSets[index], binding, *accelStructHandle);
 }
 
 void Pipeline::createGraphicsPipeline()
 {
-	vk::SpecializationInfo vertexSpecializationInfo;
-	vertexSpecializationInfo.setMapEntries(graphicsPipelineDesc.vertexSpecConstants)
-		.setDataSize((!graphicsPipelineDesc.vertexSpecConstants.empty() ?
-			graphicsPipelineDesc.vertexSpecConstants.back().offset +
-			graphicsPipelineDesc.vertexSpecConstants.back().size : 0))
-		.setPData(graphicsPipelineDesc.vertexSpecializationData);
+	keepShader(graphicsPipelineDesc.vertexShader);
+	keepShader(graphicsPipelineDesc.fragmentShader);
+	graphicsPipelineDesc.vertexSpecializationData = keepSpecializationData(graphicsPipelineDesc.vertexSpecConstants,
+		graphicsPipelineDesc.vertexSpecializationData);
+	graphicsPipelineDesc.fragmentSpecializationData = keepSpecializationData(graphicsPipelineDesc.fragmentSpecConstants,
+		graphicsPipelineDesc.fragmentSpecializationData);
 
-	vk::SpecializationInfo fragmentSpecializationInfo;
-	fragmentSpecializationInfo.setMapEntries(graphicsPipelineDesc.fragmentSpecConstants)
-		.setDataSize((!graphicsPipelineDesc.fragmentSpecConstants.empty() ?
-			graphicsPipelineDesc.fragmentSpecConstants.back().offset +
-			graphicsPipelineDesc.fragmentSpecConstants.back().size : 0))
-		.setPData(graphicsPipelineDesc.fragmentSpecializationData);
+	// Descriptor Set
+	initDescriptorLayout();
+
+	// End of descriptor set layout
+	// TODO: does order matter in descSetLayouts? YES!
+	std::vector<vk::DescriptorSetLayout> descSetLayouts(m_descriptorSets.size());
+	for (const auto& set : m_descriptorSets)
+	{
+		descSetLayouts[set.first] = set.second.vkLayout;
+	}
+
+	m_pipelineLayout = createPipelineLayout(descSetLayouts, graphicsPipelineDesc.pushConstants);
+	initPermutations(graphicsPipelineDesc.permutations);
+	requestVariant();
+}
+
+vk::Pipeline Pipeline::compileGraphicsPipeline(const std::vector<uint32_t>& values, const std::string& variantName)
+{
+	Specialization vertexSpecialization;
+	Specialization fragmentSpecialization;
+	const vk::SpecializationInfo* vertexSpecializationInfo = specialize(vertexSpecialization, vk::ShaderStageFlagBits::eVertex,
+		graphicsPipelineDesc.vertexSpecConstants, graphicsPipelineDesc.vertexSpecializationData, values);
+	const vk::SpecializationInfo* fragmentSpecializationInfo = specialize(fragmentSpecialization, vk::ShaderStageFlagBits::eFragment,
+		graphicsPipelineDesc.fragmentSpecConstants, graphicsPipelineDesc.fragmentSpecializationData, values);
 
 	const auto vertShader = graphicsPipelineDesc.vertexShader.lock();
 	const auto fragShader = graphicsPipelineDesc.fragmentShader.lock();
@@ -437,19 +339,19 @@ void Pipeline::createGraphicsPipeline()
 	shaderStages[0].setStage(vk::ShaderStageFlagBits::eVertex)
 		.setModule(vertShader->module)
 		.setPName(vertShader->name.c_str())
-		.setPSpecializationInfo((!graphicsPipelineDesc.vertexSpecConstants.empty() ?
-			&vertexSpecializationInfo : nullptr));
+		.setPSpecializationInfo(vertexSpecializationInfo);
 	shaderStages[1].setStage(vk::ShaderStageFlagBits::eFragment)
 		.setModule(fragShader->module)
 		.setPName(fragShader->name.c_str())
-		.setPSpecializationInfo((!graphicsPipelineDesc.fragmentSpecConstants.empty() ?
-			&fragmentSpecializationInfo : nullptr));
+		.setPSpecializationInfo(fragmentSpecializationInfo);
 
 	vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
 	inputAssembly.setTopology(graphicsPipelineDesc.primitiveTopology)
 		.setPrimitiveRestartEnable(VK_FALSE);
 
-	graphicsPipelineDesc.vertexInputCI.setVertexAttributeDescriptionCount(0)
+	// a copy, variants compile on worker threads and the descriptor is only ever read
+	vk::PipelineVertexInputStateCreateInfo vertexInputCI = graphicsPipelineDesc.vertexInputCI;
+	vertexInputCI.setVertexAttributeDescriptionCount(0)
 		.setVertexBindingDescriptionCount(0);
 
 	vk::Viewport viewport = graphicsPipelineDesc.viewport;
@@ -508,19 +410,6 @@ void Pipeline::createGraphicsPipeline()
 		.setAttachments(colorBlendAttachments)
 		.setBlendConstants({ 0.0f, 0.0f, 0.0f, 0.0f });
 
-	// Descriptor Set
-	initDescriptorLayout();
-
-	// End of descriptor set layout
-	// TODO: does order matter in descSetLayouts? YES!
-	std::vector<vk::DescriptorSetLayout> descSetLayouts(m_descriptorSets.size());
-	for (const auto& set : m_descriptorSets)
-	{
-		descSetLayouts[set.first] = set.second.vkLayout;
-	}
-
-	m_pipelineLayout = createPipelineLayout(descSetLayouts, graphicsPipelineDesc.pushConstants);
-
 	vk::PipelineDepthStencilStateCreateInfo depthStencilSCI;
 	depthStencilSCI.setDepthTestEnable(graphicsPipelineDesc.depthTestEnable)
 		.setDepthWriteEnable(graphicsPipelineDesc.depthWriteEnable)
@@ -541,10 +430,15 @@ void Pipeline::createGraphicsPipeline()
 		.setDepthAttachmentFormat(graphicsPipelineDesc.depthTextureFormat)
 		.setStencilAttachmentFormat(graphicsPipelineDesc.stencilTextureFormat);
 
+	vk::PipelineCreationFeedback feedback;
+	vk::PipelineCreationFeedbackCreateInfo feedbackCI;
+	feedbackCI.setPPipelineCreationFeedback(&feedback)
+		.setPNext(graphicsPipelineDesc.useDynamicRendering ? &pipelineRenderCI : nullptr);
+
 	vk::GraphicsPipelineCreateInfo pipelineCI;
-	pipelineCI.setPNext(graphicsPipelineDesc.useDynamicRendering ? &pipelineRenderCI : nullptr)
+	pipelineCI.setPNext(&feedbackCI)
 		.setStages(shaderStages)
-		.setPVertexInputState(&graphicsPipelineDesc.vertexInputCI)
+		.setPVertexInputState(&vertexInputCI)
 		.setPInputAssemblyState(&inputAssembly)
 		.setPViewportState(&viewportSCI)
 		.setPRasterizationState(&rasterizerSCI)
@@ -557,25 +451,22 @@ void Pipeline::createGraphicsPipeline()
 		.setBasePipelineHandle({})
 		.setBasePipelineIndex(-1);
 
-	auto result = Context::GetInstance().device.createGraphicsPipelines({}, pipelineCI);
+	const auto start = std::chrono::steady_clock::now();
+	auto result = Context::GetInstance().device.createGraphicsPipelines(PipelineCache::Instance().Handle(), pipelineCI);
+	PipelineCache::Instance().Record(variantName,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), feedback);
 	if (result.result != vk::Result::eSuccess)
 	{
 
 	}
-	m_pipeline = result.value[0];
+	return result.value[0];
 }
 
 void Pipeline::createComputePipeline()
 {
-	const auto computeShader = computePipelineDesc.computerShader.lock();
-	ASSERT(computeShader, "Compute's ShaderModule has been destroyed before being used to create a pipeline");
-
-	vk::SpecializationInfo specializationInfo;
-	specializationInfo.setMapEntries(computePipelineDesc.specializationConsts)
-		.setDataSize((!computePipelineDesc.specializationConsts.empty() ?
-			computePipelineDesc.specializationConsts.back().offset +
-			computePipelineDesc.specializationConsts.back().size : 0))
-		.setPData(computePipelineDesc.specializationData_);
+	keepShader(computePipelineDesc.computerShader);
+	computePipelineDesc.specializationData_ = keepSpecializationData(computePipelineDesc.specializationConsts,
+		computePipelineDesc.specializationData_);
 
 	initDescriptorLayout();
 
@@ -585,26 +476,57 @@ void Pipeline::createComputePipeline()
 		descSetLayouts.push_back(set.second.vkLayout);
 	}
 	m_pipelineLayout = createPipelineLayout(descSetLayouts, computePipelineDesc.pushConstants);
+	initPermutations(computePipelineDesc.permutations);
+	requestVariant();
+}
+
+vk::Pipeline Pipeline::compileComputePipeline(const std::vector<uint32_t>& values, const std::string& variantName)
+{
+	const auto computeShader = computePipelineDesc.computerShader.lock();
+	ASSERT(computeShader, "Compute's ShaderModule has been destroyed before being used to create a pipeline");
+
+	Specialization specialization;
+	const vk::SpecializationInfo* specializationInfo = specialize(specialization, vk::ShaderStageFlagBits::eCompute,
+		computePipelineDesc.specializationConsts, computePipelineDesc.specializationData_, values);
 
 	vk::PipelineShaderStageCreateInfo shaderStage;
 	//TODO: òͬstage
 	shaderStage.setStage(vk::ShaderStageFlagBits::eCompute)
 		.setModule(computeShader->module)
-		.setPName(computeShader->name.c_str());
+		.setPName(computeShader->name.c_str())
+		.setPSpecializationInfo(specializationInfo);
+
+	vk::PipelineCreationFeedback feedback;
+	vk::PipelineCreationFeedbackCreateInfo feedbackCI;
+	feedbackCI.setPPipelineCreationFeedback(&feedback);
 
 	vk::ComputePipelineCreateInfo computePipelineCI;
-	computePipelineCI.setStage(shaderStage)
+	computePipelineCI.setPNext(&feedbackCI)
+		.setStage(shaderStage)
 		.setLayout(m_pipelineLayout);
 
-	auto result = Context::GetInstance().device.createComputePipelines({}, computePipelineCI);
+	const auto start = std::chrono::steady_clock::now();
+	auto result = Context::GetInstance().device.createComputePipelines(PipelineCache::Instance().Handle(), computePipelineCI);
+	PipelineCache::Instance().Record(variantName,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), feedback);
 	if (result.result != vk::Result::eSuccess)
 	{
 	}
-	m_pipeline = result.value[0];
+	return result.value[0];
 }
 
 void Pipeline::createRayTracingPipeline()
 {
+	keepShader(rayTracingPipelineDesc.rayGenShader);
+	for (const auto& shader : rayTracingPipelineDesc.rayMissShaders)
+	{
+		keepShader(shader);
+	}
+	for (const auto& shader : rayTracingPipelineDesc.rayClosestHitShaders)
+	{
+		keepShader(shader);
+	}
+
 	initDescriptorLayout();
 
 	std::vector<vk::DescriptorSetLayout> descSetLayouts;
@@ -613,7 +535,11 @@ void Pipeline::createRayTracingPipeline()
 		descSetLayouts.push_back(set.second.vkLayout);
 	}
 	m_pipelineLayout = createPipelineLayout(descSetLayouts, rayTracingPipelineDesc.pushConstants);
+	requestVariant();
+}
 
+vk::Pipeline Pipeline::compileRayTracingPipeline(const std::string& variantName)
+{
 	std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
 	std::vector<vk::RayTracingShaderGroupCreateInfoKHR> shaderGroups;
 
@@ -672,8 +598,13 @@ void Pipeline::createRayTracingPipeline()
 		shaderGroups.push_back(shaderGroup);
 	}
 
+	vk::PipelineCreationFeedback feedback;
+	vk::PipelineCreationFeedbackCreateInfo feedbackCI;
+	feedbackCI.setPPipelineCreationFeedback(&feedback);
+
 	vk::RayTracingPipelineCreateInfoKHR rayTracingPipelineInfo;
-	rayTracingPipelineInfo.setStages(shaderStages)
+	rayTracingPipelineInfo.setPNext(&feedbackCI)
+		.setStages(shaderStages)
 		.setGroups(shaderGroups)
 		.setMaxPipelineRayRecursionDepth(10)
 		.setLayout(m_pipelineLayout);
@@ -686,11 +617,207 @@ void Pipeline::createRayTracingPipeline()
 	{
 	}
 	//dls.vkCreateRayTracingPipelinesKHR
-	auto result = Context::GetInstance().device.createRayTracingPipelinesKHR({}, {}, rayTracingPipelineInfo, nullptr, dld);
+	const auto start = std::chrono::steady_clock::now();
+	auto result = Context::GetInstance().device.createRayTracingPipelinesKHR({}, PipelineCache::Instance().Handle(),
+		rayTracingPipelineInfo, nullptr, dld);
+	PipelineCache::Instance().Record(variantName,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), feedback);
 	if (result.result != vk::Result::eSuccess)
 	{
 	}
-	m_pipeline = result.value[0];
+	return result.value[0];
+}
+
+void Pipeline::setSpecialization(const std::string& constant, uint32_t value)
+{
+	for (auto& permutation : m_permutations)
+	{
+		if (permutation.name == constant)
+		{
+			permutation.value = std::clamp(value, permutation.minValue, permutation.maxValue);
+			requestVariant();
+			return;
+		}
+	}
+	DEMO_LOG(Warning, std::format("Pipeline {} has no specialization constant {}", name, constant));
+}
+
+void Pipeline::SetSpecializationDefault(const std::string& constant, uint32_t value)
+{
+	std::lock_guard<std::mutex> lock(s_permutationMutex);
+	s_specializationDefaults[constant] = value;
+}
+
+std::vector<Pipeline*> Pipeline::Permutable()
+{
+	std::lock_guard<std::mutex> lock(s_permutationMutex);
+	return s_permutable;
+}
+
+void Pipeline::initPermutations(const std::vector<SpecConstant>& permutations)
+{
+	m_permutations = permutations;
+	if (m_permutations.empty())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(s_permutationMutex);
+	for (auto& permutation : m_permutations)
+	{
+		const auto value = s_specializationDefaults.find(permutation.name);
+		if (value != s_specializationDefaults.end())
+		{
+			permutation.value = value->second;
+		}
+		permutation.value = std::clamp(permutation.value, permutation.minValue, permutation.maxValue);
+	}
+	s_permutable.push_back(this);
+}
+
+void Pipeline::unregisterPermutable(Pipeline* pipeline)
+{
+	if (pipeline->m_permutations.empty())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(s_permutationMutex);
+	std::erase(s_permutable, pipeline);
+}
+
+void Pipeline::requestVariant()
+{
+	m_selected.clear();
+	std::string variantName = name;
+	for (size_t i = 0; i < m_permutations.size(); i++)
+	{
+		m_selected.push_back(m_permutations[i].value);
+		variantName += std::format("{}{}={}", i ? ", " : " [", m_permutations[i].name, m_permutations[i].value);
+	}
+	if (!m_permutations.empty())
+	{
+		variantName += "]";
+	}
+	if (m_variants.contains(m_selected))
+	{
+		return;
+	}
+	m_variants[m_selected].compile = PipelineCompiler::Instance().Compile(variantName,
+		[this, values = m_selected, variantName]()
+		{
+			switch (bindPoint)
+			{
+			case vk::PipelineBindPoint::eGraphics:
+				return compileGraphicsPipeline(values, variantName);
+			case vk::PipelineBindPoint::eCompute:
+				return compileComputePipeline(values, variantName);
+			default:
+				return compileRayTracingPipeline(variantName);
+			}
+		});
+}
+
+void Pipeline::resolve() const
+{
+	auto& selected = m_variants.at(m_selected);
+	if (selected.compile.valid())
+	{
+		const bool ready = selected.compile.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		if (!ready && m_pipeline)
+		{
+			// a switch keeps the variant it came from bound until the new one is built
+			return;
+		}
+		if (!ready)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			selected.compile.wait();
+			PipelineCompiler::Instance().Waited(name,
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		selected.pipeline = selected.compile.get();
+	}
+	m_pipeline = selected.pipeline;
+	// the modules are not needed once the pipeline exists, unless other variants may be built from them
+	if (m_permutations.empty())
+	{
+		m_shaders.clear();
+	}
+	if (m_variants.size() > 1)
+	{
+		dropUnusedVariants();
+	}
+}
+
+void Pipeline::dropUnusedVariants() const
+{
+	for (auto it = m_variants.begin(); it != m_variants.end();)
+	{
+		auto& variant = it->second;
+		// a job still running reads the descriptor, it is dropped on a later call
+		const bool building = variant.compile.valid() &&
+			variant.compile.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+		if (it->first == m_selected || building || (variant.pipeline && variant.pipeline == m_pipeline))
+		{
+			++it;
+			continue;
+		}
+		if (variant.compile.valid())
+		{
+			variant.pipeline = variant.compile.get();
+		}
+		// frames in flight may still have it bound
+		DeletionQueue::Instance().Retire(variant.pipeline);
+		it = m_variants.erase(it);
+	}
+}
+
+const vk::SpecializationInfo* Pipeline::specialize(Specialization& out, vk::ShaderStageFlagBits stage,
+	const std::vector<vk::SpecializationMapEntry>& entries, const void* data, const std::vector<uint32_t>& values) const
+{
+	out.entries = entries;
+	if (!entries.empty() && data)
+	{
+		const auto bytes = static_cast<const uint8_t*>(data);
+		out.data.assign(bytes, bytes + entries.back().offset + entries.back().size);
+	}
+	for (size_t i = 0; i < m_permutations.size(); i++)
+	{
+		if (bindPoint == vk::PipelineBindPoint::eGraphics && !(m_permutations[i].stages & stage))
+		{
+			continue;
+		}
+		const uint32_t offset = static_cast<uint32_t>((out.data.size() + 3) & ~size_t(3));
+		out.data.resize(offset + sizeof(uint32_t));
+		std::memcpy(out.data.data() + offset, &values[i], sizeof(uint32_t));
+		out.entries.push_back({ m_permutations[i].constantID, offset, sizeof(uint32_t) });
+	}
+	if (out.entries.empty())
+	{
+		return nullptr;
+	}
+	out.info.setMapEntries(out.entries)
+		.setDataSize(out.data.size())
+		.setPData(out.data.data());
+	return &out.info;
+}
+
+void Pipeline::keepShader(const std::weak_ptr<Shader>& shader)
+{
+	if (auto locked = shader.lock())
+	{
+		m_shaders.push_back(std::move(locked));
+	}
+}
+
+void* Pipeline::keepSpecializationData(const std::vector<vk::SpecializationMapEntry>& entries, const void* data)
+{
+	if (entries.empty() || !data)
+	{
+		return nullptr;
+	}
+	const auto bytes = static_cast<const uint8_t*>(data);
+	m_specializationData.emplace_back(bytes, bytes + entries.back().offset + entries.back().size);
+	return m_specializationData.back().data();
 }
 
 vk::PipelineLayout Pipeline::createPipelineLayout(const std::vector<vk::DescriptorSetLayout>& descLayouts, const std::vector<vk::PushConstantRange>& pushConsts) const
@@ -758,7 +885,25 @@ void Pipeline::initDescriptorLayout()
 
 	for (size_t setIndex = 0; const auto & set : sets)
 	{
+		if (set.layout)
+		{
+			auto& descriptorSet = m_descriptorSets[set.set];
+			descriptorSet.vkLayout = set.layout;
+			descriptorSet.vkSets = { set.shared };
+			descriptorSet.shared = true;
+			continue;
+		}
 		std::vector<vk::DescriptorBindingFlags> bindFlags(set.bindings.size(), flagsToEnable);
+#if defined(_WIN32)
+		// bindless images are rewritten while frames in flight still sample the array, e.g. by texture streaming
+		for (size_t i = 0; i < set.bindings.size(); i++)
+		{
+			if (set.bindings[i].descriptorType == vk::DescriptorType::eSampledImage)
+			{
+				bindFlags[i] |= vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+			}
+		}
+#endif
 		/* this won't work for android */
 		vk::DescriptorSetLayoutBindingFlagsCreateInfo extendedInfo;
 		extendedInfo.setBindingFlags(bindFlags);
@@ -774,5 +919,63 @@ void Pipeline::initDescriptorLayout()
 		/* end of not working for android*/
 		vk::DescriptorSetLayout descriptorSetLayout = Context::GetInstance().device.createDescriptorSetLayout(dslci);
 		m_descriptorSets[set.set].vkLayout = descriptorSetLayout;
+		m_descriptorSets[set.set].bindings = set.bindings;
 	}
 }
+
+vk::DescriptorUpdateTemplate Pipeline::descriptorUpdateTemplate(uint32_t set)
+{
+	auto& descriptorSet = m_descriptorSets[set];
+	if (descriptorSet.updateTemplate)
+	{
+		return descriptorSet.updateTemplate;
+	}
+	ASSERT(!descriptorSet.shared, "Shared sets are written by their owner");
+
+	std::vector<vk::DescriptorUpdateTemplateEntry> entries;
+	entries.reserve(descriptorSet.bindings.size());
+	size_t offset = 0;
+	for (const auto& binding : descriptorSet.bindings)
+	{
+		size_t stride = sizeof(vk::DescriptorBufferInfo);
+		switch (binding.descriptorType)
+		{
+		case vk::DescriptorType::eSampler:
+		case vk::DescriptorType::eCombinedImageSampler:
+		case vk::DescriptorType::eSampledImage:
+		case vk::DescriptorType::eStorageImage:
+		case vk::DescriptorType::eInputAttachment:
+			stride = sizeof(vk::DescriptorImageInfo);
+			break;
+		case vk::DescriptorType::eUniformTexelBuffer:
+		case vk::DescriptorType::eStorageTexelBuffer:
+			stride = sizeof(vk::BufferView);
+			break;
+		case vk::DescriptorType::eUniformBuffer:
+		case vk::DescriptorType::eStorageBuffer:
+		case vk::DescriptorType::eUniformBufferDynamic:
+		case vk::DescriptorType::eStorageBufferDynamic:
+			break;
+		default:
+			ASSERT(false, "Update templates only write images, buffers and texel buffers");
+			break;
+		}
+		vk::DescriptorUpdateTemplateEntry entry;
+		entry.setDstBinding(binding.binding)
+			.setDstArrayElement(0)
+			.setDescriptorCount(binding.descriptorCount)
+			.setDescriptorType(binding.descriptorType)
+			.setOffset(offset)
+			.setStride(stride);
+		entries.push_back(entry);
+		offset += stride * binding.descriptorCount;
+	}
+
+	vk::DescriptorUpdateTemplateCreateInfo templateInfo;
+	templateInfo.setDescriptorUpdateEntries(entries)
+		.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet)
+		.setDescriptorSetLayout(descriptorSet.vkLayout);
+	descriptorSet.updateTemplate = Context::GetInstance().device.createDescriptorUpdateTemplate(templateInfo);
+	descriptorSet.templateSize = offset;
+	return descriptorSet.updateTemplate;
+}
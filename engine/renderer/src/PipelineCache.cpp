@@ -0,0 +1,164 @@
+#include "PipelineCache.h"
+#include "Context.h"
+#include "hash_table.h"
+#include "log.h"
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+std::unique_ptr<PipelineCache> PipelineCache::instance_ = nullptr;
+
+namespace {
+    constexpr uint32_t Magic = 0x43505644; // "DVPC"
+    constexpr uint32_t Version = 1;
+}
+
+void PipelineCache::Init(const std::string& file)
+{
+    auto device = Context::GetInstance().device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ = file;
+    lastSave_ = std::chrono::steady_clock::now();
+
+    std::vector<char> data;
+    std::ifstream in(file, std::ios::binary);
+    if (in) {
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        const FileHeader expected = header();
+        FileHeader stored;
+        if (bytes.size() < sizeof(FileHeader)) {
+            DEMO_LOG(Warning, std::format("Pipeline cache {} is truncated, starting empty", file));
+        }
+        else {
+            std::memcpy(&stored, bytes.data(), sizeof(FileHeader));
+            const char* payload = bytes.data() + sizeof(FileHeader);
+            if (stored.magic != Magic || stored.version != Version) {
+                DEMO_LOG(Warning, std::format("Pipeline cache {} has an unknown format, starting empty", file));
+            }
+            else if (stored.vendorID != expected.vendorID || stored.deviceID != expected.deviceID ||
+                stored.driverVersion != expected.driverVersion ||
+                std::memcmp(stored.driverUUID, expected.driverUUID, VK_UUID_SIZE) != 0 ||
+                std::memcmp(stored.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+                DEMO_LOG(Info, std::format("Pipeline cache {} is from another device or driver, starting empty", file));
+            }
+            else if (stored.dataSize != bytes.size() - sizeof(FileHeader) ||
+                fnv1a_64(payload, stored.dataSize) != stored.dataHash) {
+                DEMO_LOG(Warning, std::format("Pipeline cache {} is damaged, starting empty", file));
+            }
+            else {
+                data.assign(payload, payload + stored.dataSize);
+            }
+        }
+    }
+
+    vk::PipelineCacheCreateInfo cacheCI;
+    cacheCI.setInitialDataSize(data.size())
+        .setPInitialData(data.empty() ? nullptr : data.data());
+    cache_ = device.createPipelineCache(cacheCI);
+    stats_.loaded = !data.empty();
+    stats_.loadedBytes = data.size();
+    if (stats_.loaded) {
+        DEMO_LOG(Info, std::format("Pipeline cache: loaded {} KB from {}", data.size() >> 10, file));
+    }
+}
+
+void PipelineCache::Quit()
+{
+    if (!cache_) {
+        return;
+    }
+    Save();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Context::GetInstance().device.destroyPipelineCache(cache_);
+    cache_ = nullptr;
+    DEMO_LOG(Info, std::format("Pipeline cache: {} pipelines created in {:.1f} ms, {} found in the cache, {} saves",
+        stats_.pipelines, stats_.milliseconds, stats_.hits, stats_.saves));
+}
+
+void PipelineCache::Update()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!cache_ || stats_.pipelines == savedPipelines_ ||
+            std::chrono::steady_clock::now() - lastSave_ < SaveInterval) {
+            return;
+        }
+    }
+    Save();
+}
+
+bool PipelineCache::Save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!cache_ || file_.empty()) {
+        return false;
+    }
+    lastSave_ = std::chrono::steady_clock::now();
+    savedPipelines_ = stats_.pipelines;
+    const auto data = Context::GetInstance().device.getPipelineCacheData(cache_);
+    FileHeader out = header();
+    out.dataSize = data.size();
+    out.dataHash = fnv1a_64(data.data(), data.size());
+
+    // written next to the target and renamed, so a crash never leaves a truncated cache
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(file_).parent_path(), ec);
+    const std::string temp = file_ + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file || !file.write(reinterpret_cast<const char*>(&out), sizeof(out)) ||
+            !file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            DEMO_LOG(Warning, std::format("Failed to write the pipeline cache to {}", temp));
+            return false;
+        }
+    }
+    std::filesystem::rename(temp, file_, ec);
+    if (ec) {
+        DEMO_LOG(Warning, std::format("Failed to replace {}: {}", file_, ec.message()));
+        return false;
+    }
+    stats_.saves++;
+    return true;
+}
+
+void PipelineCache::Record(const std::string& name, double milliseconds, const vk::PipelineCreationFeedback& feedback)
+{
+    const bool valid = static_cast<bool>(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eValid);
+    const bool hit = valid &&
+        static_cast<bool>(feedback.flags & vk::PipelineCreationFeedbackFlagBits::eApplicationPipelineCacheHit);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.pipelines++;
+        stats_.hits += hit;
+        stats_.milliseconds += milliseconds;
+    }
+    DEMO_LOG(Info, std::format("Pipeline {} created in {:.2f} ms, {}", name.empty() ? "(unnamed)" : name, milliseconds,
+        !valid ? "no cache feedback" : hit ? "cache hit" : "cache miss"));
+}
+
+PipelineCache::Stats PipelineCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+PipelineCache::FileHeader PipelineCache::header() const
+{
+    auto chain = Context::GetInstance().physicaldevice.getProperties2<vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceIDProperties>();
+    const auto& properties = chain.get<vk::PhysicalDeviceProperties2>().properties;
+    const auto& ids = chain.get<vk::PhysicalDeviceIDProperties>();
+    FileHeader out = {};
+    out.magic = Magic;
+    out.version = Version;
+    out.vendorID = properties.vendorID;
+    out.deviceID = properties.deviceID;
+    out.driverVersion = properties.driverVersion;
+    std::memcpy(out.driverUUID, ids.driverUUID.data(), VK_UUID_SIZE);
+    std::memcpy(out.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    return out;
+}
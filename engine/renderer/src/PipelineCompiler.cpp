@@ -0,0 +1,112 @@
+#include "PipelineCompiler.h"
+#include "log.h"
+
+#include <algorithm>
+#include <format>
+
+std::unique_ptr<PipelineCompiler> PipelineCompiler::instance_ = nullptr;
+
+void PipelineCompiler::Init()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = false;
+    const uint32_t hardware = std::max(std::thread::hardware_concurrency(), 2u);
+    const uint32_t threads = std::min(hardware - 1, MaxThreads);
+    for (uint32_t i = 0; i < threads; i++) {
+        workers_.emplace_back(&PipelineCompiler::work, this);
+    }
+    stats_.threads = threads;
+    DEMO_LOG(Info, std::format("Pipeline compiler: {} threads", threads));
+}
+
+void PipelineCompiler::Quit()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    workers_.clear();
+    DEMO_LOG(Info, std::format("Pipeline compiler: {} pipelines, {:.1f} ms of compiling, first uses waited {} times for {:.1f} ms",
+        stats_.pipelines, stats_.compileMilliseconds, stats_.waits, stats_.waitMilliseconds));
+}
+
+std::future<vk::Pipeline> PipelineCompiler::Compile(const std::string& name, std::function<vk::Pipeline()> job)
+{
+    Job entry{ name, std::packaged_task<vk::Pipeline()>(std::move(job)) };
+    auto future = entry.task.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!workers_.empty() && !stop_) {
+            if (jobs_.empty() && running_ == 0) {
+                burstStart_ = std::chrono::steady_clock::now();
+                burstPipelines_ = 0;
+                burstMilliseconds_ = 0.0;
+            }
+            jobs_.push_back(std::move(entry));
+            wake_.notify_one();
+            return future;
+        }
+    }
+    const auto start = std::chrono::steady_clock::now();
+    entry.task();
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.pipelines++;
+    stats_.compileMilliseconds += milliseconds;
+    return future;
+}
+
+void PipelineCompiler::Waited(const std::string& name, double milliseconds)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.waits++;
+        stats_.waitMilliseconds += milliseconds;
+    }
+    DEMO_LOG(Info, std::format("Pipeline {} was waited on for {:.2f} ms at its first use", name.empty() ? "(unnamed)" : name,
+        milliseconds));
+}
+
+PipelineCompiler::Stats PipelineCompiler::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void PipelineCompiler::work()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            // stop_ is set and every job has been taken
+            return;
+        }
+        Job job = std::move(jobs_.front());
+        jobs_.pop_front();
+        running_++;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        job.task();
+        const auto end = std::chrono::steady_clock::now();
+        const double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+        lock.lock();
+        running_--;
+        stats_.pipelines++;
+        stats_.compileMilliseconds += milliseconds;
+        burstPipelines_++;
+        burstMilliseconds_ += milliseconds;
+        if (jobs_.empty() && running_ == 0) {
+            const double wall = std::chrono::duration<double, std::milli>(end - burstStart_).count();
+            stats_.wallMilliseconds += wall;
+            DEMO_LOG(Info, std::format("Pipeline compiler: {} pipelines created in {:.1f} ms on {} threads, {:.1f} ms one after another",
+                burstPipelines_, wall, workers_.size(), burstMilliseconds_));
+        }
+    }
+}
@@ -1,4 +1,9 @@
 #include "ShaderPool.h"
+#include "hash_table.h"
+#include "log.h"
+#include "mapped_file.h"
+
+#include <format>
 
 std::unique_ptr<ShaderPool> ShaderPool::instance = nullptr;
 
@@ -16,31 +21,86 @@ void ShaderPool::Quit()
 	instance.reset();
 }
 
-Shader ShaderPool::CreateShader(const std::string filename, const std::string_view name)
+std::shared_ptr<Shader> ShaderPool::Get(const std::string& filename)
 {
-	Shader shader(filename);
-	for (Shader _shader : m_Shaders)
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto path = m_Paths.find(filename);
+	if (path != m_Paths.end())
 	{
-		if (name == _shader.name)
-			return std::move(_shader);
+		if (auto shader = m_Modules[path->second].lock())
+		{
+			m_Stats.pathHits++;
+			return shader;
+		}
 	}
-	shader.name = name;
-	if (name == "")
+
+	MappedFile file(filename);
+	if (!file.valid() || file.size() == 0)
 	{
-		shader.name = std::to_string(m_Shaders.size());
+		DEMO_LOG(Error, std::format("Failed to open external shader file: {}", filename));
+		return nullptr;
 	}
-	m_Shaders.emplace_back(shader);
-	return std::move(shader);
+	if (file.size() % 4)
+	{
+		DEMO_LOG(Error, std::format("File Size is {} bytes, it isn't 4 times", file.size()));
+		return nullptr;
+	}
+	const uint64_t hash = path != m_Paths.end() ? path->second : fnv1a_64(file.data(), file.size());
+	m_Paths[filename] = hash;
+	auto& entry = m_Modules[hash];
+	if (auto shader = entry.lock())
+	{
+		m_Stats.contentHits++;
+		return shader;
+	}
+
+	// mappings are page aligned, the code can be read in place
+	const std::span<const uint32_t> code(reinterpret_cast<const uint32_t*>(file.data()), file.size() / 4);
+	std::shared_ptr<Shader> shader(new Shader(code), [hash](Shader* released)
+		{
+			if (instance)
+			{
+				instance->release(hash);
+			}
+			released->destroy();
+			delete released;
+		});
+	shader->hash = hash;
+	entry = shader;
+	m_Stats.loads++;
+	m_Stats.loadedBytes += file.size();
+	return shader;
 }
 
-ShaderPool::~ShaderPool()
+ShaderPool::Stats ShaderPool::GetStats()
 {
-	for (auto shader : m_Shaders)
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	Stats stats = m_Stats;
+	for (const auto& module : m_Modules)
 	{
-		shader.destroy();
+		stats.modules += !module.second.expired();
 	}
+	return stats;
 }
 
-ShaderPool::ShaderPool()
+void ShaderPool::release(uint64_t hash)
 {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto entry = m_Modules.find(hash);
+	// the entry may already hold a module made again after this one expired
+	if (entry != m_Modules.end() && entry->second.expired())
+	{
+		m_Modules.erase(entry);
+	}
 }
+
+ShaderPool::~ShaderPool()
+{
+	m_Stats.modules = GetStats().modules;
+	DEMO_LOG(Info, std::format("Shader pool: {} modules made from {} KB, {} found by path, {} by content, {} still alive",
+		m_Stats.loads, m_Stats.loadedBytes >> 10, m_Stats.pathHits, m_Stats.contentHits, m_Stats.modules));
+}
+
+ShaderPool::ShaderPool()
+{
+}
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "StagingRing.h"
+#include "Buffer.h"
+#include "CommandBuffer.h"
+#include "Context.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <tuple>
+
+std::unique_ptr<StagingRing> StagingRing::instance_ = nullptr;
+
+void StagingRing::Init(uint32_t framesInFlight, vk::DeviceSize capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    framesInFlight_ = framesInFlight;
+    capacity_ = capacity;
+    ring_.reset(new Buffer(capacity, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+    mapped_ = static_cast<char*>(ring_->mapped);
+    vk::CommandPoolCreateInfo poolCI;
+    poolCI.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+        .setQueueFamilyIndex(Context::GetInstance().queueFamileInfo.graphicsFamilyIndex.value());
+    pool_ = Context::GetInstance().device.createCommandPool(poolCI);
+}
+
+void StagingRing::Quit()
+{
+    auto device = Context::GetInstance().device;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ring_) {
+        return;
+    }
+    if (!pending_.empty()) {
+        DEMO_LOG(Warning, std::format("{} staged copies were never recorded", pending_.size()));
+    }
+    for (auto& retirement : retirements_) {
+        release(retirement);
+    }
+    retirements_.clear();
+    for (auto [cmdbuf, fence] : spare_) {
+        device.destroyFence(fence);
+    }
+    spare_.clear();
+    device.destroyCommandPool(pool_);
+    pending_.clear();
+    pendingOversized_.clear();
+    ring_.reset();
+    mapped_ = nullptr;
+    DEMO_LOG(Info, std::format("Staging ring: {} uploads of {} MB, {} oversized, {} submissions, {} waits",
+        stats_.uploads, stats_.bytes >> 20, stats_.oversized, stats_.submissions, stats_.waits));
+}
+
+void StagingRing::Upload(vk::Buffer dst, vk::DeviceSize offset, vk::DeviceSize size, const void* data)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.uploads++;
+    stats_.bytes += size;
+
+    vk::DeviceSize src = 0;
+    bool fits = reserve(size, src);
+    // outside the frame loop only submissions hold the ring, the oldest is waited for until there is room.
+    // Space held by a frame is left alone, its fence belongs to the frame loop
+    while (!fits && size <= capacity_) {
+        submit();
+        if (retirements_.empty() || !retirements_.front().fence) {
+            break;
+        }
+        auto device = Context::GetInstance().device;
+        if (device.waitForFences(retirements_.front().fence, true, UINT64_MAX) != vk::Result::eSuccess) {
+            break;
+        }
+        stats_.waits++;
+        release(retirements_.front());
+        retirements_.pop_front();
+        fits = reserve(size, src);
+    }
+
+    if (fits) {
+        std::memcpy(mapped_ + src, data, size);
+        pending_.push_back({ ring_->buffer, dst, vk::BufferCopy(src, offset, size) });
+        return;
+    }
+    std::unique_ptr<Buffer> staging(new Buffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+    std::memcpy(staging->mapped, data, size);
+    pending_.push_back({ staging->buffer, dst, vk::BufferCopy(0, offset, size) });
+    pendingOversized_.push_back(std::move(staging));
+    stats_.oversized++;
+}
+
+void StagingRing::Submit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    submit();
+}
+
+void StagingRing::BeginFrame(vk::CommandBuffer cmdbuf)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_++;
+    while (!retirements_.empty() && retired(retirements_.front())) {
+        release(retirements_.front());
+        retirements_.pop_front();
+    }
+    if (pending_.empty()) {
+        return;
+    }
+    record(cmdbuf);
+    Retirement retirement;
+    retirement.end = head_;
+    retirement.frame = frame_;
+    retirement.oversized = std::move(pendingOversized_);
+    retirements_.push_back(std::move(retirement));
+}
+
+StagingRing::Stats StagingRing::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+bool StagingRing::reserve(vk::DeviceSize size, vk::DeviceSize& offset)
+{
+    if (!ring_ || size > capacity_) {
+        return false;
+    }
+    uint64_t position = (head_ + Alignment - 1) & ~(Alignment - 1);
+    // an upload never straddles the end of the ring, the rest of the lap is skipped
+    if (position % capacity_ + size > capacity_) {
+        position = (position + capacity_ - 1) / capacity_ * capacity_;
+    }
+    // nothing is in flight, the ring starts over wherever the head is
+    if (head_ == tail_) {
+        tail_ = position;
+    }
+    if (position + size - tail_ > capacity_) {
+        return false;
+    }
+    head_ = position + size;
+    offset = position % capacity_;
+    return true;
+}
+
+bool StagingRing::retired(const Retirement& retirement)
+{
+    if (retirement.fence) {
+        return Context::GetInstance().device.getFenceStatus(retirement.fence) == vk::Result::eSuccess;
+    }
+    // the fence of that frame's slot is waited on framesInFlight frames later, the queue completes in order
+    return retirement.frame + framesInFlight_ <= frame_;
+}
+
+void StagingRing::release(Retirement& retirement)
+{
+    tail_ = std::max(tail_, retirement.end);
+    retirement.oversized.clear();
+    if (retirement.fence) {
+        Context::GetInstance().device.resetFences(retirement.fence);
+        retirement.cmdbuf.reset();
+        spare_.emplace_back(retirement.cmdbuf, retirement.fence);
+        retirement.fence = nullptr;
+    }
+}
+
+void StagingRing::record(vk::CommandBuffer cmdbuf)
+{
+    // what the destinations were used for by earlier frames has to finish before they are overwritten, and the
+    // copies before anything after them reads the destinations
+    vk::MemoryBarrier before(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+        vk::AccessFlagBits::eTransferWrite);
+    cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, {},
+        before, {}, {});
+    for (const auto& copy : pending_) {
+        cmdbuf.copyBuffer(copy.src, copy.dst, copy.region);
+    }
+    vk::MemoryBarrier after(vk::AccessFlagBits::eTransferWrite,
+        vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite);
+    cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {},
+        after, {}, {});
+    pending_.clear();
+}
+
+void StagingRing::submit()
+{
+    if (pending_.empty()) {
+        return;
+    }
+    auto device = Context::GetInstance().device;
+    Retirement retirement;
+    if (!spare_.empty()) {
+        std::tie(retirement.cmdbuf, retirement.fence) = spare_.back();
+        spare_.pop_back();
+    }
+    else {
+        retirement.cmdbuf = CommandManager::Allocate(pool_, 1, true)[0];
+        retirement.fence = device.createFence(vk::FenceCreateInfo());
+    }
+    CommandManager::Begin(retirement.cmdbuf);
+    record(retirement.cmdbuf);
+    CommandManager::End(retirement.cmdbuf);
+    vk::SubmitInfo submitInfo;
+    submitInfo.setCommandBuffers(retirement.cmdbuf);
+    Context::GetInstance().graphicsQueue.submit(submitInfo, retirement.fence);
+    retirement.end = head_;
+    retirement.oversized = std::move(pendingOversized_);
+    retirements_.push_back(std::move(retirement));
+    stats_.submissions++;
+}
@@ -0,0 +1,420 @@
+#include "TLSF.h"
+#include "log.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <random>
+
+namespace
+{
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+TLSF::TLSF(uint64_t size)
+    : size_(size & ~(Granularity - 1)), free_(size_)
+{
+    for (auto& level : heads_)
+    {
+        std::fill(std::begin(level), std::end(level), InvalidNode);
+    }
+    // node 0 always starts at offset 0: it is never split from the front or merged into a predecessor
+    Node whole;
+    whole.size = size_;
+    whole.free = true;
+    nodes_.push_back(whole);
+    insertFree(0);
+}
+
+bool TLSF::allocate(uint64_t size, uint64_t alignment, Allocation& out)
+{
+    size = alignUp(std::max<uint64_t>(size, 1), Granularity);
+    alignment = std::max(alignment, Granularity);
+    uint32_t node = findFree(size);
+    // the head of a list fits as long as alignment does not push it past its end, otherwise the class that is
+    // large enough for any alignment
+    if (node != InvalidNode && !fits(node, size, alignment))
+    {
+        node = findFree(size + alignment - Granularity);
+    }
+    // rounding up to the next class passes over the blocks of the class the size falls in, some of which can
+    // be large enough, so every candidate is looked at before giving up
+    if (node == InvalidNode)
+    {
+        node = findFit(size, alignment);
+    }
+    if (node == InvalidNode)
+    {
+        return false;
+    }
+    removeFree(node);
+
+    const uint64_t aligned = alignUp(nodes_[node].offset, alignment);
+    if (aligned > nodes_[node].offset)
+    {
+        // the padding in front stays free, its predecessor is in use since free neighbours are always merged
+        const uint32_t upper = split(node, aligned);
+        insertFree(node);
+        node = upper;
+    }
+    if (nodes_[node].size - size >= Granularity)
+    {
+        insertFree(split(node, nodes_[node].offset + size));
+    }
+    nodes_[node].free = false;
+    free_ -= nodes_[node].size;
+    allocations_++;
+    out = { nodes_[node].offset, nodes_[node].size, node };
+    return true;
+}
+
+void TLSF::free(uint32_t node)
+{
+    free_ += nodes_[node].size;
+    allocations_--;
+    const uint32_t prev = nodes_[node].prevPhysical;
+    if (prev != InvalidNode && nodes_[prev].free)
+    {
+        removeFree(prev);
+        nodes_[prev].size += nodes_[node].size;
+        nodes_[prev].nextPhysical = nodes_[node].nextPhysical;
+        if (nodes_[node].nextPhysical != InvalidNode)
+        {
+            nodes_[nodes_[node].nextPhysical].prevPhysical = prev;
+        }
+        spare_.push_back(node);
+        node = prev;
+    }
+    const uint32_t next = nodes_[node].nextPhysical;
+    if (next != InvalidNode && nodes_[next].free)
+    {
+        removeFree(next);
+        nodes_[node].size += nodes_[next].size;
+        nodes_[node].nextPhysical = nodes_[next].nextPhysical;
+        if (nodes_[next].nextPhysical != InvalidNode)
+        {
+            nodes_[nodes_[next].nextPhysical].prevPhysical = node;
+        }
+        spare_.push_back(next);
+    }
+    insertFree(node);
+}
+
+uint64_t TLSF::largestFree() const
+{
+    if (!firstLevel_)
+    {
+        return 0;
+    }
+    const uint32_t firstLevel = 63 - std::countl_zero(firstLevel_);
+    const uint32_t secondLevel = 31 - std::countl_zero(secondLevel_[firstLevel]);
+    uint64_t largest = 0;
+    for (uint32_t node = heads_[firstLevel][secondLevel]; node != InvalidNode; node = nodes_[node].nextFree)
+    {
+        largest = std::max(largest, nodes_[node].size);
+    }
+    return largest;
+}
+
+bool TLSF::validate() const
+{
+    uint64_t offset = 0;
+    uint64_t freeBytes = 0;
+    uint32_t used = 0;
+    uint32_t freeBlocks = 0;
+    uint32_t prev = InvalidNode;
+    for (uint32_t node = 0; node != InvalidNode; node = nodes_[node].nextPhysical)
+    {
+        const Node& entry = nodes_[node];
+        if (entry.offset != offset || entry.size == 0 || entry.prevPhysical != prev)
+        {
+            return false;
+        }
+        if (entry.free)
+        {
+            if (prev != InvalidNode && nodes_[prev].free)
+            {
+                return false;
+            }
+            uint32_t firstLevel, secondLevel;
+            mapping(entry.size, firstLevel, secondLevel);
+            bool listed = false;
+            for (uint32_t it = heads_[firstLevel][secondLevel]; it != InvalidNode && !listed; it = nodes_[it].nextFree)
+            {
+                listed = it == node;
+            }
+            if (!listed)
+            {
+                return false;
+            }
+            freeBytes += entry.size;
+            freeBlocks++;
+        }
+        else
+        {
+            used++;
+        }
+        offset += entry.size;
+        prev = node;
+    }
+
+    uint32_t listedBlocks = 0;
+    for (uint32_t firstLevel = 0; firstLevel < FirstLevelCount; firstLevel++)
+    {
+        for (uint32_t secondLevel = 0; secondLevel < SecondLevelCount; secondLevel++)
+        {
+            const bool nonEmpty = heads_[firstLevel][secondLevel] != InvalidNode;
+            if (nonEmpty != static_cast<bool>(secondLevel_[firstLevel] & (1u << secondLevel)))
+            {
+                return false;
+            }
+            for (uint32_t it = heads_[firstLevel][secondLevel]; it != InvalidNode; it = nodes_[it].nextFree)
+            {
+                listedBlocks++;
+            }
+        }
+        if (static_cast<bool>(secondLevel_[firstLevel]) != static_cast<bool>(firstLevel_ & (1ull << firstLevel)))
+        {
+            return false;
+        }
+    }
+    return offset == size_ && freeBytes == free_ && used == allocations_ && listedBlocks == freeBlocks;
+}
+
+void TLSF::benchmark(uint32_t operations)
+{
+    using clock = std::chrono::steady_clock;
+    constexpr uint64_t BlockSize = uint64_t(256) << 20;
+    // kept around this full, past it frees become more likely than allocations
+    constexpr double TargetFill = 0.8;
+    constexpr uint32_t SampleInterval = 1024;
+
+    // buffers from 256 bytes to 16 MB and image sized allocations, log-uniform, aligned like buffers and images
+    std::mt19937_64 rng(1234);
+    std::uniform_real_distribution<double> sizeLog2(8.0, 24.0);
+    std::uniform_int_distribution<uint32_t> alignmentLog2(4, 16);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+    TLSF allocator(BlockSize);
+    std::vector<Allocation> live;
+    uint64_t used = 0;
+    uint32_t failed = 0;
+    double fragmentationSum = 0.0;
+    double fragmentationWorst = 0.0;
+    uint32_t samples = 0;
+    bool consistent = true;
+    double elapsed = 0.0;
+    for (uint32_t i = 0; i < operations; i++)
+    {
+        const double fill = double(used) / double(BlockSize);
+        const bool allocate = live.empty() || unit(rng) < (fill < TargetFill ? 0.6 : 0.4);
+        const uint64_t size = static_cast<uint64_t>(std::exp2(sizeLog2(rng)));
+        const uint64_t alignment = uint64_t(1) << alignmentLog2(rng);
+        const size_t victim = live.empty() ? 0 : rng() % live.size();
+
+        const auto start = clock::now();
+        if (allocate)
+        {
+            Allocation allocation;
+            if (allocator.allocate(size, alignment, allocation))
+            {
+                consistent &= allocation.offset % alignment == 0 && allocation.size >= size;
+                used += allocation.size;
+                live.push_back(allocation);
+            }
+            else
+            {
+                failed++;
+            }
+        }
+        else
+        {
+            allocator.free(live[victim].node);
+            used -= live[victim].size;
+            live[victim] = live.back();
+            live.pop_back();
+        }
+        elapsed += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if (i % SampleInterval == SampleInterval - 1)
+        {
+            consistent &= allocator.validate() && allocator.freeBytes() == BlockSize - used;
+            // how much of the free space a single allocation cannot get at
+            if (allocator.freeBytes() > 0)
+            {
+                const double fragmentation = 1.0 - double(allocator.largestFree()) / double(allocator.freeBytes());
+                fragmentationSum += fragmentation;
+                fragmentationWorst = std::max(fragmentationWorst, fragmentation);
+                samples++;
+            }
+        }
+    }
+
+    const size_t leftover = live.size();
+    for (const auto& allocation : live)
+    {
+        allocator.free(allocation.node);
+    }
+    // everything freed has to coalesce back into the one block it started as
+    consistent &= allocator.validate() && allocator.empty() && allocator.largestFree() == BlockSize;
+
+    DEMO_LOG(Info, std::format("TLSF: {} operations in {:.1f} ms, {:.0f} ns each, {} allocations failed, {} live at the end. "
+        "Fragmentation mean {:.1f}% worst {:.1f}%, {}", operations, elapsed / 1e6, elapsed / std::max(operations, 1u), failed,
+        leftover, 100.0 * fragmentationSum / std::max(samples, 1u), 100.0 * fragmentationWorst,
+        consistent ? "consistent" : "INCONSISTENT"));
+}
+
+void TLSF::mapping(uint64_t size, uint32_t& firstLevel, uint32_t& secondLevel)
+{
+    if (size < SmallSize)
+    {
+        firstLevel = 0;
+        secondLevel = static_cast<uint32_t>(size >> (SmallShift - SecondLevelBits));
+        return;
+    }
+    const uint32_t bit = 63 - std::countl_zero(size);
+    firstLevel = bit - SmallShift + 1;
+    secondLevel = static_cast<uint32_t>(size >> (bit - SecondLevelBits)) - SecondLevelCount;
+}
+
+uint32_t TLSF::findFree(uint64_t size) const
+{
+    // rounded up to the next class, so that any block of the class found is large enough
+    if (size >= SmallSize)
+    {
+        size += (uint64_t(1) << (63 - std::countl_zero(size) - SecondLevelBits)) - 1;
+    }
+    else
+    {
+        size += (SmallSize >> SecondLevelBits) - 1;
+    }
+    if (size >= (uint64_t(1) << 63))
+    {
+        return InvalidNode;
+    }
+    uint32_t firstLevel, secondLevel;
+    mapping(size, firstLevel, secondLevel);
+    uint32_t secondMap = secondLevel_[firstLevel] & (~0u << secondLevel);
+    if (!secondMap)
+    {
+        const uint64_t firstMap = firstLevel_ & (~0ull << (firstLevel + 1));
+        if (!firstMap)
+        {
+            return InvalidNode;
+        }
+        firstLevel = std::countr_zero(firstMap);
+        secondMap = secondLevel_[firstLevel];
+    }
+    return heads_[firstLevel][std::countr_zero(secondMap)];
+}
+
+uint32_t TLSF::findFit(uint64_t size, uint64_t alignment) const
+{
+    uint32_t firstLevel, secondLevel;
+    mapping(size, firstLevel, secondLevel);
+    uint64_t firstMap = firstLevel_ & (~0ull << firstLevel);
+    for (; firstMap; firstMap &= firstMap - 1)
+    {
+        const uint32_t level = std::countr_zero(firstMap);
+        uint32_t secondMap = secondLevel_[level] & (level == firstLevel ? ~0u << secondLevel : ~0u);
+        for (; secondMap; secondMap &= secondMap - 1)
+        {
+            for (uint32_t node = heads_[level][std::countr_zero(secondMap)]; node != InvalidNode; node = nodes_[node].nextFree)
+            {
+                if (fits(node, size, alignment))
+                {
+                    return node;
+                }
+            }
+        }
+    }
+    return InvalidNode;
+}
+
+bool TLSF::fits(uint32_t node, uint64_t size, uint64_t alignment) const
+{
+    return alignUp(nodes_[node].offset, alignment) + size <= nodes_[node].offset + nodes_[node].size;
+}
+
+void TLSF::insertFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    mapping(nodes_[node].size, firstLevel, secondLevel);
+    auto& entry = nodes_[node];
+    entry.free = true;
+    entry.prevFree = InvalidNode;
+    entry.nextFree = heads_[firstLevel][secondLevel];
+    if (entry.nextFree != InvalidNode)
+    {
+        nodes_[entry.nextFree].prevFree = node;
+    }
+    heads_[firstLevel][secondLevel] = node;
+    firstLevel_ |= 1ull << firstLevel;
+    secondLevel_[firstLevel] |= 1u << secondLevel;
+}
+
+void TLSF::removeFree(uint32_t node)
+{
+    uint32_t firstLevel, secondLevel;
+    mapping(nodes_[node].size, firstLevel, secondLevel);
+    auto& entry = nodes_[node];
+    if (entry.prevFree != InvalidNode)
+    {
+        nodes_[entry.prevFree].nextFree = entry.nextFree;
+    }
+    else
+    {
+        heads_[firstLevel][secondLevel] = entry.nextFree;
+    }
+    if (entry.nextFree != InvalidNode)
+    {
+        nodes_[entry.nextFree].prevFree = entry.prevFree;
+    }
+    entry.free = false;
+    entry.prevFree = InvalidNode;
+    entry.nextFree = InvalidNode;
+    if (heads_[firstLevel][secondLevel] == InvalidNode)
+    {
+        secondLevel_[firstLevel] &= ~(1u << secondLevel);
+        if (!secondLevel_[firstLevel])
+        {
+            firstLevel_ &= ~(1ull << firstLevel);
+        }
+    }
+}
+
+uint32_t TLSF::newNode()
+{
+    if (!spare_.empty())
+    {
+        const uint32_t node = spare_.back();
+        spare_.pop_back();
+        nodes_[node] = Node();
+        return node;
+    }
+    nodes_.emplace_back();
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+uint32_t TLSF::split(uint32_t node, uint64_t offset)
+{
+    const uint32_t upper = newNode();
+    Node& lower = nodes_[node];
+    Node& entry = nodes_[upper];
+    entry.offset = offset;
+    entry.size = lower.offset + lower.size - offset;
+    entry.prevPhysical = node;
+    entry.nextPhysical = lower.nextPhysical;
+    if (lower.nextPhysical != InvalidNode)
+    {
+        nodes_[lower.nextPhysical].prevPhysical = upper;
+    }
+    lower.nextPhysical = upper;
+    lower.size = offset - lower.offset;
+    return upper;
+}
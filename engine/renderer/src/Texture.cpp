@@ -1,19 +1,28 @@
 #include "Texture.h"
 #include <stb_image.h>
+#include <chrono>
+#include <filesystem>
 #include <format>
+#include <fstream>
 
 #include "log.h"
+#include "define.h"
+#include "hash_table.h"
 #include "Context.h"
+#include "BindlessHeap.h"
 #include "CommandBuffer.h"
 #include "convert2Cubemap.h"
+#include "DeletionQueue.h"
+#include "HDRPack.h"
+#include "MemoryAllocator.h"
 
 namespace
 {
     std::string extFormat = ".hdr";
 }
 
-Texture::Texture(std::string_view filename) {
-    stbi_set_flip_vertically_on_load(true);
+Texture::Texture(std::string_view filename, vk::Format format) {
+    stbi_set_flip_vertically_on_load_thread(true);
     int w, h, channel;
     stbi_uc* pixels = stbi_load(filename.data(), &w, &h, &channel, STBI_rgb_alpha);
     size_t size = w * h * 4;
@@ -22,44 +31,11 @@ Texture::Texture(std::string_view filename) {
         throw std::runtime_error("image load failed");
     }
 
-    init(pixels, w, h, 4, vk::Format::eR8G8B8A8Srgb);
+    init(pixels, w, h, 4, format);
 
     stbi_image_free(pixels);
 }
 
-Texture::Texture(std::string_view filename, vk::Format format)
-{
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, nrComponents;
-    float* data = stbi_loadf(filename.data(), &width, &height, &nrComponents, STBI_rgb_alpha);
-    if (!data)
-    {
-        throw std::runtime_error("image load failed");
-    }
-    vk::ImageFormatProperties formatProperties;
-    vk::PhysicalDeviceImageFormatInfo2 formatInfo;
-    formatInfo.setFormat(vk::Format::eR32G32B32A32Sfloat)
-        .setType(vk::ImageType::e2D)
-        .setTiling(vk::ImageTiling::eOptimal)
-        .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled);
-    vk::ImageFormatProperties2 properties;
-    auto result = Context::GetInstance().physicaldevice.getImageFormatProperties2(&formatInfo, &properties);
-
-    std::shared_ptr<Texture> temp;
-    temp.reset(new Texture());
-    temp->init(data, width, height, 4 * sizeof(float), vk::Format::eR32G32B32A32Sfloat);
-    stbi_image_free(data);
-    auto ret = convert2Cubemap(temp); 
-    this->image = ret->image;
-    this->view = ret->view;
-    this->memory = ret->memory;
-    ret->image = VK_NULL_HANDLE;
-    ret->view = VK_NULL_HANDLE;
-    ret->memory = VK_NULL_HANDLE;
-    temp.reset();
-    ret.reset();
-}
-
 Texture::Texture(void* data, unsigned int w, unsigned int h, vk::Format format) {
     init(data, w, h, 4, format);
 }
@@ -68,12 +44,13 @@ Texture::Texture(void* data, unsigned int w, unsigned int h, unsigned int channe
     init(data, w, h, channel, format);
 }
 
-Texture::Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels)
+Texture::Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels, uint32_t layers)
 {
     width = w;
     height = h;
     this->format = format;
     this->miplevels = miplevels;
+    this->layers = layers;
     usageFlag = usage;
     flags = vk::SampleCountFlagBits::e1;
     if (format == vk::Format::eD24UnormS8Uint || format == vk::Format::eD16Unorm || format == vk::Format::eD16UnormS8Uint
@@ -111,8 +88,9 @@ Texture::Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags
     auto& device = Context::GetInstance().device;
     vk::ImageCreateInfo createInfo;
     createInfo.setImageType(vk::ImageType::e2D)
+        .setFlags(layers == 6 ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags())
         .setSharingMode(vk::SharingMode::eExclusive)
-        .setArrayLayers(1)
+        .setArrayLayers(layers)
         .setMipLevels(miplevels)
         .setExtent({ w, h, 1 })
         .setFormat(format)
@@ -121,24 +99,8 @@ Texture::Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags
         .setUsage(usageFlag)
         .setSamples(vk::SampleCountFlagBits::e1);
     image = device.createImage(createInfo);
-    vk::MemoryAllocateInfo allocInfo;
-
-    auto requirements = device.getImageMemoryRequirements(image);
-    allocInfo.setAllocationSize(requirements.size);
-
-    uint32_t index = 0;
-    auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
-    for (size_t i = 0; i < properties.memoryTypeCount; i++)
-    {
-        if ((1 << i) & requirements.memoryTypeBits && properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)
-        {
-            index = i;
-            break;
-        }
-    }
-    allocInfo.setMemoryTypeIndex(index);
-    memory = device.allocateMemory(allocInfo);
-    device.bindImageMemory(image, memory, 0);
+    allocation = MemoryAllocator::Instance().Allocate(image, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryBudget::CategoryOf(usage));
     auto cmdbuf = CommandManager::BeginSingle(Context::GetInstance().graphicsCmdPool);
     //transitionImageLayoutFromUndefine2Opt(cmdbuf);
     CommandManager::EndSingle(Context::GetInstance().graphicsCmdPool, cmdbuf, Context::GetInstance().graphicsQueue);
@@ -152,17 +114,38 @@ Texture::Texture(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags
     range.setAspectMask((is_depth ? vk::ImageAspectFlagBits::eDepth : (is_stencil ? vk::ImageAspectFlagBits::eStencil :
             vk::ImageAspectFlagBits::eColor)))
         .setBaseArrayLayer(0)
-        .setLayerCount(1)
+        .setLayerCount(layers)
         .setLevelCount(miplevels)
         .setBaseMipLevel(0);
     viewCreateInfo.setImage(image)
-        .setViewType(vk::ImageViewType::e2D)
+        .setViewType(layers == 6 ? vk::ImageViewType::eCube : vk::ImageViewType::e2D)
         .setComponents(mapping)
         .setFormat(format)
         .setSubresourceRange(range);
     view = Context::GetInstance().device.createImageView(viewCreateInfo);
 }
 
+Texture::Texture(const KTX2Image& image, bool upload)
+{
+    width = image.width;
+    height = image.height;
+    format = image.format;
+    miplevels = static_cast<uint32_t>(image.levels.size());
+    layers = image.faces;
+    flags = vk::SampleCountFlagBits::e1;
+    layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    is_depth = false;
+    is_stencil = false;
+    if (upload)
+    {
+        uploadLevels(image.data.data(), image.data.size(), image.levels);
+        return;
+    }
+    createImage(width, height);
+    allocMemory();
+    createImageView();
+}
+
 void Texture::init(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format) {
     width = w;
     height = h;
@@ -171,35 +154,91 @@ void Texture::init(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::For
     layout = vk::ImageLayout::eShaderReadOnlyOptimal;
     is_depth = false;
     is_stencil = false;
-    const uint32_t size = w * h * channel;
-    std::unique_ptr<Buffer> buffer(new Buffer(size,
+
+    auto& manager = TextureManager::Instance();
+    MipGeneration mipMode = manager.GetMipGeneration();
+    if (mipMode == MipGeneration::CPU && !MipGenerator::supportsCPU(format, channel))
+    {
+        mipMode = MipGeneration::GPUBlit;
+    }
+    if (mipMode == MipGeneration::GPUBlit && !MipGenerator::supportsBlit(Context::GetInstance().physicaldevice, format))
+    {
+        mipMode = MipGenerator::supportsCPU(format, channel) ? MipGeneration::CPU : MipGeneration::None;
+    }
+    miplevels = mipMode == MipGeneration::None ? 1 : getMipLevelsCount(w, h);
+
+    // the CPU backend uploads the whole chain from one staging buffer
+    if (mipMode == MipGeneration::CPU)
+    {
+        std::vector<unsigned char> chain;
+        auto levels = MipGenerator::generate(data, w, h, channel, format, manager.GetMipFilter(), chain);
+        uploadLevels(chain.data(), chain.size(), levels);
+        return;
+    }
+    const size_t size = size_t(w) * h * channel;
+    blitMips_ = mipMode == MipGeneration::GPUBlit;
+    uploadLevels(data, size, { { w, h, 0, size } });
+}
+
+void Texture::uploadLevels(const void* data, size_t size, const std::vector<MipGenerator::Level>& levels)
+{
+    staging_.reset(new Buffer(size,
         vk::BufferUsageFlagBits::eTransferSrc,
         vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
 
-    auto device = Context::GetInstance().device;
-    void* p = device.mapMemory(buffer->memory, 0, size);
-    memcpy(p, data, size);
-    device.unmapMemory(buffer->memory);
+    memcpy(staging_->mapped, data, size);
+    stagedLevels_ = levels;
 
-    createImage(w, h);
+    createImage(width, height);
     allocMemory();
-    device.bindImageMemory(image, memory, 0);
-
-    auto cmdbuf = CommandManager::BeginSingle(Context::GetInstance().graphicsCmdPool);
+    createImageView();
+}
 
-    transitionImageLayoutFromUndefine2Dst(cmdbuf);
-    transformData2Image(cmdbuf, *buffer, w, h);
-    transitionImageLayoutFromDst2Optimal(cmdbuf);
-    CommandManager::EndSingle(Context::GetInstance().graphicsCmdPool, cmdbuf, Context::GetInstance().graphicsQueue);
+KTX2Image Texture::readback()
+{
+    KTX2Image out;
+    out.format = format;
+    out.width = width;
+    out.height = height;
+    out.faces = layers;
+    const uint32_t texel = HDRCubemap::texelBytes(format);
+    size_t total = 0;
+    for (uint32_t i = 0; i < miplevels; i++) {
+        const uint32_t w = std::max(1u, width >> i);
+        const uint32_t h = std::max(1u, height >> i);
+        out.levels.push_back({ w, h, total, size_t(w) * h * texel * layers });
+        total += out.levels.back().size;
+    }
+    Buffer buffer(total, vk::BufferUsageFlagBits::eTransferDst,
+        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible);
+
+    auto& context = Context::GetInstance();
+    auto cmdbuf = CommandManager::BeginSingle(context.graphicsCmdPool);
+    const vk::ImageLayout previous = layout;
+    transitionImageLayout(cmdbuf, vk::ImageLayout::eTransferSrcOptimal);
+    std::vector<vk::BufferImageCopy> regions;
+    for (uint32_t i = 0; i < miplevels; i++) {
+        vk::BufferImageCopy region;
+        region.setBufferOffset(out.levels[i].offset)
+            .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, layers))
+            .setImageExtent(vk::Extent3D{ out.levels[i].width, out.levels[i].height, 1 });
+        regions.push_back(region);
+    }
+    cmdbuf.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, buffer.buffer, regions);
+    transitionImageLayout(cmdbuf, previous);
+    CommandManager::EndSingle(context.graphicsCmdPool, cmdbuf, context.graphicsQueue);
 
-    createImageView();
+    out.data.resize(total);
+    memcpy(out.data.data(), buffer.mapped, total);
+    return out;
 }
 
 Texture::~Texture() {
+    BindlessHeap::Instance().Release(BindlessType::Textures, bindlessIndex);
     auto& device = Context::GetInstance().device;
     device.destroyImageView(view);
-    device.freeMemory(memory);
     device.destroyImage(image);
+    MemoryAllocator::Instance().Free(allocation);
 }
 
 void Texture::transitionImageLayout(vk::CommandBuffer cmdbuf, vk::ImageLayout newLayout)
@@ -305,7 +344,7 @@ void Texture::transitionImageLayout(vk::CommandBuffer cmdbuf, vk::ImageLayout ne
     range.setAspectMask(aspectMask)
         .setBaseArrayLayer(0)
         .setBaseMipLevel(0)
-        .setLayerCount(1)
+        .setLayerCount(layers)
         .setLevelCount(miplevels);
     vk::ImageMemoryBarrier barrier;
     barrier.setSrcAccessMask(srcAccessMask)
@@ -322,37 +361,21 @@ void Texture::transitionImageLayout(vk::CommandBuffer cmdbuf, vk::ImageLayout ne
 void Texture::createImage(uint32_t w, uint32_t h) {
     vk::ImageCreateInfo createInfo;
     createInfo.setImageType(vk::ImageType::e2D)
-        .setArrayLayers(1)
-        .setMipLevels(1)
+        .setFlags(layers == 6 ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags())
+        .setArrayLayers(layers)
+        .setMipLevels(miplevels)
         .setExtent({ w, h, 1 })
         .setFormat(format)
         .setTiling(vk::ImageTiling::eOptimal)
         .setInitialLayout(vk::ImageLayout::eUndefined)
-        .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+        .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled)
         .setSamples(vk::SampleCountFlagBits::e1);
     image = Context::GetInstance().device.createImage(createInfo);
 }
 
 void Texture::allocMemory() {
-    auto& device = Context::GetInstance().device;
-    vk::MemoryAllocateInfo allocInfo;
-
-    auto requirements = device.getImageMemoryRequirements(image);
-    allocInfo.setAllocationSize(requirements.size);
-
-    uint32_t index = 0;
-    auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
-    for (size_t i = 0; i < properties.memoryTypeCount; i++)
-    {
-        if ((1 << i) & requirements.memoryTypeBits && properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)
-        {
-            index = i;
-            break;
-        }
-    }
-    allocInfo.setMemoryTypeIndex(index);
-
-    memory = device.allocateMemory(allocInfo);
+    allocation = MemoryAllocator::Instance().Allocate(image, vk::MemoryPropertyFlagBits::eDeviceLocal,
+        MemoryCategory::Textures);
 }
 
 
@@ -379,8 +402,8 @@ void Texture::transitionImageLayoutFromUndefine2Dst(vk::CommandBuffer buffer)
     range.setAspectMask(vk::ImageAspectFlagBits::eColor)
         .setBaseArrayLayer(0)
         .setBaseMipLevel(0)
-        .setLayerCount(1)
-        .setLevelCount(1);
+        .setLayerCount(layers)
+        .setLevelCount(miplevels);
     vk::ImageMemoryBarrier barrier;
     barrier.setImage(image)
         .setOldLayout(vk::ImageLayout::eUndefined)
@@ -398,8 +421,8 @@ void Texture::transitionImageLayoutFromDst2Optimal(vk::CommandBuffer buffer) {
     range.setAspectMask(vk::ImageAspectFlagBits::eColor)
         .setBaseArrayLayer(0)
         .setBaseMipLevel(0)
-        .setLayerCount(1)
-        .setLevelCount(1);
+        .setLayerCount(layers)
+        .setLevelCount(miplevels);
     vk::ImageMemoryBarrier barrier;
     barrier.setImage(image)
         .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
@@ -434,16 +457,15 @@ void Texture::transitionImageLayoutFromUndefine2Opt(vk::CommandBuffer buffer)
 
 void Texture::createImageView() {
     vk::ImageViewCreateInfo createInfo;
-    vk::ComponentMapping mapping;
     vk::ImageSubresourceRange range;
     range.setAspectMask(vk::ImageAspectFlagBits::eColor)
         .setBaseArrayLayer(0)
-        .setLayerCount(1)
-        .setLevelCount(1)
+        .setLayerCount(layers)
+        .setLevelCount(miplevels)
         .setBaseMipLevel(0);
     createInfo.setImage(image)
-        .setViewType(vk::ImageViewType::e2D)
-        .setComponents(mapping)
+        .setViewType(layers == 6 ? vk::ImageViewType::eCube : vk::ImageViewType::e2D)
+        .setComponents(BlockCompressor::components(format))
         .setFormat(format)
         .setSubresourceRange(range);
     view = Context::GetInstance().device.createImageView(createInfo);
@@ -451,50 +473,437 @@ void Texture::createImageView() {
 
 std::unique_ptr<TextureManager> TextureManager::instance_ = nullptr;
 
-std::shared_ptr<Texture> TextureManager::Load(const std::string& filename) {
-    datas_.push_back(std::shared_ptr<Texture>(new Texture(filename)));
-    return datas_.back();
+std::shared_ptr<Texture> TextureManager::Load(const std::string& filename, TextureKind kind) {
+    // the kind decides the format, a file loaded as color and as data gives two textures
+    const std::string path = std::format("{}|{}", std::filesystem::path(filename).lexically_normal().string(),
+        static_cast<int>(kind));
+    if (auto it = pathLookup_.find(path); it != pathLookup_.end()) {
+        return acquireShared(it->second);
+    }
+    if (blockCompression_ == BlockCompression::None) {
+        // only color is stored as sRGB, normals and data are read as they are
+        const vk::Format format = kind == TextureKind::Color ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+        auto texture = add(std::shared_ptr<Texture>(new Texture(filename, format)));
+        addShared(texture, path, 0);
+        return texture;
+    }
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("image load failed");
+    }
+    std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+    // keyed by the encoded file, a cache hit skips decoding entirely
+    const bool srgb = kind == TextureKind::Color;
+    const uint64_t fileHash = fnv1a_64(bytes.data(), bytes.size());
+    const uint64_t contentHash = contentSharing_ ? fnv1a_64(&kind, sizeof(kind), fileHash) : 0;
+    if (auto it = contentLookup_.find(contentHash); contentHash != 0 && it != contentLookup_.end()) {
+        shared_[it->second].paths.push_back(path);
+        pathLookup_[path] = it->second;
+        return acquireShared(it->second);
+    }
+    const std::string cacheFile = cacheFileName(fileHash, kind, srgb);
+    std::shared_ptr<Texture> texture;
+    KTX2Image image;
+    if (loadCached(cacheFile, image)) {
+        texture.reset(new Texture(image));
+    }
+    else {
+        stbi_set_flip_vertically_on_load_thread(true);
+        int w, h, channel;
+        stbi_uc* pixels = stbi_load_from_memory(bytes.data(), static_cast<int>(bytes.size()), &w, &h, &channel, STBI_rgb_alpha);
+        if (!pixels) {
+            throw std::runtime_error("image load failed");
+        }
+        if (encodeCached(filename, cacheFile, pixels, w, h, srgb, kind, image)) {
+            texture.reset(new Texture(image));
+        }
+        else {
+            texture.reset(new Texture(pixels, w, h, 4, srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm));
+        }
+        stbi_image_free(pixels);
+    }
+    add(texture);
+    addShared(texture, path, contentHash);
+    return texture;
+}
+
+std::shared_ptr<Texture> TextureManager::LoadHDRCubemap(const std::string& filename, vk::Format format, KTX2Image* out)
+{
+    if (!HDRCubemap::supports(format)) {
+        DEMO_LOG(Warning, std::format("{} cubemaps are not supported, using B10G11R11", vk::to_string(format)));
+        format = vk::Format::eB10G11R11UfloatPack32;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        throw std::runtime_error("image load failed");
+    }
+    std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+    const std::string cacheFile = cubemapCacheFile(bytes, format);
+
+    KTX2Image image;
+    const bool cached = KTX2::read(cacheFile, image) && image.faces == 6 && image.format == format;
+    if (!cached) {
+        stbi_set_flip_vertically_on_load_thread(true);
+        int w, h, channel;
+        float* data = stbi_loadf_from_memory(bytes.data(), static_cast<int>(bytes.size()), &w, &h, &channel, STBI_rgb_alpha);
+        if (!data) {
+            throw std::runtime_error("image load failed");
+        }
+        // the render pass of convert2Cubemap only writes B10G11R11
+        if (cubemapConversion_ == CubemapConversion::GPU && format == vk::Format::eB10G11R11UfloatPack32) {
+            // the panorama is resampled into the faces anyway, so it goes up in the smallest format the device
+            // filters and, unless mips are off, blits
+            vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+            if (mipGeneration_ != MipGeneration::None) {
+                required |= vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst;
+            }
+            const vk::Format flatFormat = HDRPack::chooseFormat(Context::GetInstance().physicaldevice,
+                vk::Format::eE5B9G9R9UfloatPack32, required);
+            const uint32_t texel = HDRPack::texelBytes(flatFormat);
+            std::vector<unsigned char> packed(size_t(w) * h * texel);
+            HDRPack::pack(data, size_t(w) * h, flatFormat, packed.data());
+            stbi_image_free(data);
+            std::shared_ptr<Texture> flat(new Texture(packed.data(), w, h, texel, flatFormat));
+            // convert2Cubemap renders from it right away
+            upload(flat);
+            FinishUploads();
+            DEMO_LOG(Info, std::format("Uploaded the {}x{} panorama as {}, {:.1f} MB instead of {:.1f} MB", w, h,
+                vk::to_string(flatFormat), packed.size() / (1024.0 * 1024.0), size_t(w) * h * 16 / (1024.0 * 1024.0)));
+            packed = {};
+            auto cube = convert2Cubemap(flat);
+            flat.reset();
+            const KTX2Image faces = cube->readback();
+            cube.reset();
+            image = HDRCubemap::build(HDRCubemap::FaceSize, format, [&](uint32_t face, std::vector<float>& texels) {
+                const size_t count = size_t(HDRCubemap::FaceSize) * HDRCubemap::FaceSize;
+                texels.resize(count * 4);
+                HDRPack::unpack(faces.data.data() + count * face * 4, count, format, texels.data());
+            });
+        }
+        else {
+            image = HDRCubemap::convert(data, w, h, HDRCubemap::FaceSize, format);
+            stbi_image_free(data);
+        }
+        if (!KTX2::write(cacheFile, image)) {
+            DEMO_LOG(Warning, std::format("Failed to write the cubemap cache {}", cacheFile));
+        }
+    }
+    std::shared_ptr<Texture> texture(new Texture(image));
+    add(texture);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    DEMO_LOG(Info, std::format("{} {} to a {}x{} {} cubemap with {} mips in {:.1f} ms", cached ? "Loaded" : "Converted",
+        filename, image.width, image.height, vk::to_string(format), image.levels.size(), ms));
+    if (out) {
+        *out = std::move(image);
+    }
+    return texture;
 }
 
-std::shared_ptr<Texture> TextureManager::LoadHDRCubemap(const std::string& filename, vk::Format format)
+std::string TextureManager::CubemapCacheFile(const std::string& filename, vk::Format format) const
 {
-    datas_.push_back(std::shared_ptr<Texture>(new Texture(filename, format)));
-    return datas_.back();
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return {};
+    }
+    std::vector<unsigned char> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    return cubemapCacheFile(bytes, format);
 }
 
 std::shared_ptr<Texture> TextureManager::Create(void* data, uint32_t w, uint32_t h, vk::Format format) {
-    datas_.push_back(std::shared_ptr<Texture>(new Texture(data, w, h, format)));
-    return datas_.back();
+    return add(std::shared_ptr<Texture>(new Texture(data, w, h, format)));
 }
 
 std::shared_ptr<Texture> TextureManager::Create(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format) {
-    datas_.push_back(std::shared_ptr<Texture>(new Texture(data, w, h, channel, format)));
-    return datas_.back();
+    return add(std::shared_ptr<Texture>(new Texture(data, w, h, channel, format)));
 }
 
-std::shared_ptr<Texture> TextureManager::Create(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels)
+std::shared_ptr<Texture> TextureManager::Create(uint32_t w, uint32_t h, vk::Format format, vk::ImageUsageFlags usage, int miplevels,
+    uint32_t layers)
 {
-    datas_.push_back(std::shared_ptr<Texture>(new Texture(w, h, format, usage, miplevels)));
-    return datas_.back();
+    return add(std::shared_ptr<Texture>(new Texture(w, h, format, usage, miplevels, layers)));
 }
 
-void TextureManager::Clear() {
-    for (auto t : datas_)
-    {
-        t.reset();
+std::shared_ptr<Texture> TextureManager::Create(const KTX2Image& image)
+{
+    return add(std::shared_ptr<Texture>(new Texture(image)));
+}
+
+std::shared_ptr<Texture> TextureManager::CreateCompressed(void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format,
+    TextureKind kind)
+{
+    const uint64_t contentHash = ContentHash(data, w, h, channel, format, kind);
+    if (auto texture = FindShared(contentHash)) {
+        return texture;
+    }
+    KTX2Image image;
+    auto texture = PrepareCompressed(data, w, h, channel, format, kind, image) ? Create(image) :
+        Create(data, w, h, channel, format);
+    AddShared(texture, contentHash);
+    return texture;
+}
+
+bool TextureManager::PrepareCompressed(const void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format,
+    TextureKind kind, KTX2Image& image, std::string* cacheFile)
+{
+    const bool rgba8 = channel == 4 && (format == vk::Format::eR8G8B8A8Unorm || format == vk::Format::eR8G8B8A8Srgb);
+    if (blockCompression_ == BlockCompression::None || !rgba8) {
+        return false;
+    }
+    const bool srgb = format == vk::Format::eR8G8B8A8Srgb && kind != TextureKind::Normal;
+    const auto* pixels = static_cast<const unsigned char*>(data);
+    const uint32_t extent[2] = { w, h };
+    const uint64_t hash = fnv1a_64(extent, sizeof(extent), fnv1a_64(pixels, size_t(w) * h * 4));
+    const std::string file = cacheFileName(hash, kind, srgb);
+    if (cacheFile) {
+        *cacheFile = file;
+    }
+    return loadCached(file, image) || encodeCached(file, file, pixels, w, h, srgb, kind, image);
+}
+
+void TextureManager::BeginBatch()
+{
+    batchDepth_++;
+}
+
+void TextureManager::EndBatch()
+{
+    if (batchDepth_ == 0 || --batchDepth_ > 0) {
+        return;
+    }
+    UploadEngine::Instance().Flush();
+    if (batch_.textures > 0) {
+        DEMO_LOG(Info, std::format("Queued {} texture uploads ({:.1f} MB)", batch_.textures,
+            batch_.totalBytes / (1024.0 * 1024.0)));
+    }
+    batch_ = UploadBatch();
+}
+
+void TextureManager::BeginFrame(vk::CommandBuffer cmdbuf)
+{
+    acquireUploads(cmdbuf);
+}
+
+void TextureManager::FinishUploads()
+{
+    auto& engine = UploadEngine::Instance();
+    if (engine.Done(uploads_) && blits_.empty()) {
+        return;
+    }
+    engine.Wait(uploads_);
+    auto& context = Context::GetInstance();
+    auto cmdbuf = CommandManager::BeginSingle(context.graphicsCmdPool);
+    acquireUploads(cmdbuf);
+    CommandManager::EndSingle(context.graphicsCmdPool, cmdbuf, context.graphicsQueue);
+}
+
+void TextureManager::upload(const std::shared_ptr<Texture>& texture)
+{
+    if (!texture->staging_) {
+        return;
+    }
+    batch_.textures++;
+    batch_.totalBytes += texture->staging_->size;
+    // the blit reads level 0 and writes the others on the graphics queue, all of them stay transfer destinations
+    // until then
+    const vk::ImageLayout layout = texture->blitMips_ ? vk::ImageLayout::eTransferDstOptimal :
+        vk::ImageLayout::eShaderReadOnlyOptimal;
+    auto& engine = UploadEngine::Instance();
+    uploads_ = engine.Upload(texture, std::move(texture->staging_), texture->stagedLevels_, layout);
+    texture->stagedLevels_.clear();
+    if (texture->blitMips_) {
+        blits_.push_back(texture);
+    }
+    if (batchDepth_ == 0) {
+        engine.Flush();
+    }
+}
+
+void TextureManager::acquireUploads(vk::CommandBuffer cmdbuf)
+{
+    // tickets complete in order, the last one covers every upload before it
+    UploadEngine::Instance().Acquire(cmdbuf, uploads_);
+    for (const auto& texture : blits_) {
+        MipGenerator::recordBlit(cmdbuf, texture->image, texture->width, texture->height, texture->miplevels);
+        texture->blitMips_ = false;
+    }
+    blits_.clear();
+}
+
+std::string TextureManager::cacheFileName(uint64_t sourceHash, TextureKind kind, bool srgb) const
+{
+    // everything that changes the encoded result is part of the key
+    const uint32_t params[] = { static_cast<uint32_t>(kind), srgb, static_cast<uint32_t>(blockCompression_),
+        mipGeneration_ != MipGeneration::None, static_cast<uint32_t>(mipFilter_), BlockCompressor::Version };
+    const uint64_t key = fnv1a_64(params, sizeof(params), sourceHash);
+    return (std::filesystem::path(cachePath) / "textures" / std::format("{:016x}.ktx2", key)).string();
+}
+
+std::string TextureManager::cubemapCacheFile(const std::vector<unsigned char>& bytes, vk::Format format) const
+{
+    if (!HDRCubemap::supports(format)) {
+        format = vk::Format::eB10G11R11UfloatPack32;
+    }
+    const uint32_t params[] = { static_cast<uint32_t>(format), HDRCubemap::FaceSize, HDRCubemap::Version };
+    const uint64_t key = fnv1a_64(params, sizeof(params), fnv1a_64(bytes.data(), bytes.size()));
+    return (std::filesystem::path(cachePath) / "cubemaps" / std::format("{:016x}.ktx2", key)).string();
+}
+
+bool TextureManager::loadCached(const std::string& cacheFile, KTX2Image& image)
+{
+    return KTX2::read(cacheFile, image) && supportsBlockFormat(image.format);
+}
+
+bool TextureManager::encodeCached(const std::string& name, const std::string& cacheFile, const unsigned char* rgba,
+    uint32_t w, uint32_t h, bool srgb, TextureKind kind, KTX2Image& image)
+{
+    const vk::Format format = BlockCompressor::chooseFormat(rgba, w, h, kind, srgb, blockCompression_);
+    if (!supportsBlockFormat(format)) {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    // the chain is filtered from the uncompressed image, every level is then encoded on its own
+    std::vector<unsigned char> chain;
+    std::vector<MipGenerator::Level> mips;
+    if (mipGeneration_ == MipGeneration::None) {
+        mips.push_back({ w, h, 0, size_t(w) * h * 4 });
+        chain.assign(rgba, rgba + mips[0].size);
+    }
+    else {
+        mips = MipGenerator::generate(rgba, w, h, 4, srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm,
+            mipFilter_, chain);
     }
+    image.format = format;
+    image.width = w;
+    image.height = h;
+    image.levels.clear();
+    size_t total = 0;
+    for (const auto& mip : mips) {
+        const size_t size = BlockCompressor::levelSize(format, mip.width, mip.height);
+        image.levels.push_back({ mip.width, mip.height, total, size });
+        total += size;
+    }
+    image.data.resize(total);
+    size_t texels = 0;
+    for (size_t i = 0; i < mips.size(); i++) {
+        BlockCompressor::encode(chain.data() + mips[i].offset, mips[i].width, mips[i].height, format,
+            image.data.data() + image.levels[i].offset);
+        texels += size_t(mips[i].width) * mips[i].height;
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const double psnr = BlockCompressor::psnr(rgba, w, h, format, image.data.data());
+    DEMO_LOG(Info, std::format("Encoded {} ({}x{}, {} mips) to {} in {:.1f} ms, {:.1f} MPixel/s, PSNR {:.2f} dB",
+        name, w, h, mips.size(), vk::to_string(format), ms, texels / ms / 1000.0, psnr));
+
+    if (!KTX2::write(cacheFile, image)) {
+        DEMO_LOG(Warning, std::format("Failed to write texture cache {}", cacheFile));
+    }
+    return true;
+}
+
+bool TextureManager::supportsBlockFormat(vk::Format format)
+{
+    auto& context = Context::GetInstance();
+    if (format == vk::Format::eUndefined || !context.physicaldevice.getFeatures().textureCompressionBC) {
+        return false;
+    }
+    const auto features = context.physicaldevice.getFormatProperties(format).optimalTilingFeatures;
+    return static_cast<bool>(features & vk::FormatFeatureFlagBits::eSampledImage);
+}
+
+void TextureManager::Clear() {
+    blits_.clear();
+    pathLookup_.clear();
+    contentLookup_.clear();
+    shared_.clear();
     datas_.clear();
 }
 
+uint64_t TextureManager::ContentHash(const void* data, uint32_t w, uint32_t h, uint32_t channel, vk::Format format,
+    TextureKind kind)
+{
+    const uint32_t key[5] = { w, h, channel, static_cast<uint32_t>(format), static_cast<uint32_t>(kind) };
+    return fnv1a_64(key, sizeof(key), fnv1a_64(data, size_t(w) * h * channel));
+}
+
+std::shared_ptr<Texture> TextureManager::FindShared(uint64_t contentHash)
+{
+    if (!contentSharing_) {
+        return nullptr;
+    }
+    auto it = contentLookup_.find(contentHash);
+    return it == contentLookup_.end() ? nullptr : acquireShared(it->second);
+}
+
+void TextureManager::AddShared(const std::shared_ptr<Texture>& texture, uint64_t contentHash)
+{
+    if (contentSharing_) {
+        addShared(texture, "", contentHash);
+    }
+}
+
+std::shared_ptr<Texture> TextureManager::acquireShared(Texture* texture)
+{
+    auto& shared = shared_[texture];
+    shared.users++;
+    sharingStats_.hits++;
+    sharingStats_.bytesSaved += shared.bytes;
+    return shared.texture;
+}
+
+void TextureManager::addShared(const std::shared_ptr<Texture>& texture, const std::string& path, uint64_t contentHash)
+{
+    auto [it, inserted] = shared_.try_emplace(texture.get());
+    auto& shared = it->second;
+    if (inserted) {
+        shared.texture = texture;
+        shared.bytes = Context::GetInstance().device.getImageMemoryRequirements(texture->image).size;
+        sharingStats_.textures++;
+    }
+    if (!path.empty()) {
+        shared.paths.push_back(path);
+        pathLookup_[path] = texture.get();
+    }
+    if (contentHash != 0) {
+        shared.contentHash = contentHash;
+        contentLookup_[contentHash] = texture.get();
+    }
+}
+
 void TextureManager::Destroy(std::shared_ptr<Texture> texture) {
-    auto it = std::find_if(datas_.begin(), datas_.end(),
-        [&](const std::shared_ptr<Texture>& t) {
-            return t.get() == texture.get();
-        });
-    if (it != datas_.end()) {
-        Context::GetInstance().device.waitIdle();
+    if (auto shared = shared_.find(texture.get()); shared != shared_.end()) {
+        if (--shared->second.users > 0) {
+            return;
+        }
+        for (const auto& path : shared->second.paths) {
+            pathLookup_.erase(path);
+        }
+        if (auto it = contentLookup_.find(shared->second.contentHash); it != contentLookup_.end() && it->second == texture.get()) {
+            contentLookup_.erase(it);
+        }
+        shared_.erase(shared);
+    }
+    if (auto it = datas_.find(texture.get()); it != datas_.end()) {
+        DeletionQueue::Instance().Retire(std::move(it->second));
         datas_.erase(it);
-        texture.reset();
-        return;
     }
-}
\ No newline at end of file
+}
+
+std::shared_ptr<Texture> TextureManager::add(std::shared_ptr<Texture> texture) {
+    upload(texture);
+    // render targets and cubemaps are bound by the passes that use them
+    if (texture->layout == vk::ImageLayout::eShaderReadOnlyOptimal && texture->layers == 1) {
+        texture->bindlessIndex = BindlessHeap::Instance().Register(*texture);
+    }
+    datas_.emplace(texture.get(), texture);
+    return texture;
+}
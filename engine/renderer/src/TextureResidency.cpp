@@ -0,0 +1,224 @@
+#include "TextureResidency.h"
+
+#include <algorithm>
+#include <utility>
+
+void TextureResidency::resize(uint32_t textures)
+{
+    textures_.resize(textures);
+}
+
+void TextureResidency::track(uint32_t texture, std::vector<size_t> levelBytes, uint32_t residentMip)
+{
+    if (texture >= textures_.size())
+    {
+        textures_.resize(texture + 1);
+    }
+    untrack(texture);
+    auto& entry = textures_[texture];
+    const uint32_t levels = static_cast<uint32_t>(levelBytes.size());
+    entry.tracked = true;
+    entry.pending = false;
+    entry.tail = tailFor(levels);
+    entry.resident = std::min(residentMip, entry.tail);
+    entry.target = entry.resident;
+    entry.wanted = entry.tail;
+    entry.bytes.assign(levels + 1, 0);
+    for (uint32_t i = levels; i-- > 0;)
+    {
+        entry.bytes[i] = entry.bytes[i + 1] + levelBytes[i];
+    }
+    committed_ += entry.bytes[entry.target];
+}
+
+void TextureResidency::untrack(uint32_t texture)
+{
+    if (!tracked(texture))
+    {
+        return;
+    }
+    auto& entry = textures_[texture];
+    committed_ -= entry.bytes[entry.target];
+    entry = Entry();
+    std::erase_if(requests_, [&](const Request& request) { return request.texture == texture; });
+}
+
+void TextureResidency::update(std::span<const uint32_t> feedback, uint64_t frame)
+{
+    std::vector<uint32_t> loads;
+    for (uint32_t i = 0; i < textures_.size(); i++)
+    {
+        auto& entry = textures_[i];
+        if (!entry.tracked)
+        {
+            continue;
+        }
+        if (i < feedback.size() && feedback[i] > 0)
+        {
+            entry.lastUsed = frame;
+            // the finest level is the one whose resolution is 2^(feedback - 1) along the larger axis
+            const uint32_t top = static_cast<uint32_t>(entry.bytes.size()) - 2;
+            const uint32_t finest = std::min(feedback[i] - 1, top);
+            const uint32_t wanted = std::min(top - finest, entry.tail);
+            // finer right away, coarser only once the finer level has not been asked for in a while
+            if (wanted <= entry.wanted || frame - entry.wantedFrame > CoarsenDelay)
+            {
+                entry.wanted = wanted;
+                entry.wantedFrame = frame;
+            }
+        }
+        else if (frame - entry.lastUsed >= IdleFrames)
+        {
+            entry.wanted = entry.tail;
+        }
+        if (!entry.pending && entry.wanted < entry.resident)
+        {
+            loads.push_back(i);
+        }
+    }
+
+    // the largest shortfall first, recently used textures break ties
+    std::sort(loads.begin(), loads.end(), [&](uint32_t a, uint32_t b) {
+        const auto& ea = textures_[a];
+        const auto& eb = textures_[b];
+        const uint32_t da = ea.resident - ea.wanted;
+        const uint32_t db = eb.resident - eb.wanted;
+        return da != db ? da > db : ea.lastUsed > eb.lastUsed;
+        });
+
+    // a lowered budget is honoured before anything is loaded
+    if (committed_ > budget_)
+    {
+        makeRoom(0, UINT32_MAX, frame);
+    }
+
+    uint32_t issued = 0;
+    for (uint32_t texture : loads)
+    {
+        if (issued == MaxLoadsPerUpdate)
+        {
+            break;
+        }
+        auto& entry = textures_[texture];
+        // makeRoom may have picked it as a victim for an earlier load, it keeps that drop
+        if (entry.pending)
+        {
+            continue;
+        }
+        // steps back towards the resident level when the whole way does not fit
+        bool loaded = false;
+        for (uint32_t mip = entry.wanted; mip < entry.resident; mip++)
+        {
+            const size_t extra = entry.bytes[mip] - entry.bytes[entry.target];
+            if (makeRoom(extra, texture, frame))
+            {
+                request(texture, mip);
+                stats_.loads++;
+                issued++;
+                loaded = true;
+                break;
+            }
+        }
+        if (!loaded)
+        {
+            stats_.deferred++;
+        }
+    }
+}
+
+std::vector<TextureResidency::Request> TextureResidency::takeRequests()
+{
+    return std::exchange(requests_, {});
+}
+
+void TextureResidency::completed(uint32_t texture, uint32_t mip, bool success)
+{
+    if (!tracked(texture))
+    {
+        return;
+    }
+    auto& entry = textures_[texture];
+    entry.pending = false;
+    if (success)
+    {
+        entry.resident = mip;
+        return;
+    }
+    committed_ = committed_ - entry.bytes[entry.target] + entry.bytes[entry.resident];
+    entry.target = entry.resident;
+}
+
+size_t TextureResidency::residentBytes() const
+{
+    size_t total = 0;
+    for (const auto& entry : textures_)
+    {
+        if (entry.tracked)
+        {
+            total += entry.bytes[entry.resident];
+        }
+    }
+    return total;
+}
+
+void TextureResidency::request(uint32_t texture, uint32_t mip)
+{
+    auto& entry = textures_[texture];
+    committed_ = committed_ - entry.bytes[entry.target] + entry.bytes[mip];
+    entry.target = mip;
+    entry.pending = true;
+    requests_.push_back({ texture, mip });
+}
+
+bool TextureResidency::makeRoom(size_t extra, uint32_t keep, uint64_t frame)
+{
+    if (committed_ + extra <= budget_)
+    {
+        return true;
+    }
+    std::vector<uint32_t> victims;
+    for (uint32_t i = 0; i < textures_.size(); i++)
+    {
+        const auto& entry = textures_[i];
+        if (entry.tracked && !entry.pending && i != keep && entry.resident < entry.tail)
+        {
+            victims.push_back(i);
+        }
+    }
+    std::sort(victims.begin(), victims.end(), [&](uint32_t a, uint32_t b) {
+        const auto& ea = textures_[a];
+        const auto& eb = textures_[b];
+        const bool surplusA = ea.resident < ea.wanted;
+        const bool surplusB = eb.resident < eb.wanted;
+        return surplusA != surplusB ? surplusA : ea.lastUsed < eb.lastUsed;
+        });
+
+    // only levels not wanted any more, and levels of textures not sampled this frame, can go
+    size_t freeable = 0;
+    std::vector<uint32_t> drops(victims.size());
+    for (size_t v = 0; v < victims.size() && committed_ + extra > budget_ + freeable; v++)
+    {
+        const auto& entry = textures_[victims[v]];
+        uint32_t mip = entry.resident;
+        const uint32_t floor = entry.lastUsed == frame ? std::max(entry.wanted, entry.resident) : entry.tail;
+        while (mip < floor && committed_ + extra > budget_ + freeable + (entry.bytes[entry.resident] - entry.bytes[mip]))
+        {
+            mip++;
+        }
+        drops[v] = mip;
+        freeable += entry.bytes[entry.resident] - entry.bytes[mip];
+    }
+    if (committed_ + extra > budget_ + freeable)
+    {
+        return false;
+    }
+    for (size_t v = 0; v < victims.size(); v++)
+    {
+        if (drops[v] > textures_[victims[v]].resident)
+        {
+            request(victims[v], drops[v]);
+            stats_.drops++;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,252 @@
+#include "TextureStreamer.h"
+#include "Texture.h"
+#include "Buffer.h"
+#include "BindlessHeap.h"
+#include "Context.h"
+#include "DeletionQueue.h"
+#include "MemoryBudget.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+
+std::unique_ptr<TextureStreamer> TextureStreamer::instance_ = nullptr;
+
+TextureStreamer::~TextureStreamer()
+{
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        worker_.join();
+    }
+}
+
+std::shared_ptr<Texture> TextureStreamer::Create(const KTX2Image& image, const std::string& cacheFile)
+{
+    const uint32_t levels = static_cast<uint32_t>(image.levels.size());
+    const uint32_t tail = TextureResidency::tailFor(levels);
+    std::error_code ec;
+    if (!enabled_ || tail == 0 || !std::filesystem::exists(cacheFile, ec)) {
+        return nullptr;
+    }
+    auto texture = TextureManager::Instance().Create(slice(image, tail));
+    Source source{ cacheFile, {}, tail };
+    for (const auto& level : image.levels) {
+        source.levelBytes.push_back(level.size);
+    }
+    sources_[texture.get()] = std::move(source);
+    return texture;
+}
+
+void TextureStreamer::Init(const std::vector<std::shared_ptr<Texture>>& textures)
+{
+    // the feedback is written with fragment shader atomics
+    if (!enabled_ || feedback_ || !Context::GetInstance().physicaldevice.getFeatures().fragmentStoresAndAtomics) {
+        return;
+    }
+    // every index a material can sample gets a slot, whether it is streamed or not
+    slotCount_ = 0;
+    for (const auto& texture : textures) {
+        if (texture && texture->bindlessIndex != BindlessHeap::InvalidIndex) {
+            slotCount_ = std::max(slotCount_, texture->bindlessIndex + 1);
+        }
+    }
+    slots_.assign(slotCount_, nullptr);
+    slotFiles_.assign(slotCount_, {});
+    residency_.resize(slotCount_);
+
+    // a texture shared by several materials has one index, so its feedback already lands in one slot
+    uint32_t streamed = 0;
+    for (const auto& texture : textures) {
+        auto source = texture ? sources_.find(texture.get()) : sources_.end();
+        if (source == sources_.end() || texture->bindlessIndex == BindlessHeap::InvalidIndex ||
+            slots_[texture->bindlessIndex]) {
+            continue;
+        }
+        const uint32_t slot = texture->bindlessIndex;
+        slots_[slot] = texture;
+        residency_.track(slot, source->second.levelBytes, source->second.residentMip);
+        slotFiles_[slot] = source->second.cacheFile;
+        streamed++;
+    }
+    if (streamed == 0) {
+        return;
+    }
+
+    auto device = Context::GetInstance().device;
+    framesInFlight_ = Context::GetInstance().swapchain->info.imageCount;
+    const size_t size = size_t(slotCount_) * framesInFlight_ * sizeof(uint32_t);
+    feedback_.reset(new Buffer(size, vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::MemoryPropertyFlagBits::eHostCoherent | vk::MemoryPropertyFlagBits::eHostVisible));
+    mapped_ = static_cast<uint32_t*>(feedback_->mapped);
+    std::memset(mapped_, 0, size);
+    stop_ = false;
+    worker_ = std::thread(&TextureStreamer::work, this);
+    // lowering the budget makes the next update drop the least recently used levels. It is computed from what
+    // is resident, which only changes once swaps land, so repeated calls do not keep lowering it
+    pressureCallback_ = MemoryBudget::Instance().AddPressureCallback([this](uint32_t heap, vk::DeviceSize excess) {
+        if (!MemoryBudget::Instance().Heaps()[heap].deviceLocal) {
+            return;
+        }
+        const size_t resident = residency_.residentBytes();
+        const size_t target = resident > excess ? resident - static_cast<size_t>(excess) : 0;
+        if (target < residency_.budget()) {
+            DEMO_LOG(Info, std::format("Texture streaming budget lowered to {:.1f} MB", target / (1024.0 * 1024.0)));
+            residency_.setBudget(target);
+        }
+        });
+    DEMO_LOG(Info, std::format("Streaming {} of {} textures, {:.1f} MB resident, budget {:.1f} MB", streamed, textures.size(),
+        residency_.residentBytes() / (1024.0 * 1024.0), residency_.budget() / (1024.0 * 1024.0)));
+}
+
+void TextureStreamer::BeginFrame(uint32_t frame)
+{
+    if (!feedback_) {
+        return;
+    }
+    frameCount_++;
+    uint32_t* feedback = mapped_ + FeedbackOffset(frame);
+    residency_.update({ feedback, slotCount_ }, frameCount_);
+    std::memset(feedback, 0, slotCount_ * sizeof(uint32_t));
+
+    auto requests = residency_.takeRequests();
+    if (!requests.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& request : requests) {
+                jobs_.push_back({ request.texture, request.mip, slotFiles_[request.texture] });
+            }
+        }
+        wake_.notify_one();
+    }
+
+    // tickets are acquired in order, UploadEngine::BeginFrame has acquired what finished
+    auto& engine = UploadEngine::Instance();
+    while (!uploads_.empty() && engine.Done(uploads_.front().ticket)) {
+        auto& upload = uploads_.front();
+        swap(upload.slot, std::move(upload.texture));
+        residency_.completed(upload.slot, upload.mip, true);
+        uploads_.pop_front();
+    }
+
+    const uint32_t maxStarts = engine.Available() ? MaxUploadsPerFrame : MaxSwapsPerFrame;
+    bool uploaded = false;
+    for (uint32_t starts = 0; starts < maxStarts; starts++) {
+        Result result;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (results_.empty()) {
+                break;
+            }
+            result = std::move(results_.front());
+            results_.pop_front();
+        }
+        if (!result.success) {
+            DEMO_LOG(Warning, std::format("Failed to stream mip {} from {}", result.mip, slotFiles_[result.slot]));
+            residency_.completed(result.slot, result.mip, false);
+            continue;
+        }
+        std::shared_ptr<Texture> fresh(new Texture(result.image, false));
+        const auto ticket = engine.Upload(fresh, result.image.data.data(), result.image.data.size(), result.image.levels);
+        // without the transfer queue the copy has already finished on the graphics queue
+        if (!engine.Available()) {
+            swap(result.slot, std::move(fresh));
+            residency_.completed(result.slot, result.mip, true);
+            continue;
+        }
+        uploads_.push_back({ result.slot, result.mip, std::move(fresh), ticket });
+        uploaded = true;
+    }
+    // the next frame can swap them in when the copies are quick
+    if (uploaded) {
+        engine.Flush();
+    }
+}
+
+void TextureStreamer::Clear()
+{
+    if (worker_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        worker_.join();
+    }
+    if (pressureCallback_) {
+        MemoryBudget::Instance().RemovePressureCallback(pressureCallback_);
+        pressureCallback_ = 0;
+    }
+    if (feedback_) {
+        DEMO_LOG(Info, std::format("Texture streaming: {} loads, {} drops, {} loads deferred by the budget",
+            residency_.stats().loads, residency_.stats().drops, residency_.stats().deferred));
+        mapped_ = nullptr;
+        feedback_.reset();
+    }
+    jobs_.clear();
+    results_.clear();
+    uploads_.clear();
+    slots_.clear();
+    slotFiles_.clear();
+    sources_.clear();
+    slotCount_ = 0;
+    const size_t budget = residency_.budget();
+    residency_ = TextureResidency();
+    residency_.setBudget(budget);
+}
+
+void TextureStreamer::swap(uint32_t slot, std::shared_ptr<Texture> fresh)
+{
+    auto& texture = *slots_[slot];
+    std::swap(texture.image, fresh->image);
+    std::swap(texture.allocation, fresh->allocation);
+    std::swap(texture.view, fresh->view);
+    std::swap(texture.width, fresh->width);
+    std::swap(texture.height, fresh->height);
+    std::swap(texture.miplevels, fresh->miplevels);
+    DeletionQueue::Instance().Retire(fresh);
+    BindlessHeap::Instance().Update(slot, texture);
+}
+
+void TextureStreamer::work()
+{
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || !jobs_.empty(); });
+            if (stop_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        Result result{ job.slot, job.mip, false, {} };
+        KTX2Image image;
+        if (KTX2::read(job.cacheFile, image) && job.mip < image.levels.size()) {
+            result.image = slice(image, job.mip);
+            result.success = true;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        results_.push_back(std::move(result));
+    }
+}
+
+KTX2Image TextureStreamer::slice(const KTX2Image& image, uint32_t first)
+{
+    KTX2Image out;
+    out.format = image.format;
+    out.width = image.levels[first].width;
+    out.height = image.levels[first].height;
+    for (size_t i = first; i < image.levels.size(); i++) {
+        const auto& level = image.levels[i];
+        out.levels.push_back({ level.width, level.height, out.data.size(), level.size });
+        out.data.insert(out.data.end(), image.data.begin() + level.offset, image.data.begin() + level.offset + level.size);
+    }
+    return out;
+}
@@ -0,0 +1,400 @@
+#include "UploadEngine.h"
+#include "Buffer.h"
+#include "CommandBuffer.h"
+#include "Context.h"
+#include "Texture.h"
+#include "log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <iterator>
+#include <utility>
+
+std::unique_ptr<UploadEngine> UploadEngine::instance_ = nullptr;
+
+namespace
+{
+    // how often the worker looks for finished batches while there is nothing to submit
+    constexpr auto RecycleInterval = std::chrono::milliseconds(8);
+
+    vk::ImageSubresourceRange wholeImage(const Texture& texture)
+    {
+        return vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, texture.miplevels, 0, texture.layers);
+    }
+}
+
+void UploadEngine::Init()
+{
+    auto& context = Context::GetInstance();
+    // the worker submits to the queue on its own, the render loop must never submit to it
+    if (context.transferQueue == context.graphicsQueue || context.transferQueue == context.presentQueue) {
+        DEMO_LOG(Info, "No transfer queue apart from the graphics queue, uploads go through the staging ring");
+        return;
+    }
+    srcFamily_ = context.queueFamileInfo.transferFamilyIndex.value();
+    dstFamily_ = context.queueFamileInfo.graphicsFamilyIndex.value();
+
+    vk::SemaphoreTypeCreateInfo type(vk::SemaphoreType::eTimeline, 0);
+    semaphore_ = context.device.createSemaphore(vk::SemaphoreCreateInfo().setPNext(&type));
+    vk::CommandPoolCreateInfo poolCI;
+    poolCI.setFlags(vk::CommandPoolCreateFlagBits::eResetCommandBuffer)
+        .setQueueFamilyIndex(srcFamily_);
+    pool_ = context.device.createCommandPool(poolCI);
+
+    stop_ = false;
+    worker_ = std::thread(&UploadEngine::work, this);
+    DEMO_LOG(Info, std::format("Uploading on queue family {}{}", srcFamily_,
+        srcFamily_ != dstFamily_ ? " with ownership transfers to the graphics family" : ""));
+}
+
+void UploadEngine::Quit()
+{
+    if (!worker_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    worker_.join();
+
+    auto device = Context::GetInstance().device;
+    if (submittedValue_ > 0 &&
+        device.waitSemaphores(vk::SemaphoreWaitInfo({}, semaphore_, submittedValue_), UINT64_MAX) != vk::Result::eSuccess) {
+        DEMO_LOG(Error, "wait for the last upload batch failed.");
+    }
+    recycle();
+    inflight_.clear();
+    spare_.clear();
+    acquires_.clear();
+    device.destroyCommandPool(pool_);
+    device.destroySemaphore(semaphore_);
+    DEMO_LOG(Info, std::format("Upload engine: {} uploads of {} MB in {} batches, {} acquires waited on a running batch",
+        stats_.uploads, stats_.bytes >> 20, stats_.batches, stats_.stalls));
+}
+
+UploadTicket UploadEngine::Upload(std::shared_ptr<Buffer> dst, vk::DeviceSize offset, vk::DeviceSize size, const void* data)
+{
+    if (!Available()) {
+        UploadBufferDataRange({}, dst, offset, size, data);
+        return {};
+    }
+    Request request;
+    request.staging.reset(new Buffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+    std::memcpy(request.staging->mapped, data, size);
+    request.buffer = std::move(dst);
+    request.offset = offset;
+    return enqueue(std::move(request), size);
+}
+
+UploadTicket UploadEngine::Upload(std::shared_ptr<Texture> dst, const void* data, size_t size,
+    const std::vector<MipGenerator::Level>& levels, vk::ImageLayout layout)
+{
+    std::unique_ptr<Buffer> staging(new Buffer(size, vk::BufferUsageFlagBits::eTransferSrc,
+        vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+    std::memcpy(staging->mapped, data, size);
+    return Upload(std::move(dst), std::move(staging), levels, layout);
+}
+
+UploadTicket UploadEngine::Upload(std::shared_ptr<Texture> dst, std::unique_ptr<Buffer> staging,
+    const std::vector<MipGenerator::Level>& levels, vk::ImageLayout layout)
+{
+    const vk::DeviceSize size = staging->size;
+    Request request;
+    request.staging = std::move(staging);
+    request.texture = std::move(dst);
+    request.levels = levels;
+    request.layout = layout;
+    if (!Available()) {
+        auto& context = Context::GetInstance();
+        std::vector<Request> requests;
+        requests.push_back(std::move(request));
+        auto cmdbuf = CommandManager::BeginSingle(context.graphicsCmdPool);
+        record(cmdbuf, requests, nullptr);
+        CommandManager::EndSingle(context.graphicsCmdPool, cmdbuf, context.graphicsQueue);
+        return {};
+    }
+    return enqueue(std::move(request), size);
+}
+
+void UploadEngine::Acquire(vk::CommandBuffer cmdbuf, UploadTicket ticket)
+{
+    if (Done(ticket)) {
+        return;
+    }
+    if (Context::GetInstance().device.getSemaphoreCounterValue(semaphore_) < ticket.value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.stalls++;
+    }
+    flush(ticket.value, true);
+    acquire(cmdbuf, ticket.value);
+}
+
+void UploadEngine::Wait(UploadTicket ticket)
+{
+    if (Done(ticket)) {
+        return;
+    }
+    flush(ticket.value, true);
+    if (Context::GetInstance().device.waitSemaphores(vk::SemaphoreWaitInfo({}, semaphore_, ticket.value), UINT64_MAX) !=
+        vk::Result::eSuccess) {
+        DEMO_LOG(Error, "wait for upload batch failed.");
+    }
+}
+
+void UploadEngine::Flush()
+{
+    if (!Available()) {
+        return;
+    }
+    uint64_t value;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value = openBytes_ > 0 ? openValue_ : openValue_ - 1;
+    }
+    flush(value, false);
+}
+
+void UploadEngine::BeginFrame(vk::CommandBuffer cmdbuf)
+{
+    if (!Available()) {
+        return;
+    }
+    const uint64_t done = Context::GetInstance().device.getSemaphoreCounterValue(semaphore_);
+    if (done > acquired_) {
+        acquire(cmdbuf, done);
+    }
+    Flush();
+}
+
+uint64_t UploadEngine::TakeFrameWait()
+{
+    return std::exchange(frameWait_, 0);
+}
+
+UploadEngine::Stats UploadEngine::GetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+UploadTicket UploadEngine::enqueue(Request request, vk::DeviceSize size)
+{
+    UploadTicket ticket;
+    bool full = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (openBytes_ > 0 && openBytes_ + size > MaxBatchBytes) {
+            closedValue_ = openValue_++;
+            openBytes_ = 0;
+            full = true;
+        }
+        ticket.value = request.value = openValue_;
+        openBytes_ += size;
+        stats_.uploads++;
+        stats_.bytes += size;
+        pending_.push_back(std::move(request));
+    }
+    if (full) {
+        wake_.notify_one();
+    }
+    return ticket;
+}
+
+void UploadEngine::flush(uint64_t value, bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (value == openValue_) {
+        openValue_++;
+        openBytes_ = 0;
+    }
+    closedValue_ = std::max(closedValue_, value);
+    wake_.notify_one();
+    if (wait) {
+        submitted_.wait(lock, [&] { return submittedValue_ >= value; });
+    }
+}
+
+void UploadEngine::work()
+{
+    for (;;) {
+        std::vector<Request> requests;
+        bool stop = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [&] { return stop_ || (!pending_.empty() && pending_.front().value <= closedValue_); };
+            if (inflight_.empty()) {
+                wake_.wait(lock, ready);
+            }
+            else {
+                wake_.wait_for(lock, RecycleInterval, ready);
+            }
+            stop = stop_;
+            // everything left is submitted before stopping
+            auto end = stop ? pending_.end() : std::find_if(pending_.begin(), pending_.end(),
+                [&](const Request& request) { return request.value > closedValue_; });
+            requests.assign(std::make_move_iterator(pending_.begin()), std::make_move_iterator(end));
+            pending_.erase(pending_.begin(), end);
+        }
+        recycle();
+        for (size_t first = 0; first < requests.size();) {
+            size_t last = first + 1;
+            while (last < requests.size() && requests[last].value == requests[first].value) {
+                last++;
+            }
+            submit({ std::make_move_iterator(requests.begin() + first), std::make_move_iterator(requests.begin() + last) });
+            first = last;
+        }
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void UploadEngine::record(vk::CommandBuffer cmdbuf, const std::vector<Request>& requests, Acquires* acquires)
+{
+    const bool transfer = acquires && srcFamily_ != dstFamily_;
+    const uint32_t src = transfer ? srcFamily_ : VK_QUEUE_FAMILY_IGNORED;
+    const uint32_t dst = transfer ? dstFamily_ : VK_QUEUE_FAMILY_IGNORED;
+
+    std::vector<vk::ImageMemoryBarrier> images;
+    for (const auto& request : requests) {
+        if (request.texture) {
+            images.emplace_back(vk::AccessFlags(), vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined,
+                vk::ImageLayout::eTransferDstOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                request.texture->image, wholeImage(*request.texture));
+        }
+    }
+    if (!images.empty()) {
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {},
+            {}, {}, images);
+    }
+
+    images.clear();
+    std::vector<vk::BufferMemoryBarrier> buffers;
+    for (const auto& request : requests) {
+        const vk::DeviceSize size = request.staging->size;
+        if (request.buffer) {
+            cmdbuf.copyBuffer(request.staging->buffer, request.buffer->buffer, vk::BufferCopy(0, request.offset, size));
+            if (transfer) {
+                buffers.emplace_back(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags(), src, dst,
+                    request.buffer->buffer, request.offset, size);
+            }
+            continue;
+        }
+        const auto& texture = *request.texture;
+        std::vector<vk::BufferImageCopy> regions;
+        for (uint32_t i = 0; i < request.levels.size(); i++) {
+            vk::BufferImageCopy region;
+            region.setBufferOffset(request.levels[i].offset)
+                .setImageSubresource(vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, i, 0, texture.layers))
+                .setImageExtent(vk::Extent3D{ request.levels[i].width, request.levels[i].height, 1 });
+            regions.push_back(region);
+        }
+        cmdbuf.copyBufferToImage(request.staging->buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, regions);
+        images.emplace_back(vk::AccessFlagBits::eTransferWrite, vk::AccessFlags(), vk::ImageLayout::eTransferDstOptimal,
+            request.layout, src, dst, texture.image, wholeImage(texture));
+    }
+    // on the transfer queue the batch's semaphore makes the writes visible to the frames that wait on it, the
+    // barrier only releases the resources and changes layouts. A transfer only queue has no later stage anyway
+    if (acquires) {
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {},
+            {}, buffers, images);
+    }
+    else {
+        for (auto& barrier : images) {
+            barrier.setDstAccessMask(vk::AccessFlagBits::eMemoryRead);
+        }
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, {},
+            {}, {}, images);
+    }
+    if (!transfer) {
+        return;
+    }
+    // the acquires repeat the releases, layouts included, with the access moved to the graphics side
+    for (auto barrier : buffers) {
+        acquires->buffers.push_back(barrier.setSrcAccessMask({})
+            .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite));
+    }
+    for (auto barrier : images) {
+        acquires->images.push_back(barrier.setSrcAccessMask({})
+            .setDstAccessMask(vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite));
+    }
+}
+
+void UploadEngine::submit(std::vector<Request> requests)
+{
+    Batch batch;
+    batch.value = requests.front().value;
+    if (!spare_.empty()) {
+        batch.cmdbuf = spare_.back();
+        spare_.pop_back();
+    }
+    else {
+        batch.cmdbuf = CommandManager::Allocate(pool_, 1, true)[0];
+    }
+    Acquires acquires;
+    acquires.value = batch.value;
+    CommandManager::Begin(batch.cmdbuf);
+    record(batch.cmdbuf, requests, &acquires);
+    CommandManager::End(batch.cmdbuf);
+
+    vk::TimelineSemaphoreSubmitInfo timeline;
+    timeline.setSignalSemaphoreValues(batch.value);
+    vk::SubmitInfo submitInfo;
+    submitInfo.setCommandBuffers(batch.cmdbuf)
+        .setSignalSemaphores(semaphore_)
+        .setPNext(&timeline);
+    Context::GetInstance().transferQueue.submit(submitInfo);
+
+    const uint64_t value = batch.value;
+    batch.requests = std::move(requests);
+    inflight_.push_back(std::move(batch));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!acquires.buffers.empty() || !acquires.images.empty()) {
+            acquires_.push_back(std::move(acquires));
+        }
+        submittedValue_ = value;
+        stats_.batches++;
+    }
+    submitted_.notify_all();
+}
+
+void UploadEngine::acquire(vk::CommandBuffer cmdbuf, uint64_t value)
+{
+    std::vector<vk::BufferMemoryBarrier> buffers;
+    std::vector<vk::ImageMemoryBarrier> images;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (!acquires_.empty() && acquires_.front().value <= value) {
+            const auto& front = acquires_.front();
+            buffers.insert(buffers.end(), front.buffers.begin(), front.buffers.end());
+            images.insert(images.end(), front.images.begin(), front.images.end());
+            acquires_.pop_front();
+        }
+    }
+    if (!buffers.empty() || !images.empty()) {
+        cmdbuf.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, {},
+            {}, buffers, images);
+    }
+    acquired_ = std::max(acquired_, value);
+    frameWait_ = std::max(frameWait_, value);
+}
+
+void UploadEngine::recycle()
+{
+    if (inflight_.empty()) {
+        return;
+    }
+    const uint64_t done = Context::GetInstance().device.getSemaphoreCounterValue(semaphore_);
+    while (!inflight_.empty() && inflight_.front().value <= done) {
+        inflight_.front().cmdbuf.reset();
+        spare_.push_back(inflight_.front().cmdbuf);
+        inflight_.pop_front();
+    }
+}
@@ -11,13 +11,32 @@
 #include "program.h"
 #include "render_process.h"
 #include "CommandBuffer.h"
+#include "BindlessHeap.h"
+#include "DeletionQueue.h"
+#include "MemoryBudget.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "Texture.h"
+#include "UploadEngine.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "DescriptorUpdater.h"
+#include "define.h"
 #include "log.h"
 
+#include <filesystem>
+
 
 void VulkanBackend::Init()
 {
 	Context::InitContext();
 	Context::GetInstance().InitSwapchain();
+	DeletionQueue::Instance().Init(Context::GetInstance().swapchain->info.imageCount);
+	BindlessHeap::Instance().Init(Context::GetInstance().swapchain->info.imageCount);
+	StagingRing::Instance().Init(Context::GetInstance().swapchain->info.imageCount);
+	UploadEngine::Instance().Init();
+	PipelineCache::Instance().Init((std::filesystem::path(cachePath) / "pipelines.bin").string());
+	PipelineCompiler::Instance().Init();
 
 	ShaderPool::Initialize();
 }
@@ -25,7 +44,15 @@ void VulkanBackend::Init()
 void VulkanBackend::Quit()
 {
 	ShaderPool::Quit();
+	DescriptorUpdater::Instance().Quit();
+	PipelineCompiler::Instance().Quit();
+	PipelineCache::Instance().Quit();
 	Context::GetInstance().DestroySwapchain();
+	UploadEngine::Instance().Quit();
+	DeletionQueue::Instance().Quit();
+	StagingRing::Instance().Quit();
+	BindlessHeap::Instance().Quit();
+	MemoryAllocator::Instance().Quit();
 	Context::Quit();
 }
 
@@ -42,6 +69,11 @@ bool VulkanBackend::BeginFrame(double _deltatime, vk::CommandBuffer& buffer, vk:
 		DEMO_LOG(Error, "wait for fence failed.");
 
 	device.resetFences(cmdbufAvaliableFence);
+	DeletionQueue::Instance().BeginFrame();
+	BindlessHeap::Instance().BeginFrame();
+	DescriptorUpdater::Instance().BeginFrame();
+	MemoryBudget::Instance().Update();
+	PipelineCache::Instance().Update();
 
 	auto result = device.acquireNextImageKHR(swapchain->swapchain, std::numeric_limits<uint64_t>::max(), imageAvaliable);
 	if (result.result != vk::Result::eSuccess)
@@ -52,6 +84,9 @@ bool VulkanBackend::BeginFrame(double _deltatime, vk::CommandBuffer& buffer, vk:
 	vk::CommandBufferBeginInfo cmdBI;
 	cmdBI.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
 	buffer.begin(cmdBI);
+	StagingRing::Instance().BeginFrame(buffer);
+	UploadEngine::Instance().BeginFrame(buffer);
+	TextureManager::Instance().BeginFrame(buffer);
 	return true;
 }
 
@@ -60,11 +95,23 @@ bool VulkanBackend::EndFrame(double _deltatime, vk::CommandBuffer& buffer, vk::F
 	buffer.end();
 
 	vk::SubmitInfo submitInfo;
-	vk::PipelineStageFlags waitMask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+	std::vector<vk::Semaphore> waitSemaphores = { imageAvaliable };
+	std::vector<vk::PipelineStageFlags> waitMasks = { vk::PipelineStageFlagBits::eColorAttachmentOutput };
+	std::vector<uint64_t> waitValues = { 0 };
+	// the uploads the frame acquired, already finished unless the frame asked for a batch through Acquire
+	if (uint64_t uploads = UploadEngine::Instance().TakeFrameWait())
+	{
+		waitSemaphores.push_back(UploadEngine::Instance().Semaphore());
+		waitMasks.push_back(vk::PipelineStageFlagBits::eAllCommands);
+		waitValues.push_back(uploads);
+	}
+	vk::TimelineSemaphoreSubmitInfo timelineInfo;
+	timelineInfo.setWaitSemaphoreValues(waitValues);
 	submitInfo.setCommandBuffers(buffer)
-		.setPWaitDstStageMask(&waitMask)
-		.setWaitSemaphores(imageAvaliable)
-		.setSignalSemaphores(imageDrawFinish);
+		.setWaitDstStageMask(waitMasks)
+		.setWaitSemaphores(waitSemaphores)
+		.setSignalSemaphores(imageDrawFinish)
+		.setPNext(&timelineInfo);
 	Context::GetInstance().graphicsQueue.submit(submitInfo, cmdbufAvaliableFence);
 
 	Context::GetInstance().swapchain->Present(imageDrawFinish, Context::GetInstance().image_index);
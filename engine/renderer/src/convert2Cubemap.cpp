@@ -3,11 +3,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "Texture.h"
+#include "HDRCubemap.h"
 #include "Pipeline.h"
 #include "render_process.h"
 #include "CommandBuffer.h"
 #include "program.h"
 #include "Context.h"
+#include "MemoryAllocator.h"
 #include "Sampler.h"
 #include "define.h"
 #include "mesh.h"
@@ -94,37 +96,25 @@ std::shared_ptr<Texture> convert2Cubemap(std::shared_ptr<Texture> flatTex)
 			retTex->is_depth = false;
 			retTex->is_stencil = false;
 			retTex->layout = vk::ImageLayout::eColorAttachmentOptimal;
+			retTex->width = HDRCubemap::FaceSize;
+			retTex->height = HDRCubemap::FaceSize;
+			retTex->layers = 6;
 			vk::ImageCreateInfo imageCI;
 			imageCI.setFormat(vk::Format::eB10G11R11UfloatPack32)
 				.setArrayLayers(6)
-				.setExtent(vk::Extent3D{ 2048, 2048, 1 })
+				.setExtent(vk::Extent3D{ HDRCubemap::FaceSize, HDRCubemap::FaceSize, 1 })
 				.setImageType(vk::ImageType::e2D)
 				.setInitialLayout(vk::ImageLayout::eUndefined)
 				.setMipLevels(1)
 				.setTiling(vk::ImageTiling::eOptimal)
-				.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled)
+				.setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc)
 				.setSamples(vk::SampleCountFlagBits::e1)
 				.setSharingMode(vk::SharingMode::eExclusive)
 				.setFlags(vk::ImageCreateFlagBits::eCubeCompatible);
 			retTex->image = device.createImage(imageCI);
 
-			vk::MemoryAllocateInfo allocInfo;
-			auto requirements = device.getImageMemoryRequirements(retTex->image);
-			allocInfo.setAllocationSize(requirements.size);
-
-			uint32_t index = 0;
-			auto properties = Context::GetInstance().physicaldevice.getMemoryProperties();
-			for (size_t i = 0; i < properties.memoryTypeCount; i++)
-			{
-				if ((1 << i) & requirements.memoryTypeBits && properties.memoryTypes[i].propertyFlags & vk::MemoryPropertyFlagBits::eDeviceLocal)
-				{
-					index = i;
-					break;
-				}
-			}
-			allocInfo.setMemoryTypeIndex(index);
-			retTex->memory = device.allocateMemory(allocInfo);
-			device.bindImageMemory(retTex->image, retTex->memory, 0);
+			retTex->allocation = MemoryAllocator::Instance().Allocate(retTex->image, vk::MemoryPropertyFlagBits::eDeviceLocal,
+				MemoryCategory::Textures);
 			vk::ImageSubresourceRange range;
 			range.setAspectMask(vk::ImageAspectFlagBits::eColor)
 				.setBaseArrayLayer(0)
@@ -157,8 +147,8 @@ std::shared_ptr<Texture> convert2Cubemap(std::shared_ptr<Texture> flatTex)
 					framebufferCI.setAttachments(imageViews.back())
 						.setLayers(1)
 						.setRenderPass(renderPass->vkRenderPass())
-						.setWidth(2048)
-						.setHeight(2048);
+						.setWidth(HDRCubemap::FaceSize)
+						.setHeight(HDRCubemap::FaceSize);
 					framebuffers.emplace_back(device.createFramebuffer(framebufferCI));
 				}
 			}
@@ -221,29 +211,20 @@ std::shared_ptr<Texture> convert2Cubemap(std::shared_ptr<Texture> flatTex)
 			.depthWriteEnable = true,
 			.depthCompareOperation = vk::CompareOp::eLess,
 		};
-		pipeline.reset(new Pipeline(gpDesc, renderPass->vkRenderPass()));
+		pipeline.reset(new Pipeline(gpDesc, renderPass->vkRenderPass(), "equirect to cubemap"));
 		pipeline->allocateDescriptors({
 				{.set = TEXTURES_AND_SAMPLER_SET, .count = 1},
 				{.set = VERTEX_INDEX_SET, .count = 1},
 			});
 	}
 	glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.f);
-	glm::mat4 captureViews[] =
-	{
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  -1.0f,  0.0f), glm::vec3(0.0f,  0.0f,  1.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f,  0.0f), glm::vec3(0.0f,  0.0f, 1.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
-		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f,  0.0f, -1.0f), glm::vec3(0.0f, -1.0f,  0.0f))
-	};
 	for (int i = 0; i < 6; i++)
 	{
 		pipeline->bindResource(TEXTURES_AND_SAMPLER_SET, 0, 0, flatTex, sampler);
 		pipeline->bindResource(VERTEX_INDEX_SET, 0, 0, vertexBuffer, 0, vertexBuffer->size, vk::DescriptorType::eStorageBuffer);
 
 		std::array<glm::mat4, 2> c;
-		c[0] = captureViews[i];
+		c[0] = HDRCubemap::captureView(i);
 		c[1] = proj;
 
 		vk::RenderPassBeginInfo renderPassBI;
@@ -251,12 +232,12 @@ std::shared_ptr<Texture> convert2Cubemap(std::shared_ptr<Texture> flatTex)
 		clear[0].setColor({ 0.f, 0.f, 0.f, 1.0f });
 		renderPassBI.setRenderPass(renderPass->vkRenderPass())
 			.setFramebuffer(framebuffers[i])
-			.setRenderArea(VkRect2D({ 0,0 }, { 2048, 2048 }))
+			.setRenderArea(VkRect2D({ 0,0 }, { HDRCubemap::FaceSize, HDRCubemap::FaceSize }))
 			.setClearValues(clear);
 		auto cmdbuf = CommandManager::BeginSingle(Context::GetInstance().graphicsCmdPool);
 		cmdbuf.beginRenderPass(renderPassBI, vk::SubpassContents::eInline);
-		cmdbuf.setViewport(0, { vk::Viewport{ 0, 2048, (float)2048, (float)-2048, 0.0f, 1.0f } });
-		cmdbuf.setScissor(0, { vk::Rect2D{vk::Offset2D{0, 0}, vk::Extent2D{ 2048, 2048 }} });
+		cmdbuf.setViewport(0, { vk::Viewport{ 0, (float)HDRCubemap::FaceSize, (float)HDRCubemap::FaceSize, -(float)HDRCubemap::FaceSize, 0.0f, 1.0f } });
+		cmdbuf.setScissor(0, { vk::Rect2D{vk::Offset2D{0, 0}, vk::Extent2D{ HDRCubemap::FaceSize, HDRCubemap::FaceSize }} });
 		cmdbuf.setDepthTestEnable(VK_TRUE);
 		pipeline->bind(cmdbuf);
 		pipeline->bindDescriptorSets(cmdbuf,
@@ -286,6 +267,7 @@ std::shared_ptr<Texture> convert2Cubemap(std::shared_ptr<Texture> flatTex)
 
 		CommandManager::EndSingle(Context::GetInstance().graphicsCmdPool, cmdbuf, Context::GetInstance().graphicsQueue);
 	}
+	retTex->layout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	vertexBuffer.reset();
 	indiceBuffer.reset();
 	sampler.reset();
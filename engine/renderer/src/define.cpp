@@ -2,4 +2,5 @@
 
 std::string shaderPath = R"(assets\shaders\)";
 std::string texturePath = R"(assets\textures\)";
-std::string modelPath = R"(assets\models\)";
\ No newline at end of file
+std::string modelPath = R"(assets\models\)";
+std::string cachePath = R"(cache\)";
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include "prefilterEnvironment.h"
+#include "Texture.h"
+#include "Pipeline.h"
+#include "CommandBuffer.h"
+#include "program.h"
+#include "Context.h"
+#include "Sampler.h"
+#include "define.h"
+#include <algorithm>
+
+struct PrefilterPushConst
+{
+	uint32_t level;
+	uint32_t size;
+	float roughness;
+	uint32_t samples;
+};
+
+std::shared_ptr<Texture> prefilterEnvironment(std::shared_ptr<Texture> environment, uint32_t size, uint32_t levels,
+	uint32_t samples)
+{
+	constexpr uint32_t PREFILTER_SET = 0;
+	constexpr uint32_t BINDING_ENVIRONMENT = 0;
+	constexpr uint32_t BINDING_OUT_LEVELS = 1;
+	constexpr vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+	auto device = Context::GetInstance().device;
+
+	auto specular = TextureManager::Instance().Create(size, size, format,
+		vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc,
+		levels, 6);
+	specular->layout = vk::ImageLayout::eUndefined;
+	// one cube view per level, imageCube in the shader
+	std::vector<vk::ImageView> levelViews;
+	for (uint32_t i = 0; i < levels; i++)
+	{
+		vk::ImageSubresourceRange range;
+		range.setAspectMask(vk::ImageAspectFlagBits::eColor)
+			.setBaseMipLevel(i)
+			.setLevelCount(1)
+			.setBaseArrayLayer(0)
+			.setLayerCount(6);
+		vk::ImageViewCreateInfo viewCI;
+		viewCI.setViewType(vk::ImageViewType::eCube)
+			.setFormat(format)
+			.setSubresourceRange(range)
+			.setImage(specular->image);
+		levelViews.push_back(device.createImageView(viewCI));
+	}
+
+	std::shared_ptr<Sampler> sampler(new Sampler(vk::Filter::eLinear, vk::Filter::eLinear,
+		vk::SamplerAddressMode::eClampToEdge, vk::SamplerAddressMode::eClampToEdge,
+		vk::SamplerAddressMode::eClampToEdge, float(environment->miplevels)));
+	auto shader = std::make_shared<GPUProgram>(shaderPath + "prefilter_specular.comp.spv");
+	std::vector<Pipeline::SetDescriptor> setLayouts;
+	{
+		Pipeline::SetDescriptor set;
+		set.set = PREFILTER_SET;
+		vk::DescriptorSetLayoutBinding binding;
+		binding.setBinding(BINDING_ENVIRONMENT)
+			.setDescriptorCount(1)
+			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		set.bindings.push_back(binding);
+		binding.setBinding(BINDING_OUT_LEVELS)
+			.setDescriptorCount(levels)
+			.setDescriptorType(vk::DescriptorType::eStorageImage)
+			.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+		set.bindings.push_back(binding);
+		setLayouts.push_back(set);
+	}
+	std::vector<vk::PushConstantRange> ranges(1);
+	ranges[0].setOffset(0)
+		.setSize(sizeof(PrefilterPushConst))
+		.setStageFlags(vk::ShaderStageFlagBits::eCompute);
+	// the size of the level array in the shader
+	vk::SpecializationMapEntry specializationMap;
+	specializationMap.setConstantID(0)
+		.setOffset(0)
+		.setSize(sizeof(uint32_t));
+
+	const Pipeline::ComputePipelineDescriptor desc = {
+		.sets = setLayouts,
+		.computerShader = shader->Compute,
+		.pushConstants = ranges,
+		.specializationConsts = { specializationMap },
+		.specializationData_ = &levels,
+	};
+	std::shared_ptr<Pipeline> pipeline(new Pipeline(desc, "prefilter environment"));
+	pipeline->allocateDescriptors({
+		{.set = PREFILTER_SET, .count = 1}
+		});
+	pipeline->bindResource(PREFILTER_SET, BINDING_ENVIRONMENT, 0, environment, sampler);
+	pipeline->bindResource(PREFILTER_SET, BINDING_OUT_LEVELS, 0, std::span<vk::ImageView>(levelViews),
+		vk::DescriptorType::eStorageImage);
+
+	auto cmdbuf = CommandManager::BeginSingle(Context::GetInstance().graphicsCmdPool);
+	pipeline->bind(cmdbuf);
+	pipeline->bindDescriptorSets(cmdbuf,
+		{
+			{.set = PREFILTER_SET, .bindIdx = 0},
+		});
+	pipeline->updateDescriptorSets();
+	specular->transitionImageLayout(cmdbuf, vk::ImageLayout::eGeneral);
+	// levels only read the environment, so they need no barriers between them
+	for (uint32_t i = 0; i < levels; i++)
+	{
+		const PrefilterPushConst pushConst{
+			.level = i,
+			.size = std::max(size >> i, 1u),
+			.roughness = levels > 1 ? float(i) / float(levels - 1) : 0.0f,
+			.samples = samples,
+		};
+		pipeline->updatePushConstant(cmdbuf, vk::ShaderStageFlagBits::eCompute, sizeof(PrefilterPushConst), &pushConst);
+		cmdbuf.dispatch((pushConst.size + 7) / 8, (pushConst.size + 7) / 8, 6);
+	}
+	specular->transitionImageLayout(cmdbuf, vk::ImageLayout::eShaderReadOnlyOptimal);
+	CommandManager::EndSingle(Context::GetInstance().graphicsCmdPool, cmdbuf, Context::GetInstance().graphicsQueue);
+
+	pipeline.reset();
+	for (auto view : levelViews)
+	{
+		device.destroyImageView(view);
+	}
+	return specular;
+}
@@ -1,8 +1,9 @@
 #include "program.h"
+#include "ShaderPool.h"
 
 GPUProgram::GPUProgram(std::string comp)
 {
-	Compute.reset(new Shader(comp));
+	Compute = ShaderPool::GetInstance().Get(comp);
 	stages.resize(1);
 	stages[0].setStage(vk::ShaderStageFlagBits::eCompute)
 		.setModule(Compute->module)
@@ -11,8 +12,8 @@ GPUProgram::GPUProgram(std::string comp)
 
 GPUProgram::GPUProgram(std::string vertex, std::string fragment)
 {
-	Vertex.reset(new Shader(vertex));
-	Fragment.reset(new Shader(fragment));
+	Vertex = ShaderPool::GetInstance().Get(vertex);
+	Fragment = ShaderPool::GetInstance().Get(fragment);
 	stages.resize(2);
 	stages[0].setStage(vk::ShaderStageFlagBits::eVertex)
 		.setModule(Vertex->module)
@@ -24,9 +25,9 @@ GPUProgram::GPUProgram(std::string vertex, std::string fragment)
 
 GPUProgram::GPUProgram(std::string vertex, std::string geometry, std::string fragment)
 {
-	Vertex.reset(new Shader(vertex));
-	Geometry.reset(new Shader(geometry));
-	Fragment.reset(new Shader(fragment));
+	Vertex = ShaderPool::GetInstance().Get(vertex);
+	Geometry = ShaderPool::GetInstance().Get(geometry);
+	Fragment = ShaderPool::GetInstance().Get(fragment);
 	stages.resize(3);
 	stages[0].setStage(vk::ShaderStageFlagBits::eVertex)
 		.setModule(Vertex->module)
@@ -41,28 +42,4 @@ GPUProgram::GPUProgram(std::string vertex, std::string geometry, std::string fra
 
 GPUProgram::~GPUProgram()
 {
-	if (Vertex.get())
-	{
-		Vertex->destroy();
-	}
-	if (TessellationControl.get())
-	{
-		TessellationControl->destroy();
-	}
-	if (TessellationEvaluation.get())
-	{
-		TessellationEvaluation->destroy();
-	}
-	if (Geometry.get())
-	{
-		Geometry->destroy();
-	}
-	if (Fragment.get())
-	{
-		Fragment->destroy();
-	}
-	if (Compute.get())
-	{
-		Compute->destroy();
-	}
 }
@@ -0,0 +1,265 @@
+#include "HDRPack.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr float Infinity = std::numeric_limits<float>::infinity();
+    constexpr float HalfMax = 65504.0f;
+    constexpr float SharedExponentMax = 65408.0f;
+    // (2 - 2^-6) * 2^15 and (2 - 2^-5) * 2^15
+    constexpr float Ufloat11Max = 65024.0f;
+    constexpr float Ufloat10Max = 64512.0f;
+
+    const vk::Format Formats[] = { vk::Format::eR16G16B16A16Sfloat, vk::Format::eE5B9G9R9UfloatPack32,
+        vk::Format::eB10G11R11UfloatPack32 };
+
+    // every pairing of the special values across the channels, then random bit patterns. The count is not a
+    // multiple of four and spans several chunks, so pack goes through its vector loop and its scalar tail
+    std::vector<float> edgeCases()
+    {
+        const float specials[] = { 0.0f, -0.0f, 1.0f, -1.0f, HalfMax, 65520.0f, 1e9f, Infinity, -Infinity,
+            std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN(),
+            std::numeric_limits<float>::denorm_min(), 1e-40f, std::ldexp(1.0f, -14), std::ldexp(1.0f, -15),
+            std::ldexp(1.0f, -24), std::ldexp(1.0f, -25), std::ldexp(3.0f, -26), 1e-20f, SharedExponentMax, 65409.0f,
+            Ufloat11Max, Ufloat10Max, 0.5f, 1.0f / 3.0f, 511.5f / 512.0f, -123.456f };
+        std::vector<float> rgba;
+        for (float r : specials)
+        {
+            for (float g : specials)
+            {
+                for (float b : specials)
+                {
+                    rgba.insert(rgba.end(), { r, g, b, g });
+                }
+            }
+        }
+        std::mt19937 rng(7);
+        for (size_t i = 0; i < 4 * 40001; i++)
+        {
+            const uint32_t bits = rng();
+            float value;
+            std::memcpy(&value, &bits, 4);
+            rgba.push_back(value);
+        }
+        return rgba;
+    }
+
+    // log-uniform over the normal range every format shares
+    std::vector<float> normalRange(size_t count)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> exponent(-14.0f, 15.0f);
+        std::vector<float> rgba(count * 4);
+        for (float& value : rgba)
+        {
+            value = std::exp2(exponent(rng));
+        }
+        return rgba;
+    }
+
+    std::vector<float> roundTrip(const std::vector<float>& rgba, vk::Format format)
+    {
+        const size_t count = rgba.size() / 4;
+        std::vector<unsigned char> packed(count * HDRPack::texelBytes(format));
+        std::vector<float> unpacked(count * 4);
+        HDRPack::pack(rgba.data(), count, format, packed.data());
+        HDRPack::unpack(packed.data(), count, format, unpacked.data());
+        return unpacked;
+    }
+
+    // one texel at a time through the scalar functions
+    std::vector<unsigned char> packScalar(const std::vector<float>& rgba, vk::Format format)
+    {
+        const size_t count = rgba.size() / 4;
+        std::vector<unsigned char> packed(count * HDRPack::texelBytes(format));
+        for (size_t i = 0; i < count; i++)
+        {
+            const float* texel = rgba.data() + i * 4;
+            if (format == vk::Format::eR16G16B16A16Sfloat)
+            {
+                const uint16_t halves[4] = { HDRPack::packHalf(texel[0]), HDRPack::packHalf(texel[1]),
+                    HDRPack::packHalf(texel[2]), HDRPack::packHalf(texel[3]) };
+                std::memcpy(packed.data() + i * 8, halves, 8);
+                continue;
+            }
+            const uint32_t value = format == vk::Format::eE5B9G9R9UfloatPack32 ? HDRPack::packE5B9G9R9(texel)
+                : HDRPack::packB10G11R11(texel);
+            std::memcpy(packed.data() + i * 4, &value, 4);
+        }
+        return packed;
+    }
+
+    std::vector<float> unpackOne(const float* rgb, vk::Format format)
+    {
+        const float rgba[4] = { rgb[0], rgb[1], rgb[2], 1.0f };
+        return roundTrip(std::vector<float>(rgba, rgba + 4), format);
+    }
+}
+
+TEST(HDRPack, SimdMatchesScalar)
+{
+    const std::vector<float> rgba = edgeCases();
+    const size_t count = rgba.size() / 4;
+    for (vk::Format format : Formats)
+    {
+        std::vector<unsigned char> packed(count * HDRPack::texelBytes(format));
+        HDRPack::pack(rgba.data(), count, format, packed.data());
+        const std::vector<unsigned char> scalar = packScalar(rgba, format);
+        const uint32_t texel = HDRPack::texelBytes(format);
+        size_t mismatches = 0;
+        size_t first = count;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (std::memcmp(packed.data() + i * texel, scalar.data() + i * texel, texel) != 0)
+            {
+                first = std::min(first, i);
+                mismatches++;
+            }
+        }
+        EXPECT_EQ(mismatches, 0u) << vk::to_string(format) << ", first at texel " << first;
+    }
+}
+
+TEST(HDRPack, HalfErrorBound)
+{
+    const std::vector<float> rgba = normalRange(100000);
+    const std::vector<float> unpacked = roundTrip(rgba, vk::Format::eR16G16B16A16Sfloat);
+    double maxError = 0.0;
+    for (size_t i = 0; i < rgba.size(); i++)
+    {
+        maxError = std::max(maxError, std::abs(double(unpacked[i]) - rgba[i]) / rgba[i]);
+    }
+    EXPECT_LE(maxError, std::ldexp(1.0, -11));
+}
+
+TEST(HDRPack, SharedExponentErrorBound)
+{
+    // the channels share the exponent of the largest, so the error is relative to it
+    const std::vector<float> rgba = normalRange(100000);
+    const std::vector<float> unpacked = roundTrip(rgba, vk::Format::eE5B9G9R9UfloatPack32);
+    double maxError = 0.0;
+    for (size_t i = 0; i < rgba.size() / 4; i++)
+    {
+        const double largest = std::max({ rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2] });
+        for (int c = 0; c < 3; c++)
+        {
+            maxError = std::max(maxError, std::abs(double(unpacked[i * 4 + c]) - rgba[i * 4 + c]) / largest);
+        }
+        ASSERT_EQ(unpacked[i * 4 + 3], 1.0f);
+    }
+    EXPECT_LE(maxError, std::ldexp(1.0, -9));
+}
+
+TEST(HDRPack, B10G11R11ErrorBound)
+{
+    const std::vector<float> rgba = normalRange(100000);
+    const std::vector<float> unpacked = roundTrip(rgba, vk::Format::eB10G11R11UfloatPack32);
+    double maxError[3] = {};
+    for (size_t i = 0; i < rgba.size() / 4; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const size_t j = i * 4 + c;
+            maxError[c] = std::max(maxError[c], std::abs(double(unpacked[j]) - rgba[j]) / rgba[j]);
+        }
+    }
+    EXPECT_LE(maxError[0], std::ldexp(1.0, -6));
+    EXPECT_LE(maxError[1], std::ldexp(1.0, -6));
+    EXPECT_LE(maxError[2], std::ldexp(1.0, -5));
+}
+
+TEST(HDRPack, Nan)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    EXPECT_TRUE(std::isnan(HDRPack::unpackHalf(HDRPack::packHalf(nan))));
+    EXPECT_TRUE(std::isnan(HDRPack::unpackHalf(HDRPack::packHalf(-nan))));
+
+    // the unsigned formats have no use for it in a texture, NaN becomes 0 rather than poisoning filtering
+    const float rgb[3] = { nan, 1.0f, nan };
+    for (vk::Format format : { vk::Format::eE5B9G9R9UfloatPack32, vk::Format::eB10G11R11UfloatPack32 })
+    {
+        const std::vector<float> unpacked = unpackOne(rgb, format);
+        EXPECT_EQ(unpacked[0], 0.0f) << vk::to_string(format);
+        EXPECT_EQ(unpacked[1], 1.0f) << vk::to_string(format);
+        EXPECT_EQ(unpacked[2], 0.0f) << vk::to_string(format);
+    }
+}
+
+TEST(HDRPack, Negative)
+{
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(-2.5f)), -2.5f);
+    EXPECT_EQ(HDRPack::packHalf(-0.0f), 0x8000);
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(-1e9f)), -HalfMax);
+
+    const float rgb[3] = { -1.0f, -0.0f, -Infinity };
+    for (vk::Format format : { vk::Format::eE5B9G9R9UfloatPack32, vk::Format::eB10G11R11UfloatPack32 })
+    {
+        const std::vector<float> unpacked = unpackOne(rgb, format);
+        for (int c = 0; c < 3; c++)
+        {
+            EXPECT_EQ(unpacked[c], 0.0f) << vk::to_string(format) << " channel " << c;
+            EXPECT_FALSE(std::signbit(unpacked[c])) << vk::to_string(format) << " channel " << c;
+        }
+    }
+}
+
+TEST(HDRPack, Denormal)
+{
+    // float denormals are far below anything the formats hold
+    EXPECT_EQ(HDRPack::packHalf(std::numeric_limits<float>::denorm_min()), 0);
+    EXPECT_EQ(HDRPack::packHalf(1e-40f), 0);
+
+    // half denormals step by 2^-24 and round to nearest
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(std::ldexp(1.0f, -24))), std::ldexp(1.0f, -24));
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(std::ldexp(3.0f, -26))), std::ldexp(1.0f, -24));
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(std::ldexp(1.0f, -26))), 0.0f);
+    // the largest denormal rounding up lands on the smallest normal
+    EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(std::ldexp(1.0f, -14) - std::ldexp(1.0f, -26))),
+        std::ldexp(1.0f, -14));
+
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<float> mantissa(0.0f, 1.0f);
+    for (int i = 0; i < 10000; i++)
+    {
+        const float value = std::ldexp(mantissa(rng), -14);
+        EXPECT_LE(std::abs(HDRPack::unpackHalf(HDRPack::packHalf(value)) - value), std::ldexp(1.0f, -25));
+        float rgb[3] = { value, value, value };
+        HDRPack::unpackB10G11R11(HDRPack::packB10G11R11(rgb), rgb);
+        EXPECT_LE(std::abs(rgb[0] - value), std::ldexp(1.0f, -21));
+        EXPECT_LE(std::abs(rgb[2] - value), std::ldexp(1.0f, -20));
+    }
+
+    // with the shared exponent a channel far below the largest one is what goes to 0
+    const float rgb[3] = { 1.0f, std::ldexp(1.0f, -10), 1e-40f };
+    const std::vector<float> unpacked = unpackOne(rgb, vk::Format::eE5B9G9R9UfloatPack32);
+    EXPECT_EQ(unpacked[0], 1.0f);
+    EXPECT_EQ(unpacked[1], 0.0f);
+    EXPECT_EQ(unpacked[2], 0.0f);
+}
+
+TEST(HDRPack, AboveMaxClamps)
+{
+    for (float value : { 65520.0f, 1e9f, Infinity })
+    {
+        EXPECT_EQ(HDRPack::unpackHalf(HDRPack::packHalf(value)), HalfMax) << value;
+
+        const float rgb[3] = { value, value, value };
+        std::vector<float> unpacked = unpackOne(rgb, vk::Format::eB10G11R11UfloatPack32);
+        EXPECT_EQ(unpacked[0], Ufloat11Max) << value;
+        EXPECT_EQ(unpacked[1], Ufloat11Max) << value;
+        EXPECT_EQ(unpacked[2], Ufloat10Max) << value;
+
+        unpacked = unpackOne(rgb, vk::Format::eE5B9G9R9UfloatPack32);
+        for (int c = 0; c < 3; c++)
+        {
+            EXPECT_EQ(unpacked[c], SharedExponentMax) << value;
+        }
+    }
+}
@@ -0,0 +1,193 @@
+#include "TLSF.h"
+#include "MemoryAllocator.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace
+{
+    constexpr uint64_t KB = 1024;
+    constexpr uint64_t MB = 1024 * KB;
+
+    bool overlaps(const TLSF::Allocation& a, const TLSF::Allocation& b)
+    {
+        return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+    }
+}
+
+TEST(TLSF, AllocateAndFree)
+{
+    TLSF allocator(MB);
+    TLSF::Allocation a, b, c;
+    ASSERT_TRUE(allocator.allocate(100, 1, a));
+    ASSERT_TRUE(allocator.allocate(4 * KB, 1, b));
+    ASSERT_TRUE(allocator.allocate(1, 1, c));
+    EXPECT_EQ(allocator.allocationCount(), 3u);
+    EXPECT_GE(a.size, 100u);
+    EXPECT_GE(c.size, 1u);
+    EXPECT_FALSE(overlaps(a, b));
+    EXPECT_FALSE(overlaps(a, c));
+    EXPECT_FALSE(overlaps(b, c));
+    EXPECT_EQ(allocator.freeBytes(), MB - a.size - b.size - c.size);
+    EXPECT_TRUE(allocator.validate());
+
+    allocator.free(b.node);
+    EXPECT_EQ(allocator.allocationCount(), 2u);
+    EXPECT_EQ(allocator.freeBytes(), MB - a.size - c.size);
+    EXPECT_TRUE(allocator.validate());
+
+    // the hole b left is reused
+    TLSF::Allocation d;
+    ASSERT_TRUE(allocator.allocate(4 * KB, 1, d));
+    EXPECT_EQ(d.offset, b.offset);
+    EXPECT_TRUE(allocator.validate());
+}
+
+TEST(TLSF, Alignment)
+{
+    TLSF allocator(16 * MB);
+    std::vector<TLSF::Allocation> live;
+    for (uint64_t alignment = 1; alignment <= MB; alignment *= 2)
+    {
+        TLSF::Allocation small, aligned;
+        // leaves the next free offset unaligned
+        ASSERT_TRUE(allocator.allocate(48, 1, small));
+        ASSERT_TRUE(allocator.allocate(3 * KB, alignment, aligned)) << alignment;
+        EXPECT_EQ(aligned.offset % alignment, 0u) << alignment;
+        EXPECT_GE(aligned.size, 3 * KB);
+        live.push_back(small);
+        live.push_back(aligned);
+    }
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        for (size_t j = i + 1; j < live.size(); j++)
+        {
+            EXPECT_FALSE(overlaps(live[i], live[j]));
+        }
+    }
+    EXPECT_TRUE(allocator.validate());
+}
+
+TEST(TLSF, LargeAlignmentFindsABlockTheClassRoundingSkips)
+{
+    // [0, 16) used, [16, 80K + 16) free, up to 128K used, [128K, 252K) free. The free block at 16 is the head
+    // for 64K but 64K aligned it does not fit, and the one at 128K is in the class just below the 128K - 16
+    // that would fit any alignment
+    TLSF allocator(252 * KB);
+    TLSF::Allocation first, hole, middle;
+    ASSERT_TRUE(allocator.allocate(16, 1, first));
+    ASSERT_TRUE(allocator.allocate(80 * KB, 1, hole));
+    ASSERT_TRUE(allocator.allocate(48 * KB - 16, 1, middle));
+    allocator.free(hole.node);
+    ASSERT_EQ(middle.offset + middle.size, 128 * KB);
+    ASSERT_GE(allocator.largestFree(), 64 * KB);
+
+    TLSF::Allocation aligned;
+    ASSERT_TRUE(allocator.allocate(64 * KB, 64 * KB, aligned));
+    EXPECT_EQ(aligned.offset, 128 * KB);
+    EXPECT_TRUE(allocator.validate());
+}
+
+TEST(TLSF, LargeAlignmentFindsABlockBehindTheHead)
+{
+    // two free blocks of the same class, the head of its list is the one alignment pushes past its end
+    TLSF allocator(MB);
+    TLSF::Allocation first, upper, separator, lower, rest;
+    ASSERT_TRUE(allocator.allocate(16, 1, first));
+    ASSERT_TRUE(allocator.allocate(128 * KB - 16, 1, upper));
+    ASSERT_TRUE(allocator.allocate(16, 1, separator));
+    ASSERT_TRUE(allocator.allocate(126 * KB, 1, lower));
+    ASSERT_TRUE(allocator.allocate(allocator.freeBytes(), 1, rest));
+    allocator.free(upper.node);
+    allocator.free(lower.node);
+
+    TLSF::Allocation aligned;
+    ASSERT_TRUE(allocator.allocate(64 * KB, 64 * KB, aligned));
+    EXPECT_EQ(aligned.offset, 64 * KB);
+    EXPECT_TRUE(allocator.validate());
+}
+
+TEST(TLSF, FreeCoalescesIntoOneBlock)
+{
+    constexpr uint64_t Size = 64 * MB;
+    TLSF allocator(Size);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint64_t> size(1, 256 * KB);
+    std::uniform_int_distribution<uint32_t> alignmentLog2(0, 16);
+    std::vector<TLSF::Allocation> live;
+    TLSF::Allocation allocation;
+    while (allocator.allocate(size(rng), uint64_t(1) << alignmentLog2(rng), allocation))
+    {
+        live.push_back(allocation);
+    }
+    ASSERT_GT(live.size(), 100u);
+    EXPECT_TRUE(allocator.validate());
+
+    // every other one first, the rest in random order so that frees merge on either side and on both
+    std::vector<TLSF::Allocation> remaining;
+    for (size_t i = 0; i < live.size(); i++)
+    {
+        if (i % 2 == 0)
+        {
+            allocator.free(live[i].node);
+        }
+        else
+        {
+            remaining.push_back(live[i]);
+        }
+    }
+    EXPECT_TRUE(allocator.validate());
+    std::shuffle(remaining.begin(), remaining.end(), rng);
+    for (const auto& entry : remaining)
+    {
+        allocator.free(entry.node);
+    }
+    EXPECT_TRUE(allocator.validate());
+    EXPECT_TRUE(allocator.empty());
+    EXPECT_EQ(allocator.freeBytes(), Size);
+    EXPECT_EQ(allocator.largestFree(), Size);
+    ASSERT_TRUE(allocator.allocate(Size, 1, allocation));
+    EXPECT_EQ(allocation.offset, 0u);
+}
+
+TEST(TLSF, OutOfSpace)
+{
+    TLSF allocator(MB);
+    TLSF::Allocation whole, more;
+    EXPECT_FALSE(allocator.allocate(MB + 1, 1, more));
+    ASSERT_TRUE(allocator.allocate(MB, 1, whole));
+    EXPECT_EQ(allocator.freeBytes(), 0u);
+    EXPECT_EQ(allocator.largestFree(), 0u);
+    EXPECT_FALSE(allocator.allocate(1, 1, more));
+    EXPECT_TRUE(allocator.validate());
+
+    allocator.free(whole.node);
+    // the free space is there, only not at a 1M boundary once the first 16 bytes are taken
+    TLSF::Allocation first;
+    ASSERT_TRUE(allocator.allocate(16, 1, first));
+    EXPECT_FALSE(allocator.allocate(KB, MB, more));
+    EXPECT_TRUE(allocator.allocate(MB - 16, 1, more));
+    EXPECT_TRUE(allocator.validate());
+}
+
+TEST(TLSF, BufferImageGranularitySeparatesBlocks)
+{
+    // the TLSF packs whatever it is given next to each other, a buffer and an image end up on one page
+    constexpr uint64_t Granularity = 4 * KB;
+    TLSF allocator(MB);
+    TLSF::Allocation buffer, image;
+    ASSERT_TRUE(allocator.allocate(256, 256, buffer));
+    ASSERT_TRUE(allocator.allocate(256, 256, image));
+    EXPECT_EQ(buffer.offset / Granularity, image.offset / Granularity);
+
+    // so the allocator keeps them in blocks of their own unless the device says they cannot alias
+    EXPECT_FALSE(MemoryAllocator::SharesBlock(Granularity, true, false));
+    EXPECT_FALSE(MemoryAllocator::SharesBlock(Granularity, false, true));
+    EXPECT_TRUE(MemoryAllocator::SharesBlock(Granularity, true, true));
+    EXPECT_TRUE(MemoryAllocator::SharesBlock(Granularity, false, false));
+    EXPECT_TRUE(MemoryAllocator::SharesBlock(1, true, false));
+    EXPECT_TRUE(MemoryAllocator::SharesBlock(1, false, true));
+}
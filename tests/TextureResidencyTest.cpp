@@ -0,0 +1,238 @@
+#include "TextureResidency.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    // a square chain, level i of levels is 4^(levels - 1 - i) bytes
+    std::vector<size_t> chain(uint32_t levels)
+    {
+        std::vector<size_t> bytes(levels);
+        for (uint32_t i = 0; i < levels; i++)
+        {
+            bytes[i] = size_t(1) << (2 * (levels - 1 - i));
+        }
+        return bytes;
+    }
+
+    // the feedback value of a texture of levels that samples mip
+    uint32_t sampling(uint32_t levels, uint32_t mip)
+    {
+        return levels - mip;
+    }
+
+    size_t requestsFor(const std::vector<TextureResidency::Request>& requests, uint32_t texture)
+    {
+        return std::count_if(requests.begin(), requests.end(),
+            [&](const TextureResidency::Request& request) { return request.texture == texture; });
+    }
+}
+
+TEST(TextureResidency, LoadsWhatTheFeedbackAsksFor)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 10);
+    EXPECT_EQ(residency.residentMip(0), TextureResidency::tailFor(10));
+
+    const std::vector<uint32_t> feedback = { sampling(10, 0) };
+    residency.update(feedback, 1);
+    const auto requests = residency.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0].texture, 0u);
+    EXPECT_EQ(requests[0].mip, 0u);
+
+    residency.completed(0, 0);
+    EXPECT_EQ(residency.residentMip(0), 0u);
+    EXPECT_EQ(residency.residentBytes(), residency.committedBytes());
+}
+
+TEST(TextureResidency, FailedLoadGivesItsBytesBack)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 10);
+    const size_t before = residency.committedBytes();
+
+    const std::vector<uint32_t> feedback = { sampling(10, 0) };
+    residency.update(feedback, 1);
+    ASSERT_EQ(residency.takeRequests().size(), 1u);
+    EXPECT_GT(residency.committedBytes(), before);
+
+    residency.completed(0, 0, false);
+    EXPECT_EQ(residency.committedBytes(), before);
+    EXPECT_EQ(residency.residentMip(0), TextureResidency::tailFor(10));
+}
+
+TEST(TextureResidency, BudgetEvictsTheLeastRecentlyUsed)
+{
+    const auto levels = chain(10);
+    const uint32_t tail = TextureResidency::tailFor(10);
+    TextureResidency residency;
+    residency.track(0, levels, tail);
+    residency.track(1, levels, tail);
+    residency.track(2, levels, tail);
+
+    // 0 and 1 go to mip 0, 0 is sampled first
+    residency.update(std::vector<uint32_t>{ sampling(10, 0), 0, 0 }, 1);
+    residency.update(std::vector<uint32_t>{ 0, sampling(10, 0), 0 }, 2);
+    for (const auto& request : residency.takeRequests())
+    {
+        residency.completed(request.texture, request.mip);
+    }
+    ASSERT_EQ(residency.residentMip(0), 0u);
+    ASSERT_EQ(residency.residentMip(1), 0u);
+
+    // room for two full chains, 2 can only come in once one of the others goes
+    residency.setBudget(residency.committedBytes());
+    residency.update(std::vector<uint32_t>{ 0, 0, sampling(10, 0) }, 3);
+    const auto requests = residency.takeRequests();
+    ASSERT_EQ(requests.size(), 2u);
+    EXPECT_EQ(requests[0].texture, 0u);
+    EXPECT_GT(requests[0].mip, 0u);
+    EXPECT_EQ(requests[1].texture, 2u);
+    EXPECT_EQ(requests[1].mip, 0u);
+    EXPECT_LE(residency.committedBytes(), residency.budget());
+    EXPECT_EQ(residency.stats().drops, 1u);
+}
+
+TEST(TextureResidency, LoweredBudgetDropsBeforeLoading)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 10);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 1);
+    for (const auto& request : residency.takeRequests())
+    {
+        residency.completed(request.texture, request.mip);
+    }
+
+    residency.setBudget(residency.committedBytes() / 2);
+    residency.update(std::vector<uint32_t>{ 0 }, 2);
+    const auto requests = residency.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_GT(requests[0].mip, 0u);
+    EXPECT_LE(residency.committedBytes(), residency.budget());
+}
+
+TEST(TextureResidency, SampledTexturesKeepWhatTheyUse)
+{
+    const auto levels = chain(10);
+    TextureResidency residency;
+    residency.track(0, levels, 0);
+    residency.track(1, levels, TextureResidency::tailFor(10));
+    residency.update(std::vector<uint32_t>{ sampling(10, 0), 0 }, 1);
+
+    // 0 is sampled at mip 0 this frame, so 1 has nowhere to get its bytes from
+    residency.setBudget(residency.committedBytes());
+    residency.update(std::vector<uint32_t>{ sampling(10, 0), sampling(10, 0) }, 2);
+    EXPECT_TRUE(residency.takeRequests().empty());
+    EXPECT_EQ(residency.stats().deferred, 1u);
+}
+
+TEST(TextureResidency, CoarsensOnlyAfterTheDelay)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 0);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 1);
+    EXPECT_EQ(residency.wantedMip(0), 0u);
+
+    uint64_t frame = 2;
+    for (; frame <= 1 + TextureResidency::CoarsenDelay; frame++)
+    {
+        residency.update(std::vector<uint32_t>{ sampling(10, 2) }, frame);
+        ASSERT_EQ(residency.wantedMip(0), 0u) << "frame " << frame;
+    }
+    residency.update(std::vector<uint32_t>{ sampling(10, 2) }, frame);
+    EXPECT_EQ(residency.wantedMip(0), 2u);
+
+    // going finer is immediate
+    residency.update(std::vector<uint32_t>{ sampling(10, 1) }, frame + 1);
+    EXPECT_EQ(residency.wantedMip(0), 1u);
+}
+
+TEST(TextureResidency, FinerSamplesRestartTheDelay)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 0);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 1);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 100);
+    residency.update(std::vector<uint32_t>{ sampling(10, 2) }, 1 + TextureResidency::CoarsenDelay + 1);
+    EXPECT_EQ(residency.wantedMip(0), 0u);
+    residency.update(std::vector<uint32_t>{ sampling(10, 2) }, 100 + TextureResidency::CoarsenDelay + 1);
+    EXPECT_EQ(residency.wantedMip(0), 2u);
+}
+
+TEST(TextureResidency, IdleTexturesFallBackToTheirTail)
+{
+    const uint32_t tail = TextureResidency::tailFor(10);
+    TextureResidency residency;
+    residency.track(0, chain(10), 0);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 1);
+    ASSERT_EQ(residency.wantedMip(0), 0u);
+
+    residency.update(std::vector<uint32_t>{ 0 }, TextureResidency::IdleFrames);
+    EXPECT_EQ(residency.wantedMip(0), 0u);
+    residency.update(std::vector<uint32_t>{ 0 }, 1 + TextureResidency::IdleFrames);
+    EXPECT_EQ(residency.wantedMip(0), tail);
+
+    // the surplus is what goes first once the budget is short
+    residency.setBudget(residency.committedBytes() - 1);
+    residency.update(std::vector<uint32_t>{ 0 }, 2 + TextureResidency::IdleFrames);
+    const auto requests = residency.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    EXPECT_EQ(requests[0].texture, 0u);
+    EXPECT_EQ(requests[0].mip, 1u);
+}
+
+TEST(TextureResidency, VictimOfAnEarlierLoadIsNotLoadedAgain)
+{
+    const auto levels = chain(12);
+    const uint32_t tail = TextureResidency::tailFor(12);
+    TextureResidency residency;
+    // a wants one level more than it has, c is resident in full, b sits at its tail
+    residency.track(0, levels, 2);
+    residency.track(1, levels, tail);
+    residency.track(2, levels, 0);
+
+    residency.update(std::vector<uint32_t>{ sampling(12, 1), 0, sampling(12, 0) }, 1);
+    auto requests = residency.takeRequests();
+    ASSERT_EQ(requests.size(), 1u);
+    residency.completed(0, 1, false);
+    ASSERT_EQ(residency.residentMip(0), 2u);
+
+    // c is sampled, so a cannot make room for its load
+    residency.setBudget(residency.committedBytes());
+    residency.update(std::vector<uint32_t>{ 0, 0, sampling(12, 0) }, 2);
+    ASSERT_TRUE(residency.takeRequests().empty());
+
+    // b goes first, and a is the least recently used texture its load drops a level of. a is still in the
+    // list of loads after that and c would make room for it, but it has to keep the drop
+    residency.update(std::vector<uint32_t>{ 0, sampling(12, tail - 2), 0 }, 3);
+    requests = residency.takeRequests();
+    ASSERT_EQ(requestsFor(requests, 0), 1u);
+    ASSERT_EQ(requestsFor(requests, 1), 1u);
+    EXPECT_EQ(requestsFor(requests, 2), 0u);
+    for (const auto& request : requests)
+    {
+        if (request.texture == 0)
+        {
+            EXPECT_EQ(request.mip, 3u);
+        }
+        else
+        {
+            EXPECT_EQ(request.mip, tail - 2);
+        }
+    }
+    EXPECT_LE(residency.committedBytes(), residency.budget());
+}
+
+TEST(TextureResidency, UntrackForgetsItsRequests)
+{
+    TextureResidency residency;
+    residency.track(0, chain(10), 10);
+    residency.update(std::vector<uint32_t>{ sampling(10, 0) }, 1);
+    residency.untrack(0);
+    EXPECT_TRUE(residency.takeRequests().empty());
+    EXPECT_EQ(residency.committedBytes(), 0u);
+}